@@ -3,6 +3,7 @@
 #include "main.h"
 
 #include <stdbool.h>
+#include <string.h>
 
 
 
@@ -56,9 +57,17 @@ extern int _sys_write(int fh, const uint8_t *buf, uint32_t len, int mode) \
 	\
 	if ((ITM_TCR & ITM_TCR_ITMENA_Msk) && /* ITM enabled */ (ITM_TER & (1UL << 0))) /* ITM Port #0 enabled */\
 	{\
-		for (uint32_t i = 0; i < len; i++)\
+		uint32_t i = 0;\
+		for (; i + 4 <= len; i += 4) /* 4 bytes per stimulus write */\
 		{\
-			while (ITM_PORT0_U32 != 0);\
+			uint32_t word;\
+			memcpy(&word, buf + i, sizeof(word));\
+			while (ITM_PORT0_U32 == 0);\
+			ITM_PORT0_U32 = word;\
+		}\
+		for (; i < len; i++)\
+		{\
+			while (ITM_PORT0_U32 == 0);\
 			ITM_PORT0_U8 = buf[i];\
 		}\
 		return 0;\
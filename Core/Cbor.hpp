@@ -0,0 +1,224 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+#include "./strv.hpp"
+
+
+
+namespace STM32T::Cbor
+{
+	enum class Major : uint8_t
+	{
+		Unsigned = 0,
+		Negative = 1,
+		Bytes = 2,
+		Text = 3,
+		Array = 4,
+		Map = 5,
+		Tag = 6,
+		Simple = 7,
+	};
+	
+	/**
+	* @brief Converts a float to a half-precision float if it can be done without losing anything. NaN becomes the canonical 0x7E00.
+	* @retval false if the value isn't exactly representable as a half-precision float.
+	*/
+	inline bool to_half(const float val, uint16_t &half)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &val, sizeof(bits));
+		
+		const uint16_t sign = (bits >> 16) & 0x8000;
+		const int exp = int((bits >> 23) & 0xFF) - 127;
+		const uint32_t mant = bits & 0x7FFFFF;
+		
+		if (exp == 128)			// Infinity or NaN
+			half = mant ? 0x7E00 : sign | 0x7C00;
+		else if (exp == -127)	// Zero or subnormal (too small for a half)
+		{
+			if (mant)
+				return false;
+			
+			half = sign;
+		}
+		else if (exp >= -14 && exp <= 15)
+		{
+			if (mant & 0x1FFF)
+				return false;
+			
+			half = sign | uint16_t((exp + 15) << 10) | uint16_t(mant >> 13);
+		}
+		else if (exp >= -24 && exp < -14)		// Subnormal half
+		{
+			const uint32_t full = 0x800000 | mant, shift = -exp - 1;
+			if (full & ((1u << shift) - 1))
+				return false;
+			
+			half = sign | uint16_t(full >> shift);
+		}
+		else
+			return false;
+		
+		return true;
+	}
+	
+	/**
+	* @brief Writes CBOR (RFC 8949) data items into a buffer, using the shortest encoding of every head and floating-point number.
+	*		Like Format::Writer, the length keeps counting when the buffer is full so that ok() can tell if everything fit.
+	*/
+	class Writer
+	{
+		uint8_t *const m_buf;
+		const size_t m_size;
+		size_t m_len = 0;
+		
+		void put(const void *data, const size_t len)
+		{
+			if (m_len + len <= m_size)
+				std::memcpy(m_buf + m_len, data, len);
+			
+			m_len += len;
+		}
+		
+		void put_be(const uint64_t val, const size_t len)
+		{
+			if (m_len + len <= m_size)
+				for (size_t i = 0; i < len; i++)
+					m_buf[m_len + i] = uint8_t(val >> ((len - 1 - i) * 8));
+			
+			m_len += len;
+		}
+		
+	public:
+		Writer(void *buf, size_t size) : m_buf(reinterpret_cast<uint8_t *>(buf)), m_size(size) {}
+		
+		const uint8_t *data() const { return m_buf; }
+		size_t size() const { return m_len; }
+		bool ok() const { return m_len <= m_size; }
+		void clear() { m_len = 0; }
+		
+		/**
+		* @brief Writes the head of a data item: the major type and an argument (a value, a length or a count).
+		*/
+		Writer& head(const Major major, const uint64_t arg)
+		{
+			const uint8_t type = uint8_t(major) << 5;
+			
+			if (arg < 24)
+				put_be(type | arg, 1);
+			else if (arg <= UINT8_MAX)
+			{
+				put_be(type | 24, 1);
+				put_be(arg, 1);
+			}
+			else if (arg <= UINT16_MAX)
+			{
+				put_be(type | 25, 1);
+				put_be(arg, 2);
+			}
+			else if (arg <= UINT32_MAX)
+			{
+				put_be(type | 26, 1);
+				put_be(arg, 4);
+			}
+			else
+			{
+				put_be(type | 27, 1);
+				put_be(arg, 8);
+			}
+			
+			return *this;
+		}
+		
+		Writer& uint(const uint64_t val) { return head(Major::Unsigned, val); }
+		Writer& integer(const int64_t val) { return val < 0 ? head(Major::Negative, ~uint64_t(val)) : head(Major::Unsigned, val); }
+		Writer& boolean(const bool val) { return head(Major::Simple, val ? 21 : 20); }
+		Writer& null() { return head(Major::Simple, 22); }
+		Writer& array(const size_t count) { return head(Major::Array, count); }
+		Writer& map(const size_t count) { return head(Major::Map, count); }
+		Writer& tag(const uint64_t tag) { return head(Major::Tag, tag); }
+		
+		Writer& text(const strv str)
+		{
+			head(Major::Text, str.size());
+			put(str.data(), str.size());
+			
+			return *this;
+		}
+		
+		Writer& bytes(const void *data, const size_t len)
+		{
+			head(Major::Bytes, len);
+			put(data, len);
+			
+			return *this;
+		}
+		
+		/**
+		* @brief Writes a floating-point number as a half, single or double-precision float, whichever is the shortest exact one.
+		*/
+		Writer& real(const float val)
+		{
+			uint16_t half;
+			if (to_half(val, half))
+			{
+				put_be(0xF9, 1);
+				put_be(half, 2);
+			}
+			else
+			{
+				uint32_t bits;
+				std::memcpy(&bits, &val, sizeof(bits));
+				
+				put_be(0xFA, 1);
+				put_be(bits, 4);
+			}
+			
+			return *this;
+		}
+		
+		Writer& real(const double val)
+		{
+			const float single = float(val);
+			if (val != val || double(single) == val)
+				return real(single);
+			
+			uint64_t bits;
+			std::memcpy(&bits, &val, sizeof(bits));
+			
+			put_be(0xFB, 1);
+			put_be(bits, 8);
+			
+			return *this;
+		}
+		
+		/**
+		* @brief Writes a value according to its type: bool, integers, enums, floating-point numbers, strings or nullptr.
+		*/
+		template <class T>
+		Writer& value(const T& val)
+		{
+			if constexpr (std::is_same_v<T, bool>)
+				return boolean(val);
+			else if constexpr (std::is_enum_v<T>)
+				return value(std::underlying_type_t<T>(val));
+			else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+				return integer(val);
+			else if constexpr (std::is_integral_v<T>)
+				return uint(val);
+			else if constexpr (std::is_floating_point_v<T>)
+				return real(double(val));
+			else if constexpr (std::is_same_v<T, std::nullptr_t>)
+				return null();
+			else
+			{
+				static_assert(std::is_convertible_v<const T&, std::string_view>, "Unsupported value type!");
+				return text(std::string_view(val));		// strv itself only converts from a temporary std::string_view.
+			}
+		}
+	};
+}
@@ -0,0 +1,930 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdarg>
+#include <cstdio>		// snprintf (fallback)
+#include <charconv>
+#include <cmath>
+#include <iterator>
+#include <type_traits>
+#include <limits>
+
+
+
+namespace STM32T::Format
+{
+	/**
+	* @brief A printf conversion specification.
+	*/
+	struct Spec
+	{
+		int width = 0;			// Minimum field width
+		int precision = -1;		// Negative means the default precision
+		bool left = false, plus = false, space = false, alt = false, zero = false;
+		bool star_width = false, star_prec = false;
+		char mod[3] = {};		// Length modifier
+		char conv = 0;
+		
+		/**
+		* @brief Parses a conversion specification. p must point to the character after '%' and is moved to the conversion character.
+		*/
+		static constexpr Spec Parse(const char *&p)
+		{
+			Spec spec;
+			
+			for (;; p++)
+			{
+				if (*p == '-')
+					spec.left = true;
+				else if (*p == '+')
+					spec.plus = true;
+				else if (*p == ' ')
+					spec.space = true;
+				else if (*p == '#')
+					spec.alt = true;
+				else if (*p == '0')
+					spec.zero = true;
+				else
+					break;
+			}
+			
+			if (*p == '*')
+			{
+				spec.star_width = true;
+				p++;
+			}
+			
+			for (; *p >= '0' && *p <= '9'; p++)
+				spec.width = spec.width * 10 + (*p - '0');
+			
+			if (*p == '.')
+			{
+				spec.precision = 0;
+				
+				if (*++p == '*')
+				{
+					spec.star_prec = true;
+					p++;
+				}
+				
+				for (; *p >= '0' && *p <= '9'; p++)
+					spec.precision = spec.precision * 10 + (*p - '0');
+			}
+			
+			for (size_t i = 0; i < 2 && (*p == 'h' || *p == 'l' || *p == 'L' || *p == 'z' || *p == 'j' || *p == 't'); i++)
+				spec.mod[i] = *p++;
+			
+			spec.conv = *p;
+			return spec;
+		}
+		
+		/**
+		* @brief Sets the field width from a '*' argument (a negative width means left-justified).
+		*/
+		constexpr void SetWidth(const int w)
+		{
+			left = left || w < 0;
+			width = w < 0 ? -w : w;
+		}
+		
+		constexpr bool HasMod(const char *m) const
+		{
+			return mod[0] == m[0] && mod[1] == (m[0] ? m[1] : 0);
+		}
+	};
+	
+	/**
+	* @brief The return value of the formatting functions when the value or conversion isn't supported (the caller should use snprintf).
+	*/
+	inline constexpr int UNSUPPORTED = -1;
+	
+	inline constexpr char c_digitPairs[] =
+		"00010203040506070809"
+		"10111213141516171819"
+		"20212223242526272829"
+		"30313233343536373839"
+		"40414243444546474849"
+		"50515253545556575859"
+		"60616263646566676869"
+		"70717273747576777879"
+		"80818283848586878889"
+		"90919293949596979899";
+	
+	inline constexpr double c_pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16,
+		1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+	
+	template <typename U>
+	constexpr size_t count_digits(U val)
+	{
+		size_t n = 1;
+		for (; val >= 10000; val /= 10000)
+			n += 4;
+		
+		return n + (val >= 10) + (val >= 100) + (val >= 1000);
+	}
+	
+	/**
+	* @brief Writes the decimal digits of val (no terminator) using a two-digit table. 32-bit values never use 64-bit divisions.
+	* @retval The end of the written digits.
+	*/
+	template <typename U>
+	char *utoa(char *buf, U val)
+	{
+		static_assert(std::is_unsigned_v<U>);
+		
+		if constexpr (sizeof(U) > sizeof(uint32_t))
+			if (val <= UINT32_MAX)
+				return utoa(buf, uint32_t(val));
+		
+		char *const end = buf + count_digits(val);
+		char *p = end;
+		
+		while (val >= 100)
+		{
+			const size_t i = (val % 100) * 2;
+			val /= 100;
+			*--p = c_digitPairs[i + 1];
+			*--p = c_digitPairs[i];
+		}
+		
+		if (val >= 10)
+		{
+			*--p = c_digitPairs[val * 2 + 1];
+			*--p = c_digitPairs[val * 2];
+		}
+		else
+			*--p = '0' + val;
+		
+		return end;
+	}
+	
+	/**
+	* @brief Writes the digits of val in a power-of-2 base (8 or 16) with no terminator.
+	* @retval The end of the written digits.
+	*/
+	template <typename U>
+	char *utoa_pow2(char *buf, U val, const unsigned base, const bool upper = false)
+	{
+		static_assert(std::is_unsigned_v<U>);
+		
+		const char *const digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+		const unsigned shift = base == 16 ? 4 : base == 8 ? 3 : 1;
+		
+		size_t n = 1;
+		for (U v = val >> shift; v; v >>= shift)
+			n++;
+		
+		char *const end = buf + n;
+		for (char *p = end; p != buf; val >>= shift)
+			*--p = digits[val & (base - 1)];
+		
+		return end;
+	}
+	
+	/**
+	* @brief A faster std::to_chars() for integers. Bases 10, 8 and 16 use dedicated paths and the rest use std::to_chars().
+	*/
+	template <typename T>
+	std::to_chars_result to_chars(char *first, char *last, const T val, const int base = 10)
+	{
+		static_assert(std::is_integral_v<T>);
+		
+		using U = std::make_unsigned_t<T>;
+		
+		if (base != 10 && base != 16 && base != 8)
+			return std::to_chars(first, last, val, base);
+		
+		char buf[std::numeric_limits<U>::digits / 3 + 2];
+		char *p = buf;
+		U uval = val;
+		
+		if constexpr (std::is_signed_v<T>)
+		{
+			if (val < 0)
+			{
+				*p++ = '-';
+				uval = U(0) - uval;
+			}
+		}
+		
+		p = base == 10 ? utoa(p, uval) : utoa_pow2(p, uval, base);
+		
+		if (p - buf > last - first)
+			return { last, std::errc::value_too_large };
+		
+		std::memcpy(first, buf, p - buf);
+		return { first + (p - buf), std::errc() };
+	}
+	
+	/**
+	* @brief Writes to a buffer the way snprintf() does (truncating but counting all the characters).
+	*/
+	class Writer
+	{
+		char *const m_buf;
+		const size_t m_size;
+		size_t m_len = 0;
+		
+	public:
+		Writer(char *buf, size_t size) : m_buf(buf), m_size(size) {}
+		
+		void put(const char ch)
+		{
+			if (m_len + 1 < m_size)
+				m_buf[m_len] = ch;
+			
+			m_len++;
+		}
+		
+		void put(const char *str, const size_t len)
+		{
+			if (m_len + 1 < m_size)
+				std::memcpy(m_buf + m_len, str, std::min(len, m_size - 1 - m_len));
+			
+			m_len += len;
+		}
+		
+		void fill(const char ch, size_t n)
+		{
+			if (m_len + 1 < m_size)
+				std::memset(m_buf + m_len, ch, std::min(n, m_size - 1 - m_len));
+			
+			m_len += n;
+		}
+		
+		/**
+		* @brief Writes a number made of a prefix (sign, "0x", etc.), leading zeros and digits, padded according to spec.
+		*/
+		void put_number(const Spec& spec, const char *prefix, const size_t prefix_len, const size_t zeros, const char *digits,
+			const size_t digits_len, const bool zero_pad)
+		{
+			const size_t len = prefix_len + zeros + digits_len;
+			const size_t pad = size_t(spec.width) > len ? spec.width - len : 0;
+			
+			if (!spec.left && !zero_pad)
+				fill(' ', pad);
+			
+			put(prefix, prefix_len);
+			fill('0', zeros + (!spec.left && zero_pad ? pad : 0));
+			put(digits, digits_len);
+			
+			if (spec.left)
+				fill(' ', pad);
+		}
+		
+		/**
+		* @brief Where the next characters can be written directly (e.g. by snprintf()). Call advance() with the count afterwards.
+		* @param room: Set to the room left, including the null.
+		*/
+		char *tail(size_t& room)
+		{
+			room = m_len < m_size ? m_size - m_len : 0;
+			return m_buf + m_len;
+		}
+		
+		/**
+		* @brief Counts N characters written at tail(), including those that didn't fit.
+		*/
+		void advance(const size_t n)
+		{
+			m_len += n;
+		}
+		
+		int finish()
+		{
+			if (m_size)
+				m_buf[std::min(m_len, m_size - 1)] = '\0';
+			
+			return m_len;
+		}
+	};
+	
+	/**
+	* @brief Writes an integer like printf() with a d, i, u, o, x, X or c conversion. The length modifier in spec is ignored (except for
+	*		%lc, which isn't supported); convert val to the right type beforehand.
+	* @retval false if the conversion isn't supported (nothing is written).
+	*/
+	template <typename T>
+	bool put_integer(Writer &w, const T val, const Spec& spec)
+	{
+		static_assert(std::is_integral_v<T>);
+		
+		using U = std::make_unsigned_t<T>;
+		
+		if (spec.conv == 'c')
+		{
+			if (spec.HasMod("l"))
+				return false;
+			
+			const char ch = val;
+			w.put_number(spec, nullptr, 0, 0, &ch, 1, false);
+			return true;
+		}
+		
+		char prefix[2];
+		size_t prefix_len = 0;
+		U uval = val;
+		
+		if (spec.conv == 'd' || spec.conv == 'i')
+		{
+			if (std::is_signed_v<T> && val < T(0))
+			{
+				prefix[prefix_len++] = '-';
+				uval = U(0) - uval;
+			}
+			else if (spec.plus)
+				prefix[prefix_len++] = '+';
+			else if (spec.space)
+				prefix[prefix_len++] = ' ';
+		}
+		else if (spec.conv != 'u' && spec.conv != 'o' && spec.conv != 'x' && spec.conv != 'X')
+			return false;
+		
+		char digits[std::numeric_limits<U>::digits / 3 + 1];
+		size_t len = 0;
+		
+		if (uval || spec.precision != 0)
+		{
+			if (spec.conv == 'x' || spec.conv == 'X')
+				len = utoa_pow2(digits, uval, 16, spec.conv == 'X') - digits;
+			else if (spec.conv == 'o')
+				len = utoa_pow2(digits, uval, 8) - digits;
+			else
+				len = utoa(digits, uval) - digits;
+		}
+		
+		size_t zeros = spec.precision > 0 && size_t(spec.precision) > len ? spec.precision - len : 0;
+		
+		if (spec.alt)
+		{
+			if (spec.conv == 'o' && zeros == 0 && (len == 0 || digits[0] != '0'))
+				zeros = 1;
+			else if ((spec.conv == 'x' || spec.conv == 'X') && uval)
+			{
+				prefix[prefix_len++] = '0';
+				prefix[prefix_len++] = spec.conv;
+			}
+		}
+		
+		w.put_number(spec, prefix, prefix_len, zeros, digits, len, spec.zero && spec.precision < 0);
+		return true;
+	}
+	
+	namespace _detail
+	{
+		/**
+		* @brief Calculates round(mant * pow5 / 2^shift) with round-half-to-even. mant must be below 2^53.
+		* @retval false if the result doesn't fit in 64 bits.
+		*/
+		inline bool scale_round(const uint64_t mant, const uint32_t pow5, const int shift, uint64_t &result)
+		{
+			// product = hi * 2^32 + lo (below 2^85)
+			const uint64_t lo_part = (mant & UINT32_MAX) * pow5;
+			const uint64_t hi = (mant >> 32) * pow5 + (lo_part >> 32), lo = lo_part & UINT32_MAX;
+			
+			if (shift <= 0)
+			{
+				if (hi >> 32 || -shift >= 64 || ((hi << 32) | lo) > (UINT64_MAX >> -shift))
+					return false;
+				
+				result = ((hi << 32) | lo) << -shift;
+				return true;
+			}
+			
+			if (shift > 96)		// Less than half
+			{
+				result = 0;
+				return true;
+			}
+			
+			uint64_t q, rem_hi, half_hi;	// The remainder and half of the divisor are rem_hi * 2^32 + rem_lo and half_hi * 2^32 + half_lo.
+			uint32_t rem_lo, half_lo;
+			
+			if (shift < 32)
+			{
+				if (hi >> (32 + shift))
+					return false;
+				
+				q = (hi << (32 - shift)) | (lo >> shift);
+				rem_hi = half_hi = 0;
+				rem_lo = lo & ((uint32_t(1) << shift) - 1);
+				half_lo = uint32_t(1) << (shift - 1);
+			}
+			else
+			{
+				const int s = shift - 32;
+				q = s >= 64 ? 0 : hi >> s;
+				rem_hi = s >= 64 ? hi : hi & ((uint64_t(1) << s) - 1);
+				rem_lo = lo;
+				half_hi = s == 0 ? 0 : uint64_t(1) << (s - 1);
+				half_lo = s == 0 ? 0x80000000u : 0;
+			}
+			
+			const bool above = rem_hi > half_hi || (rem_hi == half_hi && rem_lo > half_lo);
+			const bool at = rem_hi == half_hi && rem_lo == half_lo;
+			
+			result = q + (above || (at && (q & 1)));
+			return result >= q;
+		}
+		
+		inline double scale10(double val, int exp)
+		{
+			for (; exp > 22; exp -= 22)
+				val *= 1e22;
+			
+			for (; exp < -22; exp += 22)
+				val /= 1e22;
+			
+			return exp >= 0 ? val * c_pow10[exp] : val / c_pow10[-exp];
+		}
+		
+		inline bool put_special(Writer &w, const Spec& spec, const double val, const bool neg)
+		{
+			if (std::isfinite(val))
+				return false;
+			
+			const bool upper = spec.conv >= 'A' && spec.conv <= 'Z';
+			const char *const str = std::isnan(val) ? (upper ? "NAN" : "nan") : (upper ? "INF" : "inf");
+			const char sign = neg ? '-' : spec.plus ? '+' : ' ';
+			
+			w.put_number(spec, &sign, neg || spec.plus || spec.space, 0, str, 3, false);
+			return true;
+		}
+	}
+	
+	/**
+	* @brief Writes a floating-point number like printf() with an f or F conversion. The result is exact (correctly rounded) but only
+	*		values with |val| * 10^precision < 2^64 and precisions up to 13 are supported.
+	* @retval false if the value or conversion isn't supported (nothing is written).
+	*/
+	inline bool put_fixed(Writer &w, const double val, const Spec& spec)
+	{
+		static constexpr uint32_t POW5[] = { 1, 5, 25, 125, 625, 3125, 15625, 78125, 390625, 1953125, 9765625, 48828125, 244140625,
+			1220703125 };
+		
+		if (spec.conv != 'f' && spec.conv != 'F')
+			return false;
+		
+		const int precision = spec.precision < 0 ? 6 : spec.precision;
+		if (precision >= int(std::size(POW5)))
+			return false;
+		
+		const bool neg = std::signbit(val);
+		if (_detail::put_special(w, spec, val, neg))
+			return true;
+		
+		// val = mant * 2^exp2, so val * 10^p = mant * 5^p / 2^-(exp2 + p)
+		uint64_t bits;
+		std::memcpy(&bits, &val, sizeof(bits));
+		
+		const int biased = (bits >> 52) & 0x7FF;
+		const uint64_t mant = (bits & ((uint64_t(1) << 52) - 1)) | (uint64_t(biased != 0) << 52);
+		const int exp2 = biased ? biased - 1075 : -1074;
+		
+		uint64_t scaled;
+		if (!_detail::scale_round(mant, POW5[precision], -(exp2 + precision), scaled))
+			return false;
+		
+		char digits[24];
+		size_t len = utoa(digits, scaled) - digits;
+		
+		// At least one digit before the point
+		if (len <= size_t(precision))
+		{
+			const size_t missing = precision + 1 - len;
+			std::memmove(digits + missing, digits, len);
+			std::memset(digits, '0', missing);
+			len += missing;
+		}
+		
+		const char sign = neg ? '-' : spec.plus ? '+' : ' ';
+		const size_t sign_len = neg || spec.plus || spec.space;
+		const size_t int_len = len - precision, total = sign_len + len + (precision || spec.alt);
+		const size_t pad = size_t(spec.width) > total ? spec.width - total : 0;
+		
+		if (!spec.left && !spec.zero)
+			w.fill(' ', pad);
+		
+		w.put(&sign, sign_len);
+		
+		if (!spec.left && spec.zero)
+			w.fill('0', pad);
+		
+		w.put(digits, int_len);
+		
+		if (precision || spec.alt)
+			w.put('.');
+		
+		w.put(digits + int_len, precision);
+		
+		if (spec.left)
+			w.fill(' ', pad);
+		
+		return true;
+	}
+	
+	/**
+	* @brief Writes a floating-point number with the fewest significant digits that still read back as the same value, choosing between
+	*		fixed and scientific notation like std::to_chars(first, last, val). The digits are found by trial: a float candidate is
+	*		checked in double precision and a double candidate only when the check is exact (up to 15 digits and 10^±22), otherwise
+	*		std::to_chars() is used. When several candidates round-trip, the last digit might differ from std::to_chars().
+	*/
+	template <typename F>
+	void put_shortest(Writer &w, const F val)
+	{
+		static_assert(std::is_same_v<F, float> || std::is_same_v<F, double>);
+		
+		static constexpr bool IS_DOUBLE = std::is_same_v<F, double>;
+		static constexpr int MAX_DIGITS = IS_DOUBLE ? 17 : 9;
+		
+		const bool neg = std::signbit(val);
+		
+		Spec spec;
+		spec.conv = 'g';
+		
+		if (_detail::put_special(w, spec, val, neg))
+			return;
+		
+		const double abs = std::fabs(double(val));
+		if (abs == 0)
+		{
+			w.put(neg ? "-0" : "0", 1 + neg);
+			return;
+		}
+		
+		// Estimate the decimal exponent and correct it.
+		int exp2;
+		std::frexp(abs, &exp2);
+		int exp10 = int(std::floor((exp2 - 1) * 0.30102999566398119521));
+		
+		if (_detail::scale10(abs, -exp10) >= 10)
+			exp10++;
+		else if (_detail::scale10(abs, -exp10) < 1)
+			exp10--;
+		
+		uint64_t best = 0;
+		int digits = 1;
+		bool found = false;
+		
+		for (; digits <= MAX_DIGITS && !found; digits++)
+		{
+			const uint64_t low = uint64_t(c_pow10[digits - 1]), high = uint64_t(c_pow10[digits]);
+			const int k = exp10 - (digits - 1);		// val ~ n * 10^k
+			
+			// n * 10^k is only computed exactly (one rounding) for n < 2^53 and |k| <= 22.
+			if (IS_DOUBLE && (digits > 15 || k < -22 || k > 22))
+				break;
+			
+			const uint64_t n = uint64_t(std::llround(_detail::scale10(abs, -k)));
+			
+			double best_err = 0;
+			
+			for (const uint64_t cand : { n, n - 1, n + 1 })
+			{
+				if (cand < low || cand >= high)
+					continue;
+				
+				const double back = _detail::scale10(double(cand), k);
+				if (F(back) != F(abs))
+					continue;
+				
+				const double err = std::fabs(back - abs);
+				if (!found || err < best_err)
+				{
+					best = cand;
+					best_err = err;
+					found = true;
+				}
+			}
+			
+			if (!found && digits == MAX_DIGITS)
+			{
+				best = std::min(std::max(n, low), high - 1);
+				found = true;
+			}
+		}
+		
+		digits--;
+		
+		if (!found)
+		{
+			char str[32];
+			const auto res = std::to_chars(str, str + sizeof(str), val);
+			w.put(str, res.ptr - str);
+			return;
+		}
+		
+		if (neg)
+			w.put('-');
+		
+		// Remove trailing zeros (e.g. 100 found with 3 digits).
+		while (digits > 1 && best % 10 == 0)
+		{
+			best /= 10;
+			digits--;
+		}
+		
+		char str[20];
+		utoa(str, best);
+		
+		// Fixed: "ddd000", "dd.ddd" or "0.000ddd"; scientific: "d.ddde+XX"
+		const int exp_abs = exp10 < 0 ? -exp10 : exp10;
+		const int fixed_len = exp10 >= 0 ? std::max(digits, exp10 + 1) + (digits > exp10 + 1) : digits + 1 - exp10;
+		const int sci_len = digits + (digits > 1) + 2 + (exp_abs >= 100 ? 3 : 2);
+		
+		if (fixed_len <= sci_len)
+		{
+			if (exp10 >= digits - 1)
+			{
+				w.put(str, digits);
+				w.fill('0', exp10 + 1 - digits);
+			}
+			else if (exp10 >= 0)
+			{
+				w.put(str, exp10 + 1);
+				w.put('.');
+				w.put(str + exp10 + 1, digits - exp10 - 1);
+			}
+			else
+			{
+				w.put("0.", 2);
+				w.fill('0', -exp10 - 1);
+				w.put(str, digits);
+			}
+		}
+		else
+		{
+			w.put(str[0]);
+			
+			if (digits > 1)
+			{
+				w.put('.');
+				w.put(str + 1, digits - 1);
+			}
+			
+			w.put(exp10 < 0 ? "e-" : "e+", 2);
+			
+			char exp[4];
+			const char *const end = utoa(exp, unsigned(exp_abs));
+			if (end - exp < 2)
+				w.put('0');
+			
+			w.put(exp, end - exp);
+		}
+	}
+	
+	/**
+	* @brief The length of a string printed with a precision (if it isn't negative). Doesn't read past the precision, so the string
+	*		doesn't need a null terminator then.
+	*/
+	inline size_t string_length(const char *const str, const int precision)
+	{
+		if (precision < 0)
+			return std::strlen(str);
+		
+		const void *const end = std::memchr(str, 0, size_t(precision));
+		return end ? static_cast<const char *>(end) - str : size_t(precision);
+	}
+	
+	/**
+	* @brief Writes a string like printf() with an s conversion.
+	*/
+	inline void put_string(Writer &w, const char *str, const Spec& spec)
+	{
+		if (!str)
+			str = "(null)";
+		
+		const size_t len = string_length(str, spec.precision);
+		w.put_number(spec, nullptr, 0, 0, str, len, false);
+	}
+	
+	/**
+	* @brief Formats an integer like snprintf(). See put_integer().
+	* @retval The same as snprintf() or UNSUPPORTED.
+	*/
+	template <typename T>
+	int integer(char *const buf, const size_t size, const T val, const Spec& spec)
+	{
+		Writer w(buf, size);
+		return put_integer(w, val, spec) ? w.finish() : UNSUPPORTED;
+	}
+	
+	/**
+	* @brief Formats a floating-point number like snprintf(). See put_fixed().
+	* @retval The same as snprintf() or UNSUPPORTED.
+	*/
+	inline int fixed(char *const buf, const size_t size, const double val, const Spec& spec)
+	{
+		Writer w(buf, size);
+		return put_fixed(w, val, spec) ? w.finish() : UNSUPPORTED;
+	}
+	
+	/**
+	* @brief Formats a floating-point number in the shortest form. See put_shortest().
+	* @retval The same as snprintf().
+	*/
+	template <typename F>
+	int shortest(char *const buf, const size_t size, const F val)
+	{
+		Writer w(buf, size);
+		put_shortest(w, val);
+		return w.finish();
+	}
+	
+	/**
+	* @brief A vsnprintf() replacement. Integers (d, i, u, o, x, X, c), strings and f/F conversions (see put_fixed()) are handled
+	*		directly; everything else (e, g, a, p, wide characters and strings, etc.) is passed to snprintf() one conversion at a time.
+	* @retval The same as vsnprintf() or a negative number if fmt is invalid.
+	*/
+	inline int vformat(char *const buf, const size_t size, const char *fmt, va_list args)
+	{
+		Writer w(buf, size);
+		
+		while (*fmt)
+		{
+			const char *p = std::strchr(fmt, '%');
+			if (!p)
+			{
+				w.put(fmt, std::strlen(fmt));
+				break;
+			}
+			
+			w.put(fmt, p - fmt);
+			fmt = ++p;
+			
+			if (*p == '%')
+			{
+				w.put('%');
+				fmt++;
+				continue;
+			}
+			
+			Spec spec = Spec::Parse(p);
+			if (!spec.conv)
+				return -1;
+			
+			fmt = p + 1;
+			
+			if (spec.star_width)
+				spec.SetWidth(va_arg(args, int));
+			
+			if (spec.star_prec)
+				spec.precision = va_arg(args, int);
+			
+			const bool ll = spec.HasMod("ll") || spec.HasMod("j");
+			const bool l = spec.HasMod("l") || spec.HasMod("z") || spec.HasMod("t");
+			bool done = true;
+			
+			switch (spec.conv)
+			{
+				case 'd': case 'i':
+				{
+					if (ll)
+						put_integer(w, va_arg(args, long long), spec);
+					else if (l)
+						put_integer(w, va_arg(args, long), spec);
+					else if (spec.HasMod("h"))
+						put_integer(w, short(va_arg(args, int)), spec);
+					else if (spec.HasMod("hh"))
+						put_integer(w, (signed char)va_arg(args, int), spec);
+					else
+						put_integer(w, va_arg(args, int), spec);
+					
+					break;
+				}
+				
+				case 'u': case 'o': case 'x': case 'X':
+				{
+					if (ll)
+						put_integer(w, va_arg(args, unsigned long long), spec);
+					else if (l)
+						put_integer(w, va_arg(args, unsigned long), spec);
+					else if (spec.HasMod("h"))
+						put_integer(w, (unsigned short)va_arg(args, unsigned), spec);
+					else if (spec.HasMod("hh"))
+						put_integer(w, (unsigned char)va_arg(args, unsigned), spec);
+					else
+						put_integer(w, va_arg(args, unsigned), spec);
+					
+					break;
+				}
+				
+				case 'c': case 's':
+				{
+					if (l)
+						done = false;
+					else if (spec.conv == 'c')
+						put_integer(w, va_arg(args, int), spec);
+					else
+						put_string(w, va_arg(args, const char *), spec);
+					
+					break;
+				}
+				
+				default:
+					done = false;
+					break;
+			}
+			
+			if (done)
+				continue;
+			
+			// Let snprintf() handle the conversion. Width and precision were already taken from args.
+			char spec_str[16];
+			size_t spec_len = 0;
+			
+			spec_str[spec_len++] = '%';
+			for (const auto& [flag, ch] : { std::pair{ spec.left, '-' }, { spec.plus, '+' }, { spec.space, ' ' }, { spec.alt, '#' },
+				{ spec.zero, '0' } })
+				if (flag)
+					spec_str[spec_len++] = ch;
+			
+			spec_str[spec_len++] = '*';
+			spec_str[spec_len++] = '.';
+			spec_str[spec_len++] = '*';
+			
+			for (const char m : spec.mod)
+				if (m)
+					spec_str[spec_len++] = m;
+			
+			spec_str[spec_len++] = spec.conv;
+			spec_str[spec_len] = '\0';
+			
+			const auto put_printf = [&](const auto val)
+			{
+				char var[64];
+				const int n = snprintf(var, sizeof(var), spec_str, spec.width, spec.precision, val);
+				
+				if (n >= 0 && size_t(n) < sizeof(var))
+					w.put(var, n);
+				else if (n >= 0)
+				{
+					// Too long for var (e.g. a wide width): written straight to the buffer, truncated like snprintf() but counted in full.
+					size_t room;
+					char *const dst = w.tail(room);
+					if (room)
+						snprintf(dst, room, spec_str, spec.width, spec.precision, val);
+					
+					w.advance(n);
+				}
+				
+				return n;
+			};
+			
+			int n;
+			switch (spec.conv)
+			{
+				case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+				{
+					if (spec.HasMod("L"))
+						n = put_printf(va_arg(args, long double));
+					else
+					{
+						const double d = va_arg(args, double);
+						if (put_fixed(w, d, spec))
+							continue;
+						
+						n = put_printf(d);
+					}
+					
+					break;
+				}
+				
+				case 'c':
+					n = put_printf(va_arg(args, wint_t));
+					break;
+				
+				case 's':
+					n = put_printf(va_arg(args, const wchar_t *));
+					break;
+				
+				case 'p':
+					n = put_printf(va_arg(args, void *));
+					break;
+				
+				default:
+					return -1;
+			}
+			
+			if (n < 0)
+				return n;
+		}
+		
+		return w.finish();
+	}
+	
+	/**
+	* @brief An snprintf() replacement. See vformat().
+	*/
+	inline int format(char *const buf, const size_t size, const char *fmt, ...)
+	{
+		va_list args;
+		va_start(args, fmt);
+		const int n = vformat(buf, size, fmt, args);
+		va_end(args);
+		
+		return n;
+	}
+}
@@ -5,6 +5,8 @@
 #include <vector>
 #include <functional>
 #include <type_traits>
+#include <optional>
+#include <limits>
 
 
 
@@ -16,6 +18,71 @@ namespace STM32T
 	template <class F>
 	using func = std::function<F>;
 	
+	template <class F>
+	class function_ref;
+	
+	/**
+	* @brief A non-owning reference to a callable (a pointer to it and a trampoline), for callback parameters. Never allocates, unlike
+	*		func<> with captures bigger than its small buffer.
+	* @note It doesn't extend the lifetime of the callable, so it mustn't be stored beyond the call it's passed to.
+	*/
+	template <class R, class... Args>
+	class function_ref<R(Args...)>
+	{
+		union
+		{
+			void *p_obj;
+			void (*p_func)();		// Cast back to its type by p_call
+		};
+		
+		R (*p_call)(const function_ref *self, Args... args) = nullptr;
+		
+		template <class T>
+		struct is_function_ref : std::false_type {};
+		template <class S>
+		struct is_function_ref<function_ref<S>> : std::true_type {};
+		
+	public:
+		constexpr function_ref() noexcept : p_obj(nullptr) {}
+		constexpr function_ref(std::nullptr_t) noexcept : p_obj(nullptr) {}
+		
+		template <class F, class D = std::remove_reference_t<F>, class = std::enable_if_t<!is_function_ref<std::remove_cv_t<D>>::value &&
+			std::is_invocable_r_v<R, D&, Args...>>>
+		function_ref(F&& f) noexcept
+		{
+			using P = std::decay_t<D>;
+			
+			if constexpr (std::is_pointer_v<P> && std::is_function_v<std::remove_pointer_t<P>>)		// Functions are stored by value.
+			{
+				p_func = reinterpret_cast<void (*)()>(P(f));
+				p_call = [](const function_ref *self, Args... args) -> R { return reinterpret_cast<P>(self->p_func)(std::forward<Args>(args)...); };
+				
+				if constexpr (std::is_pointer_v<D>)
+				{
+					if (!f)
+						p_call = nullptr;
+				}
+			}
+			else if constexpr (std::is_class_v<P> && std::is_convertible_v<D&, R (*)(Args...)>)		// Lambdas without captures too
+			{
+				p_func = reinterpret_cast<void (*)()>(static_cast<R (*)(Args...)>(f));
+				p_call = [](const function_ref *self, Args... args) -> R
+				{
+					return reinterpret_cast<R (*)(Args...)>(self->p_func)(std::forward<Args>(args)...);
+				};
+			}
+			else
+			{
+				p_obj = const_cast<void *>(static_cast<const volatile void *>(std::addressof(f)));
+				p_call = [](const function_ref *self, Args... args) -> R { return (*static_cast<D *>(self->p_obj))(std::forward<Args>(args)...); };
+			}
+		}
+		
+		R operator()(Args... args) const { return p_call(this, std::forward<Args>(args)...); }
+		
+		explicit operator bool() const noexcept { return p_call != nullptr; }
+	};
+	
 	template <class T>
 	constexpr bool is_int_v = !std::is_same_v<T, bool> && std::is_integral_v<T>;
 	
@@ -191,6 +258,21 @@ namespace STM32T
 		}
 	};
 	
+	/**
+	* @brief Disables interrupts for the lifetime of the object and restores the previous state (PRIMASK) afterwards, so it can be nested.
+	*/
+	class CriticalSection
+	{
+		const uint32_t c_primask = __get_PRIMASK();
+		
+	public:
+		CriticalSection() { __disable_irq(); }
+		~CriticalSection() { __set_PRIMASK(c_primask); }
+		
+		CriticalSection(const CriticalSection&) = delete;
+		CriticalSection& operator=(const CriticalSection&) = delete;
+	};
+	
 	class ScopeAction
 	{
 		void (*m_end)();
@@ -217,35 +299,55 @@ namespace STM32T
 		}
 	};
 	
+	/**
+	* @brief Runs END at the end of the scope. The callable is stored inside (the type is deduced: ScopeActionF exit([&] { ... });), so
+	*		it never allocates.
+	*/
+	template <class F = func<void()>>
 	class ScopeActionF
 	{
 	public:
-		using funt_t = func<void()>;
+		using funt_t = F;
 		
 		ScopeActionF(funt_t &&end) : m_end(std::move(end)) {}
 		~ScopeActionF()
 		{
-			if (m_end)
+			if (armed())
 				m_end();
 		}
 		
+		ScopeActionF(const ScopeActionF&) = delete;
+		ScopeActionF& operator=(const ScopeActionF&) = delete;
+		
 		void EarlyExit()
 		{
-			if (m_end)
+			if (armed())
 				m_end();
 			
-			m_end = nullptr;
+			m_active = false;
 		}
 		
 		void Cancel()
 		{
-			m_end = nullptr;
+			m_active = false;
 		}
 		
 	private:
 		funt_t m_end;
+		bool m_active = true;
+		
+		bool armed() const
+		{
+			if constexpr (std::is_pointer_v<funt_t> || std::is_constructible_v<funt_t, std::nullptr_t>)		// An empty func<> isn't called.
+				return m_active && m_end;
+			else
+				return m_active;
+		}
 	};
 	
+	template <class F>
+	ScopeActionF(F) -> ScopeActionF<F>;
+	
 	template <typename T, T MIN, T MAX>
 	class ClampedInt
 	{
@@ -1272,7 +1374,7 @@ namespace STM32T
 		*					- RemSecond: The second item is removed from the queue and the search continues.
 		*					- RemBoth: Both items are removed from the queue and the search is restarted.
 		*/
-		std::optional<T> pop_front(const func<PopAction (const T *, std::optional<const T *>)>& filter = nullptr)
+		std::optional<T> pop_front(const function_ref<PopAction (const T *, std::optional<const T *>)> filter = nullptr)
 		{
 			const index_t back = m_back, front = m_front;	// For fewer volatile accesses
 			
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+
+
+namespace STM32T
+{
+	template <class Signature, size_t Capacity = 16, size_t Alignment = alignof(std::max_align_t)>
+	class inplace_function;
+	
+	/**
+	* @brief A std::function that stores the callable inside itself (up to Capacity bytes) and never allocates. A callable that doesn't
+	*		fit is a compile-time error. Trivially copyable callables (function pointers, lambdas capturing pointers or numbers...) are
+	*		copied with memcpy.
+	* @note Calling an empty inplace_function is undefined behavior (there are no exceptions); check it with operator bool.
+	*/
+	template <class R, class... Args, size_t Capacity, size_t Alignment>
+	class inplace_function<R(Args...), Capacity, Alignment>
+	{
+		enum class Op { Copy, Move, Destroy };
+		
+		using invoke_t = R (*)(void *storage, Args&&... args);
+		using manage_t = void (*)(Op op, void *dst, void *src);
+		
+		alignas(Alignment) unsigned char m_storage[Capacity];
+		invoke_t p_invoke = nullptr;
+		manage_t p_manage = nullptr;		// nullptr: trivially copyable
+		
+		template <class F>
+		static R invoke(void *storage, Args&&... args)
+		{
+			return (*static_cast<F *>(storage))(std::forward<Args>(args)...);
+		}
+		
+		template <class F>
+		static void manage(const Op op, void *const dst, void *const src)
+		{
+			switch (op)
+			{
+			case Op::Copy:
+				::new (dst) F(*static_cast<const F *>(src));
+				break;
+			
+			case Op::Move:
+				::new (dst) F(std::move(*static_cast<F *>(src)));
+				static_cast<F *>(src)->~F();
+				break;
+			
+			case Op::Destroy:
+				static_cast<F *>(dst)->~F();
+				break;
+			}
+		}
+		
+		template <class T>
+		struct is_inplace_function : std::false_type {};
+		template <class S, size_t C, size_t A>
+		struct is_inplace_function<inplace_function<S, C, A>> : std::true_type {};
+		
+		void copy_from(const inplace_function& other)
+		{
+			if (!other.p_invoke)
+				return;
+			
+			if (other.p_manage)
+				other.p_manage(Op::Copy, m_storage, const_cast<unsigned char *>(other.m_storage));
+			else
+				std::memcpy(m_storage, other.m_storage, Capacity);
+			
+			p_invoke = other.p_invoke;
+			p_manage = other.p_manage;
+		}
+		
+		void move_from(inplace_function& other)
+		{
+			if (!other.p_invoke)
+				return;
+			
+			if (other.p_manage)
+				other.p_manage(Op::Move, m_storage, other.m_storage);
+			else
+				std::memcpy(m_storage, other.m_storage, Capacity);
+			
+			p_invoke = other.p_invoke;
+			p_manage = other.p_manage;
+			other.p_invoke = nullptr;
+			other.p_manage = nullptr;
+		}
+		
+	public:
+		inplace_function() noexcept = default;
+		inplace_function(std::nullptr_t) noexcept {}
+		
+		template <class F, class D = std::decay_t<F>, class = std::enable_if_t<!is_inplace_function<D>::value &&
+			std::is_invocable_r_v<R, D&, Args...>>>
+		inplace_function(F&& f)
+		{
+			static_assert(sizeof(D) <= Capacity, "The callable doesn't fit in the inplace_function. Increase its capacity!");
+			static_assert(Alignment % alignof(D) == 0, "The alignment of the callable is too strict for the inplace_function!");
+			static_assert(std::is_copy_constructible_v<D>, "The callable must be copy constructible!");
+			
+			// A function reference is never null; a pointer may be.
+			if constexpr (std::is_pointer_v<std::remove_reference_t<F>> || std::is_member_pointer_v<std::remove_reference_t<F>>)
+				if (f == nullptr)		// Empty, like std::function
+					return;
+			
+			::new (m_storage) D(std::forward<F>(f));
+			p_invoke = &invoke<D>;
+			
+			if constexpr (!std::is_trivially_copyable_v<D> || !std::is_trivially_destructible_v<D>)
+				p_manage = &manage<D>;
+			else if constexpr (sizeof(D) < Capacity)
+				std::memset(m_storage + sizeof(D), 0, Capacity - sizeof(D));		// All of it is copied with memcpy.
+		}
+		
+		inplace_function(const inplace_function& other) { copy_from(other); }
+		inplace_function(inplace_function&& other) noexcept { move_from(other); }
+		
+		~inplace_function() { reset(); }
+		
+		inplace_function& operator=(const inplace_function& other)
+		{
+			if (this != &other)
+			{
+				reset();
+				copy_from(other);
+			}
+			
+			return *this;
+		}
+		
+		inplace_function& operator=(inplace_function&& other) noexcept
+		{
+			if (this != &other)
+			{
+				reset();
+				move_from(other);
+			}
+			
+			return *this;
+		}
+		
+		inplace_function& operator=(std::nullptr_t) noexcept
+		{
+			reset();
+			return *this;
+		}
+		
+		void reset() noexcept
+		{
+			if (p_manage)
+				p_manage(Op::Destroy, m_storage, nullptr);
+			
+			p_invoke = nullptr;
+			p_manage = nullptr;
+		}
+		
+		void swap(inplace_function& other) noexcept
+		{
+			inplace_function temp(std::move(other));
+			other = std::move(*this);
+			*this = std::move(temp);
+		}
+		
+		R operator()(Args... args) const
+		{
+			return p_invoke(const_cast<unsigned char *>(m_storage), std::forward<Args>(args)...);
+		}
+		
+		explicit operator bool() const noexcept { return p_invoke != nullptr; }
+		
+		static constexpr size_t capacity() noexcept { return Capacity; }
+	};
+}
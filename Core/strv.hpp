@@ -311,7 +311,7 @@ namespace STM32T
 		{
 			if (starts_with(ch))
 			{
-				remove_prefix(1u);
+				base::remove_prefix(1);
 				return true;
 			}
 
@@ -334,7 +334,7 @@ namespace STM32T
 		{
 			if (ends_with(ch))
 			{
-				remove_suffix(1u);
+				base::remove_suffix(1);
 				return true;
 			}
 
@@ -0,0 +1,230 @@
+#pragma once
+
+#include "main.h"
+
+#include "./Runnable.hpp"
+
+
+
+/**
+* @brief Stackless coroutines (protothreads) for C++17. The body of Task::run() goes between STM32T_CO_BEGIN() and STM32T_CO_END(); the
+*		waits return to the scheduler and the task resumes from there later. The local variables don't survive a wait (use members),
+*		the waits can't be inside a switch statement and there can be only one of them on a line.
+*/
+#define STM32T_CO_BEGIN()		switch (m_line) { case 0:
+#define STM32T_CO_END()			} m_line = 0; return STM32T::Co::Status::Done
+
+/**
+* @brief Lets the other tasks run.
+*/
+#define STM32T_CO_YIELD() \
+	do { m_line = __LINE__; return STM32T::Co::Status::Ready; case __LINE__:; } while (0)
+
+/**
+* @brief Waits until COND is true. COND is checked every tick.
+*/
+#define STM32T_CO_AWAIT(COND) \
+	do { m_line = __LINE__; case __LINE__: if (!(COND)) return STM32T::Co::Status::Polling; } while (0)
+
+/**
+* @brief Waits until COND is true or for MS ticks at most. TimedOut() tells which one happened.
+*/
+#define STM32T_CO_AWAIT_FOR(COND, MS) \
+	do { m_wake = HAL_GetTick() + (MS); m_line = __LINE__; case __LINE__: \
+		if ((m_timedOut = !(COND)) && int32_t(HAL_GetTick() - m_wake) < 0) return STM32T::Co::Status::Polling; } while (0)
+
+/**
+* @brief Waits for MS ticks (instead of HAL_Delay()).
+*/
+#define STM32T_CO_DELAY(MS) \
+	do { m_wake = HAL_GetTick() + (MS); m_line = __LINE__; case __LINE__: \
+		if (int32_t(HAL_GetTick() - m_wake) < 0) return STM32T::Co::Status::Sleeping; } while (0)
+
+/**
+* @brief Waits until the pin IO (an STM32T::IO) reads STATE.
+*/
+#define STM32T_CO_PIN(IO, STATE)		STM32T_CO_AWAIT((IO).Read() == (STATE))
+
+/**
+* @brief Waits until the Co::Future F is completed (e.g. by a driver callback).
+*/
+#define STM32T_CO_FUTURE(F)				STM32T_CO_AWAIT((F).ready())
+
+
+
+namespace STM32T::Co
+{
+	enum class Status : uint8_t
+	{
+		Done,
+		Ready,		// Yielded
+		Polling,	// Waiting for a condition
+		Sleeping,	// Waiting for m_wake
+	};
+	
+	/**
+	* @brief The result of an operation that completes later, e.g. in an interrupt callback. A task waits for it with STM32T_CO_FUTURE().
+	*/
+	template <class T = bool>
+	class Future
+	{
+		T m_value{};
+		volatile bool m_ready = false;
+		
+	public:
+		/**
+		* @brief Completes the future. Can be called from an ISR.
+		*/
+		void set(const T& value = T{})
+		{
+			m_value = value;
+			__DMB();	// The value must be stored before ready() can see the flag.
+			m_ready = true;
+		}
+		
+		bool ready() const
+		{
+			const bool ready = m_ready;
+			__DMB();	// get() mustn't be read before the flag.
+			return ready;
+		}
+		
+		const T& get() const { return m_value; }
+		
+		/**
+		* @brief Prepares the future for the next operation. Call it before starting the operation.
+		*/
+		void reset() { m_ready = false; }
+	};
+	
+	/**
+	* @brief A cooperative task. Derive from it, implement run() with the STM32T_CO_* macros and Start() it. The tasks are run by a
+	*		Runnable task, which is scheduled for the earliest wake-up (so Runnable::Idle() can sleep meanwhile); the tasks that wait for a
+	*		condition are polled every tick.
+	*
+	* @note Must not be started or stopped from ISRs (use a Future instead).
+	*/
+	class Task
+	{
+		Task *m_next = nullptr;
+		bool m_linked = false;
+		Status m_status = Status::Done;
+		
+		static inline Task *s_first = nullptr;
+		static inline bool s_started = false;		// A task was started while the tasks were being run.
+		
+		static void schedule(const uint32_t delay)
+		{
+			Runnable::Remove(Process, true);
+			Runnable::Do(Process, delay);
+		}
+		
+		static void Process()
+		{
+			uint32_t delay = UINT32_MAX;
+			s_started = false;
+			
+			for (Task **p = &s_first; *p;)
+			{
+				Task& t = **p;
+				
+				if (t.m_status == Status::Done)
+				{
+					*p = t.m_next;
+					t.m_linked = false;
+					continue;
+				}
+				
+				if (t.m_status != Status::Sleeping || int32_t(HAL_GetTick() - t.m_wake) >= 0)
+				{
+					const Status status = t.run();
+					if (t.m_status != Status::Done)		// Not stopped meanwhile
+						t.m_status = status;
+				}
+				
+				switch (t.m_status)
+				{
+				case Status::Ready:
+					delay = 0;
+					break;
+				
+				case Status::Polling:
+					delay = std::min<uint32_t>(delay, 1);
+					break;
+				
+				case Status::Sleeping:
+					delay = std::min<uint32_t>(delay, std::max<int32_t>(int32_t(t.m_wake - HAL_GetTick()), 0));
+					break;
+				
+				default:
+					break;
+				}
+				
+				p = &t.m_next;
+			}
+			
+			Runnable::Remove(Process, true);
+			if (s_started)
+				Runnable::Do(Process, 0);
+			else if (delay != UINT32_MAX)
+				Runnable::Do(Process, delay);
+		}
+		
+	protected:
+		int m_line = 0;
+		uint32_t m_wake = 0;
+		bool m_timedOut = false;
+		
+		/**
+		* @brief The body of the task, between STM32T_CO_BEGIN() and STM32T_CO_END().
+		*/
+		virtual Status run() = 0;
+		
+	public:
+		virtual ~Task()
+		{
+			for (Task **p = &s_first; *p; p = &(*p)->m_next)
+			{
+				if (*p == this)
+				{
+					*p = m_next;
+					break;
+				}
+			}
+		}
+		
+		/**
+		* @brief Starts (or restarts) the task from the beginning. It runs for the first time in the next Runnable::Process().
+		*/
+		void Start()
+		{
+			m_line = 0;
+			m_status = Status::Ready;
+			
+			if (!m_linked)
+			{
+				m_next = s_first;
+				s_first = this;
+				m_linked = true;
+			}
+			
+			s_started = true;
+			schedule(0);
+		}
+		
+		/**
+		* @brief Stops the task. It is unlinked the next time the tasks are run (or when it is destroyed).
+		*/
+		void Stop()
+		{
+			m_status = Status::Done;
+		}
+		
+		bool IsRunning() const { return m_status != Status::Done; }
+		
+		/**
+		* @retval true if the last STM32T_CO_AWAIT_FOR() timed out.
+		*/
+		bool TimedOut() const { return m_timedOut; }
+	};
+}
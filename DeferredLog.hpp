@@ -0,0 +1,228 @@
+#pragma once
+
+#include "./Log.hpp"
+#include "./Core/Utils.hpp"
+
+
+
+/**
+* @brief Records a deferred log message. FMT must be a string literal so that its ID is computed at compile time and DeferredLog.py can
+*		find it in the sources. The arguments are still checked against FMT by the compiler.
+*/
+#define STM32T_DLOG(LOGGER, LEVEL, FMT, ...) \
+do \
+{ \
+	(void)sizeof(std::printf(FMT, ##__VA_ARGS__)); \
+	static constexpr uint32_t _id = STM32T::Log::FormatId(FMT); \
+	(LOGGER).record(LEVEL, _id, ##__VA_ARGS__); \
+} while (0)
+
+#define STM32T_DLOG_F(LOGGER, FMT, ...)	STM32T_DLOG(LOGGER, STM32T::Log::Level::Fatal, FMT, ##__VA_ARGS__)
+#define STM32T_DLOG_E(LOGGER, FMT, ...)	STM32T_DLOG(LOGGER, STM32T::Log::Level::Error, FMT, ##__VA_ARGS__)
+#define STM32T_DLOG_W(LOGGER, FMT, ...)	STM32T_DLOG(LOGGER, STM32T::Log::Level::Warning, FMT, ##__VA_ARGS__)
+#define STM32T_DLOG_I(LOGGER, FMT, ...)	STM32T_DLOG(LOGGER, STM32T::Log::Level::Info, FMT, ##__VA_ARGS__)
+#define STM32T_DLOG_D(LOGGER, FMT, ...)	STM32T_DLOG(LOGGER, STM32T::Log::Level::Debug, FMT, ##__VA_ARGS__)
+
+
+
+namespace STM32T::Log
+{
+	/**
+	* @brief The ID of a deferred log format string (32-bit FNV-1a of the string). DeferredLog.py uses the same hash.
+	*/
+	constexpr uint32_t FormatId(const char *fmt)
+	{
+		uint32_t hash = 2166136261u;
+		while (*fmt)
+			hash = (hash ^ uint8_t(*fmt++)) * 16777619u;
+		
+		return hash ? hash : 1;		// 0 is reserved for the "dropped" record.
+	}
+	
+	/**
+	* @brief A logger that doesn't format anything on the device. Each call stores the format ID, a timestamp and the raw arguments in a
+	*		ring buffer and Drain() later sends the binary records to the outputs. Use DeferredLog.py to turn them back into text.
+	*
+	*		Record: [SYNC][len][level][id: u32][timestamp: u32][args...], little-endian, len being the number of bytes after itself.
+	*		Integers up to 32 bits and pointers take 4 bytes, 64-bit integers and floating-point numbers (as double) take 8 bytes and
+	*		strings are stored as [len: u8][chars...].
+	*
+	* @note record() can be called from any context (including ISRs). Drain() must only be called from one context.
+	*/
+	template <size_t SIZE = 1024, size_t OUTPUT_COUNT = 1>
+	class DeferredLogger
+	{
+		static_assert(SIZE >= 512 && (SIZE & (SIZE - 1)) == 0, "SIZE must be a power of 2 and at least 512!");
+		
+	public:
+		using stamp_t = uint32_t (*)();
+		
+		static constexpr uint8_t SYNC = 0xA5;
+		static constexpr size_t HEADER_SIZE = 11, MAX_RECORD_SIZE = 2 + UINT8_MAX, MAX_STRING_LEN = 64;
+		
+		Level level;
+		std::array<output_t, OUTPUT_COUNT> outputs;
+		stamp_t timestamp = HAL_GetTick;
+		
+	private:
+		uint8_t m_buf[SIZE];
+		volatile size_t m_head = 0, m_tail = 0;		// Free-running; m_head is written by record() and m_tail by Drain().
+		volatile uint32_t m_dropped = 0;
+		uint32_t m_droppedTotal = 0;
+		
+		template <class T>
+		static void encode(uint8_t *const rec, size_t &len, size_t &str_budget, const T arg)
+		{
+			if constexpr (std::is_same_v<T, const char *> || std::is_same_v<T, char *>)
+			{
+				const size_t str_len = std::min({ arg ? std::strlen(arg) : 0, MAX_STRING_LEN, str_budget });
+				
+				str_budget -= str_len;
+				rec[len++] = str_len;
+				std::memcpy(rec + len, arg, str_len);
+				len += str_len;
+			}
+			else if constexpr (std::is_floating_point_v<T>)
+			{
+				const double d = arg;
+				std::memcpy(rec + len, &d, sizeof(d));
+				len += sizeof(d);
+			}
+			else if constexpr (std::is_pointer_v<T>)
+				len += unpack_le<uint32_t>(rec + len, reinterpret_cast<uintptr_t>(arg));
+			else if constexpr (sizeof(T) > sizeof(uint32_t))
+				len += unpack_le<uint64_t>(rec + len, arg);
+			else
+			{
+				static_assert(std::is_integral_v<T> || std::is_enum_v<T>, "Unsupported argument type!");
+				len += unpack_le<uint32_t>(rec + len, uint32_t(arg));
+			}
+		}
+		
+		template <class T>
+		static constexpr size_t fixed_size()
+		{
+			if constexpr (std::is_same_v<T, const char *> || std::is_same_v<T, char *>)
+				return 1;
+			else if constexpr (std::is_floating_point_v<T> || (!std::is_pointer_v<T> && sizeof(T) > sizeof(uint32_t)))
+				return sizeof(uint64_t);
+			else
+				return sizeof(uint32_t);
+		}
+		
+		bool push(const uint8_t *const rec, const size_t len)
+		{
+			CriticalSection cs;
+			
+			const size_t head = m_head;
+			if (SIZE - (head - m_tail) < len)
+			{
+				++m_dropped;
+				return false;
+			}
+			
+			const size_t index = head % SIZE, first = std::min(len, SIZE - index);
+			std::memcpy(m_buf + index, rec, first);
+			std::memcpy(m_buf, rec + first, len - first);
+			
+			m_head = head + len;
+			return true;
+		}
+		
+		void dispatch_chunk(const uint8_t *buf, size_t len, bool last) const
+		{
+			for (auto out : outputs)
+				if (out)
+					out({reinterpret_cast<const char *>(buf), len}, last);
+		}
+		
+	public:
+		DeferredLogger(Level level, std::array<output_t, OUTPUT_COUNT> outputs) : level(level), outputs(outputs) {}
+		DeferredLogger(Level level, std::array<output_t, OUTPUT_COUNT> outputs, stamp_t timestamp) : level(level), outputs(outputs),
+			timestamp(timestamp) {}
+		
+		bool isEnabled(const Level level) const { return this->level >= level; }
+		
+		/**
+		* @brief Stores a record. Use the STM32T_DLOG_X macros instead of calling this directly.
+		* @retval false if the level is disabled or the buffer is full.
+		*/
+		template <class... Args>
+		bool record(const Level level, const uint32_t id, const Args... args)
+		{
+			constexpr size_t FIXED_SIZE = HEADER_SIZE + (fixed_size<Args>() + ... + 0);
+			static_assert(FIXED_SIZE <= MAX_RECORD_SIZE, "Too many arguments!");
+			
+			if (!isEnabled(level))
+				return false;
+			
+			uint8_t rec[MAX_RECORD_SIZE];
+			rec[0] = SYNC;
+			rec[2] = uint8_t(level);
+			unpack_le<uint32_t>(rec + 3, id);
+			unpack_le<uint32_t>(rec + 7, timestamp ? timestamp() : 0);
+			
+			size_t len = HEADER_SIZE, str_budget = MAX_RECORD_SIZE - FIXED_SIZE;
+			(encode(rec, len, str_budget, args), ...);
+			rec[1] = len - 2;
+			
+			return push(rec, len);
+		}
+		
+		/**
+		* @brief Sends the stored records to the outputs. If records were dropped, a record with ID 0 and the number of dropped
+		*		records is sent once the buffer is empty.
+		* @param max_len - The maximum number of bytes to send. Only whole records are sent.
+		* @retval The number of bytes sent.
+		*/
+		size_t Drain(size_t max_len = SIZE)
+		{
+			const size_t head = m_head;
+			size_t tail = m_tail, sent = 0;
+			
+			// Only send whole records.
+			size_t end = tail;
+			while (end != head && end - tail + 2 + m_buf[(end + 1) % SIZE] <= max_len)
+				end += 2 + m_buf[(end + 1) % SIZE];
+			
+			while (tail != end)
+			{
+				const size_t index = tail % SIZE, len = std::min(end - tail, SIZE - index);
+				
+				tail += len;
+				dispatch_chunk(m_buf + index, len, tail == end);
+				sent += len;
+			}
+			
+			m_tail = tail;
+			
+			const uint32_t dropped = m_dropped;
+			if (dropped && tail == head)
+			{
+				uint8_t rec[HEADER_SIZE + sizeof(uint32_t)] = { SYNC, sizeof(rec) - 2, uint8_t(Level::Warning) };
+				unpack_le<uint32_t>(rec + 3, 0);
+				unpack_le<uint32_t>(rec + 7, timestamp ? timestamp() : 0);
+				unpack_le<uint32_t>(rec + HEADER_SIZE, dropped);
+				
+				dispatch_chunk(rec, sizeof(rec), true);
+				sent += sizeof(rec);
+				
+				CriticalSection cs;
+				m_dropped -= dropped;
+				m_droppedTotal += dropped;
+			}
+			
+			return sent;
+		}
+		
+		/**
+		* @retval The number of bytes waiting to be drained.
+		*/
+		size_t Pending() const { return m_head - m_tail; }
+		
+		/**
+		* @retval The total number of records dropped because the buffer was full.
+		*/
+		uint32_t Dropped() const { return m_droppedTotal + m_dropped; }
+	};
+}
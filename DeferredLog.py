@@ -0,0 +1,212 @@
+import os
+import re
+import struct
+import sys
+import argparse
+
+
+SYNC = 0xA5
+HEADER_SIZE = 11
+SOURCE_EXTS = (".c", ".cpp", ".h", ".hpp")
+LEVELS = { 0: "None ", 1: "Fatal", 2: "Error", 3: "Warn ", 4: "Info ", 5: "Debug" }
+
+MACRO_RE = re.compile(r"\bSTM32T_DLOG(?:_[FEWID])?\s*\(")
+SPEC_RE = re.compile(r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d*))?(hh|h|ll|l|L|z|j|t)?([diouxXcsfFeEgGaApn%])")
+ESCAPES = { 'n': 10, 't': 9, 'r': 13, 'a': 7, 'b': 8, 'f': 12, 'v': 11, '\\': 92, '"': 34, '\'': 39, '?': 63 }
+
+
+def fnv1a(data: bytes) -> int:
+	hash = 2166136261
+	for byte in data:
+		hash = ((hash ^ byte) * 16777619) & 0xFFFFFFFF
+	
+	return hash if hash else 1
+
+def unescape(literal: str) -> bytes:
+	out = bytearray()
+	raw = literal.encode()
+	i = 0
+	while i < len(raw):
+		ch = raw[i]
+		i += 1
+		if ch != ord('\\'):
+			out.append(ch)
+			continue
+		
+		esc = chr(raw[i])
+		if esc == 'x':
+			m = re.match(rb"[0-9a-fA-F]+", raw[i + 1:])
+			out.append(int(m.group(), 16) & 0xFF)
+			i += 1 + len(m.group())
+		elif esc in "01234567":
+			m = re.match(rb"[0-7]{1,3}", raw[i:])
+			out.append(int(m.group(), 8) & 0xFF)
+			i += len(m.group())
+		else:
+			out.append(ESCAPES[esc])
+			i += 1
+	
+	return bytes(out)
+
+def find_formats(text: str) -> list[bytes]:
+	"""Returns the format string of every STM32T_DLOG call in text (the first run of adjacent string literals in the call)."""
+	formats = []
+	for m in MACRO_RE.finditer(text):
+		depth, i, parts, done = 1, m.end(), [], False
+		while i < len(text) and depth and not done:
+			ch = text[i]
+			if ch == '"':
+				lit = re.match(r'"((?:[^"\\\n]|\\.)*)"', text[i:])
+				parts.append(lit.group(1))
+				i += len(lit.group())
+				continue
+			elif ch == '\'':
+				i += len(re.match(r"'(?:[^'\\\n]|\\.)*'", text[i:]).group())
+				continue
+			elif ch in "([{":
+				depth += 1
+			elif ch in ")]}":
+				depth -= 1
+			elif not ch.isspace() and parts:
+				done = True
+			
+			i += 1
+		
+		if parts:
+			formats.append(b"".join(unescape(p) for p in parts))
+	
+	return formats
+
+def build_table(paths: list[str]) -> dict[int, bytes]:
+	table = {}
+	for path in paths:
+		files = [path] if os.path.isfile(path) else \
+			[os.path.join(root, f) for root, _, names in os.walk(path) for f in names if f.endswith(SOURCE_EXTS)]
+		
+		for file in files:
+			with open(file, encoding="utf-8", errors="replace") as source:
+				text = source.read()
+			
+			for fmt in find_formats(text):
+				id = fnv1a(fmt)
+				if id in table and table[id] != fmt:
+					print(f"Warning: ID collision 0x{id:08X}: {table[id]!r} and {fmt!r}", file=sys.stderr)
+				
+				table[id] = fmt
+	
+	return table
+
+def render(fmt: bytes, args: bytes) -> str:
+	fmt = fmt.decode("utf-8", errors="replace")
+	out, pos, last = [], 0, 0
+	
+	def take(size: int, code: str):
+		nonlocal pos
+		val = struct.unpack_from("<" + code, args, pos)[0]
+		pos += size
+		return val
+	
+	for m in SPEC_RE.finditer(fmt):
+		out.append(fmt[last:m.start()])
+		last = m.end()
+		flags, width, precision, modifier, conv = m.groups()
+		
+		if conv == '%':
+			out.append('%')
+			continue
+		
+		if width == '*':
+			width = str(take(4, "i"))
+		
+		if precision == '*':
+			precision = str(take(4, "i"))
+		
+		spec = "%" + flags + (width or "") + ("." + precision if precision is not None else "")
+		wide = modifier in ("ll", "j")
+		
+		if conv in "di":
+			val = take(8, "q") if wide else take(4, "i")
+			if modifier == "h":
+				val = (val + 0x8000 & 0xFFFF) - 0x8000
+			elif modifier == "hh":
+				val = (val + 0x80 & 0xFF) - 0x80
+			out.append((spec + "d") % val)
+		elif conv in "ouxX":
+			val = take(8, "Q") if wide else take(4, "I")
+			if modifier == "h":
+				val &= 0xFFFF
+			elif modifier == "hh":
+				val &= 0xFF
+			out.append((spec + ("d" if conv == "u" else conv)) % val)
+		elif conv in "fFeEgG":
+			out.append((spec + conv) % take(8, "d"))
+		elif conv in "aA":
+			val = take(8, "d").hex()
+			out.append(val.upper() if conv == "A" else val)
+		elif conv == "c":
+			out.append((spec + "c") % (take(4, "I") & 0xFF))
+		elif conv == "s":
+			length = args[pos]
+			out.append((spec + "s") % args[pos + 1:pos + 1 + length].decode("utf-8", errors="replace"))
+			pos += 1 + length
+		elif conv == "p":
+			out.append("0x%08X" % take(4, "I"))
+		elif conv == "n":
+			take(4, "I")
+	
+	out.append(fmt[last:])
+	return "".join(out)
+
+def decode(data: bytes, table: dict[int, bytes], output):
+	i = 0
+	while i + HEADER_SIZE <= len(data):
+		if data[i] != SYNC:
+			i += 1
+			continue
+		
+		length = data[i + 1]
+		level, id, timestamp = struct.unpack_from("<BII", data, i + 2)
+		end = i + 2 + length
+		
+		if end > len(data) or length < HEADER_SIZE - 2 or (id and id not in table):
+			i += 1		# Not a record boundary; resynchronize.
+			continue
+		
+		args = data[i + HEADER_SIZE:end]
+		prefix = f"[{timestamp:10}][{LEVELS.get(level, ' ??? ')}]: "
+		
+		if id == 0:
+			output.write(f"{prefix}<{struct.unpack_from('<I', args)[0]} record(s) dropped>\n")
+		else:
+			try:
+				text = render(table[id], args)
+			except (struct.error, IndexError, TypeError, ValueError) as e:
+				text = f"<bad arguments for {table[id]!r}: {e}>"
+			
+			output.write(prefix + text + ("" if text.endswith("\n") else "\n"))
+		
+		i = end
+
+
+parser = argparse.ArgumentParser(formatter_class=argparse.ArgumentDefaultsHelpFormatter,
+	description="Decodes the binary output of STM32T::Log::DeferredLogger.")
+parser.add_argument('-s', metavar='', required=True, nargs='+', help="Source files or directories containing the STM32T_DLOG calls")
+parser.add_argument('-i', metavar='', default='-', help="Input file (the raw log); - for stdin")
+parser.add_argument('-o', metavar='', default='-', help="Output file; - for stdout")
+parser.add_argument('--table', action='store_true', help="Only print the format table")
+
+args = parser.parse_args()
+
+table = build_table(args.s)
+
+output = sys.stdout if args.o == '-' else open(args.o, 'w', encoding="utf-8")
+
+if args.table:
+	for id, fmt in sorted(table.items()):
+		output.write(f"0x{id:08X}: {fmt!r}\n")
+else:
+	data = sys.stdin.buffer.read() if args.i == '-' else open(args.i, 'rb').read()
+	decode(data, table, output)
+
+if output is not sys.stdout:
+	output.close()
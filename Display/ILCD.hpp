@@ -2,10 +2,12 @@
 
 #include "../Core/Utils.hpp"
 #include "../Core/strv.hpp"
+#include "../Core/Format.hpp"
 
 #include <cstdint>
 #include <cstdarg>
-#include <cstdio>		// vsnprintf
+#include <cstdio>		// snprintf
+#include <ctime>
 
 
 
@@ -69,10 +71,10 @@ namespace STM32T
 			
 			va_list args;
 			va_start(args, fmt);
-			const int len = vsnprintf(buf, sizeof(buf), fmt, args);
+			const int len = Format::vformat(buf, sizeof(buf), fmt, args);
 			va_end(args);
 			
-			return PutStr(std::min((size_t)len, BUF_SIZE - 1), buf);
+			return len < 0 ? *this : PutStr(std::min((size_t)len, BUF_SIZE - 1), buf);
 		}
 		
 		template <size_t BUF_SIZE = 64>
@@ -97,10 +99,10 @@ namespace STM32T
 			
 			va_list args;
 			va_start(args, fmt);
-			const int len = vsnprintf(buf, sizeof(buf), fmt, args);
+			const int len = Format::vformat(buf, sizeof(buf), fmt, args);
 			va_end(args);
 			
-			return PutStrCtr(field_width, {buf, len});
+			return len < 0 ? *this : PutStrCtr(field_width, {buf, std::min((size_t)len, BUF_SIZE - 1)});
 		}
 		
 		[[deprecated("Use PutStrCtr() instead.")]]
@@ -115,7 +117,7 @@ namespace STM32T
 			static_assert(std::is_integral_v<I>);
 			
 			char buf[BUF_SIZE];
-			const std::to_chars_result result = std::to_chars(buf, buf + BUF_SIZE, i, base);
+			const std::to_chars_result result = Format::to_chars(buf, buf + BUF_SIZE, i, base);
 			
 			if (result.ec != std::errc())
 			{
@@ -137,14 +139,49 @@ namespace STM32T
 			static_assert(std::is_floating_point_v<F>);
 			
 			char buf[BUF_SIZE];
-			const std::to_chars_result result = std::to_chars(buf, buf + BUF_SIZE, f);
 			
-			if (result.ec != std::errc())
-				PutChar('?');
+			if constexpr (std::is_same_v<F, long double>)
+			{
+				const std::to_chars_result result = std::to_chars(buf, buf + BUF_SIZE, f);
+				
+				if (result.ec != std::errc())
+					return PutChar('?');
+				
+				return PutStr(result.ptr - buf, buf);
+			}
 			else
-				PutStr(result.ptr - buf, buf);
+			{
+				const int len = Format::shortest(buf, BUF_SIZE, f);
+				
+				if (len >= int(BUF_SIZE))
+					return PutChar('?');
+				
+				return PutStr(len, buf);
+			}
+		}
+		
+		/**
+		* @brief Puts a floating-point number with a fixed number of decimals, like printf("%.*f", precision, f).
+		*/
+		template <typename F, size_t BUF_SIZE = 32>
+		ILCD& PutFloat(const F f, const int precision)
+		{
+			static_assert(std::is_floating_point_v<F>);
 			
-			return *this;
+			char buf[BUF_SIZE];
+			
+			Format::Spec spec;
+			spec.precision = precision;
+			spec.conv = 'f';
+			
+			int len = Format::fixed(buf, BUF_SIZE, f, spec);
+			if (len == Format::UNSUPPORTED)
+				len = snprintf(buf, BUF_SIZE, "%.*f", precision, double(f));
+			
+			if (len < 0 || len >= int(BUF_SIZE))
+				return PutChar('?');
+			
+			return PutStr(len, buf);
 		}
 	};
 }
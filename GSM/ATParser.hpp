@@ -0,0 +1,203 @@
+#pragma once
+
+#include "../Core/strv.hpp"
+
+#include <cstdint>
+#include <utility>
+
+
+
+/**
+* @brief The longest line that is kept whole (checked for a final result code or passed to a line handler); the longer ones are split.
+*/
+#ifndef STM32T_GSM_LINE_LEN
+#define STM32T_GSM_LINE_LEN		128
+#endif
+
+
+
+namespace STM32T
+{
+	/**
+	* @brief An incremental parser of AT responses. It's fed the received bytes as they arrive, in chunks of any size (even one by one),
+	*		and reports the lines, the final result code (OK, ERROR, +CME ERROR: <n>...) and the "> " prompt, so a response doesn't have to
+	*		be buffered whole to be parsed. Only the current line is kept: the lines longer than LEN are reported in fragments of LEN
+	*		bytes. The CRs are dropped and the empty lines are skipped.
+	*/
+	template <size_t LEN = STM32T_GSM_LINE_LEN>
+	class ATParser
+	{
+		static_assert(LEN >= 16 && LEN < UINT16_MAX, "LEN must be between 16 and 65534!");
+		
+	public:
+		enum class Event : uint8_t
+		{
+			None,
+			Line,		// A complete line, or the rest of a long one (IsContinued())
+			Fragment,	// LEN bytes of a long line
+			Final,		// A line with a final result code (GetResult())
+			Prompt,		// "> " at the start of a line (it isn't followed by a new line)
+		};
+		
+		enum class Result : uint8_t
+		{
+			None,
+			OK,
+			Error,
+			CME,		// +CME ERROR: Code()
+			CMS,		// +CMS ERROR: Code()
+			NoCarrier,
+			Connect,
+			Busy,
+			NoAnswer,
+			NoDialtone,
+			Prompt,
+		};
+		
+	private:
+		char m_line[LEN + 1];
+		uint16_t m_len = 0, m_code = 0;
+		Result m_result = Result::None;
+		bool m_continued = false;		// Fragments of the current line were reported.
+		bool m_ended = false;			// The current line was reported; it's cleared by the next byte.
+		bool m_fragment = false;		// The current fragment was reported; it's cleared by the next byte.
+		
+		static Result classify(strv line, uint16_t& code)
+		{
+			static constexpr std::pair<strv, Result> FINALS[] = {
+				{ "OK"sv, Result::OK }, { "ERROR"sv, Result::Error }, { "NO CARRIER"sv, Result::NoCarrier }, { "CONNECT"sv, Result::Connect },
+				{ "BUSY"sv, Result::Busy }, { "NO ANSWER"sv, Result::NoAnswer }, { "NO DIALTONE"sv, Result::NoDialtone },
+			};
+			
+			for (const auto& final : FINALS)
+			{
+				if (line == final.first)
+					return final.second;
+			}
+			
+			if (line.starts_with("CONNECT "sv))
+				return Result::Connect;
+			
+			const Result result = line.remove_prefix("+CME ERROR:"sv) ? Result::CME : line.remove_prefix("+CMS ERROR:"sv) ? Result::CMS : Result::None;
+			if (result == Result::None)
+				return result;
+			
+			// The verbose format (+CMEE=2) has a text instead of the code.
+			line.trim();
+			return !line.empty() && line.to_num(code) == line.size() ? result : Result::Error;
+		}
+		
+	public:
+		/**
+		* @brief Forgets the current line and the result, for a new response.
+		*/
+		void Reset()
+		{
+			m_len = m_code = 0;
+			m_result = Result::None;
+			m_continued = m_ended = m_fragment = false;
+		}
+		
+		/**
+		* @brief Feeds the next byte.
+		* @retval What it has completed. Line() is valid until the next byte.
+		*/
+		Event Feed(const char c)
+		{
+			if (m_ended)
+			{
+				m_len = 0;
+				m_continued = m_ended = false;
+			}
+			else if (m_fragment)
+			{
+				m_len = 0;
+				m_continued = true;
+				m_fragment = false;
+			}
+			
+			if (c == '\r')
+				return Event::None;
+			
+			if (c == '\n')
+			{
+				m_line[m_len] = 0;
+				if (!m_len && !m_continued)
+					return Event::None;
+				
+				m_ended = true;
+				if (m_continued)
+					return Event::Line;
+				
+				const Result result = classify(Line(), m_code);
+				if (result == Result::None)
+					return Event::Line;
+				
+				m_result = result;
+				return Event::Final;
+			}
+			
+			m_line[m_len++] = c;
+			
+			if (m_len == 2 && !m_continued && m_line[0] == '>' && m_line[1] == ' ')
+			{
+				m_line[m_len] = 0;
+				m_result = Result::Prompt;
+				return Event::Prompt;
+			}
+			
+			if (m_len == LEN)
+			{
+				m_line[m_len] = 0;
+				m_fragment = true;
+				return Event::Fragment;
+			}
+			
+			return Event::None;
+		}
+		
+		/**
+		* @brief Feeds DATA and calls HANDLER(event, line) for each event, up to the final result code or the prompt.
+		* @retval The number of bytes consumed: the ones after the final result code or the prompt aren't.
+		*/
+		template <class F>
+		size_t Feed(const strv data, F&& handler)
+		{
+			for (size_t i = 0; i < data.size(); i++)
+			{
+				const Event event = Feed(data[i]);
+				if (event == Event::None)
+					continue;
+				
+				handler(event, Line());
+				
+				if (event == Event::Final || event == Event::Prompt)
+					return i + 1;
+			}
+			
+			return data.size();
+		}
+		
+		/**
+		* @retval The current line (or fragment), null-terminated.
+		*/
+		strv Line() const { return strv(m_line, m_len); }
+		
+		/**
+		* @retval true if the current line or fragment continues the fragments reported before it.
+		*/
+		bool IsContinued() const { return m_continued; }
+		
+		/**
+		* @retval true once a final result code or the prompt is received.
+		*/
+		bool Done() const { return m_result != Result::None; }
+		
+		Result GetResult() const { return m_result; }
+		
+		/**
+		* @retval The code of +CME ERROR or +CMS ERROR.
+		*/
+		uint16_t Code() const { return m_code; }
+	};
+}
@@ -0,0 +1,388 @@
+#pragma once
+
+#include "main.h"
+
+#ifdef HAL_UART_MODULE_ENABLED
+
+#include "../Core/Utils.hpp"
+#include "../Core/strv.hpp"
+#include "./ATParser.hpp"
+
+
+
+#ifdef STM32T_IWDG_TIMEOUT
+extern "C" IWDG_HandleTypeDef hiwdg;
+#endif	// STM32T_IWDG_TIMEOUT
+
+/**
+* @brief The size of the circular DMA buffer. It only has to hold the bytes received between two wake-ups of the receiving code.
+*/
+#ifndef STM32T_GSM_RX_SIZE
+#define STM32T_GSM_RX_SIZE		256
+#endif
+
+/**
+* @brief What Receive() does while waiting for the next bytes; any interrupt (the UART, the DMA or SysTick) ends the wait.
+*/
+#ifndef STM32T_GSM_RX_WAIT
+#define STM32T_GSM_RX_WAIT()	__WFI()
+#endif
+
+
+
+namespace STM32T
+{
+	/**
+	* @brief Receives the responses of an AT modem with circular DMA (HAL_UARTEx_ReceiveToIdle_DMA()) instead of polling byte by byte. The
+	*		RX event interrupt (half, complete and idle line) scans the new bytes for the final result code (OK, ERROR, +CME ERROR:...,
+	*		the "> " prompt...), so Receive() sleeps until the response is complete instead of waiting for the line to go idle.
+	*		The lines received outside a command (URCs) are passed to the line handler or discarded.
+	*
+	* @note The RX DMA channel must be in circular mode, with its interrupt enabled. If USE_HAL_UART_REGISTER_CALLBACKS isn't 1, call
+	*		RxEventCallback() from HAL_UARTEx_RxEventCallback().
+	*/
+	class ATReceiver
+	{
+	public:
+		using line_handler_t = void (*)(void *context, strv line);
+		
+		static constexpr size_t SIZE = STM32T_GSM_RX_SIZE, LINE_LEN = STM32T_GSM_LINE_LEN;
+		
+	private:
+		UART_HandleTypeDef *const p_huart;
+		ATReceiver *m_next = nullptr;
+		
+		uint8_t m_buf[SIZE];
+		uint16_t m_pos = 0;		// The position of the DMA in m_buf
+		
+		// Free-running counts of bytes
+		volatile uint32_t m_head = 0;		// Received
+		uint32_t m_tail = 0;				// Read (by Receive() or, outside a command, by the interrupt)
+		uint32_t m_lineStart = 0;
+		volatile uint32_t m_end = 0;		// After the final result code
+		
+		volatile uint32_t m_lastRx = 0;
+		ATParser<LINE_LEN> m_parser;		// Finds the final result code and the lines outside a command
+		volatile bool m_busy = false, m_done = false, m_overflow = false;
+		bool m_detect = true, m_started = false, m_linked = false;
+		
+		line_handler_t p_handler = nullptr;
+		void *p_context = nullptr;
+		
+		static inline ATReceiver *s_first = nullptr;
+		
+		using Event = ATParser<LINE_LEN>::Event;
+		
+		void finish(const uint32_t end)
+		{
+			m_end = end;
+			m_done = true;
+		}
+		
+		/**
+		* @brief Passes the line of an event of PARSER to the line handler. The rest of a long line is dropped.
+		*/
+		void handleEvent(const ATParser<LINE_LEN>& parser, const Event event)
+		{
+			if ((event == Event::Line || event == Event::Final || event == Event::Fragment) && !parser.IsContinued() && p_handler)
+				p_handler(p_context, parser.Line());
+		}
+		
+		/**
+		* @brief Passes the complete lines from m_tail to the line handler.
+		*/
+		void handleLines()
+		{
+			ATParser<LINE_LEN> parser;
+			
+			for (; int32_t(m_lineStart - m_tail) > 0; m_tail++)
+				handleEvent(parser, parser.Feed(char(m_buf[m_tail % SIZE])));
+		}
+		
+		/**
+		* @brief Scans the bytes received up to POS (the position of the DMA in m_buf). Must be called with the interrupts disabled (or
+		*		from the interrupt).
+		*/
+		void advance(const uint16_t pos)
+		{
+			const uint16_t count = (pos + SIZE - m_pos) % SIZE;
+			if (!count)
+				return;
+			
+			for (uint16_t i = 0; i < count; i++)
+			{
+				const char c = char(m_buf[(m_pos + i) % SIZE]);
+				const Event event = m_parser.Feed(c);
+				const uint32_t next = m_head + i + 1;
+				
+				if (!m_busy)
+					handleEvent(m_parser, event);
+				else if (m_detect && !m_done && (event == Event::Final || event == Event::Prompt))
+					finish(next);		// The lines after it are handled by End(). The prompt isn't followed by a new line.
+				
+				if (c == '\n')
+				{
+					m_lineStart = next;
+					if (!m_busy)
+						m_tail = next;
+				}
+			}
+			
+			m_pos = pos % SIZE;
+			m_head += count;
+			m_lastRx = HAL_GetTick();
+			
+			if (m_head - m_tail > SIZE)		// Overwritten by the DMA
+			{
+				m_overflow = m_busy;
+				m_tail = m_head - SIZE;
+			}
+		}
+		
+		/**
+		* @brief Catches up with the DMA without waiting for its next interrupt.
+		*/
+		void poll()
+		{
+			advance(uint16_t(SIZE - __HAL_DMA_GET_COUNTER(p_huart->hdmarx)));
+		}
+		
+		void reset()
+		{
+			m_pos = 0;
+			m_head = m_tail = m_lineStart = m_end = 0;
+			m_parser.Reset();
+		}
+		
+		/**
+		* @brief Copies the bytes up to END to BUFFER.
+		* @retval The number of bytes copied.
+		*/
+		uint16_t copy(char *const buffer, const uint16_t len, const uint32_t end)
+		{
+			uint16_t n = 0;
+			
+			while (n < len && int32_t(end - m_tail) > 0)
+			{
+				const uint16_t offset = m_tail % SIZE;
+				const uint16_t chunk = std::min<uint32_t>({ uint32_t(len - n), end - m_tail, uint32_t(SIZE - offset) });
+				
+				memcpy(buffer + n, m_buf + offset, chunk);
+				n += chunk;
+				m_tail += chunk;
+			}
+			
+			return n;
+		}
+		
+	public:
+		ATReceiver(UART_HandleTypeDef *const huart) : p_huart(huart) {}
+		
+		~ATReceiver()
+		{
+			Stop();
+			
+			for (ATReceiver **p = &s_first; *p; p = &(*p)->m_next)
+			{
+				if (*p == this)
+				{
+					*p = m_next;
+					break;
+				}
+			}
+		}
+		
+		ATReceiver(const ATReceiver&) = delete;
+		ATReceiver& operator=(const ATReceiver&) = delete;
+		
+		/**
+		* @brief Starts the circular DMA reception. Begin() does it if it's not started.
+		*/
+		bool Start()
+		{
+			if (!m_linked)
+			{
+				m_next = s_first;
+				s_first = this;
+				m_linked = true;
+			}
+			
+			#if USE_HAL_UART_REGISTER_CALLBACKS == 1
+			if (HAL_UART_RegisterRxEventCallback(p_huart, RxEventCallback) != HAL_OK)
+				return false;
+			#endif
+			
+			{
+				CriticalSection cs;
+				reset();
+			}
+			
+			__HAL_UART_CLEAR_OREFLAG(p_huart);
+			m_started = HAL_UARTEx_ReceiveToIdle_DMA(p_huart, m_buf, SIZE) == HAL_OK;
+			
+			return m_started;
+		}
+		
+		void Stop()
+		{
+			if (!m_started)
+				return;
+			
+			HAL_UART_AbortReceive(p_huart);
+			m_started = false;
+		}
+		
+		bool IsStarted() const { return m_started; }
+		
+		/**
+		* @brief Sets the handler of the lines received outside a command (URCs). It's called from the interrupt.
+		*/
+		void SetLineHandler(const line_handler_t handler, void *const context)
+		{
+			CriticalSection cs;
+			
+			p_handler = handler;
+			p_context = context;
+		}
+		
+		/**
+		* @brief Prepares for a response. Call it before sending the command, so the response can't be missed.
+		* @param discard: Discards the bytes that haven't been handled yet (false to continue an earlier response).
+		* @param detect: If false, Receive() doesn't stop at the final result code (e.g. for data).
+		*/
+		bool Begin(const bool discard = true, const bool detect = true)
+		{
+			if (!m_started && !Start())
+				return false;
+			
+			CriticalSection cs;
+			
+			poll();
+			if (discard)
+			{
+				m_tail = m_lineStart = m_head;
+				m_parser.Reset();
+			}
+			
+			m_detect = detect;
+			m_done = m_overflow = false;
+			m_busy = true;
+			
+			return true;
+		}
+		
+		/**
+		* @brief Copies the bytes of the response (after Begin()) received so far to BUFFER, without waiting.
+		* @param done: Set to true once the final result code has been copied.
+		* @retval The number of bytes copied or -1 if the DMA overwrote unread bytes or couldn't be restarted.
+		*/
+		int32_t Read(char *const buffer, const uint16_t len, bool& done)
+		{
+			if (p_huart->RxState != HAL_UART_STATE_BUSY_RX)		// Aborted by an error (e.g. an overrun)
+			{
+				if (!Start())
+					return -1;
+				
+				m_overflow = true;
+			}
+			
+			uint32_t end;
+			
+			{
+				CriticalSection cs;
+				
+				poll();
+				done = m_done;
+				end = done ? m_end : m_head;
+			}
+			
+			const uint16_t n = copy(buffer, len, end);
+			
+			if (m_overflow)
+				return -1;
+			
+			done = done && m_tail == end;
+			
+			return n;
+		}
+		
+		/**
+		* @brief Receives the response (after Begin()) until its final result code, until the line is idle for IDLE_TIMEOUT after the
+		*		first byte, until BUFFER is full or for TIMEOUT. Sleeps with STM32T_GSM_RX_WAIT() meanwhile. Can be called repeatedly
+		*		until End() (e.g. to read data in chunks).
+		* @retval The number of bytes received (0 if it timed out) or -1 if the DMA overwrote unread bytes or couldn't be restarted.
+		*/
+		int32_t Receive(char *const buffer, const uint16_t len, const uint32_t timeout, const uint32_t idle_timeout)
+		{
+			const uint32_t start = HAL_GetTick();
+			uint16_t n = 0;
+			
+			if (!m_busy && !Begin(false, m_detect))
+				return -1;
+			
+			while (true)
+			{
+				#ifdef STM32T_IWDG_TIMEOUT
+				HAL_IWDG_Refresh(&hiwdg);
+				#endif	// STM32T_IWDG_TIMEOUT
+				
+				bool done;
+				const int32_t read = Read(buffer + n, len - n, done);
+				if (read < 0)
+					return -1;
+				
+				n += read;
+				if (done || n == len)
+					return n;
+				
+				const uint32_t now = HAL_GetTick();
+				if (now - start >= timeout || (n && now - m_lastRx >= idle_timeout))
+					return n;
+				
+				STM32T_GSM_RX_WAIT();
+			}
+		}
+		
+		/**
+		* @brief Ends the response. The lines received after its final result code are passed to the line handler (the rest is discarded).
+		* @param keep: Keeps the bytes after the final result code for Receive(), without looking for another one (e.g. the data after
+		*		CONNECT). End() must be called again later.
+		*/
+		void End(const bool keep = false)
+		{
+			CriticalSection cs;
+			
+			if (keep)
+			{
+				m_detect = false;
+				m_done = false;
+				return;
+			}
+			
+			m_busy = false;
+			
+			if (m_done && m_tail == m_end)
+				handleLines();
+			else if (int32_t(m_lineStart - m_tail) > 0)
+				m_tail = m_lineStart;
+		}
+		
+		/**
+		* @brief Passes an RX event to the ATReceiver of HUART.
+		* @param pos: The position of the DMA in the buffer.
+		*/
+		static void RxEventCallback(UART_HandleTypeDef *const huart, const uint16_t pos)
+		{
+			for (ATReceiver *r = s_first; r; r = r->m_next)
+			{
+				if (r->p_huart == huart)
+				{
+					r->advance(pos);
+					return;
+				}
+			}
+		}
+	};
+}
+
+#endif	// HAL_UART_MODULE_ENABLED
@@ -36,8 +36,55 @@ class GL865 : public STM32T::GSM<130, 55>
 		return true;
 	}
 	
+	static ErrorCode parseSignalQuality(const strv token, int8_t& rssi, int16_t& ber)
+	{
+		uint8_t t1, t2;
+		if (2 != sscanf(token.data(), "%2hhu,%2hhu", &t1, &t2) || (t1 > 31 && t1 != 99) || (t2 > 7 && t2 != 99))
+			return WRONG_FORMAT;
+		
+		if (t1 <= 31)
+			rssi = -113 + t1 * 2;
+		else
+			rssi = 0;
+		
+		if (t2 <= 7)
+		{
+			ber = 1;
+			for (uint8_t i = 0; i < t2; i++)
+				ber *= 2;
+			
+			if (t2 == 0)
+				ber = 0;
+		}
+		else
+			ber = -1;
+		
+		return OK;
+	}
+	
+	static ErrorCode parseNetworkCheck(const strv token)
+	{
+		uint8_t n, stat;
+		if (sscanf(token.data(), "%hhu,%hhu", &n, &stat) == 2)
+			return ErrorCode(stat);
+		
+		return ERR;
+	}
+	
+	static ErrorCode parseSocketStatus(const strv token, uint8_t& conn_id)
+	{
+		uint8_t conn_stat;
+		if (sscanf(token.data(), "%hhu,%hhu", &conn_id, &conn_stat) == 2)
+			return ErrorCode(conn_stat);
+		
+		return WRONG_FORMAT;
+	}
+	
 	int32_t ReceiveUART(char *buffer, uint16_t len, const uint32_t timeout, const uint32_t idle_timeout) override
 	{
+		#ifdef STM32T_GSM_DMA_RX
+		return ReceiveDMA(buffer, len, timeout, idle_timeout);
+		#else
 		const uint32_t start = HAL_GetTick();
 		
 		__HAL_UART_CLEAR_OREFLAG(p_huart);
@@ -81,6 +128,7 @@ class GL865 : public STM32T::GSM<130, 55>
 		}
 		
 		return orig_len;
+		#endif	// STM32T_GSM_DMA_RX
 	}
 	
 	ErrorCode Setup(const uint32_t timeout_ms = 1000)
@@ -112,15 +160,23 @@ public:
 	
 	int32_t NetworkCheck()
 	{
-		return ResponseToken(DEFAUL_RECEIVE_TIMEOUT, CommandType::Read, "+CGREG", strv(), [&](strv token) -> ErrorCode
+		return ResponseToken(DEFAUL_RECEIVE_TIMEOUT, CommandType::Read, "+CGREG", strv(), parseNetworkCheck);
+	}
+	
+	#ifdef STM32T_GSM_DMA_RX
+	/**
+	* @brief Queues NetworkCheck() to be sent asynchronously; HANDLER is called with its result from ProcessAsync().
+	*/
+	bool NetworkCheckAsync(void (*const handler)(void *context, int32_t stat), void *const context = nullptr)
+	{
+		return CommandAsync(DEFAUL_RECEIVE_TIMEOUT, CommandType::Read, "+CGREG"sv, {}, [handler, context](const ErrorCode code, std::vector<strv>& lines)
 		{
-			uint8_t n, stat;
-			if (sscanf(token.data(), "%hhu,%hhu", &n, &stat) == 2)
-				return ErrorCode(stat);
-			
-			return ERR;
+			strv value;
+			const ErrorCode code2 = asyncValue(code, lines, "+CGREG"sv, value);
+			handler(context, code2 == OK ? parseNetworkCheck(value) : code2);
 		});
 	}
+	#endif	// STM32T_GSM_DMA_RX
 	
 	ErrorCode ClockRead(DateTime& dt)
 	{
@@ -258,32 +314,32 @@ public:
 	ErrorCode SignalQuality(int8_t& rssi, int16_t& ber)
 	{
 		// \r\n+CSQ: 99,99\r\n + \r\nOK\r\n
-		return ResponseToken(DEFAUL_RECEIVE_TIMEOUT, CommandType::Execute, "+CSQ"sv, {}, [&rssi, &ber](strv token) -> ErrorCode
+		return ResponseToken(DEFAUL_RECEIVE_TIMEOUT, CommandType::Execute, "+CSQ"sv, {}, [&rssi, &ber](strv token)
 		{
-			uint8_t t1, t2;
-			if (2 != sscanf(token.data(), "%2hhu,%2hhu", &t1, &t2) || (t1 > 31 && t1 != 99) || (t2 > 7 && t2 != 99))
-				return WRONG_FORMAT;
-			
-			if (t1 <= 31)
-				rssi = -113 + t1 * 2;
-			else
-				rssi = 0;
+			return parseSignalQuality(token, rssi, ber);
+		});
+	}
+	
+	#ifdef STM32T_GSM_DMA_RX
+	/**
+	* @brief Queues SignalQuality() to be sent asynchronously; HANDLER is called with its result from ProcessAsync().
+	*/
+	bool SignalQualityAsync(void (*const handler)(void *context, ErrorCode code, int8_t rssi, int16_t ber), void *const context = nullptr)
+	{
+		return CommandAsync(DEFAUL_RECEIVE_TIMEOUT, CommandType::Execute, "+CSQ"sv, {}, [handler, context](ErrorCode code, std::vector<strv>& lines)
+		{
+			strv value;
+			int8_t rssi = 0;
+			int16_t ber = -1;
 			
-			if (t2 <= 7)
-			{
-				ber = 1;
-				for (uint8_t i = 0; i < t2; i++)
-					ber *= 2;
-				
-				if (t2 == 0)
-					ber = 0;
-			}
-			else
-				ber = -1;
+			code = asyncValue(code, lines, "+CSQ"sv, value);
+			if (code == OK)
+				code = parseSignalQuality(value, rssi, ber);
 			
-			return OK;
+			handler(context, code, rssi, ber);
 		});
 	}
+	#endif	// STM32T_GSM_DMA_RX
 	
 	ErrorCode ContextActivate(const uint8_t cid, const bool enable = true, const uint32_t timeout_ms = 150'000)
 	{
@@ -358,16 +414,41 @@ public:
 			return INVALID;
 		
 		// \r\n#SS: 0,0,xxx.xxx.xxx.xxx,ppppp,yyy.yyy.yyy.yyy,ppppp\r\n + \r\nOK\r\n (62)
-		return ResponseToken(DEFAUL_RECEIVE_TIMEOUT, CommandType::Write, "#SS"sv, [conn_id](strv token) -> ErrorCode
+		return ResponseToken(DEFAUL_RECEIVE_TIMEOUT, CommandType::Write, "#SS"sv, [conn_id](strv token)
 		{
-			uint8_t conn_id_r, conn_stat;
-			if (sscanf(token.data(), "%hhu,%hhu", &conn_id_r, &conn_stat) == 2 && conn_id_r == conn_id)
-				return ErrorCode(conn_stat);
+			uint8_t conn_id_r;
+			const ErrorCode stat = parseSocketStatus(token, conn_id_r);
 			
-			return WRONG_FORMAT;
+			return stat >= OK && conn_id_r != conn_id ? WRONG_FORMAT : stat;
 		}, true, "%hhu", conn_id);
 	}
 	
+	#ifdef STM32T_GSM_DMA_RX
+	/**
+	* @brief Queues SocketStatus() to be sent asynchronously; HANDLER is called with its result from ProcessAsync().
+	*/
+	bool SocketStatusAsync(const uint8_t conn_id, void (*const handler)(void *context, uint8_t conn_id, int32_t stat), void *const context = nullptr)
+	{
+		if (conn_id < 1 || conn_id > 6)
+			return false;
+		
+		const char args[] = { char('0' + conn_id) };
+		
+		// The connection is taken from the response, so the handler fits in the queue.
+		return CommandAsync(DEFAUL_RECEIVE_TIMEOUT, CommandType::Write, "#SS"sv, strv(args, 1), [handler, context](const ErrorCode code, std::vector<strv>& lines)
+		{
+			strv value;
+			uint8_t conn_id_r = 0;
+			ErrorCode stat = asyncValue(code, lines, "#SS"sv, value);
+			
+			if (stat == OK)
+				stat = parseSocketStatus(value, conn_id_r);
+			
+			handler(context, conn_id_r, stat);
+		});
+	}
+	#endif	// STM32T_GSM_DMA_RX
+	
 	ErrorCode SocketSend(const uint8_t conn_id, STM32T::span<const strv> data)
 	{
 		size_t total_len = 0;
@@ -406,29 +487,65 @@ public:
 		if (conn_id < MIN_CONN_ID || conn_id > MAX_CONN_ID || len > 1500)
 			return INVALID;
 		
-		// #SRECV: x,yyyy\r\n + \r\ndata\r\n + \r\nOK\r\n
-		return ResponseToken<DEFAULT_ARG_LEN, 16 + 4 + 1500 * 2 + 6>(3, timeout_ms, CommandType::Write, "#SRECV"sv, 2,
-		[this, conn_id, len, data](std::vector<strv>& tokens) -> ErrorCode
+		char args[12];
+		const int args_len = snprintf(args, sizeof(args), "%hhu,%hu", conn_id, len);
+		
+		uint16_t recv_len = 0, received = 0;
+		uint8_t high = 0;
+		bool header = false, done = false, odd = false;
+		
+		// #SRECV: x,yyyy\r\n + \r\ndata\r\n + \r\nOK\r\n; the data (in hex) is decoded as it's received.
+		#ifdef STM32T_GSM_DMA_RX
+		constexpr size_t CHUNK_LEN = DEFAULT_RESPONSE_LEN;
+		#else
+		constexpr size_t CHUNK_LEN = 16 + 4 + 1500 * 2 + 6;		// Polling can't stream it: it's received whole.
+		#endif	// STM32T_GSM_DMA_RX
+		
+		const ErrorCode code = Lines<CHUNK_LEN>(timeout_ms, CommandType::Write, "#SRECV"sv, strv(args, args_len), [&](strv line, const bool complete) -> ErrorCode
 		{
-			uint8_t recv_conn_id;
-			uint16_t recv_len;
+			if (!header)
+			{
+				uint8_t recv_conn_id;
+				
+				if (!complete || !responseValue(line, "#SRECV"sv) || 2 != sscanf(line.data(), "%1hhu,%4hu", &recv_conn_id, &recv_len)
+					|| recv_len > len || recv_conn_id != conn_id)
+					return WRONG_FORMAT;
+				
+				header = true;
+				return OK;
+			}
 			
-			if (2 != sscanf(tokens[0].data(), "%1hhu,%4hu", &recv_conn_id, &recv_len)
-				|| recv_len > len || tokens[1].size() != recv_len * 2 || recv_conn_id != conn_id)
+			if (done)
 				return WRONG_FORMAT;
 			
-			for (uint16_t i = 0, j = 0; i < recv_len; i++, j += 2)
+			for (const char ch : line)
 			{
-				const auto opt = STM32T::C2H<uint8_t>(tokens[1].data() + j);
-				if (!opt)
+				const uint8_t nibble = STM32T::C2H(ch);
+				if (nibble == 0xFF || received == recv_len)
 					return WRONG_FORMAT;
 				
+				odd = !odd;
+				if (odd)
+				{
+					high = nibble;
+					continue;
+				}
+				
 				if (data)
-					data[i] = *opt;
+					data[received] = char(high << 4 | nibble);
+				
+				received++;
 			}
 			
-			return ErrorCode(recv_len);
-		}, "%hhu,%hu", conn_id, len);
+			done = complete;
+			
+			return !complete || (received == recv_len && !odd) ? OK : WRONG_FORMAT;
+		});
+		
+		if (code != OK)
+			return code;
+		
+		return header && (done || !recv_len) ? int32_t(recv_len) : int32_t(WRONG_FORMAT);
 	}
 	
 	ErrorCode FTPTimeout(uint32_t ftp_to)
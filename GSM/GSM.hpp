@@ -8,6 +8,14 @@
 #include "../Core/strv.hpp"
 #include "../Core/span.hpp"
 #include "../Log.hpp"
+#include "../Trace.hpp"
+#include "./ATParser.hpp"
+#include "./URCRing.hpp"
+
+#ifdef STM32T_GSM_DMA_RX
+#include "./ATReceiver.hpp"
+#include "../Core/inplace_function.hpp"
+#endif	// STM32T_GSM_DMA_RX
 
 #include <memory>	// unique_ptr
 #include <optional>
@@ -18,10 +26,44 @@
 extern "C" IWDG_HandleTypeDef hiwdg;
 #endif	// STM32T_IWDG_TIMEOUT
 
+#ifndef STM32T_GSM_LOG_LEVEL
+#define STM32T_GSM_LOG_LEVEL	STM32T::Log::Level::Debug
+#endif
+
+/**
+* @brief The asynchronous commands (STM32T_GSM_DMA_RX) that can be queued, the longest of them (with "AT" and the arguments), the longest
+*		response and the bytes a handler can capture.
+*/
+#ifndef STM32T_GSM_ASYNC_QUEUE
+#define STM32T_GSM_ASYNC_QUEUE			8
+#endif
+
+#ifndef STM32T_GSM_ASYNC_CMD_LEN
+#define STM32T_GSM_ASYNC_CMD_LEN		48
+#endif
+
+#ifndef STM32T_GSM_ASYNC_RESPONSE_LEN
+#define STM32T_GSM_ASYNC_RESPONSE_LEN	128
+#endif
+
+#ifndef STM32T_GSM_ASYNC_CAPACITY
+#define STM32T_GSM_ASYNC_CAPACITY		16
+#endif
+
 
 
 namespace STM32T
 {
+	/**
+	* @brief The runtime log level of the GSM drivers (module "GSM"). Debug calls are compiled in and filtered with this level.
+	*/
+	inline Log::ModuleLevel g_gsmLogLevel("GSM"sv, STM32T_GSM_LOG_LEVEL);
+	
+	/**
+	* @brief Limits the messages that can flood the log during modem outages (5 at once, then 1 every 10 s per message).
+	*/
+	inline Log::RateLimiter g_gsmLogLimiter(5, 10'000);
+
 #define CM_CODE(name, code)		name = -(code)
 
 #define CM_CODE_10(name, code)		CM_CODE(name##0, (code) * 10 + 0), CM_CODE(name##1, (code) * 10 + 1), \
@@ -87,10 +129,19 @@ CM_CODE_10(name##6, (code) * 10 + 6), CM_CODE_10(name##7, (code) * 10 + 7), CM_C
 			CM_CODE(CMS_500, 2500), CM_CODE(CMS_512, 2512),
 		};
 		
+		#ifdef STM32T_GSM_DMA_RX
+		/**
+		* @brief The handler of an asynchronous command: the result and the information lines of the response.
+		*/
+		using async_handler_t = inplace_function<void (ErrorCode code, vec<strv>& lines), STM32T_GSM_ASYNC_CAPACITY>;
+		#endif	// STM32T_GSM_DMA_RX
+		
 	protected:
-		static constexpr STM32T::Log::Logger LG = STM32T::Log::g_defaultLogger.Clone(STM32T::Log::Level::Debug, "GSM"sv);
+		static constexpr STM32T::Log::Logger LG = STM32T::Log::g_defaultLogger.Clone(g_gsmLogLevel, STM32T::Log::Level::Debug, "GSM"sv);
+		static constexpr STM32T::Log::Logger LG_LIMITED = LG.Limited(g_gsmLogLimiter);
 		
 		static constexpr strv ESC = "\x1B"sv, CTRL_Z = "\x1A"sv, CMD_MODE = "+++"sv;
+		static constexpr strv NO_CARRIER = "\r\nNO CARRIER\r\n"sv;		// The end of the data in online mode
 		
 		enum class CommandType : uint8_t
 		{
@@ -103,7 +154,292 @@ CM_CODE_10(name##6, (code) * 10 + 6), CM_CODE_10(name##7, (code) * 10 + 7), CM_C
 		
 		uint32_t m_lastSend = 0;
 		UART_HandleTypeDef* const p_huart;
-		bool m_urcEnabled = false, m_noSendWait = false, m_noSendDelay = false;
+		bool m_urcEnabled = false, m_noSendWait = false, m_noSendDelay = false, m_tokensBusy = false;
+		vec<strv> m_tokens;		// Keeps its capacity, so the commands don't allocate once it has grown.
+		
+		/**
+		* @retval true if LINE, received in the response of a command with the information lines starting with PREFIX, is a URC.
+		*/
+		static bool isURC(const strv line, const strv prefix)
+		{
+			if (line == "RING"sv)
+				return true;
+			
+			if (prefix.empty() || !(line.starts_with('+') || line.starts_with('#')))
+				return false;
+			
+			return !line.starts_with(prefix) || line.size() == prefix.size() || line[prefix.size()] != ':';
+		}
+		
+		/**
+		* @retval The prefix of the information lines of the response of CMD (e.g. +CSQ), or nothing if it's not known.
+		*/
+		static strv linePrefix(const CommandType type, const strv cmd)
+		{
+			return type != CommandType::Bare && (cmd.starts_with('+') || cmd.starts_with('#')) ? cmd : strv();
+		}
+		
+		static ErrorCode resultCode(const ATParser<>& parser)
+		{
+			using Result = ATParser<>::Result;
+			
+			switch (parser.GetResult())
+			{
+			case Result::OK:
+				return OK;
+			
+			case Result::CME:
+				return ErrorCode(-1000 - parser.Code());
+			
+			case Result::CMS:
+				return ErrorCode(-2000 - parser.Code());
+			
+			case Result::Error:
+				return ERR;
+			
+			default:
+				return UNKNOWN;
+			}
+		}
+		
+		#ifdef STM32T_GSM_DMA_RX
+		ATReceiver m_rx{p_huart};
+		bool m_rxKeep = false;		// Keep the bytes after the next final result code (CONNECT) for ReceiveOnline().
+		bool m_rxStream = false;	// Lines() receives the response in chunks.
+		
+		/**
+		* @brief A ReceiveUART() that sleeps until the final result code with ATReceiver.
+		*/
+		int32_t ReceiveDMA(char *buffer, uint16_t len, const uint32_t timeout, const uint32_t idle_timeout)
+		{
+			const int32_t received = m_rx.Receive(buffer, len, timeout, idle_timeout);
+			if (!m_rxStream)
+			{
+				m_rx.End(m_rxKeep);
+				m_rxKeep = false;
+			}
+			
+			if (received < 0)
+				return FAIL;
+			
+			return received ? received : TIMEOUT;
+		}
+		
+		struct AsyncCommand
+		{
+			async_handler_t handler;
+			uint32_t timeout;
+			uint8_t len, prefix;		// The length of the text and of the prefix of the information lines (e.g. +CSQ) after "AT"
+			char text[STM32T_GSM_ASYNC_CMD_LEN];
+		};
+		
+		static_assert(STM32T_GSM_ASYNC_CMD_LEN <= UINT8_MAX, "STM32T_GSM_ASYNC_CMD_LEN must fit in uint8_t!");
+		
+		AsyncCommand m_async[STM32T_GSM_ASYNC_QUEUE];
+		uint8_t m_asyncFirst = 0, m_asyncCount = 0;
+		bool m_asyncSent = false, m_asyncFull = false, m_asyncRunning = false;
+		uint16_t m_asyncLen = 0;
+		uint32_t m_asyncStart = 0;
+		char m_asyncBuf[STM32T_GSM_ASYNC_RESPONSE_LEN];
+		
+		/**
+		* @brief Removes the first asynchronous command from the queue and calls its handler with CODE and the information lines of the
+		*		response. The URCs among them are stored.
+		*/
+		void completeAsync(ErrorCode code)
+		{
+			AsyncCommand& c = m_async[m_asyncFirst];
+			const async_handler_t handler = std::move(c.handler);
+			
+			m_asyncBuf[m_asyncLen] = 0;		// Make it safe for C str functions
+			
+			withTokens(strv(m_asyncBuf, m_asyncLen), false, [&](vec<strv>& tokens)
+			{
+				if (code == OK && (tokens.empty() || tokens.back() != "OK"sv))
+					code = Error(tokens);
+				
+				if (code == OK)
+				{
+					const strv prefix(c.text + 2, c.prefix);
+					size_t n = 0;
+					
+					tokens.pop_back();
+					for (const strv line : tokens)
+					{
+						if (isURC(line, prefix))
+							addURC(line);
+						else
+							tokens[n++] = line;
+					}
+					
+					tokens.resize(n);
+				}
+				else
+					tokens.clear();
+				
+				m_asyncFirst = (m_asyncFirst + 1) % STM32T_GSM_ASYNC_QUEUE;
+				m_asyncCount--;
+				m_asyncSent = false;
+				
+				if (handler)
+					handler(code, tokens);
+				
+				return OK;
+			});
+		}
+		
+		/**
+		* @brief Sends the first queued asynchronous command or checks its response, without waiting.
+		* @retval true if it has been completed.
+		*/
+		bool stepAsync()
+		{
+			if (!m_asyncCount || m_asyncRunning)
+				return false;
+			
+			m_asyncRunning = true;
+			ScopeActionF running([this]() { m_asyncRunning = false; });
+			
+			AsyncCommand& c = m_async[m_asyncFirst];
+			
+			if (!m_asyncSent)
+			{
+				m_asyncLen = 0;
+				m_asyncFull = false;
+				
+				if (!m_rx.Begin())
+				{
+					completeAsync(FAIL);
+					return true;
+				}
+				
+				SendUART(strv(c.text, c.len));
+				m_asyncSent = true;
+				m_asyncStart = HAL_GetTick();
+			}
+			
+			bool done = false;
+			int32_t read;
+			
+			do		// Once m_asyncBuf is full, the rest of the response is discarded.
+			{
+				char discard[16];
+				const bool full = m_asyncLen == sizeof(m_asyncBuf) - 1;
+				
+				read = full ? m_rx.Read(discard, sizeof(discard), done) : m_rx.Read(m_asyncBuf + m_asyncLen, sizeof(m_asyncBuf) - 1 - m_asyncLen, done);
+				if (read > 0 && full)
+					m_asyncFull = true;
+				else if (read > 0)
+					m_asyncLen += read;
+			} while (read > 0 && !done);
+			
+			ErrorCode code;
+			if (read < 0)
+				code = FAIL;
+			else if (done)
+				code = m_asyncFull ? BUF_FULL : OK;
+			else if (HAL_GetTick() - m_asyncStart >= c.timeout)
+				code = TIMEOUT;
+			else
+				return false;
+			
+			m_rx.End();
+			completeAsync(code);
+			
+			return true;
+		}
+		
+		/**
+		* @brief Waits for the asynchronous command in flight, so a synchronous one can be sent.
+		*/
+		void waitAsync()
+		{
+			while (m_asyncSent && !stepAsync())
+			{
+				#ifdef STM32T_IWDG_TIMEOUT
+				HAL_IWDG_Refresh(&hiwdg);
+				#endif	// STM32T_IWDG_TIMEOUT
+				
+				STM32T_GSM_RX_WAIT();
+			}
+		}
+		
+		/**
+		* @brief Queues a command to be sent by ProcessAsync() after the ones before it. HANDLER is called from ProcessAsync() with OK
+		*		and the information lines of the response (the URCs received among them are stored as usual) or with the error: the one in
+		*		the response, TIMEOUT after TIMEOUT ms from sending the command, BUF_FULL if the response is longer than
+		*		STM32T_GSM_ASYNC_RESPONSE_LEN or FAIL.
+		* @note The response must end with a final result code (OK, ERROR...), so it's not for the commands that wait for the "> " prompt
+		*		or go online.
+		* @retval false if the queue is full or the command is longer than STM32T_GSM_ASYNC_CMD_LEN (HANDLER isn't called).
+		*/
+		bool CommandAsync(const uint32_t timeout, const CommandType type, const strv cmd, const strv args, async_handler_t handler)
+		{
+			if (m_asyncCount == STM32T_GSM_ASYNC_QUEUE)
+				return false;
+			
+			AsyncCommand& c = m_async[(m_asyncFirst + m_asyncCount) % STM32T_GSM_ASYNC_QUEUE];
+			size_t len = 0;
+			bool fits = true;
+			
+			commandParts(type, cmd, args, [&](const strv part)
+			{
+				fits &= part.size() <= sizeof(c.text) - len;
+				if (!fits)
+					return;
+				
+				memcpy(c.text + len, part.data(), part.size());
+				len += part.size();
+			});
+			
+			if (!fits)
+				return false;
+			
+			c.len = uint8_t(len);
+			c.prefix = uint8_t(linePrefix(type, cmd).size());
+			c.timeout = timeout;
+			c.handler = std::move(handler);
+			m_asyncCount++;
+			
+			return true;
+		}
+		
+		/**
+		* @brief For the handlers of the asynchronous commands: the VALUE of the single information line (CMD: VALUE) of a response.
+		*/
+		static ErrorCode asyncValue(const ErrorCode code, vec<strv>& lines, const strv cmd, strv& value)
+		{
+			if (code != OK)
+				return code;
+			
+			if (lines.size() != 1 || !responseValue(lines[0], cmd))
+				return WRONG_FORMAT;
+			
+			value = lines[0];
+			
+			return OK;
+		}
+		#endif	// STM32T_GSM_DMA_RX
+		
+		/**
+		* @brief Splits RESPONSE into lines (in m_tokens) and calls OP with them. A command nested in OP uses a local vector.
+		*/
+		template <class F>
+		ErrorCode withTokens(const strv response, const bool allowSingleEnded, F&& op)
+		{
+			vec<strv> local;
+			vec<strv>& tokens = m_tokensBusy ? local : m_tokens;
+			const bool busy = m_tokensBusy;
+			
+			m_tokensBusy = true;
+			tokens.clear();
+			response.tokenize2("\r\n"sv, tokens, !allowSingleEnded);
+			
+			const ErrorCode code = op(tokens);
+			m_tokensBusy = busy;
+			
+			return code;
+		}
 		
 		void addURCs(const vec<strv>& tokens, size_t len = SIZE_MAX)
 		{
@@ -113,9 +449,11 @@ CM_CODE_10(name##6, (code) * 10 + 6), CM_CODE_10(name##7, (code) * 10 + 7), CM_C
 		
 		void addURCFromBuf(const strv buf)
 		{
-			vec<strv> tokens;
-			buf.tokenize2("\r\n"sv, tokens, true);
-			addURCs(tokens);
+			withTokens(buf, false, [this](vec<strv>& tokens)
+			{
+				addURCs(tokens);
+				return OK;
+			});
 		}
 		
 		void SendUART(strv data)
@@ -130,30 +468,57 @@ CM_CODE_10(name##6, (code) * 10 + 6), CM_CODE_10(name##7, (code) * 10 + 7), CM_C
 		
 		virtual int32_t ReceiveUART(char *buffer, uint16_t len, const uint32_t timeout, const uint32_t idle_timeout) = 0;
 		
-		int32_t Command(const uint32_t timeout, const CommandType type, const strv cmd, const strv args, char* buffer, const uint16_t len)
+		/**
+		* @brief Calls SEND with each part of the command line.
+		*/
+		template <class F>
+		static void commandParts(const CommandType type, const strv cmd, const strv args, F&& send)
 		{
 			if (type != CommandType::Bare)
 			{
-				SendUART("AT"sv);
-				SendUART(cmd);
+				send("AT"sv);
+				send(cmd);
 			}
 			
 			if ((type == CommandType::Write && !args.empty()) || type == CommandType::Test)
-				SendUART("="sv);
+				send("="sv);
 			
 			if (type == CommandType::Write || type == CommandType::Execute || type == CommandType::Bare)
-				SendUART(args);
+				send(args);
 			else
-				SendUART("?"sv);
+				send("?"sv);
 			
 			if (type != CommandType::Bare)
-				SendUART("\r"sv);
+				send("\r"sv);
+		}
+		
+		/**
+		* @brief Removes the prefix CMD: of a response line.
+		*/
+		static bool responseValue(strv& line, const strv cmd)
+		{
+			return line.remove_prefix(cmd) && (line.remove_prefix(": "sv) || line.remove_prefix(":"sv));
+		}
+		
+		int32_t Command(const uint32_t timeout, const CommandType type, const strv cmd, const strv args, char* buffer, const uint16_t len)
+		{
+			STM32T_TRACE_SCOPE_ARG("GSM::Command", Trace::Arg::Text(type == CommandType::Bare ? args : cmd));
+			
+			#ifdef STM32T_GSM_DMA_RX
+			waitAsync();
+			
+			if (buffer && len && !m_rx.Begin(type != CommandType::Bare || !args.empty()))		// Sending nothing waits for more of a response.
+				return FAIL;
+			#endif	// STM32T_GSM_DMA_RX
+			
+			// The URC reception is stopped before the command is sent, so the response isn't received as URCs.
+			if (buffer && len && m_urcEnabled)
+				stopURC();
+			
+			commandParts(type, cmd, args, [this](const strv part) { SendUART(part); });
 			
 			if (buffer && len)
 			{
-				if (m_urcEnabled)
-					stopURC();
-				
 				const int32_t len2 = ReceiveUART(buffer, len - 1, timeout, DEFAULT_IDLE_TIMEOUT);
 				
 				if (m_urcEnabled)
@@ -170,6 +535,90 @@ CM_CODE_10(name##6, (code) * 10 + 6), CM_CODE_10(name##7, (code) * 10 + 7), CM_C
 			return 0;
 		}
 		
+		/**
+		* @brief Sends the command and parses its response as it's received, instead of buffering it whole. HANDLER is called with each
+		*		information line (the URCs among them are stored as usual); a line longer than STM32T_GSM_LINE_LEN is passed in fragments,
+		*		with COMPLETE false for all but the last one. Only CHUNK_LEN + STM32T_GSM_LINE_LEN bytes are used, whatever the size of the
+		*		response.
+		* @note Without STM32T_GSM_DMA_RX, the bytes that arrive while a chunk is parsed are lost (the UART is polled byte by byte), so
+		*		only a response that is sent without pauses longer than the idle timeout can be streamed. Otherwise, CHUNK_LEN must fit
+		*		the whole response.
+		* @retval The first error returned by HANDLER (the rest of the response is still received), the result of the final result code,
+		*		TIMEOUT or FAIL.
+		*/
+		template <size_t CHUNK_LEN = DEFAULT_RESPONSE_LEN>
+		ErrorCode Lines(const uint32_t timeout, const CommandType type, const strv cmd, const strv args,
+			const function_ref<ErrorCode (strv line, bool complete)> handler)
+		{
+			using Event = ATParser<>::Event;
+			
+			if (!handler)
+				return INVALID_PARAM;
+			
+			STM32T_TRACE_SCOPE_ARG("GSM::Lines", Trace::Arg::Text(type == CommandType::Bare ? args : cmd));
+			
+			#ifdef STM32T_GSM_DMA_RX
+			waitAsync();
+			
+			if (!m_rx.Begin())
+				return FAIL;
+			
+			m_rxStream = true;
+			#endif	// STM32T_GSM_DMA_RX
+			
+			if (m_urcEnabled)
+				stopURC();
+			
+			ScopeActionF end([this]()
+			{
+				#ifdef STM32T_GSM_DMA_RX
+				m_rxStream = false;
+				m_rx.End();
+				#endif	// STM32T_GSM_DMA_RX
+				
+				if (m_urcEnabled)
+					startURC();
+			});
+			
+			commandParts(type, cmd, args, [this](const strv part) { SendUART(part); });
+			
+			ATParser<> parser;
+			const strv prefix = linePrefix(type, cmd);
+			const uint32_t start = HAL_GetTick();
+			ErrorCode code = OK;
+			char chunk[CHUNK_LEN];
+			
+			while (!parser.Done())
+			{
+				const uint32_t elapsed = HAL_GetTick() - start;
+				if (elapsed >= timeout)
+					return TIMEOUT;
+				
+				const int32_t len = ReceiveUART(chunk, CHUNK_LEN, timeout - elapsed, DEFAULT_IDLE_TIMEOUT);
+				if (len == TIMEOUT)
+					continue;
+				
+				if (len < OK)
+					return ErrorCode(len);
+				
+				const strv data(chunk, len);
+				const size_t used = parser.Feed(data, [&](const Event event, const strv line)
+				{
+					if (event != Event::Line && event != Event::Fragment)
+						return;
+					
+					if (event == Event::Line && !parser.IsContinued() && isURC(line, prefix))
+						addURC(line);
+					else if (code == OK)
+						code = handler(line, event == Event::Line);
+				});
+				
+				addURCFromBuf(data.substr(used));		// The lines after the response, if they were received in the same chunk
+			}
+			
+			return code != OK ? code : resultCode(parser);
+		}
+		
 		ErrorCode Standard(vec<strv>& tokens)
 		{
 			ErrorCode ret = UNKNOWN;
@@ -247,7 +696,7 @@ CM_CODE_10(name##6, (code) * 10 + 6), CM_CODE_10(name##7, (code) * 10 + 7), CM_C
 		}
 		
 		template <size_t LEN = DEFAULT_RESPONSE_LEN>
-		ErrorCode NoToken(const uint32_t timeout, const CommandType type, const strv cmd, const func<ErrorCode (strv)>& handler, const strv args = strv())
+		ErrorCode NoToken(const uint32_t timeout, const CommandType type, const strv cmd, const function_ref<ErrorCode (strv)> handler, const strv args = strv())
 		{
 			if (!handler)
 				return INVALID_PARAM;
@@ -261,7 +710,7 @@ CM_CODE_10(name##6, (code) * 10 + 6), CM_CODE_10(name##7, (code) * 10 + 7), CM_C
 		}
 		
 		template <size_t ARG_LEN = DEFAULT_ARG_LEN, size_t LEN = DEFAULT_RESPONSE_LEN>
-		ErrorCode NoToken(const uint32_t timeout, const CommandType type, const strv cmd, const func<ErrorCode (strv)>& handler, const char *const fmt, ...)
+		ErrorCode NoToken(const uint32_t timeout, const CommandType type, const strv cmd, const function_ref<ErrorCode (strv)> handler, const char *const fmt, ...)
 		{
 			_FORMAT_ARGS();
 			return NoToken<LEN>(timeout, type, cmd, handler, strv(args, argsLen));
@@ -292,11 +741,19 @@ CM_CODE_10(name##6, (code) * 10 + 6), CM_CODE_10(name##7, (code) * 10 + 7), CM_C
 		
 		template <size_t CHUNK_LEN = 600, size_t LEN = DEFAULT_RESPONSE_LEN>
 		int32_t ReceiveOnline(const uint32_t timeout, const uint32_t dl_to, const CommandType type, const strv cmd,
-			const func<ErrorCode (strv, size_t)>& chunk_handler = nullptr, const strv args = strv())
+			const function_ref<ErrorCode (strv, size_t)> chunk_handler = nullptr, const strv args = strv())
 		{
+			#ifdef STM32T_GSM_DMA_RX
+			std::unique_ptr<char[]> buf[1] = {std::make_unique<char[]>(CHUNK_LEN)};		// The data is received into the ring of m_rx.
+			if (!buf[0])
+				return FAIL;
+			
+			m_rxKeep = true;		// The data can follow CONNECT immediately.
+			#else
 			std::unique_ptr<char[]> buf[2] = {std::make_unique<char[]>(CHUNK_LEN), std::make_unique<char[]>(CHUNK_LEN)};
 			if (!buf[0] || !buf[1])
 				return FAIL;
+			#endif	// STM32T_GSM_DMA_RX
 			
 			ErrorCode code = EnterOnline<LEN>(timeout, type, cmd, args);
 			
@@ -307,7 +764,11 @@ CM_CODE_10(name##6, (code) * 10 + 6), CM_CODE_10(name##7, (code) * 10 + 7), CM_C
 			
 			ScopeActionF exit([this, urcEnabled]()
 			{
+				#ifdef STM32T_GSM_DMA_RX
+				m_rx.End();
+				#else
 				HAL_UART_AbortReceive_IT(p_huart);
+				#endif	// STM32T_GSM_DMA_RX
 				ExitOnline();
 				
 				if (urcEnabled)
@@ -320,9 +781,58 @@ CM_CODE_10(name##6, (code) * 10 + 6), CM_CODE_10(name##7, (code) * 10 + 7), CM_C
 			const uint32_t start = HAL_GetTick();
 			uint32_t rem = dl_to;
 			size_t len = 0;
-			ClampedInt<uint8_t, 0, std::size(buf) - 1> index = 0;
 			
 			HAL_UART_StateTypeDef state = HAL_UART_STATE_READY;
+			
+			#ifdef STM32T_GSM_DMA_RX
+			HAL_StatusTypeDef stat = HAL_OK;
+			size_t kept = 0;		// The end of the last chunk, which could be the start of NO CARRIER
+			
+			while (code == OK && rem)
+			{
+				const int32_t received = m_rx.Receive(buf[0].get() + kept, CHUNK_LEN - kept, rem, DEFAULT_IDLE_TIMEOUT);
+				rem = Time::Remaining_Tick(start, dl_to);
+				
+				if (received < 0)
+				{
+					stat = HAL_ERROR;
+					break;
+				}
+				
+				// NO CARRIER can be received with the end of the data, or split between two chunks.
+				strv chunk = {buf[0].get(), kept + size_t(received)};
+				const bool end = chunk.remove_suffix(NO_CARRIER);
+				
+				kept = 0;
+				if (!end)
+				{
+					for (size_t n = std::min(chunk.size(), NO_CARRIER.size() - 1); n && !kept; n--)
+						if (chunk.ends_with(NO_CARRIER.substr(0, n)))
+							kept = n;
+					
+					chunk.remove_suffix(kept);
+				}
+				
+				if (chunk_handler && !chunk.empty())
+					code = chunk_handler(chunk, len);
+				
+				len += chunk.size();
+				
+				if (end)
+					return len;
+				
+				memmove(buf[0].get(), chunk.data() + chunk.size(), kept);
+			}
+			
+			if (kept && code == OK)		// It wasn't NO CARRIER.
+			{
+				if (chunk_handler)
+					code = chunk_handler(strv(buf[0].get(), kept), len);
+				
+				len += kept;
+			}
+			#else
+			ClampedInt<uint8_t, 0, std::size(buf) - 1> index = 0;
 			HAL_StatusTypeDef stat = HAL_UARTEx_ReceiveToIdle_IT(p_huart, reinterpret_cast<uint8_t *>(buf[index].get()), CHUNK_LEN);
 			
 			while (stat == HAL_OK && code == OK && state == HAL_UART_STATE_READY && rem)
@@ -339,8 +849,13 @@ CM_CODE_10(name##6, (code) * 10 + 6), CM_CODE_10(name##7, (code) * 10 + 7), CM_C
 				while (state == HAL_UART_STATE_BUSY_RX && rem);
 				
 				strv chunk = {buf[index].get(), size_t(p_huart->RxXferSize - p_huart->RxXferCount)};
-				if (chunk == "\r\nNO CARRIER\r\n"sv)
-					return len;		// end
+				if (chunk.remove_suffix(NO_CARRIER))		// It can be received with the end of the data.
+				{
+					if (chunk_handler && !chunk.empty())
+						code = chunk_handler(chunk, len);
+					
+					return len + chunk.size();		// end
+				}
 				
 				if (state == HAL_UART_STATE_READY && rem)
 					stat = HAL_UARTEx_ReceiveToIdle_IT(p_huart, reinterpret_cast<uint8_t *>(buf[++index].get()), CHUNK_LEN);
@@ -350,6 +865,7 @@ CM_CODE_10(name##6, (code) * 10 + 6), CM_CODE_10(name##7, (code) * 10 + 7), CM_C
 				
 				len += chunk.size();
 			}
+			#endif	// STM32T_GSM_DMA_RX
 			
 			if ((state != HAL_UART_STATE_READY || stat != HAL_OK) && !len)
 				return FAIL;
@@ -365,14 +881,14 @@ CM_CODE_10(name##6, (code) * 10 + 6), CM_CODE_10(name##7, (code) * 10 + 7), CM_C
 		
 		template <size_t CHUNK_LEN = 600, size_t ARG_LEN = DEFAULT_ARG_LEN, size_t LEN = DEFAULT_RESPONSE_LEN>
 		int32_t ReceiveOnline(const uint32_t timeout, const uint32_t dl_to, const CommandType type, const strv cmd,
-			const func<ErrorCode (strv, size_t)>& chunk_handler, const char *const fmt, ...)
+			const function_ref<ErrorCode (strv, size_t)> chunk_handler, const char *const fmt, ...)
 		{
 			_FORMAT_ARGS();
 			return ReceiveOnline<CHUNK_LEN, LEN>(timeout, dl_to, type, cmd, chunk_handler, strv(args, argsLen));
 		}
 		
 		template <size_t LEN = DEFAULT_RESPONSE_LEN>
-		ErrorCode Tokens2(const uint32_t timeout, const CommandType type, const strv cmd, const strv args, const func<ErrorCode (vec<strv>&)>& op,
+		ErrorCode Tokens2(const uint32_t timeout, const CommandType type, const strv cmd, const strv args, const function_ref<ErrorCode (vec<strv>&)> op,
 			const bool allowSingleEnded = false)
 		{
 			if (!op)
@@ -383,14 +899,11 @@ CM_CODE_10(name##6, (code) * 10 + 6), CM_CODE_10(name##7, (code) * 10 + 7), CM_C
 			if (len < OK)
 				return ErrorCode(len);
 			
-			vec<strv> tokens;
-			strv(buffer, len).tokenize2("\r\n"sv, tokens, !allowSingleEnded);
-			
-			return op(tokens);
+			return withTokens(strv(buffer, len), allowSingleEnded, op);
 		}
 		
 		template <size_t LEN = DEFAULT_RESPONSE_LEN>
-		ErrorCode Tokens3(const uint32_t timeout, const CommandType type, const strv cmd, const strv args, const func<ErrorCode (vec<strv>&)>& op,
+		ErrorCode Tokens3(const uint32_t timeout, const CommandType type, const strv cmd, const strv args, const function_ref<ErrorCode (vec<strv>&)> op,
 			const bool allowSingleEnded = false)
 		{
 			if (!op)
@@ -401,15 +914,15 @@ CM_CODE_10(name##6, (code) * 10 + 6), CM_CODE_10(name##7, (code) * 10 + 7), CM_C
 			if (len < OK)
 				return ErrorCode(len);
 			
-			vec<strv> tokens;
-			strv(buffer, len).tokenize2("\r\n"sv, tokens, !allowSingleEnded);
-			
-			if (tokens.size() == 0 || tokens.back() != "OK"sv)
-				return Error(tokens);
-			
-			tokens.pop_back();
-			
-			return op(tokens);
+			return withTokens(strv(buffer, len), allowSingleEnded, [this, op](vec<strv>& tokens)
+			{
+				if (tokens.size() == 0 || tokens.back() != "OK"sv)
+					return Error(tokens);
+				
+				tokens.pop_back();
+				
+				return op(tokens);
+			});
 		}
 		
 		template <size_t LEN = DEFAULT_RESPONSE_LEN>
@@ -465,7 +978,7 @@ CM_CODE_10(name##6, (code) * 10 + 6), CM_CODE_10(name##7, (code) * 10 + 7), CM_C
 		
 		template <size_t LEN = DEFAULT_RESPONSE_LEN>
 		ErrorCode ResponseToken(size_t expectedTokens, const uint32_t timeout, const CommandType type, const strv cmd, const strv args, const size_t ok_pos,
-			const func<ErrorCode (vec<strv>&)>& op)
+			const function_ref<ErrorCode (vec<strv>&)> op)
 		{
 			if (!op)
 				return INVALID_PARAM;
@@ -493,7 +1006,7 @@ CM_CODE_10(name##6, (code) * 10 + 6), CM_CODE_10(name##7, (code) * 10 + 7), CM_C
 				if (ok)
 				{
 					const auto first = tokens[offset];
-					ok &= tokens[offset].remove_prefix(cmd) && (tokens[offset].remove_prefix(": "sv) || tokens[offset].remove_prefix(":"sv));
+					ok &= responseValue(tokens[offset], cmd);
 					if (!ok)
 						tokens[offset] = first;
 				}
@@ -513,7 +1026,7 @@ CM_CODE_10(name##6, (code) * 10 + 6), CM_CODE_10(name##7, (code) * 10 + 7), CM_C
 		}
 		
 		template <size_t LEN = DEFAULT_RESPONSE_LEN>
-		ErrorCode ResponseToken(const uint32_t timeout, const CommandType type, const strv cmd, const strv args, const func<ErrorCode (strv)>& op, const bool ok_last = true)
+		ErrorCode ResponseToken(const uint32_t timeout, const CommandType type, const strv cmd, const strv args, const function_ref<ErrorCode (strv)> op, const bool ok_last = true)
 		{
 			if (!op)
 				return INVALID_PARAM;
@@ -526,7 +1039,7 @@ CM_CODE_10(name##6, (code) * 10 + 6), CM_CODE_10(name##7, (code) * 10 + 7), CM_C
 		
 		template <size_t ARG_LEN = DEFAULT_ARG_LEN, size_t LEN = DEFAULT_RESPONSE_LEN>
 		ErrorCode ResponseToken(const size_t expectedTokens, const uint32_t timeout, const CommandType type, const strv cmd, const size_t ok_pos,
-			const func<ErrorCode (vec<strv>&)>& op, const char * const fmt, ...)
+			const function_ref<ErrorCode (vec<strv>&)> op, const char * const fmt, ...)
 		{
 			_FORMAT_ARGS();
 			return ResponseToken<LEN>(expectedTokens, timeout, type, cmd, strv(args, argsLen), ok_pos, op);
@@ -534,14 +1047,14 @@ CM_CODE_10(name##6, (code) * 10 + 6), CM_CODE_10(name##7, (code) * 10 + 7), CM_C
 		
 		template <size_t ARG_LEN = DEFAULT_ARG_LEN, size_t LEN = DEFAULT_RESPONSE_LEN>
 		ErrorCode ResponseToken(const uint32_t timeout, const CommandType type, const strv cmd,
-			const func<ErrorCode (strv)>& op, const bool ok_last, const char * const fmt, ...)
+			const function_ref<ErrorCode (strv)> op, const bool ok_last, const char * const fmt, ...)
 		{
 			_FORMAT_ARGS();
 			return ResponseToken<LEN>(timeout, type, cmd, strv(args, argsLen), op, ok_last);
 		}
 		
 		template <size_t LEN = DEFAULT_RESPONSE_LEN>
-		ErrorCode DelayedResponseToken(const uint32_t timeout, const CommandType type, const strv cmd, const strv args, const func<ErrorCode (strv)>& op)
+		ErrorCode DelayedResponseToken(const uint32_t timeout, const CommandType type, const strv cmd, const strv args, const function_ref<ErrorCode (strv)> op)
 		{
 			bool done = false;
 			const uint32_t start = HAL_GetTick();
@@ -576,7 +1089,7 @@ CM_CODE_10(name##6, (code) * 10 + 6), CM_CODE_10(name##7, (code) * 10 + 7), CM_C
 		}
 		
 		template <size_t ARG_LEN = DEFAULT_ARG_LEN, size_t LEN = DEFAULT_RESPONSE_LEN>
-		ErrorCode DelayedResponseToken(const uint32_t timeout, const CommandType type, const strv cmd, const func<ErrorCode (strv)>& op, const char * const fmt, ...)
+		ErrorCode DelayedResponseToken(const uint32_t timeout, const CommandType type, const strv cmd, const function_ref<ErrorCode (strv)> op, const char * const fmt, ...)
 		{
 			_FORMAT_ARGS();
 			return DelayedResponseToken<LEN>(timeout, type, cmd, strv(args, argsLen), op);
@@ -744,6 +1257,30 @@ CM_CODE_10(name##6, (code) * 10 + 6), CM_CODE_10(name##7, (code) * 10 + 7), CM_C
 			return SingleToken<LEN>(timeout, CommandType::Execute, command);
 		}
 		
+		#ifdef STM32T_GSM_DMA_RX
+		/**
+		* @brief Queues Custom() to be sent asynchronously. See CommandAsync().
+		*/
+		bool CustomAsync(const strv command, async_handler_t handler, const uint32_t timeout = DEFAUL_RECEIVE_TIMEOUT)
+		{
+			return CommandAsync(timeout, CommandType::Execute, command, {}, std::move(handler));
+		}
+		
+		/**
+		* @brief Sends the queued asynchronous commands one after another and calls the handlers of the completed ones. Never waits; call
+		*		it from the main loop. A synchronous command waits for the asynchronous one in flight (if any) and goes before the rest.
+		*/
+		void ProcessAsync()
+		{
+			while (stepAsync()) {}
+		}
+		
+		/**
+		* @retval The number of asynchronous commands queued or in flight.
+		*/
+		size_t AsyncPending() const { return m_asyncCount; }
+		#endif	// STM32T_GSM_DMA_RX
+		
 		int32_t GetBrand(char *const buf, const size_t max_len)
 		{
 			return StrToken2(buf, max_len, CommandType::Execute, "+CGMI"sv);
@@ -825,44 +1362,20 @@ CM_CODE_10(name##6, (code) * 10 + 6), CM_CODE_10(name##7, (code) * 10 + 7), CM_C
 		#if defined(STM32T_GSM_URC_SUPPORT) && USE_HAL_UART_REGISTER_CALLBACKS == 1
 		#define STM32T_GSM_URC_ENABLED
 	private:
-		class URC
-		{
-			friend class GSM<DEF_RX_TO, DEF_IDLE_TO>;
-			friend class LinkedList<URC, 32>;
-			
-			char *m_buf;
-			size_t m_size;
-			uint32_t m_timestamp;
-			
-			URC(const URC& other) = delete;
-			URC(URC&& other) : m_buf(other.m_buf), m_size(other.m_size), m_timestamp(other.m_timestamp)
-			{
-				other.m_buf = nullptr;
-				other.m_size = 0;
-			}
-			
-			~URC()
-			{
-				delete[] m_buf;
-				m_buf = nullptr;
-				m_size = 0;
-			}
-			
-			URC(const strv& urc) : URC(urc, HAL_GetTick()) {}
-			URC(const strv& urc, const uint32_t timestamp) : m_buf(new char[urc.size() + 1]), m_size(urc.size()), m_timestamp(timestamp)
-			{
-				memcpy(m_buf, urc.data(), m_size);
-				m_buf[m_size] = 0;
-			}
-			
-			operator strv() const { return {m_buf, m_size}; }
-		};
-		
+		#ifndef STM32T_GSM_DMA_RX
 		uint8_t m_buf[512];
-		LinkedList<URC, 32> m_urcs;
+		char m_urcLine[STM32T_GSM_LINE_LEN];		// The start of the line split between two RX events
+		uint16_t m_urcLineLen = 0;
+		#endif	// STM32T_GSM_DMA_RX
+		URCRing<> m_urcs;
 		
 		static inline This *s_this = nullptr;
 		
+		#ifdef STM32T_GSM_DMA_RX
+		// m_rx receives the URCs too.
+		void startURC() {}
+		void stopURC() {}
+		#else
 		void startURC()
 		{
 			__HAL_UART_CLEAR_OREFLAG(p_huart);
@@ -871,17 +1384,71 @@ CM_CODE_10(name##6, (code) * 10 + 6), CM_CODE_10(name##7, (code) * 10 + 7), CM_C
 			__HAL_DMA_DISABLE_IT(p_huart->hdmarx, DMA_IT_HT);	//Disable half transfer interrupt if it is enabled in HAL_UARTEx_ReceiveToIdle_DMA()
 		}
 		
-		void stopURC() { HAL_UART_DMAStop(p_huart); }	// todo: handle half received URC
+		/**
+		* @brief Stores the URCs completed by the received DATA, straight from the DMA buffer. Only the start of a line that isn't complete
+		*		yet is copied, to m_urcLine, for the next RX event; a line longer than STM32T_GSM_LINE_LEN is truncated.
+		*/
+		void feedURC(strv data)
+		{
+			while (!data.empty())
+			{
+				const size_t end = data.find('\n');
+				strv line = data.substr(0, end);
+				
+				if (m_urcLineLen || end == strv::npos)
+				{
+					const size_t len = std::min(line.size(), sizeof(m_urcLine) - m_urcLineLen);
+					memcpy(m_urcLine + m_urcLineLen, line.data(), len);
+					m_urcLineLen += len;
+					
+					if (end == strv::npos)
+						return;
+					
+					line = strv(m_urcLine, m_urcLineLen);
+					m_urcLineLen = 0;
+				}
+				
+				line.remove_suffix('\r');
+				
+				if (!line.empty())
+					addURC(line);
+				
+				data.remove_prefix(end + 1);
+			}
+		}
+		
+		void stopURC()
+		{
+			HAL_UART_DMAStop(p_huart);
+			
+			// The bytes received since the last RX event, before the command is sent. A URC that is still incomplete is dropped: its rest
+			// is received with the response.
+			feedURC(strv(reinterpret_cast<const char *>(m_buf), sizeof(m_buf) - __HAL_DMA_GET_COUNTER(p_huart->hdmarx)));
+			m_urcLineLen = 0;
+		}
+		#endif	// STM32T_GSM_DMA_RX
 		
 	protected:
 		void addURC(const strv token)
 		{
-			m_urcs.push_back(URC{token});
+			m_urcs.Push(token, HAL_GetTick());
 		}
 		
 	public:
 		void EnableURC(bool enable = true)
 		{
+			#ifdef STM32T_GSM_DMA_RX
+			if (enable)
+			{
+				m_rx.SetLineHandler([](void *context, const strv line) { static_cast<This *>(context)->addURC(line); }, this);
+				if (!m_rx.IsStarted())
+					m_rx.Start();
+			}
+			else
+				m_rx.SetLineHandler(nullptr, nullptr);
+			
+			m_urcEnabled = enable;
+			#else
 			if (enable)
 			{
 				if (m_urcEnabled)
@@ -896,8 +1463,7 @@ CM_CODE_10(name##6, (code) * 10 + 6), CM_CODE_10(name##7, (code) * 10 + 7), CM_C
 					
 					const Time::cycle_t start = Time::GetCycle();
 					
-					strv data = {reinterpret_cast<const char *>(huart->pRxBuffPtr), size};
-					data.tokenize2("\r\n"sv, [](const strv token) { s_this->addURC(token); }, false);
+					s_this->feedURC(strv(reinterpret_cast<const char *>(huart->pRxBuffPtr), size));
 					
 					const Time::cycle_t end = Time::GetCycle();
 					const auto time = Time::CyclesTo_us(end - start);
@@ -905,7 +1471,7 @@ CM_CODE_10(name##6, (code) * 10 + 6), CM_CODE_10(name##7, (code) * 10 + 7), CM_C
 					static const Time::us_time_t MaxTime = 1'000'000u * 10u / huart->Init.BaudRate;		// Time of 1 byte
 					
 					if (time >= MaxTime)	// todo: Can't use LG directly (LOG_W<LG>)
-						LG.w("Rx event proccessing time (%u us) has exceeded maximum (%u us).", time, MaxTime);
+						LG_LIMITED.w("Rx event proccessing time (%u us) has exceeded maximum (%u us).", time, MaxTime);
 					
 					s_this->startURC();
 					
@@ -926,35 +1492,28 @@ CM_CODE_10(name##6, (code) * 10 + 6), CM_CODE_10(name##7, (code) * 10 + 7), CM_C
 				stopURC();
 				HAL_UART_UnRegisterRxEventCallback(p_huart);
 			}
+			#endif	// STM32T_GSM_DMA_RX
 		}
 		
 		/**
+		* @brief Calls HANDLER(urc, timestamp) for each stored URC, oldest first. The URC is a view into the URC buffer (null-terminated),
+		*		valid until HandleURCs() returns.
 		* @param handler - If it returns true, the urc will be removed and considered handled.
 		* @retval - The number of urcs handled.
 		*/
-		size_t HandleURCs(const func<bool (strv, uint32_t ts)>& handler, const bool stop_when_handled = false)
+		size_t HandleURCs(const function_ref<bool (strv, uint32_t ts)> handler, const bool stop_when_handled = false)
 		{
 			if (!handler)
 				return 0;
 			
-			size_t handled = 0;
-			auto it = m_urcs.begin();
-			while (it != m_urcs.end())
-			{
-				if (handler(*it, it->m_timestamp))
-				{
-					it = m_urcs.erase(it);
-					++handled;
-					
-					if (stop_when_handled)
-						return handled;
-				}
-				else
-					++it;
-			}
-			
-			return handled;
+			return m_urcs.Handle(handler, stop_when_handled);
 		}
+		
+		/**
+		* @retval The number of URCs dropped because the URC buffer (STM32T_GSM_URC_BUFFER_SIZE) was full.
+		*/
+		size_t DroppedURCs() const { return m_urcs.Dropped(); }
+		
 		#else
 	protected:
 		void addURC(const strv token) {}
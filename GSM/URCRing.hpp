@@ -0,0 +1,189 @@
+#pragma once
+
+#include "main.h"
+
+#include "../Core/Utils.hpp"
+#include "../Core/strv.hpp"
+
+#include <cstring>
+
+
+
+/**
+* @brief The bytes for the stored URCs. Each one takes 8 bytes more than its text, rounded up to 8.
+*/
+#ifndef STM32T_GSM_URC_BUFFER_SIZE
+#define STM32T_GSM_URC_BUFFER_SIZE		1024
+#endif
+
+
+
+namespace STM32T
+{
+	/**
+	* @brief Stores URCs with their timestamps as records in a fixed byte ring, so storing one doesn't allocate (even from an ISR) and
+	*		they're handled in place, as strv views. A record is a header (the length, whether it's handled and the timestamp) and the
+	*		null-terminated text, padded to 8 bytes. A record never wraps (the end of the buffer is skipped instead), so its text is
+	*		contiguous. The handled records are reclaimed once the records before them are handled too.
+	*
+	* @note Push() can be called from ISRs and from the main code; Handle() must not be called from ISRs.
+	*/
+	template <size_t SIZE = STM32T_GSM_URC_BUFFER_SIZE>
+	class URCRing
+	{
+		static_assert(SIZE >= 64 && SIZE % 8 == 0 && SIZE < UINT16_MAX, "SIZE must be a multiple of 8 between 64 and 65528!");
+		
+		struct Header
+		{
+			uint16_t len;				// SKIP: the rest of the buffer is skipped.
+			volatile uint8_t handled;
+			uint8_t reserved;
+			uint32_t timestamp;
+		};
+		
+		static_assert(sizeof(Header) == 8);
+		
+		static constexpr uint16_t SKIP = UINT16_MAX;
+		
+		alignas(8) uint8_t m_buf[SIZE];
+		volatile size_t m_head = 0, m_tail = 0;		// Free-running
+		size_t m_dropped = 0, m_maxUsed = 0;
+		uint8_t m_depth = 0;		// Nested Handle() calls
+		
+		static constexpr size_t recordSize(const size_t len) { return sizeof(Header) + ((len + 1 + 7) & ~size_t(7)); }
+		
+		Header& header(const size_t pos) { return *reinterpret_cast<Header *>(m_buf + pos % SIZE); }
+		
+		/**
+		* @retval The position of the next record after POS.
+		*/
+		size_t next(const size_t pos)
+		{
+			const uint16_t len = header(pos).len;
+			return len == SKIP ? pos + SIZE - pos % SIZE : pos + recordSize(len);
+		}
+		
+		/**
+		* @brief Frees the handled records at the tail. An empty ring is rewound, so the next records start at the beginning of the buffer
+		*		(a record that doesn't fit before the end would need the space after the skipped end too).
+		*/
+		void reclaim()
+		{
+			size_t tail = m_tail;
+			
+			while (tail != m_head && (header(tail).len == SKIP || header(tail).handled))
+				tail = next(tail);
+			
+			CriticalSection cs;		// Push() can't see the empty ring before it's rewound.
+			
+			if (tail == m_head)
+				m_head = tail = 0;
+			
+			m_tail = tail;
+		}
+		
+	public:
+		URCRing() = default;
+		
+		URCRing(const URCRing&) = delete;
+		URCRing& operator=(const URCRing&) = delete;
+		
+		/**
+		* @brief Stores a copy of URC.
+		* @retval false if there isn't enough space (the URC is dropped).
+		*/
+		bool Push(const strv urc, const uint32_t timestamp)
+		{
+			const size_t size = recordSize(urc.size());
+			
+			CriticalSection cs;
+			
+			size_t head = m_head;
+			const size_t left = SIZE - head % SIZE;
+			const size_t needed = left < size ? left + size : size;
+			
+			if (size > SIZE || urc.size() >= SKIP || needed > SIZE - (head - m_tail))
+			{
+				++m_dropped;
+				return false;
+			}
+			
+			if (left < size)
+			{
+				header(head).len = SKIP;
+				head += left;
+			}
+			
+			Header& h = header(head);
+			h.len = uint16_t(urc.size());
+			h.handled = false;
+			h.timestamp = timestamp;
+			
+			char *const text = reinterpret_cast<char *>(&h + 1);
+			memcpy(text, urc.data(), urc.size());
+			text[urc.size()] = 0;
+			
+			m_maxUsed = std::max(m_maxUsed, head + size - m_tail);
+			
+			__DMB();	// The record must be in the buffer before Handle() can see it.
+			m_head = head + size;
+			
+			return true;
+		}
+		
+		/**
+		* @brief Calls HANDLER(urc, timestamp) for each stored URC, oldest first. The URC (null-terminated) is valid until the outermost
+		*		Handle() call returns.
+		* @param handler - If it returns true, the URC is removed.
+		* @param stop_when_handled - Stops after the first URC removed.
+		* @retval The number of URCs removed.
+		*/
+		template <class F>
+		size_t Handle(F&& handler, const bool stop_when_handled = false)
+		{
+			size_t handled = 0;
+			++m_depth;
+			
+			for (size_t pos = m_tail; pos != m_head; pos = next(pos))
+			{
+				Header& h = header(pos);
+				if (h.len == SKIP || h.handled)
+					continue;
+				
+				if (handler(strv(reinterpret_cast<const char *>(&h + 1), h.len), h.timestamp))
+				{
+					h.handled = true;
+					++handled;
+					
+					if (stop_when_handled)
+						break;
+				}
+			}
+			
+			if (--m_depth == 0)		// A nested call mustn't free the record that the outer one is handling.
+				reclaim();
+			
+			return handled;
+		}
+		
+		/**
+		* @brief Removes all the URCs.
+		*/
+		void Clear()
+		{
+			Handle([](strv, uint32_t) { return true; });
+		}
+		
+		bool Empty() const { return m_head == m_tail; }
+		
+		/**
+		* @retval The number of URCs dropped because the buffer was full.
+		*/
+		size_t Dropped() const { return m_dropped; }
+		
+		/**
+		* @retval The highest number of bytes used in the buffer.
+		*/
+		size_t MaxUsed() const { return m_maxUsed; }
+	};
+}
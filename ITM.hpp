@@ -0,0 +1,258 @@
+#pragma once
+
+#include "./Log.hpp"
+#include "./Core/Time.hpp"
+#include "./Core/Utils.hpp"
+
+#ifdef ITM
+
+
+
+#ifndef STM32T_ITM_PORT_TEXT
+#define	STM32T_ITM_PORT_TEXT		0
+#endif
+
+#ifndef STM32T_ITM_PORT_EVENT
+#define	STM32T_ITM_PORT_EVENT		1
+#endif
+
+#ifndef STM32T_ITM_PORT_VARIABLE
+#define	STM32T_ITM_PORT_VARIABLE	2
+#endif
+
+#define	_STM32T_ITM_CAT2(A, B)	A##B
+#define	_STM32T_ITM_CAT(A, B)	_STM32T_ITM_CAT2(A, B)
+
+/**
+* @brief Sends a Begin event now and an End event at the end of the enclosing scope. NAME must be a string literal.
+*/
+#define STM32T_ITM_ZONE(NAME) \
+	static STM32T::Itm::Name _STM32T_ITM_CAT(_stm32t_itm_name_, __LINE__)(NAME); \
+	const STM32T::Itm::Zone _STM32T_ITM_CAT(_stm32t_itm_zone_, __LINE__)(_STM32T_ITM_CAT(_stm32t_itm_name_, __LINE__))
+
+#define STM32T_ITM_MARK(NAME) \
+do \
+{ \
+	static STM32T::Itm::Name _name(NAME); \
+	STM32T::Itm::Mark(_name); \
+} while (0)
+
+#define STM32T_ITM_VALUE(NAME, VALUE) \
+do \
+{ \
+	static STM32T::Itm::Name _name(NAME); \
+	STM32T::Itm::Value(_name, VALUE); \
+} while (0)
+
+
+
+namespace STM32T::Itm
+{
+	/**
+	* @brief The type of an event packet (the high byte of its first word).
+	*
+	*		Packets are made of 32-bit words: [type << 24 | id][timestamp (cycles)][value] for the events and
+	*		[Name << 24 | id][len][chars... (padded to 4 bytes)] for the name definitions.
+	*/
+	enum class Packet : uint8_t
+	{
+		Name = 0x01,
+		Begin = 0x02,
+		End = 0x03,
+		Mark = 0x04,
+		Int = 0x05,
+		Uint = 0x06,
+		Float = 0x07,
+	};
+	
+	inline bool IsEnabled(const uint8_t port)
+	{
+		return (ITM->TCR & ITM_TCR_ITMENA_Msk) && (ITM->TER & (1UL << port));
+	}
+	
+	[[gnu::always_inline]] inline void Write32(const uint8_t port, const uint32_t word)
+	{
+		while (ITM->PORT[port].u32 == 0);
+		ITM->PORT[port].u32 = word;
+	}
+	
+	/**
+	* @brief Writes data to a stimulus port with 32-bit writes (one ITM packet per 4 bytes) and 16/8-bit writes for the rest.
+	*		Does nothing if the ITM or the port is disabled (e.g. no debugger attached).
+	*/
+	inline void Write(const uint8_t port, const void *data, size_t len)
+	{
+		if (!IsEnabled(port))
+			return;
+		
+		const uint8_t *p = reinterpret_cast<const uint8_t *>(data);
+		
+		for (; len >= 4; len -= 4, p += 4)
+			Write32(port, pack_le<uint32_t>(p));
+		
+		if (len >= 2)
+		{
+			while (ITM->PORT[port].u32 == 0);
+			ITM->PORT[port].u16 = pack_le<uint16_t>(p);
+			
+			len -= 2;
+			p += 2;
+		}
+		
+		if (len)
+		{
+			while (ITM->PORT[port].u32 == 0);
+			ITM->PORT[port].u8 = *p;
+		}
+	}
+	
+	/**
+	* @brief A log output (output_t) that writes to a stimulus port, STM32T_ITM_PORT_TEXT by default.
+	*/
+	template <uint8_t PORT = STM32T_ITM_PORT_TEXT>
+	void Output(strv data, bool last_chunk)
+	{
+		Write(PORT, data.data(), data.size());
+	}
+	
+	/**
+	* @brief The name of an event or a variable. It gets an ID and its definition is sent to its port the first time it is used.
+	*
+	* @note Must have static storage duration. Use the STM32T_ITM_XXX macros.
+	*/
+	class Name
+	{
+		const char *const c_name;
+		uint32_t m_id = 0;
+		uint8_t m_port = 0;
+		Name *m_next = nullptr;
+		
+		static inline Name *s_first = nullptr;
+		static inline uint32_t s_lastId = 0;
+		
+		void define() const
+		{
+			if (!IsEnabled(m_port))
+				return;
+			
+			const size_t len = std::strlen(c_name);
+			
+			CriticalSection cs;
+			
+			Write32(m_port, uint32_t(Packet::Name) << 24 | m_id);
+			Write32(m_port, len);
+			Write(m_port, c_name, len);
+			
+			const uint32_t pad = 0;
+			Write(m_port, &pad, -len & 3);
+		}
+		
+	public:
+		constexpr Name(const char *name) : c_name(name) {}
+		
+		Name(const Name&) = delete;
+		Name& operator=(const Name&) = delete;
+		
+		const char *name() const { return c_name; }
+		
+		/**
+		* @brief Returns the ID of the name, assigning it and sending the definition to port on first use.
+		*/
+		uint32_t id(const uint8_t port)
+		{
+			if (!m_id)
+			{
+				CriticalSection cs;
+				
+				if (!m_id)
+				{
+					m_id = ++s_lastId & 0xFFFFFF;
+					m_port = port;
+					m_next = s_first;
+					s_first = this;
+					
+					define();
+				}
+			}
+			
+			return m_id;
+		}
+		
+		/**
+		* @brief Sends the definitions of all the names again (e.g. when the trace capture was started after they were first used).
+		*/
+		static void Redefine()
+		{
+			for (const Name *name = s_first; name; name = name->m_next)
+				name->define();
+		}
+	};
+	
+	/**
+	* @brief Sends an event packet (a header, a timestamp and an optional value) as a whole.
+	*/
+	inline void Event(const uint8_t port, const Packet type, Name& name, const uint32_t *value = nullptr)
+	{
+		if (!IsEnabled(port))
+			return;
+		
+		const uint32_t header = uint32_t(type) << 24 | name.id(port);
+		
+		CriticalSection cs;
+		
+		Write32(port, header);
+		Write32(port, Time::GetCycle());
+		
+		if (value)
+			Write32(port, *value);
+	}
+	
+	inline void Begin(Name& name) { Event(STM32T_ITM_PORT_EVENT, Packet::Begin, name); }
+	inline void End(Name& name) { Event(STM32T_ITM_PORT_EVENT, Packet::End, name); }
+	inline void Mark(Name& name) { Event(STM32T_ITM_PORT_EVENT, Packet::Mark, name); }
+	
+	/**
+	* @brief Traces the value of a variable (an integer, an enum, a bool or a floating-point number sent as a float).
+	*/
+	template <class T>
+	void Value(Name& name, const T val)
+	{
+		uint32_t word;
+		
+		if constexpr (std::is_floating_point_v<T>)
+		{
+			const float f = val;
+			std::memcpy(&word, &f, sizeof(word));
+			Event(STM32T_ITM_PORT_VARIABLE, Packet::Float, name, &word);
+		}
+		else if constexpr (std::is_enum_v<T> || std::is_same_v<T, bool>)
+			Value(name, uint32_t(val));
+		else if constexpr (std::is_signed_v<T>)
+		{
+			word = int32_t(val);
+			Event(STM32T_ITM_PORT_VARIABLE, Packet::Int, name, &word);
+		}
+		else
+		{
+			word = uint32_t(val);
+			Event(STM32T_ITM_PORT_VARIABLE, Packet::Uint, name, &word);
+		}
+	}
+	
+	/**
+	* @brief Sends a Begin event in the constructor and an End event in the destructor. Use STM32T_ITM_ZONE() instead.
+	*/
+	class Zone
+	{
+		Name &m_name;
+		
+	public:
+		Zone(Name& name) : m_name(name) { Begin(name); }
+		~Zone() { End(m_name); }
+		
+		Zone(const Zone&) = delete;
+		Zone& operator=(const Zone&) = delete;
+	};
+}
+
+#endif	// ITM
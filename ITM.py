@@ -0,0 +1,167 @@
+import json
+import struct
+import sys
+import argparse
+
+
+PACKET_NAME, PACKET_BEGIN, PACKET_END, PACKET_MARK, PACKET_INT, PACKET_UINT, PACKET_FLOAT = range(1, 8)
+VALUE_PACKETS = (PACKET_INT, PACKET_UINT, PACKET_FLOAT)
+
+
+def parse_itm(data: bytes):
+	"""Splits a raw SWO/ITM stream into (port, payload) software source packets, in order. Protocol packets (sync, overflow,
+	timestamps, extensions) and hardware source packets are skipped."""
+	i, overflows = 0, 0
+	while i < len(data):
+		header = data[i]
+		i += 1
+		
+		if header == 0x00:		# Synchronization: zeros followed by 0x80
+			while i < len(data) and data[i] == 0x00:
+				i += 1
+			
+			i += 1
+			continue
+		
+		if header == 0x70:
+			overflows += 1
+			continue
+		
+		if header & 0x03 == 0:	# Timestamps and extensions; the continuation bit of each byte tells if another one follows.
+			more = bool(header & 0x80)
+			while more and i < len(data):
+				more = bool(data[i] & 0x80)
+				i += 1
+			
+			continue
+		
+		size = { 1: 1, 2: 2, 3: 4 }[header & 0x03]
+		payload = data[i:i + size]
+		i += size
+		
+		if not header & 0x04 and len(payload) == size:
+			yield header >> 3, payload
+	
+	if overflows:
+		print(f"Warning: {overflows} ITM overflow packet(s); some data was lost.", file=sys.stderr)
+
+class EventPort:
+	"""Reassembles the 32-bit words written to an event or variable port into packets."""
+	def __init__(self):
+		self.buf = bytearray()
+	
+	def feed(self, payload: bytes):
+		self.buf += payload
+		while len(self.buf) >= 8:
+			header = struct.unpack_from("<I", self.buf)[0]
+			kind, id = header >> 24, header & 0xFFFFFF
+			
+			if kind == PACKET_NAME:
+				length = struct.unpack_from("<I", self.buf, 4)[0]
+				size = 8 + (length + 3) // 4 * 4
+				if length > 1024:
+					del self.buf[:1]		# Lost sync; resynchronize.
+					continue
+				
+				if len(self.buf) < size:
+					return
+				
+				yield kind, id, None, self.buf[8:8 + length].decode("utf-8", errors="replace")
+			elif kind in (PACKET_BEGIN, PACKET_END, PACKET_MARK):
+				size = 8
+				yield kind, id, struct.unpack_from("<I", self.buf, 4)[0], None
+			elif kind in VALUE_PACKETS:
+				size = 12
+				if len(self.buf) < size:
+					return
+				
+				code = { PACKET_INT: "<i", PACKET_UINT: "<I", PACKET_FLOAT: "<f" }[kind]
+				yield kind, id, struct.unpack_from("<I", self.buf, 4)[0], struct.unpack_from(code, self.buf, 8)[0]
+			else:
+				size = 1		# Lost sync; resynchronize.
+			
+			del self.buf[:size]
+
+class Timeline:
+	def __init__(self, text_port: int, clk: int):
+		self.text_port, self.clk = text_port, clk
+		self.names, self.ports, self.text = {}, {}, bytearray()
+		self.high, self.last = 0, 0		# Timestamps are 32-bit cycle counters; they are unwrapped to 64 bits.
+		self.open = {}
+		self.events = []
+	
+	def stamp(self, cycles: int) -> int:
+		if cycles < (self.last & 0xFFFFFFFF):
+			self.high += 1 << 32
+		
+		self.last = self.high | cycles
+		return self.last
+	
+	def name(self, id: int) -> str:
+		return self.names.get(id, f"#{id}")
+	
+	def add(self, port: int, payload: bytes):
+		if port == self.text_port:
+			self.text += payload
+			while (end := self.text.find(b"\n")) >= 0:
+				line = bytes(self.text[:end])
+				del self.text[:end + 1]
+				self.events.append({ "time": self.last, "type": "text", "text": line.decode("utf-8", errors="replace").rstrip("\r") })
+			
+			return
+		
+		for kind, id, cycles, value in self.ports.setdefault(port, EventPort()).feed(payload):
+			if kind == PACKET_NAME:
+				self.names[id] = value
+				continue
+			
+			time = self.stamp(cycles)
+			event = { "time": time, "type": { PACKET_BEGIN: "begin", PACKET_END: "end", PACKET_MARK: "mark" }.get(kind, "value"),
+				"name": self.name(id) }
+			
+			if kind == PACKET_BEGIN:
+				self.open.setdefault(id, []).append(time)
+			elif kind == PACKET_END and self.open.get(id):
+				event["duration"] = time - self.open[id].pop()
+			elif kind in VALUE_PACKETS:
+				event["value"] = value
+			
+			self.events.append(event)
+	
+	def format(self, event: dict) -> str:
+		time = event["time"]
+		stamp = f"{time / self.clk * 1e6:14.3f} us" if self.clk else f"{time:14}"
+		
+		if event["type"] == "text":
+			return f"[{stamp}] {event['text']}"
+		elif event["type"] == "end" and "duration" in event:
+			duration = f"{event['duration'] / self.clk * 1e6:.3f} us" if self.clk else f"{event['duration']} cycles"
+			return f"[{stamp}] end   {event['name']} ({duration})"
+		elif event["type"] == "value":
+			return f"[{stamp}] {event['name']} = {event['value']}"
+		else:
+			return f"[{stamp}] {event['type']:5} {event['name']}"
+
+
+parser = argparse.ArgumentParser(formatter_class=argparse.ArgumentDefaultsHelpFormatter,
+	description="Reconstructs a timeline from a raw SWO/ITM capture of STM32T::Itm (text, events and variables).")
+parser.add_argument('-i', metavar='', default='-', help="Input file (the raw SWO stream); - for stdin")
+parser.add_argument('-o', metavar='', default='-', help="Output file; - for stdout")
+parser.add_argument('--text-port', metavar='', type=int, default=0, help="The stimulus port of the text (STM32T_ITM_PORT_TEXT)")
+parser.add_argument('--clk', metavar='', type=int, default=0, help="The CPU clock in Hz to show times in us (0: show cycles)")
+parser.add_argument('--json', action='store_true', help="Write the events as JSON lines")
+
+args = parser.parse_args()
+
+output = sys.stdout if args.o == '-' else open(args.o, 'w', encoding="utf-8")
+data = sys.stdin.buffer.read() if args.i == '-' else open(args.i, 'rb').read()
+
+timeline = Timeline(args.text_port, args.clk)
+for port, payload in parse_itm(data):
+	timeline.add(port, payload)
+
+for event in timeline.events:
+	output.write((json.dumps(event) if args.json else timeline.format(event)) + "\n")
+
+if output is not sys.stdout:
+	output.close()
@@ -2,9 +2,13 @@
 
 #include "./Core/strv.hpp"
 #include "./Core/Time.hpp"
+#include "./Core/Utils.hpp"
+#include "./Core/Format.hpp"
 #include "./Versioning.hpp"
 
 #include <cstdio>
+#include <optional>
+#include <tuple>
 
 
 
@@ -12,6 +16,12 @@
 #define FH_STDOUT   0x8002
 #define FH_STDERR   0x8003
 
+/**
+* @brief Makes a format string that is parsed at compile time when passed to Logger::log() or the LOG_X functions instead of a plain
+*		string literal, e.g. LOG_I<s_log>(STM32T_FMT("temp=%d"), temp). In C++20 you can also use LOG_I<"temp=%d", s_log>(temp).
+*/
+#define STM32T_FMT(STR) [] { struct _fmt : STM32T::Log::FormatTag { static constexpr const char *str() { return STR; } }; return _fmt{}; }()
+
 
 
 #define STM32T_SYS_WRITE_GPIO(PORT, PIN, BAUD) \
@@ -66,9 +76,17 @@ extern "C" int _sys_write(int fh, const uint8_t *buf, uint32_t len, int mode) \
 	\
 	if ((ITM_TCR & ITM_TCR_ITMENA_Msk) && /* ITM enabled */ (ITM_TER & (1UL << 0))) /* ITM Port #0 enabled */\
 	{\
-		for (uint32_t i = 0; i < len; i++)\
+		uint32_t i = 0;\
+		for (; i + 4 <= len; i += 4) /* 4 bytes per stimulus write */\
+		{\
+			uint32_t word;\
+			memcpy(&word, buf + i, sizeof(word));\
+			while (ITM_PORT0_U32 == 0);\
+			ITM_PORT0_U32 = word;\
+		}\
+		for (; i < len; i++)\
 		{\
-			while (ITM_PORT0_U32 != 0);\
+			while (ITM_PORT0_U32 == 0);\
 			ITM_PORT0_U8 = buf[i];\
 		}\
 		return 0;\
@@ -86,6 +104,21 @@ extern "C" int _sys_write(int fh, const uint8_t *buf, uint32_t len, int mode) \
 	return HAL_UART_Transmit((PHUART), buf, len, HAL_MAX_DELAY) == HAL_OK ? 0 : -1; \
 }
 
+#define STM32T_SYS_WRITE_UART_DMA(PHUART) \
+namespace STM32T::Log \
+{ \
+	inline UartDmaOutput<> g_stdoutUart((PHUART)); \
+} \
+extern "C" int stdout_putchar(int ch) { return ch; } \
+extern "C" int _sys_write(int fh, const uint8_t *buf, uint32_t len, int mode) \
+{ \
+	if (fh != FH_STDOUT) \
+		return fh == FH_STDERR ? 0 : -1; \
+	\
+	STM32T::Log::g_stdoutUart.Write(STM32T::strv(reinterpret_cast<const char *>(buf), len)); \
+	return 0; \
+}
+
 #define STM32T_SYS_WRITE_USB \
 extern "C" USBD_HandleTypeDef hUsbDeviceFS; \
 extern "C" int stdout_putchar(int ch) { return ch; } \
@@ -231,7 +264,932 @@ namespace STM32T::Log
 		return strv(str, len);
 	}
 	
-	template <size_t OUTPUT_COUNT = 1>
+	enum class Overflow : uint8_t
+	{
+		DropNewest,		// The new message is dropped.
+		DropOldest,		// The oldest messages are dropped to make room. Falls back to DropNewest while Drain() is running.
+		Block,			// Drain() is called to make room. Falls back to DropNewest while Drain() is running (e.g. logging from an ISR).
+	};
+	
+	/**
+	* @brief An output that only copies the messages to a ring buffer. Drain() sends them to the real outputs later (from the main loop,
+	*		a DMA-complete callback, etc.) so that logging doesn't wait for slow outputs.
+	*
+	* @note Messages are written by one context at a time. A message logged from an ISR in the middle of another message is dropped.
+	*		Drain() can be called from any context; a call made while another one is running does nothing.
+	*/
+	template <size_t SIZE = 1024, size_t OUTPUT_COUNT = 1>
+	class AsyncOutput
+	{
+		static_assert(SIZE >= 64 && SIZE <= 65536 && (SIZE & (SIZE - 1)) == 0, "SIZE must be a power of 2 between 64 and 65536!");
+		
+		static constexpr size_t HEADER_SIZE = 2;	// Message length
+		static constexpr uint32_t NO_OWNER = UINT32_MAX;
+		
+		uint8_t m_buf[SIZE];
+		volatile size_t m_head = 0, m_tail = 0;		// Free-running. m_head is the end of the last complete message.
+		size_t m_write = 0;							// The end of the message being written.
+		volatile uint32_t m_owner = NO_OWNER;		// IPSR of the context writing a message.
+		volatile bool m_draining = false;
+		bool m_discard = false;
+		
+		volatile uint32_t m_droppedNewest = 0, m_droppedOldest = 0;
+		size_t m_maxUsed = 0;
+		
+		uint16_t length_at(const size_t pos) const
+		{
+			return m_buf[pos % SIZE] | (m_buf[(pos + 1) % SIZE] << 8);
+		}
+		
+		void copy(size_t pos, strv data)
+		{
+			const size_t index = pos % SIZE, first = std::min(data.size(), SIZE - index);
+			std::memcpy(m_buf + index, data.data(), first);
+			std::memcpy(m_buf, data.data() + first, data.size() - first);
+		}
+		
+		bool reserve(const size_t end)
+		{
+			while (end - m_tail > SIZE)
+			{
+				if (end - m_head > SIZE || policy == Overflow::DropNewest)
+					return false;
+				
+				if (policy == Overflow::Block)
+				{
+					if (!Drain())
+						return false;
+					
+					continue;
+				}
+				
+				CriticalSection cs;
+				
+				if (m_draining || m_tail == m_head)
+					return false;
+				
+				m_tail = m_tail + HEADER_SIZE + length_at(m_tail);
+				++m_droppedOldest;
+			}
+			
+			return true;
+		}
+		
+		void dispatch_chunk(strv data, bool last) const
+		{
+			for (auto out : outputs)
+				if (out)
+					out(data, last);
+		}
+		
+	public:
+		std::array<output_t, OUTPUT_COUNT> outputs;
+		Overflow policy;
+		
+		AsyncOutput(std::array<output_t, OUTPUT_COUNT> outputs, Overflow policy = Overflow::DropNewest) : outputs(outputs), policy(policy) {}
+		
+		/**
+		* @brief Adds data to the current message. Use Output<>() as the output of a logger instead of calling this directly.
+		*/
+		void Write(strv data, bool last_chunk)
+		{
+			const uint32_t context = __get_IPSR();
+			
+			if (m_owner == NO_OWNER)
+			{
+				m_owner = context;
+				m_write = m_head + HEADER_SIZE;
+				m_discard = false;
+			}
+			else if (m_owner != context)	// Interrupted another message
+			{
+				if (last_chunk)
+					++m_droppedNewest;
+				
+				return;
+			}
+			
+			if (!m_discard)
+			{
+				if (m_write + data.size() - m_head - HEADER_SIZE > UINT16_MAX || !reserve(m_write + data.size()))
+					m_discard = true;
+				else
+				{
+					copy(m_write, data);
+					m_write += data.size();
+				}
+			}
+			
+			if (!last_chunk)
+				return;
+			
+			if (m_discard)
+				++m_droppedNewest;
+			else
+			{
+				const uint16_t len = m_write - m_head - HEADER_SIZE;
+				const uint8_t header[HEADER_SIZE] = { uint8_t(len), uint8_t(len >> 8) };
+				copy(m_head, strv(reinterpret_cast<const char *>(header), HEADER_SIZE));
+				
+				m_maxUsed = std::max(m_maxUsed, m_write - m_tail);
+				
+				__DMB();	// The message must be in the buffer before Drain() can see it.
+				m_head = m_write;
+			}
+			
+			m_owner = NO_OWNER;
+		}
+		
+		/**
+		* @brief Sends the buffered messages to the outputs.
+		* @param max_count - The maximum number of messages to send.
+		* @retval The number of messages sent.
+		*/
+		size_t Drain(const size_t max_count = SIZE_MAX)
+		{
+			{
+				CriticalSection cs;
+				
+				if (m_draining)
+					return 0;
+				
+				m_draining = true;
+			}
+			
+			size_t count = 0;
+			for (; count < max_count && m_tail != m_head; count++)
+			{
+				const size_t tail = m_tail, start = tail + HEADER_SIZE, end = start + length_at(tail);
+				const size_t index = start % SIZE, first = std::min(end - start, SIZE - index);
+				
+				dispatch_chunk(strv(reinterpret_cast<const char *>(m_buf + index), first), first == end - start);
+				
+				if (first != end - start)
+					dispatch_chunk(strv(reinterpret_cast<const char *>(m_buf), end - start - first), true);
+				
+				__DMB();
+				m_tail = end;
+			}
+			
+			m_draining = false;
+			return count;
+		}
+		
+		/**
+		* @retval The number of bytes waiting to be drained.
+		*/
+		size_t Pending() const { return m_head - m_tail; }
+		
+		/**
+		* @retval The highest number of bytes used in the buffer.
+		*/
+		size_t MaxUsed() const { return m_maxUsed; }
+		
+		/**
+		* @retval The number of new messages dropped because the buffer was full or another message was being written.
+		*/
+		uint32_t DroppedNewest() const { return m_droppedNewest; }
+		
+		/**
+		* @retval The number of old messages dropped to make room for new ones (Overflow::DropOldest).
+		*/
+		uint32_t DroppedOldest() const { return m_droppedOldest; }
+		
+		/**
+		* @brief A log output (output_t) writing to async.
+		*/
+		template <auto& async>
+		static void Output(strv data, bool last_chunk)
+		{
+			async.Write(data, last_chunk);
+		}
+	};
+	
+	#ifdef HAL_UART_MODULE_ENABLED
+	/**
+	* @brief An output that sends the messages through a UART with DMA. Data is copied to one buffer while the other one is being sent;
+	*		the buffers are swapped when the transfer completes, so logging only costs a copy. Only whole messages are sent, unless a
+	*		message alone fills the buffer.
+	*
+	*		TxComplete() must be called when a transfer completes: register TxCpltCallback<>() with HAL_UART_RegisterCallback() or call
+	*		it from HAL_UART_TxCpltCallback() (and HAL_UART_ErrorCallback()).
+	*
+	*		When the buffer being filled is full, the policy decides what happens to the data that doesn't fit:
+	*		Overflow::DropNewest drops the whole message, Overflow::DropOldest discards the messages waiting in the buffer and
+	*		Overflow::Block waits for the current transfer to free the buffer (up to BLOCK_TIMEOUT ms; never in an ISR or with interrupts
+	*		disabled, where it drops instead).
+	*
+	*		A message longer than SIZE is sent in SIZE-sized pieces. Under Overflow::DropNewest only the pieces the two buffers can hold
+	*		are kept (the transfer of the first piece frees one), and the rest of the message is dropped.
+	*
+	* @note Messages are written by one context at a time.
+	*/
+	template <size_t SIZE = 256>		// The size of each buffer: the longest message always sent whole under Overflow::DropNewest
+	class UartDmaOutput
+	{
+		static_assert(SIZE > 0 && SIZE <= UINT16_MAX, "SIZE must be between 1 and 65535!");
+		
+		UART_HandleTypeDef *const p_huart;
+		
+		uint8_t m_buf[2][SIZE];
+		volatile size_t m_len[2] = {};
+		volatile size_t m_done = 0;			// The length of the whole messages in the buffer being filled
+		volatile uint8_t m_fill = 0;		// The index of the buffer being filled
+		volatile bool m_busy = false;
+		bool m_discard = false;				// The rest of the message is dropped (Overflow::DropNewest).
+		
+		volatile uint32_t m_transfers = 0, m_sent = 0, m_dropped = 0, m_blocked = 0, m_errors = 0;
+		
+		/**
+		* @brief Starts sending the whole messages of the buffer being filled if no transfer is in progress. The beginning of the message
+		*		being written is moved to the other buffer. Interrupts must be disabled.
+		*/
+		void start()
+		{
+			const uint8_t tx = m_fill;
+			const size_t len = m_done == 0 && m_len[tx] == SIZE ? SIZE : m_done;
+			
+			if (m_busy || len == 0)
+				return;
+			
+			const size_t rest = m_len[tx] - len;
+			std::memcpy(m_buf[tx ^ 1], m_buf[tx] + len, rest);
+			
+			m_fill = tx ^ 1;
+			m_len[tx ^ 1] = rest;
+			m_done = 0;
+			m_busy = true;
+			
+			if (HAL_UART_Transmit_DMA(p_huart, m_buf[tx], len) == HAL_OK)
+			{
+				++m_transfers;
+				m_sent += len;
+			}
+			else
+			{
+				m_busy = false;
+				++m_errors;
+				m_dropped += len;
+			}
+		}
+		
+		bool full() const
+		{
+			CriticalSection cs;
+			return m_len[m_fill] == SIZE;
+		}
+		
+		bool can_block() const
+		{
+			return __get_IPSR() == 0 && __get_PRIMASK() == 0;
+		}
+		
+	public:
+		static constexpr uint32_t BLOCK_TIMEOUT = 100;
+		
+		Overflow policy;
+		
+		UartDmaOutput(UART_HandleTypeDef *huart, Overflow policy = Overflow::DropNewest) : p_huart(huart), policy(policy) {}
+		
+		/**
+		* @brief Adds data to the buffer and starts a transfer if none is in progress. Use Output<>() as the output of a logger instead of
+		*		calling this directly.
+		*/
+		void Write(strv data, bool last_chunk = true)
+		{
+			while (!data.empty() && !m_discard)
+			{
+				{
+					CriticalSection cs;
+					
+					const uint8_t fill = m_fill;
+					
+					if (policy == Overflow::DropNewest && data.size() > SIZE - m_len[fill] && m_done)
+					{
+						// The part of the message already buffered is dropped with the rest. A message starting the buffer is longer
+						// than SIZE, so it's sent in pieces instead.
+						m_dropped += m_len[fill] - m_done;
+						m_len[fill] = m_done;
+						m_discard = true;
+						break;
+					}
+					
+					const size_t len = std::min(data.size(), SIZE - m_len[fill]);
+					
+					std::memcpy(m_buf[fill] + m_len[fill], data.data(), len);
+					m_len[fill] += len;
+					data.remove_prefix(len);
+					
+					if (data.empty() && last_chunk)
+						m_done = m_len[fill];
+					
+					start();
+					
+					if (data.empty() || m_len[m_fill] < SIZE)
+						continue;
+					
+					if (policy == Overflow::DropOldest)
+					{
+						// The whole messages waiting are dropped; the beginning of this one is kept unless it alone fills the buffer.
+						const size_t drop = m_done ? m_done : SIZE;
+						
+						std::memmove(m_buf[m_fill], m_buf[m_fill] + drop, SIZE - drop);
+						m_len[m_fill] = SIZE - drop;
+						m_done = 0;
+						m_dropped += drop;
+						continue;
+					}
+					
+					if (policy == Overflow::DropNewest)
+					{
+						// The transfer in progress leaves no room for the rest of a message longer than SIZE.
+						m_discard = true;
+						break;
+					}
+				}
+				
+				if (policy != Overflow::Block || !can_block())
+					break;
+				
+				++m_blocked;
+				
+				// TxComplete() starts the next transfer at once, so it's the free space that is waited for, not the end of the transfer.
+				const uint32_t start = HAL_GetTick();
+				while (full() && HAL_GetTick() - start < BLOCK_TIMEOUT);
+				
+				if (full())
+					break;
+			}
+			
+			m_dropped += data.size();
+			
+			if (last_chunk)
+				m_discard = false;
+		}
+		
+		/**
+		* @brief Must be called when a transfer completes (or fails). Starts sending the data buffered in the meantime.
+		*/
+		void TxComplete()
+		{
+			CriticalSection cs;
+			
+			m_busy = false;
+			start();
+		}
+		
+		/**
+		* @brief Waits until all the buffered messages are sent (the beginning of a message being written waits for its end).
+		* @retval false on timeout.
+		*/
+		bool Flush(const uint32_t timeout = HAL_MAX_DELAY)
+		{
+			const uint32_t start = HAL_GetTick();
+			while ((m_busy || m_done) && HAL_GetTick() - start < timeout);
+			
+			return !m_busy && !m_done;
+		}
+		
+		/**
+		* @retval true if a transfer is in progress.
+		*/
+		bool IsBusy() const { return m_busy; }
+		
+		/**
+		* @retval The number of bytes waiting for the current transfer to complete.
+		*/
+		size_t Pending() const { return m_len[m_fill]; }
+		
+		/**
+		* @retval The number of DMA transfers started.
+		*/
+		uint32_t Transfers() const { return m_transfers; }
+		
+		/**
+		* @retval The number of bytes handed to the DMA.
+		*/
+		uint32_t BytesSent() const { return m_sent; }
+		
+		/**
+		* @retval The number of bytes dropped because of the overflow policy or failed transfers.
+		*/
+		uint32_t BytesDropped() const { return m_dropped; }
+		
+		/**
+		* @retval The number of writes that had to wait for a transfer to complete (Overflow::Block).
+		*/
+		uint32_t Blocked() const { return m_blocked; }
+		
+		/**
+		* @retval The number of transfers HAL_UART_Transmit_DMA() refused to start.
+		*/
+		uint32_t Errors() const { return m_errors; }
+		
+		/**
+		* @brief A log output (output_t) writing to uart.
+		*/
+		template <auto& uart>
+		static void Output(strv data, bool last_chunk)
+		{
+			uart.Write(data, last_chunk);
+		}
+		
+		/**
+		* @brief A callback for HAL_UART_RegisterCallback(huart, HAL_UART_TX_COMPLETE_CB_ID, ...).
+		*/
+		template <auto& uart>
+		static void TxCpltCallback(UART_HandleTypeDef *huart)
+		{
+			uart.TxComplete();
+		}
+	};
+	#endif	// HAL_UART_MODULE_ENABLED
+	
+	/**
+	* @brief Parses a level name (as returned by LevelStr(), case-insensitive, "Warning" also accepted) or number.
+	*/
+	inline std::optional<Level> ParseLevel(strv str)
+	{
+		str.trim();
+		
+		uint8_t num;
+		const std::from_chars_result res = std::from_chars(str.data(), str.data() + str.size(), num);
+		if (!str.empty() && res.ec == std::errc() && res.ptr == str.data() + str.size())
+			return num <= uint8_t(Level::Debug) || num == uint8_t(Level::Max) ? std::optional(Level(num)) : std::nullopt;
+		
+		static constexpr std::pair<strv, Level> NAMES[] = { {"None"sv, Level::None}, {"Fatal"sv, Level::Fatal}, {"Error"sv, Level::Error},
+			{"Warn"sv, Level::Warning}, {"Warning"sv, Level::Warning}, {"Info"sv, Level::Info}, {"Debug"sv, Level::Debug}, {"Max"sv, Level::Max} };
+		
+		for (const auto& [name, level] : NAMES)
+		{
+			if (name.size() != str.size())
+				continue;
+			
+			size_t i = 0;
+			while (i < str.size() && (str[i] | 0x20) == (name[i] | 0x20))
+				i++;
+			
+			if (i == str.size())
+				return level;
+		}
+		
+		return std::nullopt;
+	}
+	
+	/**
+	* @brief A named log level that can be changed at runtime (e.g. from a console command with Command()). Loggers constructed with a
+	*		ModuleLevel check it on every call; calls above the level of the logger or STM32T_LOG_MAX_LEVEL are still removed at compile
+	*		time. All the module levels are kept in a list so that they can be found by name.
+	*
+	* @note Must have static storage duration. Reading and changing the level is atomic.
+	*/
+	class ModuleLevel
+	{
+		const strv c_name;
+		volatile Level m_level;
+		ModuleLevel *m_next = nullptr;
+		
+		static inline ModuleLevel *s_first = nullptr;
+		
+	public:
+		ModuleLevel(strv name, Level level) : c_name(name), m_level(level)
+		{
+			CriticalSection cs;
+			
+			m_next = s_first;
+			s_first = this;
+		}
+		
+		ModuleLevel(const ModuleLevel&) = delete;
+		ModuleLevel& operator=(const ModuleLevel&) = delete;
+		
+		strv name() const { return c_name; }
+		
+		Level level() const { return m_level; }
+		
+		void set(Level level) { m_level = level; }
+		
+		/**
+		* @retval The module level with the given name or nullptr.
+		*/
+		static ModuleLevel *Find(strv name)
+		{
+			for (ModuleLevel *module = s_first; module; module = module->m_next)
+				if (module->c_name == name)
+					return module;
+			
+			return nullptr;
+		}
+		
+		/**
+		* @brief Calls f(ModuleLevel&) for every module level (the most recently constructed first).
+		*/
+		template <class F>
+		static void ForEach(F&& f)
+		{
+			for (ModuleLevel *module = s_first; module; module = module->m_next)
+				f(*module);
+		}
+		
+		/**
+		* @brief Handles a console command. An empty command lists the modules and their levels, "<name> <level>" sets the level of a
+		*		module and "* <level>" sets the level of all modules. See ParseLevel() for the accepted levels.
+		* @param reply - Receives the list or an error message, one line per chunk.
+		* @retval false if the command is invalid.
+		*/
+		static bool Command(strv cmd, output_t reply)
+		{
+			strv tokens[3];
+			const size_t count = cmd.trim().tokenize(" "sv, tokens, std::size(tokens), false, false);
+			
+			if (count == 0)
+			{
+				ForEach([reply](const ModuleLevel& module)
+				{
+					strv level = module.level() == Level::Max ? "Max"sv : LevelStr(module.level());
+					
+					reply(module.name(), false);
+					reply(": "sv, false);
+					reply(level.trim(), false);
+					reply("\n"sv, true);
+				});
+				
+				return true;
+			}
+			
+			const std::optional<Level> level = count == 2 ? ParseLevel(tokens[1]) : std::nullopt;
+			if (!level)
+			{
+				reply("Usage: [<module>|* <None|Fatal|Error|Warn|Info|Debug|Max>]\n"sv, true);
+				return false;
+			}
+			
+			if (tokens[0] == "*"sv)
+			{
+				ForEach([&level](ModuleLevel& module) { module.set(*level); });
+				return true;
+			}
+			
+			ModuleLevel *const module = Find(tokens[0]);
+			if (!module)
+			{
+				reply("Unknown module\n"sv, true);
+				return false;
+			}
+			
+			module->set(*level);
+			return true;
+		}
+	};
+	
+	#ifndef STM32T_LOG_RATE_SLOTS
+	#define	STM32T_LOG_RATE_SLOTS		16
+	#endif
+	
+	/**
+	* @brief Limits the rate of the messages of each call site (identified by its format string) with a token bucket: a site can log
+	*		`burst` messages at once and gets one more every `period` ms. The suppressed messages are counted and the next message of the
+	*		site that gets through says how many were suppressed.
+	*
+	*		Up to STM32T_LOG_RATE_SLOTS sites are tracked at the same time; when all the slots are used, the least recently seen site is
+	*		forgotten (and its suppressed count is lost).
+	*
+	* @note Can be used from any context.
+	*/
+	class RateLimiter
+	{
+		struct Slot
+		{
+			const void *key = nullptr;
+			uint32_t refill = 0;		// The tick of the last refill
+			uint32_t seen = 0;			// The tick of the last message
+			uint16_t tokens = 0;
+			uint16_t suppressed = 0;
+		};
+		
+		Slot m_slots[STM32T_LOG_RATE_SLOTS];
+		volatile uint32_t m_suppressed = 0, m_evicted = 0;
+		
+	public:
+		const uint16_t burst;
+		const uint32_t period;
+		
+		/**
+		* @param burst - The number of messages a site can log at once.
+		* @param period - The time (ms) it takes to get back one message.
+		*/
+		RateLimiter(const uint16_t burst, const uint32_t period) : burst(burst), period(period) {}
+		
+		RateLimiter(const RateLimiter&) = delete;
+		RateLimiter& operator=(const RateLimiter&) = delete;
+		
+		/**
+		* @brief Takes a token from the bucket of a site.
+		* @param key - The format string of the site.
+		* @param suppressed - The number of messages of the site suppressed since the last one that got through (0 if it's suppressed).
+		* @retval false if the message must be suppressed.
+		*/
+		bool Allow(const void *const key, uint32_t &suppressed)
+		{
+			const uint32_t now = HAL_GetTick();
+			
+			CriticalSection cs;
+			
+			Slot *slot = nullptr, *oldest = m_slots;
+			for (Slot& it : m_slots)
+			{
+				if (it.key == key)
+				{
+					slot = &it;
+					break;
+				}
+				
+				if (!it.key || (oldest->key && now - it.seen > now - oldest->seen))
+					oldest = &it;
+			}
+			
+			if (!slot)
+			{
+				if (oldest->key)
+					++m_evicted;
+				
+				slot = oldest;
+				*slot = { key, now, now, burst, 0 };
+			}
+			
+			slot->seen = now;
+			
+			if (period)
+			{
+				const uint32_t refills = (now - slot->refill) / period;
+				if (refills)
+				{
+					slot->tokens = std::min<uint32_t>(burst, slot->tokens + refills);
+					slot->refill += refills * period;
+				}
+			}
+			
+			suppressed = 0;
+			
+			if (!slot->tokens)
+			{
+				if (slot->suppressed < UINT16_MAX)
+					++slot->suppressed;
+				
+				++m_suppressed;
+				return false;
+			}
+			
+			if (slot->tokens == burst)	// Full: the refill period starts now.
+				slot->refill = now;
+			
+			--slot->tokens;
+			suppressed = slot->suppressed;
+			slot->suppressed = 0;
+			
+			return true;
+		}
+		
+		/**
+		* @retval The total number of suppressed messages.
+		*/
+		uint32_t Suppressed() const { return m_suppressed; }
+		
+		/**
+		* @retval The number of sites forgotten because all the slots were used.
+		*/
+		uint32_t Evicted() const { return m_evicted; }
+	};
+	
+	/**
+	* @brief The base class of the compile-time format strings made by STM32T_FMT().
+	*/
+	struct FormatTag {};
+	
+	/**
+	* @brief A conversion specification parsed at compile time. "%%" is also a specification (with no arguments).
+	*/
+	struct ConvSpec
+	{
+		size_t text = 0, start = 0, end = 0;	// [text, start): the plain text before the specification, [start, end): the specification
+		size_t arg = 0;							// The index of the first argument used (including field width and precision)
+		char conv = 0;
+		char mod[3] = {};
+		bool plain = true;						// No flags, field width or precision
+		bool star_width = false, star_prec = false;
+		
+		constexpr bool has_mod(const char *m) const { return mod[0] == m[0] && mod[1] == (m[0] ? m[1] : 0); }
+		constexpr size_t arg_count() const { return conv == '%' ? 0 : 1 + star_width + star_prec; }
+		constexpr size_t value_arg() const { return arg + star_width + star_prec; }
+	};
+	
+	template <size_t N>
+	struct ParsedFormat
+	{
+		std::array<ConvSpec, N> specs = {};
+		size_t tail = 0, end = 0;	// [tail, end): the plain text after the last specification
+		size_t args = 0;
+		bool valid = true;
+	};
+	
+	constexpr bool is_one_of(const char ch, const char *set)
+	{
+		for (; *set; set++)
+			if (ch == *set)
+				return true;
+		
+		return false;
+	}
+	
+	constexpr size_t CountConvSpecs(const char *fmt)
+	{
+		size_t count = 0;
+		for (; *fmt; fmt++)
+		{
+			if (*fmt == '%')
+			{
+				count++;
+				if (fmt[1] == '%')
+					fmt++;
+			}
+		}
+		
+		return count;
+	}
+	
+	template <size_t N>
+	constexpr ParsedFormat<N> ParseFormat(const char *fmt)
+	{
+		ParsedFormat<N> ret;
+		
+		size_t i = 0, text = 0;
+		for (size_t n = 0; n < N; n++)
+		{
+			while (fmt[i] != '%')
+				i++;
+			
+			ConvSpec &spec = ret.specs[n];
+			spec.text = text;
+			spec.start = i++;
+			spec.arg = ret.args;
+			
+			for (; is_one_of(fmt[i], "-+ #0"); i++)
+				spec.plain = false;
+			
+			if (fmt[i] == '*')
+			{
+				spec.star_width = true;
+				i++;
+			}
+			
+			for (; fmt[i] >= '0' && fmt[i] <= '9'; i++)
+				spec.plain = false;
+			
+			if (fmt[i] == '.')
+			{
+				spec.plain = false;
+				
+				if (fmt[++i] == '*')
+				{
+					spec.star_prec = true;
+					i++;
+				}
+				
+				while (fmt[i] >= '0' && fmt[i] <= '9')
+					i++;
+			}
+			
+			spec.plain = spec.plain && !spec.star_width;
+			
+			for (size_t m = 0; m < 2 && is_one_of(fmt[i], "hlLzjt"); m++)
+				spec.mod[m] = fmt[i++];
+			
+			spec.conv = fmt[i];
+			if (!spec.conv)
+			{
+				ret.valid = false;
+				return ret;
+			}
+			
+			if (!is_one_of(spec.conv, "diuoxXfFeEgGaAcsp%") || (spec.conv == '%' && i != spec.start + 1))
+				ret.valid = false;
+			
+			spec.end = text = ++i;
+			ret.args += spec.arg_count();
+		}
+		
+		ret.tail = text;
+		while (fmt[i])
+			i++;
+		
+		ret.end = i;
+		return ret;
+	}
+	
+	template <class FMT>
+	inline constexpr auto c_parsedFormat = ParseFormat<CountConvSpecs(FMT::str())>(FMT::str());
+	
+	/**
+	* @brief The specification as a null-terminated string (for snprintf()).
+	*/
+	template <class FMT, size_t I>
+	inline constexpr auto c_convSpecStr = []
+	{
+		constexpr ConvSpec spec = c_parsedFormat<FMT>.specs[I];
+		
+		std::array<char, spec.end - spec.start + 1> str = {};
+		for (size_t i = 0; i < spec.end - spec.start; i++)
+			str[i] = FMT::str()[spec.start + i];
+		
+		return str;
+	}();
+	
+	/**
+	* @brief The specification parsed for the Format functions.
+	*/
+	template <class FMT, size_t I>
+	inline constexpr Format::Spec c_formatSpec = []
+	{
+		const char *p = FMT::str() + c_parsedFormat<FMT>.specs[I].start + 1;
+		return Format::Spec::Parse(p);
+	}();
+	
+	/**
+	* @brief Checks the type of the argument of a conversion specification the same way the compiler checks the arguments of printf().
+	*/
+	template <class T>
+	constexpr bool ArgMatches(const ConvSpec& spec)
+	{
+		using U = std::decay_t<T>;
+		
+		switch (spec.conv)
+		{
+			case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+			{
+				if constexpr (!std::is_integral_v<U> && !std::is_enum_v<U>)
+					return false;
+				else if (spec.has_mod("ll") || spec.has_mod("j"))
+					return sizeof(U) <= sizeof(long long);
+				else if (spec.has_mod("l") || spec.has_mod("z") || spec.has_mod("t"))
+					return sizeof(U) <= sizeof(long);
+				else
+					return sizeof(U) <= sizeof(int);
+			}
+			
+			case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+				return std::is_floating_point_v<U>;
+			
+			case 'c':
+				return std::is_integral_v<U>;
+			
+			case 's':
+				if (spec.has_mod("l"))
+					return std::is_convertible_v<U, const wchar_t *>;
+				else
+					return std::is_convertible_v<U, const char *>;
+			
+			case 'p':
+				return std::is_pointer_v<U> || std::is_null_pointer_v<U>;
+			
+			default:
+				return false;
+		}
+	}
+	
+	#if __cplusplus >= 202002L
+	template <size_t N>
+	struct FixedString
+	{
+		char data[N] = {};
+		
+		constexpr FixedString(const char (&str)[N])
+		{
+			for (size_t i = 0; i < N; i++)
+				data[i] = str[i];
+		}
+	};
+	
+	template <FixedString S>
+	struct FixedFormat : FormatTag
+	{
+		static constexpr const char *str() { return S.data; }
+	};
+	#endif
+	
+	#ifndef STM32T_DEFAULT_LOG_LINE_SIZE
+	#define	STM32T_DEFAULT_LOG_LINE_SIZE	128
+	#endif
+	
+	#ifndef STM32T_LOG_MAX_LEVEL
+	#define	STM32T_LOG_MAX_LEVEL			Level::Max		// Calls above this level are removed from all loggers at compile time.
+	#endif
+	
+	/**
+	* @param OUTPUT_COUNT - The number of outputs
+	* @param LINE_SIZE - The size of the buffer in which a line is assembled before being sent to the outputs. 0 sends every piece of
+	*		the line (prefix, plain text, conversion) to the outputs as soon as it is formatted.
+	*/
+	template <size_t OUTPUT_COUNT = 1, size_t LINE_SIZE = STM32T_DEFAULT_LOG_LINE_SIZE>
 	class Logger
 	{
 	public:
@@ -239,6 +1197,8 @@ namespace STM32T::Log
 		strv name;
 		std::array<output_t, OUTPUT_COUNT> outputs;
 		timestamp_t timestamp = default_timestamp;
+		ModuleLevel *module = nullptr;		// If set, the level is also checked against module->level() at runtime.
+		RateLimiter *limiter = nullptr;		// If set, limits the rate of the messages of each call site.
 		
 		constexpr Logger(Level level, strv name) : level(level), name(name), outputs(std::array{default_output_stdout}) {}
 		constexpr Logger(Level level, strv name, std::array<output_t, OUTPUT_COUNT> outputs) : level(level), name(name), outputs(outputs) {}
@@ -246,12 +1206,34 @@ namespace STM32T::Log
 			level(level), name(name), outputs(outputs), timestamp(timestamp) {}
 		constexpr Logger(Level level, strv name, timestamp_t timestamp) : level(level), name(name), outputs(std::array{default_output_stdout}), timestamp(timestamp) {}
 		
-		constexpr Logger Clone() const { return Logger(level, name, outputs, timestamp); }
-		constexpr Logger Clone(strv name) const { return Logger(level, name, outputs, timestamp); }
+		/**
+		* @param module - The runtime level. level is the highest level compiled in.
+		*/
+		constexpr Logger(ModuleLevel& module, Level level, strv name, std::array<output_t, OUTPUT_COUNT> outputs, timestamp_t timestamp = default_timestamp) :
+			level(level), name(name), outputs(outputs), timestamp(timestamp), module(&module) {}
+		
+		constexpr Logger Clone() const { return *this; }
+		constexpr Logger Clone(strv name) const { Logger copy = *this; copy.name = name; return copy; }
 		constexpr Logger Clone(Level level, strv name) const { return Logger(level, name, outputs, timestamp); }
+		constexpr Logger Clone(ModuleLevel& module, Level level, strv name) const { return Logger(module, level, name, outputs, timestamp); }
+		
+		/**
+		* @retval A copy of this logger whose messages are rate-limited by limiter.
+		*/
+		constexpr Logger Limited(RateLimiter& limiter) const { Logger copy = *this; copy.limiter = &limiter; return copy; }
+		
+		/**
+		* @retval The number of messages suppressed by the rate limiter.
+		*/
+		uint32_t Suppressed() const { return limiter ? limiter->Suppressed() : 0; }
 		
 		constexpr bool isEnabled() const { return level > Level::None; }
-		constexpr bool isEnabled(const Level level) const { return this->level >= level; }
+		constexpr bool isEnabled(const Level level) const { return isCompiled(level) && (!module || module->level() >= level); }
+		
+		/**
+		* @retval false if calls at this level are removed at compile time (above the level of the logger or STM32T_LOG_MAX_LEVEL).
+		*/
+		constexpr bool isCompiled(const Level level) const { return level <= STM32T_LOG_MAX_LEVEL && this->level >= level; }
 		
 		void log(const Level level, const char *fmt, ...) const
 		{
@@ -269,19 +1251,12 @@ namespace STM32T::Log
 			if (!isEnabled(level))
 				return;
 			
-			if (level > Level::None)
-			{
-				if (timestamp)
-					dispatch_format(timestamp());
-				
-				if (level != Level::Max)
-					dispatch_format(LevelStr(level));
-				
-				if (!name.empty())
-					dispatch_format(name);
-				
-				dispatch_chunk(": "sv);
-			}
+			uint32_t suppressed = 0;
+			if (limiter && !limiter->Allow(fmt, suppressed))
+				return;
+			
+			Line line(*this);
+			dispatch_prefix(line, level);
 			
 			size_t written = 0;
 			
@@ -291,7 +1266,7 @@ namespace STM32T::Log
 				if (*p != '%')
 					continue;
 				
-				dispatch_chunk({fmt, (size_t)(p - fmt)});	// dispatch plain text
+				line.put({fmt, (size_t)(p - fmt)});	// dispatch plain text
 				written += p - fmt;
 				
 				const char *const start = p++;
@@ -331,7 +1306,7 @@ namespace STM32T::Log
 						else if (strcmp(modifier, "j") == 0)
 							n = format<intmax_t>(var, sizeof(var), spec, has_field_width, has_precision, args);
 						else if (strcmp(modifier, "z") == 0)
-							n = format<std::make_signed<size_t>>(var, sizeof(var), spec, has_field_width, has_precision, args);
+							n = format<std::make_signed_t<size_t>>(var, sizeof(var), spec, has_field_width, has_precision, args);
 						else if (strcmp(modifier, "t") == 0)
 							n = format<ptrdiff_t>(var, sizeof(var), spec, has_field_width, has_precision, args);
 						else
@@ -351,7 +1326,7 @@ namespace STM32T::Log
 						else if (strcmp(modifier, "z") == 0)
 							n = format<size_t>(var, sizeof(var), spec, has_field_width, has_precision, args);
 						else if (strcmp(modifier, "t") == 0)
-							n = format<std::make_unsigned<ptrdiff_t>>(var, sizeof(var), spec, has_field_width, has_precision, args);
+							n = format<std::make_unsigned_t<ptrdiff_t>>(var, sizeof(var), spec, has_field_width, has_precision, args);
 						else
 							n = format<unsigned int>(var, sizeof(var), spec, has_field_width, has_precision, args);
 						
@@ -386,19 +1361,19 @@ namespace STM32T::Log
 						{
 							if (strcmp(spec, "%s") == 0 || strcmp(spec, "%.*s") == 0)
 							{
-								int precision = INT_MAX;
+								int precision = -1;
 								if (has_precision)
 									precision = va_arg(args, int);
 								
-								if (precision < 0)
-									precision = INT_MAX;
-								
 								const char *buf = va_arg(args, const char *);
-								const size_t len = std::min(std::strlen(buf), size_t(precision));
+								if (!buf)
+									buf = "(null)";
+								
+								const size_t len = Format::string_length(buf, precision);
 								
 								if (len > 0)
 								{
-									dispatch_chunk({buf, len});
+									line.put({buf, len});
 									written += len;
 								}
 							}
@@ -448,7 +1423,7 @@ namespace STM32T::Log
 						if (strcmp(spec, "%%") != 0)	// must match
 							return;
 						
-						dispatch_chunk("%", 1);
+						line.put("%", 1);
 						written++;
 						break;
 					}
@@ -461,43 +1436,322 @@ namespace STM32T::Log
 					return;
 				else if (n > 0)
 				{
-					dispatch_chunk({var, std::min((size_t)n, sizeof(var) - 1)});
+					line.put({var, std::min((size_t)n, sizeof(var) - 1)});
 					written += std::min((size_t)n, sizeof(var) - 1);
 					
 					if (n >= sizeof(var))
 					{
-						dispatch_chunk("..."sv);
+						line.put("..."sv);
 						written += 3;
 					}
 				}
 			}
 			
-			const bool none = level == Level::None;
-			dispatch_chunk({fmt, (size_t)(p - fmt)}, none);
+			dispatch_end(line, level, {fmt, (size_t)(p - fmt)}, suppressed);
+		}
+		
+		/**
+		* @brief Logs with a format string parsed at compile time (see STM32T_FMT()). The argument types are checked at compile time and
+		*		no parsing is done at runtime.
+		*/
+		template <class FMT, class... Args, std::enable_if_t<std::is_base_of_v<FormatTag, FMT>, int> = 0>
+		void log(const Level level, FMT, const Args&... args) const
+		{
+			constexpr auto &parsed = c_parsedFormat<FMT>;
+			static_assert(parsed.valid, "Invalid or unsupported conversion specification!");
+			static_assert(parsed.args == sizeof...(Args), "Wrong number of arguments!");
 			
-			if (!none)
-				dispatch_chunk("\n"sv, true);
+			if (!isEnabled(level))
+				return;
+			
+			uint32_t suppressed = 0;
+			if (limiter && !limiter->Allow(FMT::str(), suppressed))
+				return;
+			
+			Line line(*this);
+			dispatch_prefix(line, level);
+			
+			const auto arg_tuple = std::forward_as_tuple(args...);
+			dispatch_specs<FMT>(line, arg_tuple, std::make_index_sequence<parsed.specs.size()>());
+			
+			dispatch_end(line, level, {FMT::str() + parsed.tail, parsed.end - parsed.tail}, suppressed);
 		}
 		
-		template <class... Args>
-		void n(const char *fmt, Args... args) const { if (isEnabled()) log(Level::None, fmt, args...); }
+		template <class F, class... Args>
+		void n(F fmt, Args... args) const { if (isEnabled()) log(Level::None, fmt, args...); }
 		
-		template <class... Args>
-		void f(const char *fmt, Args... args) const { log(Level::Fatal, fmt, args...); }
+		template <class F, class... Args>
+		void f(F fmt, Args... args) const { log(Level::Fatal, fmt, args...); }
 		
-		template <class... Args>
-		void e(const char *fmt, Args... args) const { log(Level::Error, fmt, args...); }
+		template <class F, class... Args>
+		void e(F fmt, Args... args) const { log(Level::Error, fmt, args...); }
 		
-		template <class... Args>
-		void w(const char *fmt, Args... args) const { log(Level::Warning, fmt, args...); }
+		template <class F, class... Args>
+		void w(F fmt, Args... args) const { log(Level::Warning, fmt, args...); }
 		
-		template <class... Args>
-		void i(const char *fmt, Args... args) const { log(Level::Info, fmt, args...); }
+		template <class F, class... Args>
+		void i(F fmt, Args... args) const { log(Level::Info, fmt, args...); }
 		
-		template <class... Args>
-		void d(const char *fmt, Args... args) const { log(Level::Debug, fmt, args...); }
+		template <class F, class... Args>
+		void d(F fmt, Args... args) const { log(Level::Debug, fmt, args...); }
 		
 	private:
+		/**
+		* @brief Collects the chunks of a line so that each output receives a single write per line (or per LINE_SIZE bytes for longer
+		*		lines). Kept on the stack of the log() call so logging from ISRs is still safe.
+		*/
+		class Line
+		{
+			const Logger &m_logger;
+			char m_buf[LINE_SIZE ? LINE_SIZE : 1];
+			size_t m_len = 0;
+			bool m_ended = false;
+			
+		public:
+			Line(const Logger &logger) : m_logger(logger) {}
+			
+			~Line()
+			{
+				// The format was invalid and the line was cut short. It's still ended, or outputs like AsyncOutput would wait for the
+				// rest of the message.
+				if (!m_ended)
+					flush(true);
+			}
+			
+			void put(const strv data, const bool last = false)
+			{
+				if (data.size() > LINE_SIZE - m_len)
+				{
+					if (m_len)
+						flush(false);
+					
+					if (data.size() >= LINE_SIZE)
+					{
+						m_logger.dispatch_chunk(data, last);
+						m_ended = last;
+						return;
+					}
+				}
+				
+				std::memcpy(m_buf + m_len, data.data(), data.size());
+				m_len += data.size();
+				
+				if (last)
+					flush(true);
+			}
+			
+			void put(const char *buf, const size_t len, const bool last = false) { put({buf, len}, last); }
+			
+			void flush(const bool last)
+			{
+				m_logger.dispatch_chunk({m_buf, m_len}, last);
+				m_len = 0;
+				m_ended = last;
+			}
+		};
+		
+		void dispatch_prefix(Line &line, const Level level) const
+		{
+			if (level > Level::None)
+			{
+				if (timestamp)
+					dispatch_format(line, timestamp());
+				
+				if (level != Level::Max)
+					dispatch_format(line, LevelStr(level));
+				
+				if (!name.empty())
+					dispatch_format(line, name);
+				
+				line.put(": "sv);
+			}
+		}
+		
+		/**
+		* @brief Sends the text after the last conversion, the number of suppressed messages (if any) and the end of the line.
+		*/
+		void dispatch_end(Line &line, const Level level, const strv tail, const uint32_t suppressed) const
+		{
+			const bool none = level == Level::None;
+			line.put(tail, none && !suppressed);
+			
+			if (suppressed)
+			{
+				char note[32] = " [suppressed ";
+				char *end = Format::utoa(note + 13, suppressed);
+				*end++ = ']';
+				
+				line.put(note, end - note, none);
+			}
+			
+			if (!none)
+				line.put("\n"sv, true);
+		}
+		
+		template <class FMT, class Tuple, size_t... I>
+		void dispatch_specs(Line &line, const Tuple& args, std::index_sequence<I...>) const
+		{
+			(dispatch_spec<FMT, I>(line, args), ...);
+		}
+		
+		template <class FMT, size_t I, class Tuple>
+		void dispatch_spec(Line &line, const Tuple& args) const
+		{
+			static constexpr ConvSpec spec = c_parsedFormat<FMT>.specs[I];
+			
+			if constexpr (spec.start > spec.text)
+				line.put({FMT::str() + spec.text, spec.start - spec.text});
+			
+			if constexpr (spec.conv == '%')
+				line.put("%"sv);
+			else
+			{
+				using T = std::decay_t<std::tuple_element_t<spec.value_arg(), Tuple>>;
+				static_assert(ArgMatches<T>(spec), "Argument type doesn't match the conversion specification!");
+				
+				const T& val = std::get<spec.value_arg()>(args);
+				
+				if constexpr (spec.conv == 's' && (spec.plain || (spec.star_prec && spec.end - spec.start == 4)) && !spec.has_mod("l"))
+				{
+					const char *const str = val ? val : "(null)";
+					int precision = -1;
+					if constexpr (spec.star_prec)
+						precision = std::get<spec.arg>(args);
+					
+					if (const size_t len = Format::string_length(str, precision))
+						line.put({str, len});
+				}
+				else if constexpr (is_one_of(spec.conv, "diuoxX") && spec.plain)
+				{
+					static constexpr int base = spec.conv == 'o' ? 8 : (spec.conv == 'x' || spec.conv == 'X') ? 16 : 10;
+					
+					char var[24];
+					const auto res = Format::to_chars(var, std::end(var), convert<T, FMT, I>(val), base);
+					
+					if constexpr (spec.conv == 'X')
+						for (char *p = var; p != res.ptr; p++)
+							if (*p >= 'a')
+								*p -= 'a' - 'A';
+					
+					line.put({var, size_t(res.ptr - var)});
+				}
+				else
+				{
+					static constexpr auto spec_str = c_convSpecStr<FMT, I>;
+					
+					char var[100];
+					int n = Format::UNSUPPORTED;
+					
+					if constexpr ((is_one_of(spec.conv, "diuoxXc") && !(spec.conv == 'c' && spec.has_mod("l")))
+						|| (is_one_of(spec.conv, "fF") && !spec.has_mod("L")))
+					{
+						Format::Spec fs = c_formatSpec<FMT, I>;
+						
+						if constexpr (spec.star_width)
+							fs.SetWidth(int(std::get<spec.arg>(args)));
+						
+						if constexpr (spec.star_prec)
+							fs.precision = int(std::get<spec.arg + spec.star_width>(args));
+						
+						if constexpr (spec.conv == 'f' || spec.conv == 'F')
+							n = Format::fixed(var, sizeof(var), convert<T, FMT, I>(val), fs);
+						else
+							n = Format::integer(var, sizeof(var), convert<T, FMT, I>(val), fs);
+					}
+					
+					if (n == Format::UNSUPPORTED)
+					{
+						if constexpr (spec.star_width && spec.star_prec)
+							n = snprintf(var, sizeof(var), spec_str.data(), int(std::get<spec.arg>(args)), int(std::get<spec.arg + 1>(args)),
+								convert<T, FMT, I>(val));
+						else if constexpr (spec.star_width || spec.star_prec)
+							n = snprintf(var, sizeof(var), spec_str.data(), int(std::get<spec.arg>(args)), convert<T, FMT, I>(val));
+						else
+							n = snprintf(var, sizeof(var), spec_str.data(), convert<T, FMT, I>(val));
+					}
+					
+					if (n > 0)
+					{
+						line.put({var, std::min((size_t)n, sizeof(var) - 1)});
+						
+						if (n >= sizeof(var))
+							line.put("..."sv);
+					}
+				}
+			}
+		}
+		
+		/**
+		* @brief Converts an argument to the exact type expected by the conversion specification.
+		*/
+		template <class T, class FMT, size_t I>
+		static auto convert(const T& val)
+		{
+			constexpr ConvSpec spec = c_parsedFormat<FMT>.specs[I];
+			
+			if constexpr (spec.conv == 'd' || spec.conv == 'i')
+			{
+				if constexpr (spec.has_mod("ll"))
+					return (long long)val;
+				else if constexpr (spec.has_mod("l"))
+					return (long)val;
+				else if constexpr (spec.has_mod("j"))
+					return (intmax_t)val;
+				else if constexpr (spec.has_mod("z"))
+					return (std::make_signed_t<size_t>)val;
+				else if constexpr (spec.has_mod("t"))
+					return (ptrdiff_t)val;
+				else if constexpr (spec.has_mod("h"))
+					return (short)val;
+				else if constexpr (spec.has_mod("hh"))
+					return (signed char)val;
+				else
+					return (int)val;
+			}
+			else if constexpr (is_one_of(spec.conv, "uoxX"))
+			{
+				if constexpr (spec.has_mod("ll"))
+					return (unsigned long long)val;
+				else if constexpr (spec.has_mod("l"))
+					return (unsigned long)val;
+				else if constexpr (spec.has_mod("j"))
+					return (uintmax_t)val;
+				else if constexpr (spec.has_mod("z"))
+					return (size_t)val;
+				else if constexpr (spec.has_mod("t"))
+					return (std::make_unsigned_t<ptrdiff_t>)val;
+				else if constexpr (spec.has_mod("h"))
+					return (unsigned short)val;
+				else if constexpr (spec.has_mod("hh"))
+					return (unsigned char)val;
+				else
+					return (unsigned int)val;
+			}
+			else if constexpr (is_one_of(spec.conv, "fFeEgGaA"))
+			{
+				if constexpr (spec.has_mod("L"))
+					return (long double)val;
+				else
+					return (double)val;
+			}
+			else if constexpr (spec.conv == 'c')
+			{
+				if constexpr (spec.has_mod("l"))
+					return (wint_t)val;
+				else
+					return (int)val;
+			}
+			else if constexpr (spec.conv == 's')
+			{
+				if constexpr (spec.has_mod("l"))
+					return (const wchar_t *)val;
+				else
+					return (const char *)val;
+			}
+			else
+				return (const void *)val;
+		}
+		
 		void dispatch_chunk(const char *buf, size_t len, bool last = false) const
 		{
 			for (auto out : outputs)
@@ -512,11 +1766,11 @@ namespace STM32T::Log
 					out(data, last);
 		}
 		
-		void dispatch_format(strv format) const
+		void dispatch_format(Line &line, strv format) const
 		{
-			dispatch_chunk("["sv);
-			dispatch_chunk(format);
-			dispatch_chunk("]"sv);
+			line.put("["sv);
+			line.put(format);
+			line.put("]"sv);
 		}
 		
 		static bool extract_conv_spec(const char *chars, char *spec, size_t spec_len, const char * &p)
@@ -534,25 +1788,55 @@ namespace STM32T::Log
 			return *p != '\0';
 		}
 		
+		// A va_list parameter decays to a pointer on some ABIs (e.g. x86-64), so it's passed on as a reference to the decayed type.
+		using va_list_ref = std::decay_t<va_list>&;
+		
 		template <typename T>
-		static int format(char *const var, const size_t var_len, const char *const spec, const bool has_field_width, const bool has_precision, va_list& args)
+		static int format(char *const var, const size_t var_len, const char *const spec, const bool has_field_width, const bool has_precision, va_list_ref args)
 		{
-			int field_width;
+			int field_width = 0;
 			if (has_field_width)
 				field_width = va_arg(args, int);
 			
-			int precision;
+			int precision = -1;
 			if (has_precision)
 				precision = va_arg(args, int);
 			
+			const T val = va_arg(args, T);
+			
+			// Integers and f/F conversions don't need snprintf(). h and hh are left to snprintf() since val isn't converted here.
+			if constexpr (std::is_integral_v<T> || std::is_same_v<T, double>)
+			{
+				const char *p = spec + 1;
+				Format::Spec fs = Format::Spec::Parse(p);
+				
+				if (has_field_width)
+					fs.SetWidth(field_width);
+				
+				if (has_precision)
+					fs.precision = precision;
+				
+				if (!fs.HasMod("h") && !fs.HasMod("hh"))
+				{
+					int n;
+					if constexpr (std::is_integral_v<T>)
+						n = Format::integer(var, var_len, val, fs);
+					else
+						n = Format::fixed(var, var_len, val, fs);
+					
+					if (n != Format::UNSUPPORTED)
+						return n;
+				}
+			}
+			
 			if (has_field_width && has_precision)
-				return snprintf(var, var_len, spec, field_width, precision, va_arg(args, T));
+				return snprintf(var, var_len, spec, field_width, precision, val);
 			else if (has_field_width)
-				return snprintf(var, var_len, spec, field_width, va_arg(args, T));
+				return snprintf(var, var_len, spec, field_width, val);
 			else if (has_precision)
-				return snprintf(var, var_len, spec, precision, va_arg(args, T));
+				return snprintf(var, var_len, spec, precision, val);
 			else
-				return snprintf(var, var_len, spec, va_arg(args, T));
+				return snprintf(var, var_len, spec, val);
 		}
 	};
 	
@@ -584,45 +1868,71 @@ namespace STM32T::Log
 		return g_defaultLogger.isEnabled(level);
 	}
 	
-	template <auto& logger, const Level level, class... Args>
-	[[gnu::always_inline]] void _LOG(const char *fmt, Args... args)
+	template <auto& logger, const Level level, class F, class... Args>
+	[[gnu::always_inline]]
+	inline void _LOG(F fmt, Args... args)
 	{
-		if constexpr (logger.isEnabled(level))
-			logger.log(level, fmt, args...);
+		if constexpr (logger.isCompiled(level))
+			if (logger.isEnabled(level))		// Inline, so that a call below the module level doesn't cost a call to log()
+				logger.log(level, fmt, args...);
 	}
 	
 	
 	
-	template <const Level level = Level::None, auto& logger = g_defaultLogger, class... Args>
+	template <const Level level = Level::None, auto& logger = g_defaultLogger, class F, class... Args>
 	[[gnu::always_inline]]
-	inline void LOG_N(const char *fmt, Args... args)
+	inline void LOG_N(F fmt, Args... args)
 	{
-		if constexpr (logger.isEnabled() && logger.isEnabled(level))
-			logger.log(Level::None, fmt, args...);
+		if constexpr (logger.isEnabled() && logger.isCompiled(level))
+			if (logger.isEnabled(level))
+				logger.log(Level::None, fmt, args...);
 	}
 	
 	
 	
-	template <auto& logger = g_defaultLogger, class... Args>
-	void LOG_F(const char *fmt, Args... args) { _LOG<logger, Level::Fatal>(fmt, args...); }
+	template <auto& logger = g_defaultLogger, class F, class... Args>
+	void LOG_F(F fmt, Args... args) { _LOG<logger, Level::Fatal>(fmt, args...); }
+	
+	template <auto& logger = g_defaultLogger, class F, class... Args>
+	void LOG_E(F fmt, Args... args) { _LOG<logger, Level::Error>(fmt, args...); }
+	
+	template <auto& logger = g_defaultLogger, class F, class... Args>
+	void LOG_W(F fmt, Args... args) { _LOG<logger, Level::Warning>(fmt, args...); }
 	
-	template <auto& logger = g_defaultLogger, class... Args>
-	void LOG_E(const char *fmt, Args... args) { _LOG<logger, Level::Error>(fmt, args...); }
+	template <auto& logger = g_defaultLogger, class F, class... Args>
+	void LOG_I(F fmt, Args... args) { _LOG<logger, Level::Info>(fmt, args...); }
 	
-	template <auto& logger = g_defaultLogger, class... Args>
-	void LOG_W(const char *fmt, Args... args) { _LOG<logger, Level::Warning>(fmt, args...); }
+	template <auto& logger = g_defaultLogger, class F, class... Args>
+	void LOG_D(F fmt, Args... args) { _LOG<logger, Level::Debug>(fmt, args...); }
 	
-	template <auto& logger = g_defaultLogger, class... Args>
-	void LOG_I(const char *fmt, Args... args) { _LOG<logger, Level::Info>(fmt, args...); }
+	#if __cplusplus >= 202002L
+	template <FixedString S, const Level level = Level::None, auto& logger = g_defaultLogger, class... Args>
+	void LOG_N(Args... args) { LOG_N<level, logger>(FixedFormat<S>{}, args...); }
 	
-	template <auto& logger = g_defaultLogger, class... Args>
-	void LOG_D(const char *fmt, Args... args) { _LOG<logger, Level::Debug>(fmt, args...); }
+	template <FixedString S, auto& logger = g_defaultLogger, class... Args>
+	void LOG_F(Args... args) { _LOG<logger, Level::Fatal>(FixedFormat<S>{}, args...); }
+	
+	template <FixedString S, auto& logger = g_defaultLogger, class... Args>
+	void LOG_E(Args... args) { _LOG<logger, Level::Error>(FixedFormat<S>{}, args...); }
+	
+	template <FixedString S, auto& logger = g_defaultLogger, class... Args>
+	void LOG_W(Args... args) { _LOG<logger, Level::Warning>(FixedFormat<S>{}, args...); }
+	
+	template <FixedString S, auto& logger = g_defaultLogger, class... Args>
+	void LOG_I(Args... args) { _LOG<logger, Level::Info>(FixedFormat<S>{}, args...); }
+	
+	template <FixedString S, auto& logger = g_defaultLogger, class... Args>
+	void LOG_D(Args... args) { _LOG<logger, Level::Debug>(FixedFormat<S>{}, args...); }
+	#endif
 	
 	template <const Level level = Level::None, auto& logger = g_defaultLogger>
 	inline void LOGA(const uint8_t *arr, size_t len, const size_t line_count = 16)
 	{
-		if constexpr (logger.isEnabled() && logger.isEnabled(level))
+		if constexpr (logger.isEnabled() && logger.isCompiled(level))
 		{
+			if (!logger.isEnabled(level))
+				return;
+			
 			while (len)
 			{
 				for (size_t i = 0; len && i < line_count; i++, len--)
@@ -677,7 +1987,7 @@ namespace STM32T::Log
 	template <const Level level = Level::None, auto& logger = g_defaultLogger>
 	inline void Startup()
 	{
-		if constexpr (logger.isEnabled() && logger.isEnabled(level))
+		if constexpr (logger.isEnabled() && logger.isCompiled(level))
 		{
 			LOG_N<level, logger>("\n\n\n--------------------------------------------------------------------------------\nStart!\n");
 			
@@ -2,17 +2,22 @@
 
 #include "../Core/Utils.hpp"
 #include "../Core/strv.hpp"
+#include "../Core/span.hpp"
 #include "../IO.hpp"
 
 
 
 namespace STM32T
 {
+	class W25QStream;
+	
 	/**
 	* @note There are subtle differences between the different W25Q variants. This was written for W25Q128JVSQ but should work on other variants.
 	*/
 	class W25Q
 	{
+		friend class W25QStream;
+		
 	public:
 		using addr_t = uint32_t;
 		
@@ -260,11 +265,45 @@ namespace STM32T
 			return SingleByte(WRITE_ENABLE) and Write(WRITE_STATUS1, NO_ADDRESS, (uint8_t *)&status, 2) and Write(WRITE_STATUS3, NO_ADDRESS, (uint8_t *)(&status) + 2, 1) and BusyWait(15);
 		}
 		
-		bool Erase(const addr_t addr, const ET erase_type)
+		/**
+		* @retval The maximum time (in ms) an erase of this type can take.
+		*/
+		static uint32_t EraseTime(const ET erase_type)
 		{
 			static constexpr uint32_t DELAY[16] = { 400, 0, 1600, 0, 0, 0, 0, 200'000, 2000, 0 };	// lookup table for max delay
 			
-			return SingleByte(WRITE_ENABLE) and Write((CMD)erase_type, addr, nullptr, 0) and BusyWait(DELAY[(uint8_t)erase_type & 0x0F]);
+			return DELAY[(uint8_t)erase_type & 0x0F];
+		}
+		
+		bool Erase(const addr_t addr, const ET erase_type)
+		{
+			return StartErase(addr, erase_type) and BusyWait(EraseTime(erase_type));
+		}
+		
+		/**
+		* @brief Starts an erase without waiting for it to finish.
+		* @note Any write issued while the erase is in progress is ignored by the chip. Use IsBusy() or WaitReady() first.
+		*/
+		bool StartErase(const addr_t addr, const ET erase_type)
+		{
+			return SingleByte(WRITE_ENABLE) and Write((CMD)erase_type, addr, nullptr, 0);
+		}
+		
+		/**
+		* @retval True if a write or erase is in progress (or the status couldn't be read).
+		*/
+		bool IsBusy()
+		{
+			uint8_t stat;
+			return not Read(READ_STATUS1, &stat, 1) or (stat & 0b1);
+		}
+		
+		/**
+		* @retval False if there was an error or timeout
+		*/
+		bool WaitReady(const uint32_t timeout)
+		{
+			return BusyWait(timeout);
 		}
 		
 		bool ModifySector(const uint16_t sector_num, const uint16_t offset, const uint8_t * const data, const uint16_t len)
@@ -292,4 +331,144 @@ namespace STM32T
 			return ModifySector(sector_num, offset, (uint8_t *)&t, sizeof(t));
 		}
 	};
+	
+	/**
+	* @brief Sequential reader over a W25Q. A single READ_DATA burst is kept open (CS asserted) across reads so the command and address
+	*		are only sent again after a seek, a long skip or close().
+	* @note The W25Q (and the SPI bus) must not be used for anything else while the stream is open. Call close() first.
+	*/
+	class W25QStream
+	{
+		/**
+		* @brief Skipping up to this many bytes is done by clocking out dummy bytes instead of re-issuing the command (1 + 3 bytes).
+		*/
+		static constexpr size_t SKIP_CLOCK_MAX = 4;
+		
+		W25Q &m_flash;
+		W25Q::addr_t m_addr;
+		bool m_open = false;
+		
+		bool open()
+		{
+			if (m_open)
+				return true;
+			
+			const uint8_t cmd[4] = { W25Q::READ_DATA, (uint8_t)(m_addr >> 16), (uint8_t)(m_addr >> 8), (uint8_t)m_addr };
+			
+			m_flash.m_CS.Set();
+			if (HAL_SPI_Transmit(m_flash.p_hspi, (uint8_t *)cmd, sizeof(cmd), HAL_MAX_DELAY) != HAL_OK)
+			{
+				m_flash.m_CS.Reset();
+				return false;
+			}
+			
+			m_open = true;
+			return true;
+		}
+		
+		bool receive(uint8_t *buf, size_t len)
+		{
+			while (len)
+			{
+				const uint16_t chunk = std::min(len, (size_t)UINT16_MAX);
+				if (HAL_SPI_Receive(m_flash.p_hspi, buf, chunk, HAL_MAX_DELAY) != HAL_OK)
+				{
+					close();	// The position of the chip is unknown now.
+					return false;
+				}
+				
+				m_addr += chunk;
+				buf += chunk;
+				len -= chunk;
+			}
+			
+			return true;
+		}
+		
+	public:
+		W25QStream(W25Q& flash, const W25Q::addr_t addr = 0) : m_flash(flash), m_addr(addr) {}
+		~W25QStream() { close(); }
+		
+		W25QStream(const W25QStream&) = delete;
+		W25QStream& operator=(const W25QStream&) = delete;
+		
+		W25Q::addr_t tell() const { return m_addr; }
+		
+		size_t remaining() const { return m_addr > m_flash.c_MaxAddress ? 0 : m_flash.c_MaxAddress - m_addr + 1; }
+		
+		bool is_open() const { return m_open; }
+		
+		/**
+		* @brief Ends the current burst (releases CS). The next read will start a new one at the current position.
+		*/
+		void close()
+		{
+			if (m_open)
+			{
+				m_flash.m_CS.Reset();
+				m_open = false;
+			}
+		}
+		
+		void seek(const W25Q::addr_t addr)
+		{
+			if (addr == m_addr)
+				return;
+			
+			close();
+			m_addr = addr;
+		}
+		
+		/**
+		* @retval True if buf was filled. False if there was an error or if reading would go past the end of the memory.
+		*/
+		bool read(const span<uint8_t> buf)
+		{
+			if (buf.empty())
+				return true;
+			
+			if (buf.size() > remaining() || !open())
+				return false;
+			
+			return receive(buf.data(), buf.size());
+		}
+		
+		bool read(uint8_t * const buf, const size_t len)
+		{
+			return read(span<uint8_t>(buf, len));
+		}
+		
+		template <class T>
+		bool read(T& t)
+		{
+			static_assert(std::is_trivially_copyable_v<T>);
+			
+			return read(reinterpret_cast<uint8_t *>(&t), sizeof(T));
+		}
+		
+		template <class T>
+		std::optional<T> read()
+		{
+			T t;
+			if (!read(t))
+				return std::nullopt;
+			
+			return t;
+		}
+		
+		bool skip(const size_t n)
+		{
+			if (n > remaining())
+				return false;
+			
+			if (!m_open || n > SKIP_CLOCK_MAX)
+			{
+				seek(m_addr + n);
+				return true;
+			}
+			
+			uint8_t dummy[SKIP_CLOCK_MAX];
+			return receive(dummy, n);
+		}
+	};
 }
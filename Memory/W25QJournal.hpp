@@ -0,0 +1,408 @@
+#pragma once
+
+#include "./W25Q.hpp"
+
+
+
+namespace STM32T
+{
+	/**
+	* @brief A circular journal of binary records stored in a range of W25Q sectors. Meant to be used as a log output so that the history
+	*		survives a crash or reset.
+	*
+	*		Every page starts with an 8-byte header (magic, sequence number, CRC) followed by records:
+	*		[len][flags][crc8 of flags and data][data...]. A message (one log line) that doesn't fit in the rest of a page is split into
+	*		several records, all but the last having the CONTINUED flag and all but the first the CONTINUATION flag. Records are collected
+	*		in RAM and a page is only programmed when it is full or when Flush() is called. The sector after the one being written is
+	*		always erased ahead of time, without waiting for the erase to finish.
+	*
+	*		If a page can't be programmed, the journal stays on it (the error is counted in Errors()) and the data that doesn't fit is
+	*		dropped; the next write tries again.
+	*
+	* @note Call Mount() once before writing or reading. Not meant to be written from an ISR.
+	*/
+	class W25QJournal
+	{
+	public:
+		using addr_t = W25Q::addr_t;
+		
+		static constexpr size_t PAGE_SIZE = W25Q::PAGE_SIZE, PAGES_PER_SECTOR = W25Q::SECTOR_SIZE / W25Q::PAGE_SIZE;
+		static constexpr size_t PAGE_HEADER_SIZE = 8, RECORD_HEADER_SIZE = 3, MAX_RECORD_LEN = PAGE_SIZE - PAGE_HEADER_SIZE - RECORD_HEADER_SIZE;
+		
+		enum Flags : uint8_t
+		{
+			CONTINUED		= 1 << 0,	// The message continues in the next record.
+			CONTINUATION	= 1 << 1,	// The record continues the message of the previous one.
+		};
+		
+	private:
+		static constexpr uint16_t MAGIC = 0x4A4C;	// "LJ"
+		static constexpr uint8_t ERASED = 0xFF;
+		static constexpr size_t NO_RECORD = SIZE_MAX;
+		
+		W25Q &m_flash;
+		const uint16_t c_firstSector, c_sectorCount;
+		
+		uint8_t m_page[PAGE_SIZE];
+		size_t m_used = 0, m_closed = 0, m_programmed = 0, m_record = NO_RECORD;
+		uint32_t m_pageIndex = 0, m_seq = 0;
+		uint16_t m_eraseSector = UINT16_MAX;	// Relative sector index to be erased after the next program.
+		bool m_mounted = false;
+		bool m_continued = false;				// The last record closed has the CONTINUED flag.
+		bool m_discard = false;					// The rest of the message is dropped.
+		
+		uint32_t m_dropped = 0, m_programs = 0, m_errors = 0;
+		
+		static uint8_t crc8(const uint8_t *data, size_t len, uint8_t crc = 0)
+		{
+			while (len--)
+			{
+				crc ^= *data++;
+				for (uint8_t i = 0; i < 8; i++)
+					crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+			}
+			
+			return crc;
+		}
+		
+		uint32_t PageCount() const { return c_sectorCount * PAGES_PER_SECTOR; }
+		
+		addr_t PageAddress(const uint32_t page_index) const { return W25Q::Sector(c_firstSector) + page_index * PAGE_SIZE; }
+		
+		addr_t SectorAddress(const uint16_t sector_index) const { return W25Q::Sector(c_firstSector + sector_index); }
+		
+		static std::optional<uint32_t> ParseHeader(const uint8_t * const header)
+		{
+			if (pack_le<uint16_t>(header) != MAGIC || crc8(header, PAGE_HEADER_SIZE - 1) != header[PAGE_HEADER_SIZE - 1])
+				return std::nullopt;
+			
+			return pack_le<uint32_t>(header + 2);
+		}
+		
+		void StartPage()
+		{
+			std::memset(m_page, ERASED, sizeof(m_page));
+			
+			unpack_le<uint16_t>(m_page, MAGIC);
+			unpack_le<uint32_t>(m_page + 2, m_seq);
+			m_page[6] = 0;
+			m_page[7] = crc8(m_page, PAGE_HEADER_SIZE - 1);
+			
+			m_used = m_closed = PAGE_HEADER_SIZE;
+			m_programmed = 0;
+		}
+		
+		/**
+		* @brief Programs the closed records that haven't been programmed yet. The same page may be programmed several times.
+		*/
+		bool Program()
+		{
+			if (m_closed <= m_programmed)
+				return true;
+			
+			// A pending erase-ahead (or the previous program) must be finished or the chip ignores the write.
+			if (!m_flash.WaitReady(W25Q::EraseTime(W25Q::ET::SECTOR)))
+			{
+				++m_errors;
+				return false;
+			}
+			
+			if (!m_flash.WritePage(PageAddress(m_pageIndex) + m_programmed, m_page + m_programmed, m_closed - m_programmed))
+			{
+				++m_errors;
+				return false;
+			}
+			
+			++m_programs;
+			m_programmed = m_closed;
+			
+			if (m_eraseSector != UINT16_MAX)
+			{
+				m_flash.StartErase(SectorAddress(m_eraseSector), W25Q::ET::SECTOR);
+				m_eraseSector = UINT16_MAX;
+			}
+			
+			return true;
+		}
+		
+		/**
+		* @retval false if the page couldn't be programmed: it stays the current one.
+		*/
+		bool NextPage()
+		{
+			if (!Program())
+				return false;
+			
+			m_pageIndex = (m_pageIndex + 1) % PageCount();
+			++m_seq;
+			
+			if (m_pageIndex % PAGES_PER_SECTOR == 0)
+			{
+				const uint16_t sector = m_pageIndex / PAGES_PER_SECTOR;
+				
+				if (m_eraseSector == sector)	// Nothing was programmed since the erase-ahead was scheduled.
+					m_flash.StartErase(SectorAddress(sector), W25Q::ET::SECTOR);
+				
+				m_eraseSector = (sector + 1) % c_sectorCount;
+			}
+			
+			StartPage();
+			return true;
+		}
+		
+		void CloseRecord(const bool continued)
+		{
+			if (m_record == NO_RECORD)
+				return;
+			
+			const size_t len = m_used - m_record - RECORD_HEADER_SIZE;
+			if (len == 0)
+				m_used = m_record;
+			else
+			{
+				uint8_t * const rec = m_page + m_record;
+				rec[0] = len;
+				rec[1] = (continued ? CONTINUED : 0) | (m_continued ? CONTINUATION : 0);
+				rec[2] = crc8(rec + RECORD_HEADER_SIZE, len, crc8(rec + 1, 1));
+				
+				m_closed = m_used;
+				m_continued = continued;
+			}
+			
+			m_record = NO_RECORD;
+		}
+		
+		bool IsBlank(const addr_t addr, const size_t len)
+		{
+			W25QStream stream(m_flash, addr);
+			
+			for (size_t i = 0; i < len; i++)
+			{
+				uint8_t b;
+				if (!stream.read(b) || b != ERASED)
+					return false;
+			}
+			
+			return true;
+		}
+		
+	public:
+		/**
+		* @param first_sector - The first sector of the journal.
+		* @param sector_count - The number of sectors used by the journal. Must be at least 2 (one is always kept erased).
+		*/
+		W25QJournal(W25Q& flash, const uint16_t first_sector, const uint16_t sector_count) : m_flash(flash), c_firstSector(first_sector),
+			c_sectorCount(sector_count) {}
+		
+		/**
+		* @brief Finds the end of the journal and prepares the next page for writing. Must be called before any other method.
+		* @note Might block for a sector erase if the journal is empty or the previous session was cut during an erase.
+		*/
+		bool Mount()
+		{
+			if (c_sectorCount < 2)
+				return false;
+			
+			std::optional<uint32_t> head;
+			uint32_t max_seq = 0;
+			
+			for (uint32_t i = 0; i < PageCount(); i++)
+			{
+				uint8_t header[PAGE_HEADER_SIZE];
+				if (!m_flash.ReadData(PageAddress(i), header, sizeof(header)))
+					return false;
+				
+				const auto seq = ParseHeader(header);
+				if (seq && (!head || int32_t(*seq - max_seq) > 0))
+				{
+					head = i;
+					max_seq = *seq;
+				}
+			}
+			
+			m_pageIndex = head ? (*head + 1) % PageCount() : 0;
+			m_seq = head ? max_seq + 1 : 0;
+			
+			// Skip pages that were being programmed when power was lost.
+			while (m_pageIndex % PAGES_PER_SECTOR != 0 && !IsBlank(PageAddress(m_pageIndex), PAGE_SIZE))
+			{
+				m_pageIndex = (m_pageIndex + 1) % PageCount();
+				++m_seq;
+			}
+			
+			const uint16_t sector = m_pageIndex / PAGES_PER_SECTOR;
+			
+			// The erase of this sector might have been cut short.
+			if (m_pageIndex % PAGES_PER_SECTOR == 0 && !m_flash.Erase(SectorAddress(sector), W25Q::ET::SECTOR))
+				return false;
+			
+			m_eraseSector = (sector + 1) % c_sectorCount;
+			m_record = NO_RECORD;
+			m_continued = m_discard = false;
+			StartPage();
+			
+			m_mounted = true;
+			return true;
+		}
+		
+		/**
+		* @brief Appends data to the current message. The message is closed when last_chunk is true.
+		*/
+		void Write(strv data, const bool last_chunk)
+		{
+			if (!m_mounted || m_discard)
+			{
+				++m_dropped;
+				m_discard = m_mounted && !last_chunk;
+				return;
+			}
+			
+			while (!data.empty())
+			{
+				if (m_record == NO_RECORD)
+				{
+					if (PAGE_SIZE - m_used <= RECORD_HEADER_SIZE && !NextPage())
+						break;
+					
+					m_record = m_used;
+					m_used += RECORD_HEADER_SIZE;
+				}
+				
+				const size_t len = std::min(data.size(), PAGE_SIZE - m_used);
+				std::memcpy(m_page + m_used, data.data(), len);
+				m_used += len;
+				data.remove_prefix(len);
+				
+				if (!data.empty())	// page full
+				{
+					CloseRecord(true);
+					
+					if (!NextPage())
+						break;
+				}
+			}
+			
+			if (!data.empty())
+			{
+				// The page couldn't be programmed. The records of the message already closed end it (Read() sees it's cut short).
+				++m_dropped;
+				m_continued = false;
+				m_discard = !last_chunk;
+			}
+			else if (last_chunk)
+				CloseRecord(false);
+		}
+		
+		/**
+		* @brief Programs all closed records to the flash. Unclosed messages are kept in RAM.
+		*/
+		bool Flush()
+		{
+			return m_mounted && Program();
+		}
+		
+		/**
+		* @brief Reads the journal from the oldest record to the newest and passes the messages to handler in the same way a log output
+		*		receives them, so that an output_t can be used directly. Only the data in flash is read; call Flush() first to include
+		*		the records in RAM.
+		*
+		*		A message whose continuation is missing (a damaged or skipped page, or a page that couldn't be programmed) ends with an
+		*		empty last chunk. The records that continue a message whose beginning is missing (overwritten) are skipped.
+		* @param handler - Called as handler(strv data, bool last_chunk).
+		* @retval The number of records read.
+		*/
+		template <class F>
+		size_t Read(F&& handler)
+		{
+			if (!m_mounted || !m_flash.WaitReady(W25Q::EraseTime(W25Q::ET::SECTOR)))
+				return 0;
+			
+			size_t count = 0;
+			bool open = false;		// The last record passed to handler has the CONTINUED flag.
+			uint32_t next_seq = 0;
+			
+			const auto cut = [&]()
+			{
+				if (open)
+					handler(strv(), true);
+				
+				open = false;
+			};
+			
+			for (uint32_t n = 1; n <= PageCount(); n++)
+			{
+				const uint32_t index = (m_pageIndex + n) % PageCount();
+				
+				uint8_t page[PAGE_SIZE];
+				if (index == m_pageIndex)
+				{
+					if (!m_programmed)
+						break;
+					
+					std::memcpy(page, m_page, m_programmed);
+					std::memset(page + m_programmed, ERASED, PAGE_SIZE - m_programmed);
+				}
+				else if (!m_flash.ReadData(PageAddress(index), page, PAGE_SIZE))
+					break;
+				
+				const std::optional<uint32_t> seq = ParseHeader(page);
+				if (!seq || *seq != next_seq)
+					cut();		// The page that continued the message is missing.
+				
+				if (!seq)
+					continue;
+				
+				next_seq = *seq + 1;
+				
+				for (size_t pos = PAGE_HEADER_SIZE; pos + RECORD_HEADER_SIZE < PAGE_SIZE;)
+				{
+					const uint8_t * const rec = page + pos;
+					const size_t len = rec[0];
+					
+					if (len == 0 || len == ERASED || pos + RECORD_HEADER_SIZE + len > PAGE_SIZE
+						|| crc8(rec + RECORD_HEADER_SIZE, len, crc8(rec + 1, 1)) != rec[2])
+						break;		// End of page or a record damaged by a power cut.
+					
+					pos += RECORD_HEADER_SIZE + len;
+					
+					if (!(rec[1] & CONTINUATION))
+						cut();
+					else if (!open)
+						continue;		// The beginning of the message is missing.
+					
+					open = rec[1] & CONTINUED;
+					handler(strv(reinterpret_cast<const char *>(rec + RECORD_HEADER_SIZE), len), !open);
+					
+					++count;
+				}
+			}
+			
+			cut();
+			return count;
+		}
+		
+		/**
+		* @retval The number of chunks dropped (entirely or partly) because the journal wasn't mounted or a page couldn't be programmed.
+		*/
+		uint32_t Dropped() const { return m_dropped; }
+		
+		/**
+		* @retval The number of failed page programs.
+		*/
+		uint32_t Errors() const { return m_errors; }
+		
+		/**
+		* @retval The number of page programs done since Mount().
+		*/
+		uint32_t Programs() const { return m_programs; }
+		
+		/**
+		* @brief A log output (STM32T::Log::output_t) writing to journal.
+		*/
+		template <W25QJournal& journal>
+		static void Output(strv data, bool last_chunk)
+		{
+			journal.Write(data, last_chunk);
+		}
+	};
+}
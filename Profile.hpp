@@ -0,0 +1,249 @@
+#pragma once
+
+#include "./Log.hpp"
+#include "./Core/Time.hpp"
+#include "./Core/Utils.hpp"
+
+
+
+#ifndef STM32T_PROFILE_ENABLE
+#define	STM32T_PROFILE_ENABLE	1
+#endif
+
+#ifndef STM32T_PROFILE_CYCLES
+#define	STM32T_PROFILE_CYCLES()	STM32T::Time::GetCycle()		// Can be replaced with a mock cycle counter (e.g. in host tests).
+#endif
+
+#ifndef STM32T_PROFILE_BUCKETS
+#define	STM32T_PROFILE_BUCKETS	24
+#endif
+
+#define	_STM32T_PROFILE_CAT2(A, B)	A##B
+#define	_STM32T_PROFILE_CAT(A, B)	_STM32T_PROFILE_CAT2(A, B)
+
+/**
+* @brief Profiles the rest of the enclosing scope as the zone NAME (a string literal). Removed entirely if STM32T_PROFILE_ENABLE is 0.
+*/
+#if STM32T_PROFILE_ENABLE
+#define STM32T_PROFILE(NAME) \
+	static STM32T::Profile::Zone _STM32T_PROFILE_CAT(_stm32t_zone_, __LINE__)(NAME); \
+	const STM32T::Profile::Scope _STM32T_PROFILE_CAT(_stm32t_scope_, __LINE__)(_STM32T_PROFILE_CAT(_stm32t_zone_, __LINE__))
+#else
+#define STM32T_PROFILE(NAME)	((void)0)
+#endif
+
+
+
+namespace STM32T::Profile
+{
+	using Time::cycle_t;
+	
+	static constexpr size_t BUCKETS = STM32T_PROFILE_BUCKETS;
+	static_assert(BUCKETS >= 2 && BUCKETS <= 33, "STM32T_PROFILE_BUCKETS must be between 2 and 33!");
+	
+	/**
+	* @brief The statistics of a profiled zone: count, min, max, total and a log2 histogram of the cycles spent in it. Bucket 0 counts
+	*		0 cycles, bucket i counts [2^(i-1), 2^i) cycles and the last bucket also counts everything above.
+	*		A zone links itself into the zone list the first time it is used, so it can be constant-initialized (no guard variable).
+	*
+	* @note Must have static storage duration. A zone must not be entered from different contexts (e.g. main and an ISR) at the same
+	*		time, otherwise its statistics may be slightly off.
+	*/
+	class Zone
+	{
+		const char *const c_name;
+		Zone *m_next = nullptr;
+		bool m_linked = false;
+		
+		uint32_t m_count = 0, m_min = UINT32_MAX, m_max = 0;
+		uint64_t m_total = 0;
+		uint32_t m_hist[BUCKETS] = {};
+		
+		static inline Zone *s_first = nullptr;
+		static inline cycle_t s_bias = 0;
+		
+		void link()
+		{
+			CriticalSection cs;
+			
+			if (m_linked)
+				return;
+			
+			m_next = s_first;
+			s_first = this;
+			m_linked = true;
+		}
+		
+	public:
+		constexpr Zone(const char *name) : c_name(name) {}
+		
+		Zone(const Zone&) = delete;
+		Zone& operator=(const Zone&) = delete;
+		
+		static constexpr size_t Bucket(const cycle_t cycles)
+		{
+			return cycles ? std::min<size_t>(32 - __builtin_clz(cycles), BUCKETS - 1) : 0;
+		}
+		
+		/**
+		* @brief Records one pass through the zone. The bias measured by Calibrate() is subtracted from cycles.
+		*/
+		void add(cycle_t cycles)
+		{
+			if (!m_linked)
+				link();
+			
+			cycles = cycles > s_bias ? cycles - s_bias : 0;
+			
+			m_count++;
+			m_total += cycles;
+			m_min = std::min(m_min, cycles);
+			m_max = std::max(m_max, cycles);
+			m_hist[Bucket(cycles)]++;
+		}
+		
+		void reset()
+		{
+			m_count = 0;
+			m_min = UINT32_MAX;
+			m_max = 0;
+			m_total = 0;
+			std::fill(std::begin(m_hist), std::end(m_hist), 0);
+		}
+		
+		const char *name() const { return c_name; }
+		uint32_t count() const { return m_count; }
+		cycle_t min() const { return m_count ? m_min : 0; }
+		cycle_t max() const { return m_max; }
+		cycle_t mean() const { return m_count ? m_total / m_count : 0; }
+		uint64_t total() const { return m_total; }
+		uint32_t hist(size_t bucket) const { return m_hist[bucket]; }
+		
+		/**
+		* @retval The zone with the given name or nullptr. Zones that haven't been entered yet can't be found.
+		*/
+		static Zone *Find(strv name)
+		{
+			for (Zone *zone = s_first; zone; zone = zone->m_next)
+				if (name == zone->c_name)
+					return zone;
+			
+			return nullptr;
+		}
+		
+		/**
+		* @brief Calls f(Zone&) for every zone that has been entered (the most recently entered first).
+		*/
+		template <class F>
+		static void ForEach(F&& f)
+		{
+			for (Zone *zone = s_first; zone; zone = zone->m_next)
+				f(*zone);
+		}
+		
+		static cycle_t Bias() { return s_bias; }
+		static void SetBias(cycle_t bias) { s_bias = bias; }
+	};
+	
+	/**
+	* @brief Measures the cycles from the constructor to the destructor and adds them to a zone. Use STM32T_PROFILE() instead.
+	*/
+	class Scope
+	{
+		Zone &m_zone;
+		const cycle_t c_start = STM32T_PROFILE_CYCLES();
+		
+	public:
+		[[gnu::always_inline]] Scope(Zone &zone) : m_zone(zone) {}
+		[[gnu::always_inline]] ~Scope() { m_zone.add(STM32T_PROFILE_CYCLES() - c_start); }
+		
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+	};
+	
+	/**
+	* @brief Measures the cycles an empty zone reports (the cost of reading the cycle counter) and subtracts them from every
+	*		measurement from now on.
+	* @param runs - The number of runs; the minimum is kept.
+	* @retval The bias.
+	*/
+	inline cycle_t Calibrate(const uint32_t runs = 64)
+	{
+		Zone::SetBias(0);
+		
+		cycle_t bias = UINT32_MAX;
+		for (uint32_t i = 0; i < runs; i++)
+		{
+			const cycle_t start = STM32T_PROFILE_CYCLES();
+			bias = std::min<cycle_t>(bias, STM32T_PROFILE_CYCLES() - start);
+		}
+		
+		Zone::SetBias(bias);
+		return bias;
+	}
+	
+	/**
+	* @brief Measures the total cost of an empty STM32T_PROFILE() zone (reading the counter twice and updating the statistics).
+	* @retval The cycles per zone.
+	*/
+	inline cycle_t Overhead(const uint32_t runs = 64)
+	{
+		static Zone zone("Profile::Overhead");
+		
+		const cycle_t start = STM32T_PROFILE_CYCLES();
+		for (uint32_t i = 0; i < runs; i++)
+			const Scope scope(zone);
+		
+		const cycle_t cycles = STM32T_PROFILE_CYCLES() - start;
+		zone.reset();
+		
+		return runs ? cycles / runs : 0;
+	}
+	
+	/**
+	* @brief Clears the statistics of all zones.
+	*/
+	inline void Reset()
+	{
+		Zone::ForEach([](Zone& zone) { zone.reset(); });
+	}
+	
+	/**
+	* @brief Logs the statistics of every zone that has been entered since the last Reset(): one line with count, min, mean and max (cycles and us) and one
+	*		line with the non-empty histogram buckets ("<2^i: count" being the passes shorter than 2^i cycles).
+	*/
+	template <class L>
+	void Dump(const L& logger, const Log::Level level = Log::Level::Info)
+	{
+		if (!logger.isEnabled(level))
+			return;
+		
+		logger.log(level, "Profile: bias %lu cycles, overhead %lu cycles/zone", (unsigned long)Zone::Bias(), (unsigned long)Overhead());
+		
+		Zone::ForEach([&logger, level](const Zone& zone)
+		{
+			if (!zone.count())
+				return;
+			
+			logger.log(level, "%s: n=%lu min=%lu mean=%lu max=%lu cycles (mean %lu us)", zone.name(), (unsigned long)zone.count(),
+				(unsigned long)zone.min(), (unsigned long)zone.mean(), (unsigned long)zone.max(), (unsigned long)Time::CyclesTo_us(zone.mean()));
+			
+			char hist[BUCKETS * 20] = "";
+			size_t len = 0;
+			
+			for (size_t i = 0; i < BUCKETS && len < sizeof(hist); i++)
+			{
+				if (!zone.hist(i))
+					continue;
+				
+				const int n = i == BUCKETS - 1 ?
+					Format::format(hist + len, sizeof(hist) - len, " >=2^%u:%lu", unsigned(i - 1), (unsigned long)zone.hist(i)) :
+					Format::format(hist + len, sizeof(hist) - len, " <2^%u:%lu", unsigned(i), (unsigned long)zone.hist(i));
+				
+				len += std::max(n, 0);
+			}
+			
+			logger.log(level, "%s: hist%s", zone.name(), hist);
+		});
+	}
+}
@@ -2,81 +2,401 @@
 
 #include "main.h"
 
+#include "./Trace.hpp"
+#include "./Core/Utils.hpp"
+#include "./Core/inplace_function.hpp"
+
 #include <vector>
+#include <optional>
+#include <algorithm>
+
+#ifndef STM32T_RUNNABLE_CAPACITY
+#define	STM32T_RUNNABLE_CAPACITY	16		// The bytes a task can capture
+#endif
+
+#ifndef STM32T_RUNNABLE_STATS
+#define	STM32T_RUNNABLE_STATS		0		// Lateness and execution time statistics of each task
+#endif
+
+#ifndef STM32T_RUNNABLE_CYCLES
+#define	STM32T_RUNNABLE_CYCLES()	STM32T::Time::GetCycle()		// Can be replaced with a simulated clock (e.g. in host builds).
+#endif
+
+#if STM32T_RUNNABLE_STATS
+#include "./Log.hpp"		// Time, Format and Log::Level
+#endif
 
 namespace STM32T
 {
+/**
+* @brief A cooperative scheduler. The tasks are kept in a min-heap ordered by their due tick, so finding the next task is O(1) and
+*		adding or running one is O(log n). Intervals must be shorter than 2^31 ticks.
+*/
 class Runnable
 {
-	void (*p_callable)();
+public:
+	using callable_t = void (*)();
+	using task_t = inplace_function<void(), STM32T_RUNNABLE_CAPACITY>;
+	
+	/**
+	* @brief Refers to a scheduled task. A stale handle (of a task that has finished or was removed) is harmless.
+	*/
+	class Handle
+	{
+		friend class Runnable;
+		
+		uint32_t m_id = 0;
+		
+		constexpr Handle(const uint32_t id) : m_id(id) {}
+		
+	public:
+		constexpr Handle() = default;
+		
+		explicit operator bool() const { return m_id != 0; }
+		bool operator==(const Handle& other) const { return m_id == other.m_id; }
+		bool operator!=(const Handle& other) const { return m_id != other.m_id; }
+	};
+	
+	/**
+	* @brief Sleeps for at most TICKS ticks (UINT32_MAX: no limit) or until an interrupt. Called with the interrupts disabled
+	*		(PRIMASK), which still wake the core up from WFI/WFE.
+	* @retval The ticks slept that the HAL tick didn't count (e.g. measured with the RTC or an LPTIM in STOP mode), or 0.
+	*/
+	using sleep_t = uint32_t (*)(uint32_t ticks);
+	using compensate_t = void (*)(uint32_t ticks);
+	
+#if STM32T_RUNNABLE_STATS
+	/**
+	* @brief The timing statistics of a task. The lateness is the tick it ran at minus the tick it was due at.
+	*/
+	struct Stats
+	{
+		static constexpr size_t BUCKETS = 8;
+		
+		uint32_t runs = 0;
+		uint32_t late = 0;			// The runs with a lateness above 0
+		uint32_t overruns = 0;		// The runs of a repeated task that were late by its interval or more (a period was missed)
+		uint32_t maxLateness = 0;
+		uint64_t totalLateness = 0;
+		Time::cycle_t minCycles = UINT32_MAX, maxCycles = 0;
+		uint64_t totalCycles = 0;
+		uint32_t hist[BUCKETS] = {};		// The lateness: 0, 1, 2-3, 4-7... and 64 or more ticks
+		
+		void add(const uint32_t lateness, const uint32_t interval, const Time::cycle_t cycles)
+		{
+			runs++;
+			late += lateness > 0;
+			overruns += interval && lateness >= interval;
+			maxLateness = std::max(maxLateness, lateness);
+			totalLateness += lateness;
+			
+			minCycles = std::min(minCycles, cycles);
+			maxCycles = std::max(maxCycles, cycles);
+			totalCycles += cycles;
+			
+			hist[lateness ? std::min<size_t>(32 - __builtin_clz(lateness), BUCKETS - 1) : 0]++;
+		}
+		
+		uint32_t meanLateness() const { return runs ? totalLateness / runs : 0; }
+		Time::cycle_t meanCycles() const { return runs ? totalCycles / runs : 0; }
+	};
+	
+#endif
+private:
+	task_t m_task;
+	callable_t p_callable;		// The key of Remove(), Refresh() and Advance(); nullptr if the task isn't a function pointer.
 	uint32_t c_interval;
-	uint32_t m_lastTime;
+	uint32_t m_due;
+	uint32_t m_seq;		// Orders the tasks that are due at the same tick (first added or run, first served).
+	uint32_t c_id;
 	bool c_repeat;
+#if STM32T_RUNNABLE_STATS
+	Stats m_stats;
+#endif
 	
-	Runnable(void (*callable)(), uint32_t interval, uint32_t last_time, bool repeat)
-		: p_callable(callable), c_interval(interval), m_lastTime(last_time), c_repeat(repeat) {}
+	Runnable(task_t&& task, callable_t callable, uint32_t interval, uint32_t last_time, bool repeat)
+		: m_task(std::move(task)), p_callable(callable), c_interval(interval), m_due(last_time + interval), m_seq(0),
+		c_id(nextId()), c_repeat(repeat) {}
 	
-	static inline std::vector<Runnable> s_list;
-	static inline size_t s_lastIndex = 0;
+	static inline std::vector<Runnable> s_list;		// Min-heap
+	static inline uint32_t s_seq = 0, s_id = 1;
 	
-public:
-	using callable_t = void (*)();
+	// The task being run (it isn't in s_list meanwhile) and what the callable did to it.
+	static inline Runnable *s_running = nullptr;
+	static inline bool s_runningRemoved = false, s_runningRescheduled = false;
 	
-	static void Init()
+	static inline uint32_t (*s_sleep)(uint32_t ticks) = nullptr;
+	static inline void (*s_compensate)(uint32_t ticks) = nullptr;
+	static inline uint32_t s_minSleep = 1;
+	
+	static bool before(const Runnable& a, const Runnable& b)
 	{
-		s_list.reserve(8);
+		const int32_t diff = int32_t(a.m_due - b.m_due);
+		return diff < 0 || (diff == 0 && int32_t(a.m_seq - b.m_seq) < 0);
 	}
 	
-	static void Do(callable_t callable, uint32_t delay = 0)
+	static void siftUp(size_t i)
 	{
-		s_list.push_back({callable, delay, HAL_GetTick(), false});
+		while (i > 0)
+		{
+			const size_t parent = (i - 1) / 2;
+			if (!before(s_list[i], s_list[parent]))
+				break;
+			
+			std::swap(s_list[i], s_list[parent]);
+			i = parent;
+		}
 	}
 	
-	[[deprecated("Use Do().")]]
-	static void DoAfter(callable_t callable, uint32_t interval)
+	static void siftDown(size_t i)
 	{
-		s_list.push_back({callable, interval, HAL_GetTick(), false});
+		for (;;)
+		{
+			const size_t left = 2 * i + 1, right = left + 1;
+			size_t min = i;
+			
+			if (left < s_list.size() && before(s_list[left], s_list[min]))
+				min = left;
+			
+			if (right < s_list.size() && before(s_list[right], s_list[min]))
+				min = right;
+			
+			if (min == i)
+				break;
+			
+			std::swap(s_list[i], s_list[min]);
+			i = min;
+		}
 	}
 	
-	static void Repeat(callable_t callable, uint32_t interval)
+	/**
+	* @brief Restores the heap after the due tick of s_list[i] has changed.
+	*/
+	static void update(const size_t i)
 	{
-		s_list.push_back({callable, interval, HAL_GetTick(), true});
+		siftUp(i);
+		siftDown(i);
 	}
 	
-	static void DoAndRepeat(callable_t callable, uint32_t interval, uint32_t delay = 0)
+	static uint32_t nextId()
 	{
-		s_list.push_back({callable, interval, HAL_GetTick() - interval + delay, true});
+		if (s_id == 0)
+			s_id = 1;		// 0 is the invalid handle.
+		
+		return s_id++;
 	}
 	
-	static void Remove(callable_t callable, const bool all = false)
+	static void push(Runnable&& r)
+	{
+		r.m_seq = s_seq++;
+		s_list.push_back(std::move(r));
+		siftUp(s_list.size() - 1);
+	}
+	
+	template <class F>
+	static Handle add(F&& task, const uint32_t interval, const uint32_t last_time, const bool repeat)
+	{
+		callable_t callable = nullptr;
+		if constexpr (std::is_convertible_v<F, callable_t>)
+			callable = task;
+		
+		Runnable r(task_t(std::forward<F>(task)), callable, interval, last_time, repeat);
+		const Handle handle(r.c_id);
+		push(std::move(r));
+		
+		return handle;
+	}
+	
+	static void erase(const size_t i)
+	{
+		s_list[i] = std::move(s_list.back());
+		s_list.pop_back();
+		
+		if (i < s_list.size())
+			update(i);
+	}
+	
+	static void heapify()
+	{
+		for (size_t i = s_list.size() / 2; i-- > 0;)
+			siftDown(i);
+	}
+	
+	/**
+	* @retval The index of the matching task that is due first, or SIZE_MAX.
+	*/
+	template <class P>
+	static size_t find(P&& match)
+	{
+		size_t index = SIZE_MAX;
+		for (size_t i = 0; i < s_list.size(); i++)
+			if (match(s_list[i]) && (index == SIZE_MAX || before(s_list[i], s_list[index])))
+				index = i;
+		
+		return index;
+	}
+	
+	/**
+	* @brief Removes the matching task that is due first (or all of them).
+	* @retval false if there was no matching task.
+	*/
+	template <class P>
+	static bool remove(P&& match, const bool all)
 	{
-		for (auto it = s_list.cbegin(); it != s_list.cend();)
+		bool found = false;
+		if (s_running && match(*s_running) && !s_runningRemoved)
 		{
-			if (it->p_callable == callable)
-			{
-				it = s_list.erase(it);
-				if (!all)
-					return;
-			}
-			else
-				 ++it;
+			s_runningRemoved = found = true;
+			if (!all)
+				return true;
+		}
+		
+		if (all)
+		{
+			const auto end = std::remove_if(s_list.begin(), s_list.end(), match);
+			found |= end != s_list.end();
+			
+			s_list.erase(end, s_list.end());
+			heapify();
+		}
+		else if (const size_t i = find(match); i != SIZE_MAX)
+		{
+			erase(i);
+			found = true;
 		}
+		
+		return found;
 	}
 	
 	/**
-	* @brief As if the last execution of the callable was now. Refreshes the delay.
+	* @brief Changes the due tick of the matching task that is due first (or all of them) and restores the heap. The running task keeps
+	*		its new due tick when it returns.
+	* @retval false if there was no matching task.
 	*/
-	static void Refresh(callable_t callable, const bool all = false)
+	template <class P, class F>
+	static bool reschedule(P&& match, const bool all, F&& set_due)
 	{
-		for (auto& r : s_list)
+		bool found = false;
+		if (s_running && match(*s_running))
 		{
-			if (r.p_callable == callable)
+			set_due(*s_running);
+			s_runningRescheduled = found = true;
+			if (!all)
+				return true;
+		}
+		
+		if (all)
+		{
+			for (auto& r : s_list)
 			{
-				r.m_lastTime = HAL_GetTick();
-				if (!all)
-					return;
+				if (match(r))
+				{
+					set_due(r);
+					found = true;
+				}
 			}
+			
+			heapify();
 		}
+		else if (const size_t i = find(match); i != SIZE_MAX)
+		{
+			set_due(s_list[i]);
+			update(i);
+			found = true;
+		}
+		
+		return found;
+	}
+	
+	static auto byCallable(const callable_t callable)
+	{
+		return [callable](const Runnable& r) { return r.p_callable == callable; };
+	}
+	
+	static auto byHandle(const Handle handle)
+	{
+		return [id = handle.m_id](const Runnable& r) { return r.c_id == id; };
+	}
+	
+#if STM32T_RUNNABLE_STATS
+	template <class P>
+	static std::optional<Stats> getStats(P&& match)
+	{
+		if (s_running && match(*s_running))
+			return s_running->m_stats;
+		
+		if (const size_t i = find(match); i != SIZE_MAX)
+			return s_list[i].m_stats;
+		
+		return std::nullopt;
+	}
+	
+#endif
+	static void refresh(Runnable& r) { r.m_due = HAL_GetTick() + r.c_interval; }
+	static void advance(Runnable& r) { r.m_due = HAL_GetTick(); }
+	
+public:
+	static void Init()
+	{
+		s_list.reserve(8);
+	}
+	
+	/**
+	* @brief Runs TASK once after DELAY ticks. TASK is a function pointer or any callable that fits in task_t (e.g. a lambda capturing up
+	*		to STM32T_RUNNABLE_CAPACITY bytes), so there can be several instances of the same task with their own state.
+	*/
+	template <class F>
+	static Handle Do(F&& task, uint32_t delay = 0)
+	{
+		return add(std::forward<F>(task), delay, HAL_GetTick(), false);
+	}
+	
+	template <class F>
+	[[deprecated("Use Do().")]]
+	static Handle DoAfter(F&& task, uint32_t interval)
+	{
+		return add(std::forward<F>(task), interval, HAL_GetTick(), false);
+	}
+	
+	template <class F>
+	static Handle Repeat(F&& task, uint32_t interval)
+	{
+		return add(std::forward<F>(task), interval, HAL_GetTick(), true);
+	}
+	
+	template <class F>
+	static Handle DoAndRepeat(F&& task, uint32_t interval, uint32_t delay = 0)
+	{
+		return add(std::forward<F>(task), interval, HAL_GetTick() - interval + delay, true);
+	}
+	
+	/**
+	* @brief Removes the task of the callable that is due first (or all of them).
+	*/
+	static void Remove(callable_t callable, const bool all = false)
+	{
+		remove(byCallable(callable), all);
+	}
+	
+	/**
+	* @retval false if the task has already finished or was removed.
+	*/
+	static bool Remove(const Handle handle)
+	{
+		return remove(byHandle(handle), false);
+	}
+	
+	/**
+	* @brief As if the last execution of the callable was now. Refreshes the delay.
+	*/
+	static void Refresh(callable_t callable, const bool all = false)
+	{
+		reschedule(byCallable(callable), all, refresh);
+	}
+	
+	static bool Refresh(const Handle handle)
+	{
+		return reschedule(byHandle(handle), false, refresh);
 	}
 	
 	/**
@@ -84,43 +404,219 @@ public:
 	*/
 	static void Advance(callable_t callable, const bool all = false)
 	{
-		for (auto& r : s_list)
+		reschedule(byCallable(callable), all, advance);
+	}
+	
+	static bool Advance(const Handle handle)
+	{
+		return reschedule(byHandle(handle), false, advance);
+	}
+	
+	/**
+	* @retval true if the task is scheduled (or running and will be rescheduled).
+	*/
+	static bool IsScheduled(const Handle handle)
+	{
+		if (s_running && s_running->c_id == handle.m_id)
+			return s_running->c_repeat && !s_runningRemoved;
+		
+		return find(byHandle(handle)) != SIZE_MAX;
+	}
+	
+	/**
+	* @retval The tick at which the next task is due (possibly in the past), or nothing if there are no tasks. O(1).
+	*/
+	static std::optional<uint32_t> NextDeadline()
+	{
+		if (s_list.empty())
+			return std::nullopt;
+		
+		return s_list.front().m_due;
+	}
+	
+	/**
+	* @brief Sets how Idle() sleeps. nullptr disables sleeping (the default).
+	* @param compensate: Adds the ticks that the HAL tick missed while sleeping.
+	* @param min_ticks: Doesn't sleep if the next task is due sooner than this (e.g. the wake-up time of STOP mode).
+	*/
+	static void SetIdle(const sleep_t sleep, const compensate_t compensate = AddTicks, const uint32_t min_ticks = 1)
+	{
+		s_sleep = sleep;
+		s_compensate = compensate;
+		s_minSleep = min_ticks;
+	}
+	
+	/**
+	* @brief Sleeps until the next tick or an interrupt. SysTick keeps running, so there is nothing to compensate.
+	*/
+	static uint32_t SleepWFI(uint32_t)
+	{
+		__WFI();
+		return 0;
+	}
+	
+	/**
+	* @brief Adds ticks to the HAL tick.
+	*/
+	static void AddTicks(const uint32_t ticks)
+	{
+		uwTick += ticks;
+	}
+	
+	/**
+	* @brief Sleeps (see SetIdle()) until the next task is due or an interrupt. Call it after Process() in the main loop.
+	* @param deadline: Another deadline to wake up at, if sooner (e.g. TimerWheel::NextDeadline()).
+	*/
+	static void Idle(std::optional<uint32_t> deadline = std::nullopt)
+	{
+		if (!s_sleep)
+			return;
+		
+		CriticalSection cs;		// An interrupt between the check and the sleep still wakes the core up (and runs after this).
+		
+		if (const auto next = NextDeadline(); next && (!deadline || int32_t(*next - *deadline) < 0))
+			deadline = next;
+		
+		uint32_t ticks = UINT32_MAX;
+		if (deadline)
 		{
-			if (r.p_callable == callable)
-			{
-				r.m_lastTime = HAL_GetTick() - r.c_interval;
-				if (!all)
-					return;
-			}
+			const int32_t left = int32_t(*deadline - HAL_GetTick());
+			if (left < int32_t(s_minSleep))
+				return;
+			
+			ticks = left;
 		}
+		
+		if (const uint32_t missed = s_sleep(ticks); missed && s_compensate)
+			s_compensate(missed);
 	}
 	
-	static void ProcessSingle()
+#if STM32T_RUNNABLE_STATS
+	/**
+	* @retval The statistics of the task, or nothing if the handle is stale.
+	*/
+	static std::optional<Stats> GetStats(const Handle handle)
+	{
+		return getStats(byHandle(handle));
+	}
+	
+	/**
+	* @retval The statistics of the task of the callable that is due first, or nothing if there is none.
+	*/
+	static std::optional<Stats> GetStats(callable_t callable)
 	{
-		if (s_lastIndex >= s_list.size())
-			s_lastIndex = 0;
+		return getStats(byCallable(callable));
+	}
+	
+	/**
+	* @brief Clears the statistics of all tasks (except the running one).
+	*/
+	static void ResetStats()
+	{
+		for (auto& r : s_list)
+			r.m_stats = {};
+	}
+	
+	/**
+	* @brief Logs the statistics of every task that has run: one line with the runs, the late runs, the overruns, the lateness (ticks) and
+	*		the execution time (us) and one line with the non-empty lateness histogram buckets.
+	*/
+	template <class L>
+	static void DumpStats(const L& logger, const Log::Level level = Log::Level::Info)
+	{
+		if (!logger.isEnabled(level))
+			return;
 		
-		for (; s_lastIndex < s_list.size(); ++s_lastIndex)
+		const auto dump = [&logger, level](const Runnable& r)
 		{
-			if (const uint32_t now  = HAL_GetTick(); now - s_list[s_lastIndex].m_lastTime >= s_list[s_lastIndex].c_interval)
+			const Stats& stats = r.m_stats;
+			if (!stats.runs)
+				return;
+			
+			logger.log(level, "Runnable #%lu (0x%08lX, every %lu): n=%lu late=%lu overruns=%lu lateness mean=%lu max=%lu, us min=%lu mean=%lu max=%lu",
+				(unsigned long)r.c_id, (unsigned long)uintptr_t(r.p_callable), (unsigned long)(r.c_repeat ? r.c_interval : 0),
+				(unsigned long)stats.runs, (unsigned long)stats.late, (unsigned long)stats.overruns, (unsigned long)stats.meanLateness(),
+				(unsigned long)stats.maxLateness, (unsigned long)Time::CyclesTo_us(stats.minCycles),
+				(unsigned long)Time::CyclesTo_us(stats.meanCycles()), (unsigned long)Time::CyclesTo_us(stats.maxCycles));
+			
+			char hist[Stats::BUCKETS * 16] = "";
+			size_t len = 0;
+			
+			for (size_t i = 0; i < Stats::BUCKETS && len < sizeof(hist); i++)
 			{
-				s_list[s_lastIndex].p_callable();
+				if (!stats.hist[i])
+					continue;
 				
-				if (!s_list[s_lastIndex].c_repeat)
-					s_list.erase(s_list.begin() + s_lastIndex);
-				else
-					s_list[s_lastIndex++].m_lastTime = now;
+				const int n = i == Stats::BUCKETS - 1 ?
+					Format::format(hist + len, sizeof(hist) - len, " >=%u:%lu", 1u << (i - 1), (unsigned long)stats.hist[i]) :
+					Format::format(hist + len, sizeof(hist) - len, " <%u:%lu", 1u << i, (unsigned long)stats.hist[i]);
 				
-				return;
+				len += std::max(n, 0);
 			}
+			
+			logger.log(level, "Runnable #%lu: lateness%s", (unsigned long)r.c_id, hist);
+		};
+		
+		if (s_running)
+			dump(*s_running);
+		
+		for (const auto& r : s_list)
+			dump(r);
+	}
+	
+#endif
+	/**
+	* @brief Runs the task that is due first, if any.
+	* @retval true if a task was run.
+	*/
+	static bool ProcessSingle()
+	{
+		const uint32_t now = HAL_GetTick();
+		
+		if (s_list.empty() || int32_t(now - s_list.front().m_due) < 0)
+			return false;
+		
+		Runnable r = std::move(s_list.front());
+		erase(0);
+		
+		s_running = &r;
+		s_runningRemoved = s_runningRescheduled = false;
+		
+#if STM32T_RUNNABLE_STATS
+		const uint32_t lateness = now - r.m_due;
+		const Time::cycle_t start = STM32T_RUNNABLE_CYCLES();
+#endif
+		
+		{
+			STM32T_TRACE_SCOPE_ARG("Runnable", uintptr_t(r.p_callable));
+			r.m_task();
 		}
+		
+#if STM32T_RUNNABLE_STATS
+		r.m_stats.add(lateness, r.c_repeat ? r.c_interval : 0, STM32T_RUNNABLE_CYCLES() - start);
+#endif
+		
+		s_running = nullptr;
+		
+		if (r.c_repeat && !s_runningRemoved)
+		{
+			if (!s_runningRescheduled)
+				r.m_due = now + r.c_interval;
+			
+			push(std::move(r));
+		}
+		
+		return true;
 	}
 	
+	/**
+	* @brief Runs the tasks that are due, each at most once. The tasks pushed meanwhile (repeated, advanced or added by a task) wait for
+	*		the next call: they are due at the tick Process() was called at or later, so they are ordered after the ones it runs.
+	*/
 	static void Process()
 	{
-		do
-			ProcessSingle();
-		while (s_lastIndex < s_list.size());
+		const uint32_t seq = s_seq;
+		while (!s_list.empty() && int32_t(s_list.front().m_seq - seq) < 0 && ProcessSingle());
 	}
 };
 }
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "./Log.hpp"
+#include "./Core/Cbor.hpp"
+
+
+
+#ifndef STM32T_DEFAULT_TELEMETRY_SIZE
+#define	STM32T_DEFAULT_TELEMETRY_SIZE	64
+#endif
+
+
+
+namespace STM32T::Log
+{
+	/**
+	* @brief A key/value pair of a telemetry record. The value can be a bool, an integer, an enum, a floating-point number or a string.
+	*/
+	template <class T>
+	struct Field
+	{
+		strv key;
+		T value;
+	};
+	
+	template <class T>
+	Field(strv, T) -> Field<T>;
+	
+	/**
+	* @brief Sends typed key/value records (counters, measurements, etc.) encoded in CBOR to the same outputs as the text loggers.
+	*		Telemetry.py finds the records in the output stream and decodes them on the host; the text lines in between are kept.
+	*
+	*		Record: [SYNC][len][CBOR: [name, timestamp, {key: value, ...}]], len being the number of CBOR bytes (at most SIZE - 2).
+	*		Integers take 1 to 9 bytes depending on their value and floating-point numbers are sent as half, single or double
+	*		precision, whichever is the shortest exact one.
+	*
+	* @note Keep the names and keys short: they are sent as text with every record.
+	*/
+	template <size_t OUTPUT_COUNT = 1, size_t SIZE = STM32T_DEFAULT_TELEMETRY_SIZE>
+	class Telemetry
+	{
+		static_assert(SIZE >= 16 && SIZE <= 2 + UINT8_MAX, "SIZE must be between 16 and 257!");
+		
+	public:
+		using stamp_t = uint32_t (*)();
+		
+		static constexpr uint8_t SYNC = 0xA6;		// Not a valid first byte of a UTF-8 character, nor DeferredLogger's SYNC.
+		
+		bool enabled = true;
+		std::array<output_t, OUTPUT_COUNT> outputs;
+		stamp_t timestamp = HAL_GetTick;
+		
+		constexpr Telemetry() : outputs(std::array{default_output_stdout}) {}
+		constexpr Telemetry(std::array<output_t, OUTPUT_COUNT> outputs) : outputs(outputs) {}
+		constexpr Telemetry(std::array<output_t, OUTPUT_COUNT> outputs, stamp_t timestamp) : outputs(outputs), timestamp(timestamp) {}
+		
+		/**
+		* @brief Encodes a record and sends it to the outputs in a single write.
+		* @param name - The name of the record (e.g. "csq"sv).
+		* @param fields - The fields, e.g. Field{"rssi"sv, rssi}.
+		* @retval false if disabled or the record doesn't fit in SIZE bytes (it isn't sent).
+		*/
+		template <class... T>
+		bool send(const strv name, const Field<T>&... fields) const
+		{
+			if (!enabled)
+				return false;
+			
+			uint8_t buf[SIZE];
+			Cbor::Writer cbor(buf + 2, SIZE - 2);
+			
+			cbor.array(3).text(name).uint(timestamp ? timestamp() : 0).map(sizeof...(T));
+			(cbor.text(fields.key).value(fields.value), ...);
+			
+			if (!cbor.ok())
+				return false;
+			
+			buf[0] = SYNC;
+			buf[1] = cbor.size();
+			
+			for (auto out : outputs)
+				if (out)
+					out({reinterpret_cast<const char *>(buf), cbor.size() + 2}, true);
+			
+			return true;
+		}
+	};
+}
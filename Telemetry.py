@@ -0,0 +1,144 @@
+import json
+import struct
+import sys
+import argparse
+
+
+SYNC = 0xA6
+
+
+class CborError(ValueError):
+	pass
+
+def half_to_float(half: int) -> float:
+	exp, mant = (half >> 10) & 0x1F, half & 0x3FF
+	if exp == 0:
+		val = mant * 2.0 ** -24
+	elif exp == 31:
+		val = float("nan") if mant else float("inf")
+	else:
+		val = (1024 + mant) * 2.0 ** (exp - 25)
+	
+	return -val if half & 0x8000 else val
+
+def decode_item(data: bytes, pos: int):
+	"""Decodes the CBOR data item at pos. Returns the value and the position after it."""
+	if pos >= len(data):
+		raise CborError("truncated")
+	
+	initial = data[pos]
+	major, info = initial >> 5, initial & 0x1F
+	pos += 1
+	
+	if major == 7:
+		if info == 20:
+			return False, pos
+		elif info == 21:
+			return True, pos
+		elif info == 22:
+			return None, pos
+		elif info in (25, 26, 27):
+			size = { 25: 2, 26: 4, 27: 8 }[info]
+			if pos + size > len(data):
+				raise CborError("truncated")
+			
+			if info == 25:
+				return half_to_float(struct.unpack_from(">H", data, pos)[0]), pos + size
+			
+			return struct.unpack_from(">f" if info == 26 else ">d", data, pos)[0], pos + size
+		
+		raise CborError(f"unsupported simple value {info}")
+	
+	if info < 24:
+		arg = info
+	elif info <= 27:
+		size = 1 << (info - 24)
+		if pos + size > len(data):
+			raise CborError("truncated")
+		
+		arg = int.from_bytes(data[pos:pos + size], "big")
+		pos += size
+	else:
+		raise CborError("indefinite lengths aren't supported")
+	
+	if major == 0:
+		return arg, pos
+	elif major == 1:
+		return -1 - arg, pos
+	elif major in (2, 3):
+		if pos + arg > len(data):
+			raise CborError("truncated")
+		
+		raw = data[pos:pos + arg]
+		return (raw.hex() if major == 2 else raw.decode("utf-8")), pos + arg
+	elif major == 4:
+		items = []
+		for _ in range(arg):
+			item, pos = decode_item(data, pos)
+			items.append(item)
+		
+		return items, pos
+	elif major == 5:
+		items = {}
+		for _ in range(arg):
+			key, pos = decode_item(data, pos)
+			items[key], pos = decode_item(data, pos)
+		
+		return items, pos
+	else:
+		return decode_item(data, pos)		# Tags are ignored.
+
+def parse_record(data: bytes, i: int):
+	"""Returns the record at i and the position after it, or None if there is no valid record at i."""
+	if i + 2 > len(data) or data[i] != SYNC:
+		return None
+	
+	end = i + 2 + data[i + 1]
+	if end > len(data):
+		return None
+	
+	try:
+		record, pos = decode_item(data[:end], i + 2)
+	except (CborError, UnicodeDecodeError):
+		return None
+	
+	if pos != end or not isinstance(record, list) or len(record) != 3 or not isinstance(record[0], str) \
+		or not isinstance(record[1], int) or not isinstance(record[2], dict):
+		return None
+	
+	return record, end
+
+def decode(data: bytes, output, text: bool):
+	i, start = 0, 0
+	while i < len(data):
+		parsed = parse_record(data, i) if data[i] == SYNC else None
+		if parsed is None:
+			i += 1		# Text (or not a record boundary; resynchronize).
+			continue
+		
+		if text and start < i:
+			output.write(data[start:i].decode("utf-8", errors="replace"))
+		
+		(name, timestamp, fields), i = parsed
+		start = i
+		output.write(json.dumps({ "time": timestamp, "record": name, **fields }) + "\n")
+	
+	if text and start < len(data):
+		output.write(data[start:].decode("utf-8", errors="replace"))
+
+
+parser = argparse.ArgumentParser(formatter_class=argparse.ArgumentDefaultsHelpFormatter,
+	description="Decodes the telemetry records of STM32T::Log::Telemetry as JSON lines.")
+parser.add_argument('-i', metavar='', default='-', help="Input file (the raw log); - for stdin")
+parser.add_argument('-o', metavar='', default='-', help="Output file; - for stdout")
+parser.add_argument('--text', action='store_true', help="Also write the text between the records (the text logs)")
+
+args = parser.parse_args()
+
+output = sys.stdout if args.o == '-' else open(args.o, 'w', encoding="utf-8")
+data = sys.stdin.buffer.read() if args.i == '-' else open(args.i, 'rb').read()
+
+decode(data, output, args.text)
+
+if output is not sys.stdout:
+	output.close()
@@ -0,0 +1,390 @@
+#pragma once
+
+#include "main.h"
+
+#include "./Trace.hpp"
+
+#include <optional>
+
+
+
+namespace STM32T
+{
+	/**
+	* @brief A hierarchical timing wheel for many software timers (timeouts, retries, animations...). Starting, stopping and refreshing
+	*		a timer is O(1) and timers are referred to by handles, so a stale handle (of a timer that has fired or was stopped) is harmless.
+	*		Level L has 64 slots of 64^L ticks; the timers move down a level when their slot is reached. Delays up to 64^LEVELS ticks are
+	*		exact (about 4.6 hours at 1 kHz with 4 levels) and longer ones are re-filed at the top level, up to 2^31 ticks.
+	*
+	*		Process() catches up with HAL_GetTick() in one call, jumping over empty slots, so a long blocking call only delays the timers.
+	*
+	* @note Must not be used from ISRs. The timers that are due at the same tick fire in an unspecified order.
+	*/
+	template <size_t SIZE, size_t LEVELS = 4>
+	class TimerWheel
+	{
+		static_assert(SIZE > 0 && SIZE < 0xFFFF, "SIZE must be between 1 and 65534!");
+		static_assert(LEVELS >= 1 && LEVELS <= 5, "LEVELS must be between 1 and 5!");
+		
+	public:
+		using callable_t = void (*)(void *context);
+		
+		class Handle
+		{
+			friend class TimerWheel;
+			
+			uint32_t m_id = 0;		// Generation << 16 | index; 0 is invalid (generations start at 1).
+			
+			constexpr Handle(const uint32_t id) : m_id(id) {}
+			
+		public:
+			constexpr Handle() = default;
+			
+			explicit operator bool() const { return m_id != 0; }
+			bool operator==(const Handle& other) const { return m_id == other.m_id; }
+			bool operator!=(const Handle& other) const { return m_id != other.m_id; }
+		};
+		
+	private:
+		using index_t = uint16_t;
+		
+		static constexpr index_t NIL = 0xFFFF;
+		static constexpr size_t SLOT_BITS = 6, SLOTS = 1 << SLOT_BITS;
+		static constexpr uint32_t RANGE = uint32_t((uint64_t(1) << (SLOT_BITS * LEVELS)) - 1);		// The longest exact delay
+		
+		enum class State : uint8_t
+		{
+			Free,
+			Pending,
+			Running,
+			Stopped,		// Stopped from its own callable (released when it returns)
+		};
+		
+		struct Timer
+		{
+			callable_t callable;
+			void *context;
+			uint32_t due, interval;
+			index_t next, prev;
+			uint16_t gen = 0;
+			uint16_t slot;		// level * SLOTS + slot
+			State state = State::Free;
+			bool periodic;
+		};
+		
+		Timer m_timers[SIZE];
+		index_t m_heads[LEVELS * SLOTS];
+		uint64_t m_occupied[LEVELS] = {};
+		index_t m_free = 0;
+		index_t m_running = NIL;		// The timer whose callable is running
+		uint32_t m_now;		// The last tick processed
+		size_t m_count = 0;
+		
+		/**
+		* @retval The offset (0 to 63) of the first set bit at or after FROM, going around, or 64 if none.
+		*/
+		static size_t nextSet(const uint64_t bits, const size_t from)
+		{
+			if (!bits)
+				return SLOTS;
+			
+			const uint64_t rotated = from ? (bits >> from) | (bits << (SLOTS - from)) : bits;
+			return __builtin_ctzll(rotated);
+		}
+		
+		/**
+		* @retval The index of the timer of the handle, or NIL if the handle is stale.
+		*/
+		index_t find(const Handle handle) const
+		{
+			const size_t index = handle.m_id & 0xFFFF;
+			if (index >= SIZE)
+				return NIL;
+			
+			const Timer& t = m_timers[index];
+			return t.gen == handle.m_id >> 16 && (t.state == State::Pending || t.state == State::Running) ? index : NIL;
+		}
+		
+		/**
+		* @param min: The minimum delay from m_now; 0 only while moving a slot down, before the level 0 slot of m_now fires.
+		*/
+		void link(const index_t index, const uint32_t min = 1)
+		{
+			Timer& t = m_timers[index];
+			
+			uint32_t delta = t.due - m_now;
+			if (int32_t(delta) < int32_t(min))
+				delta = min;		// Overdue: the next tick
+			else if (delta > RANGE)
+				delta = RANGE;		// Re-filed when its slot is reached
+			
+			size_t level = 0;
+			while (level < LEVELS - 1 && delta >= (uint32_t(1) << (SLOT_BITS * (level + 1))))
+				level++;
+			
+			const size_t slot = ((m_now + delta) >> (SLOT_BITS * level)) & (SLOTS - 1);
+			index_t& head = m_heads[level * SLOTS + slot];
+			
+			t.slot = level * SLOTS + slot;
+			t.prev = NIL;
+			t.next = head;
+			if (head != NIL)
+				m_timers[head].prev = index;
+			
+			head = index;
+			m_occupied[level] |= uint64_t(1) << slot;
+			t.state = State::Pending;
+		}
+		
+		void unlink(const index_t index)
+		{
+			Timer& t = m_timers[index];
+			
+			if (t.prev != NIL)
+				m_timers[t.prev].next = t.next;
+			else if ((m_heads[t.slot] = t.next) == NIL)
+				m_occupied[t.slot / SLOTS] &= ~(uint64_t(1) << (t.slot % SLOTS));
+			
+			if (t.next != NIL)
+				m_timers[t.next].prev = t.prev;
+		}
+		
+		void release(const index_t index)
+		{
+			Timer& t = m_timers[index];
+			
+			t.state = State::Free;
+			if (++t.gen == 0)
+				t.gen = 1;
+			
+			t.next = m_free;
+			m_free = index;
+			m_count--;
+		}
+		
+		/**
+		* @retval The next tick after m_now at which a slot must be processed (a level 0 slot fires or a higher level slot moves down), or
+		*		nothing if there are no timers.
+		*/
+		std::optional<uint32_t> nextEvent() const
+		{
+			std::optional<uint32_t> next;
+			
+			for (size_t level = 0; level < LEVELS; level++)
+			{
+				const uint32_t block = (m_now >> (SLOT_BITS * level)) + 1;
+				const size_t offset = nextSet(m_occupied[level], block & (SLOTS - 1));
+				if (offset == SLOTS)
+					continue;
+				
+				const uint32_t tick = (block + offset) << (SLOT_BITS * level);
+				if (!next || int32_t(tick - *next) < 0)
+					next = tick;
+			}
+			
+			return next;
+		}
+		
+		/**
+		* @brief Processes the tick m_now: moves down the higher level slots that start at it and fires its level 0 slot.
+		*/
+		void processTick()
+		{
+			for (size_t level = LEVELS - 1; level > 0; level--)
+			{
+				if (m_now & ((uint32_t(1) << (SLOT_BITS * level)) - 1))
+					continue;
+				
+				index_t& head = m_heads[level * SLOTS + ((m_now >> (SLOT_BITS * level)) & (SLOTS - 1))];
+				while (head != NIL)
+				{
+					const index_t index = head;
+					unlink(index);
+					link(index, 0);
+				}
+			}
+			
+			index_t& head = m_heads[m_now & (SLOTS - 1)];
+			while (head != NIL)		// Nothing can be linked to the current slot meanwhile (the minimum delay is 1 tick).
+			{
+				const index_t index = head;
+				Timer& t = m_timers[index];
+				
+				unlink(index);
+				t.state = State::Running;
+				m_running = index;
+				
+				{
+					STM32T_TRACE_SCOPE_ARG("TimerWheel", uintptr_t(t.callable));
+					t.callable(t.context);
+				}
+				
+				m_running = NIL;
+				
+				if (t.state == State::Running && t.periodic)
+				{
+					// Missed periods (e.g. after a long blocking call) are skipped.
+					const uint32_t now = HAL_GetTick();
+					t.due = int32_t(t.due + t.interval - now) > 0 ? t.due + t.interval : now + t.interval;
+					link(index);
+				}
+				else if (t.state != State::Pending)		// Not refreshed or advanced by the callable
+					release(index);
+			}
+		}
+		
+	public:
+		TimerWheel() : m_now(HAL_GetTick())
+		{
+			for (auto& head : m_heads)
+				head = NIL;
+			
+			for (size_t i = 0; i < SIZE; i++)
+				m_timers[i].next = i + 1 < SIZE ? i + 1 : NIL;
+		}
+		
+		TimerWheel(const TimerWheel&) = delete;
+		TimerWheel& operator=(const TimerWheel&) = delete;
+		
+		/**
+		* @brief Starts a timer that calls CALLABLE(CONTEXT) after DELAY ticks.
+		* @param period: If not 0, the timer repeats with this period until it's stopped.
+		* @retval The handle of the timer, or an invalid handle if there are already SIZE timers.
+		*/
+		Handle Start(const callable_t callable, void *const context, const uint32_t delay, const uint32_t period = 0)
+		{
+			if (m_free == NIL)
+				return {};
+			
+			const index_t index = m_free;
+			Timer& t = m_timers[index];
+			
+			m_free = t.next;
+			m_count++;
+			
+			if (t.gen == 0)
+				t.gen = 1;
+			
+			t.callable = callable;
+			t.context = context;
+			t.due = HAL_GetTick() + delay;
+			t.interval = period ? period : delay;
+			t.periodic = period != 0;
+			link(index);
+			
+			return Handle(uint32_t(t.gen) << 16 | index);
+		}
+		
+		/**
+		* @brief Stops a timer. Can be called from its own callable.
+		* @retval false if the handle is stale (the timer has already fired or was stopped).
+		*/
+		bool Stop(Handle& handle)
+		{
+			const index_t index = find(handle);
+			handle = {};
+			
+			if (index == NIL)
+				return false;
+			
+			if (index == m_running)
+			{
+				// Even if the callable has refreshed it, it's released only when the callable returns.
+				if (m_timers[index].state == State::Pending)
+					unlink(index);
+				
+				m_timers[index].state = State::Stopped;
+			}
+			else
+			{
+				unlink(index);
+				release(index);
+			}
+			
+			return true;
+		}
+		
+		/**
+		* @brief As if the timer was started now: it fires after its delay (or period) from now.
+		*/
+		bool Refresh(const Handle handle)
+		{
+			const index_t index = find(handle);
+			return index != NIL && Reschedule(handle, HAL_GetTick() + m_timers[index].interval);
+		}
+		
+		/**
+		* @brief Makes the timer fire at the next tick. A periodic timer continues from then.
+		*/
+		bool Advance(const Handle handle)
+		{
+			return Reschedule(handle, HAL_GetTick());
+		}
+		
+		/**
+		* @brief Makes the timer fire at the tick DUE instead.
+		* @retval false if the handle is stale.
+		*/
+		bool Reschedule(const Handle handle, const uint32_t due)
+		{
+			const index_t index = find(handle);
+			if (index == NIL)
+				return false;
+			
+			if (m_timers[index].state == State::Pending)
+				unlink(index);
+			
+			m_timers[index].due = due;
+			link(index);
+			
+			return true;
+		}
+		
+		bool IsActive(const Handle handle) const { return find(handle) != NIL; }
+		
+		/**
+		* @retval The ticks until the timer fires (0 if it's due or running), or nothing if the handle is stale.
+		*/
+		std::optional<uint32_t> Remaining(const Handle handle) const
+		{
+			const index_t index = find(handle);
+			if (index == NIL)
+				return std::nullopt;
+			
+			const int32_t remaining = int32_t(m_timers[index].due - HAL_GetTick());
+			return m_timers[index].state == State::Pending && remaining > 0 ? uint32_t(remaining) : 0;
+		}
+		
+		size_t Count() const { return m_count; }
+		
+		/**
+		* @retval A tick at or before which the next timer fires (a higher level timer may need to move down first, so it might be earlier
+		*		than the actual deadline, never later), or nothing if there are no timers.
+		*/
+		std::optional<uint32_t> NextDeadline() const
+		{
+			return nextEvent();
+		}
+		
+		/**
+		* @brief Fires the timers that are due, catching up with HAL_GetTick() in a single call.
+		*/
+		void Process()
+		{
+			const uint32_t now = HAL_GetTick();
+			
+			while (int32_t(now - m_now) > 0)
+			{
+				const std::optional<uint32_t> next = nextEvent();
+				if (!next || int32_t(*next - now) > 0)
+				{
+					m_now = now;
+					break;
+				}
+				
+				m_now = *next;
+				processTick();
+			}
+		}
+	};
+}
@@ -0,0 +1,228 @@
+#pragma once
+
+#ifndef STM32T_TRACE_ENABLE
+#define	STM32T_TRACE_ENABLE		0
+#endif
+
+#if STM32T_TRACE_ENABLE		// Otherwise only the empty macros are defined, without the dependencies.
+#include "./Log.hpp"
+#include "./Core/Time.hpp"
+#include "./Core/Utils.hpp"
+#endif
+
+#ifndef STM32T_TRACE_SIZE
+#define	STM32T_TRACE_SIZE		256
+#endif
+
+#ifndef STM32T_TRACE_CYCLES
+#define	STM32T_TRACE_CYCLES()	STM32T::Time::GetCycle()		// Can be replaced with a simulated clock (e.g. in host builds).
+#endif
+
+#define	_STM32T_TRACE_CAT2(A, B)	A##B
+#define	_STM32T_TRACE_CAT(A, B)		_STM32T_TRACE_CAT2(A, B)
+
+/**
+* @brief Trace events. NAME must be a string literal (only its address is stored). ARG is an STM32T::Trace::Arg or an integer.
+*		All of them are removed (including their arguments) unless STM32T_TRACE_ENABLE is 1.
+*/
+#if STM32T_TRACE_ENABLE
+#define STM32T_TRACE_SCOPE(NAME)			const STM32T::Trace::Scope _STM32T_TRACE_CAT(_stm32t_trace_, __LINE__)(NAME)
+#define STM32T_TRACE_SCOPE_ARG(NAME, ARG)	const STM32T::Trace::Scope _STM32T_TRACE_CAT(_stm32t_trace_, __LINE__)(NAME, ARG)
+#define STM32T_TRACE_BEGIN(NAME)			STM32T::Trace::g_trace.record(STM32T::Trace::Type::Begin, NAME)
+#define STM32T_TRACE_END(NAME)				STM32T::Trace::g_trace.record(STM32T::Trace::Type::End, NAME)
+#define STM32T_TRACE_INSTANT(NAME)			STM32T::Trace::g_trace.record(STM32T::Trace::Type::Instant, NAME)
+#define STM32T_TRACE_COUNTER(NAME, VALUE)	STM32T::Trace::g_trace.record(STM32T::Trace::Type::Counter, NAME, STM32T::Trace::Arg(VALUE))
+#else
+#define STM32T_TRACE_SCOPE(NAME)			((void)0)
+#define STM32T_TRACE_SCOPE_ARG(NAME, ARG)	((void)0)
+#define STM32T_TRACE_BEGIN(NAME)			((void)0)
+#define STM32T_TRACE_END(NAME)				((void)0)
+#define STM32T_TRACE_INSTANT(NAME)			((void)0)
+#define STM32T_TRACE_COUNTER(NAME, VALUE)	((void)0)
+#endif
+
+
+
+#if STM32T_TRACE_ENABLE
+namespace STM32T::Trace
+{
+	enum class Type : char
+	{
+		Begin = 'B',
+		End = 'E',
+		Instant = 'i',
+		Counter = 'C',
+	};
+	
+	/**
+	* @brief The argument of an event: a number or up to 4 characters of text (e.g. the name of a command), stored in 32 bits.
+	*/
+	struct Arg
+	{
+		uint32_t value = 0;
+		bool text = false;
+		
+		constexpr Arg() = default;
+		constexpr Arg(const uint32_t value) : value(value) {}
+		
+		static constexpr Arg Text(const strv str)
+		{
+			Arg arg;
+			arg.text = true;
+			
+			for (size_t i = 0; i < std::min<size_t>(str.size(), 4); i++)
+				arg.value |= uint32_t(uint8_t(str[i])) << (i * 8);
+			
+			return arg;
+		}
+	};
+	
+	/**
+	* @brief A recorded event. Arg is stored unpacked so that an event takes 16 bytes on 32-bit targets.
+	*/
+	struct Event
+	{
+		const char *name;
+		uint32_t cycles;
+		uint32_t arg;
+		Type type;
+		uint8_t context;		// The active exception number (IPSR); 0 is thread mode.
+		bool text;				// Whether arg is text
+	};
+	
+	static_assert(sizeof(void *) != 4 || sizeof(Event) == 16, "An event must take 16 bytes!");
+	
+	/**
+	* @brief Keeps the last SIZE trace events (name, type, cycle timestamp, argument and context) in a ring buffer. Dump() writes them as
+	*		text and Trace.py converts the dump to a Chrome trace (chrome://tracing or https://ui.perfetto.dev).
+	*
+	*		Dump line: "<type>\t<cycles>\t<context>\t<name>[\t<number> | \t"<text>"]", between a "# STM32T trace" header and "# end".
+	*
+	* @note record() can be called from any context (including ISRs).
+	*/
+	template <size_t SIZE = STM32T_TRACE_SIZE>
+	class Recorder
+	{
+		static_assert(SIZE > 0, "SIZE must be positive!");
+		
+		Event m_events[SIZE];
+		size_t m_head = 0, m_count = 0;
+		uint32_t m_overwritten = 0;
+		volatile bool m_enabled = true;
+		
+	public:
+		/**
+		* @brief Records an event, overwriting the oldest one if the buffer is full.
+		*/
+		void record(const Type type, const char *const name, const Arg arg = {})
+		{
+			if (!m_enabled)
+				return;
+			
+			const uint32_t cycles = STM32T_TRACE_CYCLES();
+			const uint8_t context = __get_IPSR();
+			
+			CriticalSection cs;
+			
+			m_events[m_head] = { name, cycles, arg.value, type, context, arg.text };
+			m_head = (m_head + 1) % SIZE;
+			
+			if (m_count < SIZE)
+				m_count++;
+			else
+				m_overwritten++;
+		}
+		
+		/**
+		* @brief Stops or resumes recording (e.g. to freeze the buffer right after a problem is detected).
+		*/
+		void enable(const bool enable = true) { m_enabled = enable; }
+		bool isEnabled() const { return m_enabled; }
+		
+		void clear()
+		{
+			CriticalSection cs;
+			
+			m_head = m_count = 0;
+			m_overwritten = 0;
+		}
+		
+		size_t size() const { return m_count; }
+		uint32_t overwritten() const { return m_overwritten; }
+		
+		/**
+		* @brief Writes the events to an output, the oldest first, and clears the buffer. Recording is paused meanwhile. Each line is a
+		*		message of its own, so that buffered outputs (e.g. AsyncOutput) don't need room for the whole dump.
+		*/
+		void dump(const Log::output_t out)
+		{
+			const bool enabled = m_enabled;
+			m_enabled = false;
+			
+			char line[96];
+			int len = Format::format(line, sizeof(line), "# STM32T trace\tclk=%lu\tevents=%u\toverwritten=%lu\n",
+				(unsigned long)STM32T_TIME_CLK, unsigned(m_count), (unsigned long)m_overwritten);
+			out({line, size_t(std::clamp(len, 0, int(sizeof(line) - 1)))}, true);
+			
+			for (size_t i = 0, index = (m_head + SIZE - m_count) % SIZE; i < m_count; i++, index = (index + 1) % SIZE)
+			{
+				const Event& e = m_events[index];
+				
+				if (e.text)
+				{
+					const char text[5] = { char(e.arg), char(e.arg >> 8), char(e.arg >> 16), char(e.arg >> 24) };
+					len = Format::format(line, sizeof(line), "%c\t%lu\t%u\t%s\t\"%s\"\n", char(e.type), (unsigned long)e.cycles,
+						unsigned(e.context), e.name, text);
+				}
+				else if (e.arg || e.type == Type::Counter)
+					len = Format::format(line, sizeof(line), "%c\t%lu\t%u\t%s\t%lu\n", char(e.type), (unsigned long)e.cycles,
+						unsigned(e.context), e.name, (unsigned long)e.arg);
+				else
+					len = Format::format(line, sizeof(line), "%c\t%lu\t%u\t%s\n", char(e.type), (unsigned long)e.cycles,
+						unsigned(e.context), e.name);
+				
+				out({line, size_t(std::clamp(len, 0, int(sizeof(line) - 1)))}, true);
+			}
+			
+			out("# end\n"sv, true);
+			
+			clear();
+			m_enabled = enabled;
+		}
+	};
+	
+	inline Recorder<> g_trace;
+	
+	/**
+	* @brief Records a Begin event in the constructor and an End event in the destructor. Use STM32T_TRACE_SCOPE() instead.
+	*/
+	class Scope
+	{
+		const char *const c_name;
+		
+	public:
+		Scope(const char *name, const Arg arg = {}) : c_name(name) { g_trace.record(Type::Begin, name, arg); }
+		~Scope() { g_trace.record(Type::End, c_name); }
+		
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+	};
+	
+	/**
+	* @brief Writes the events recorded by g_trace to an output and clears them. See Recorder::dump().
+	*/
+	inline void Dump(const Log::output_t out = Log::default_output_stdout)
+	{
+		g_trace.dump(out);
+	}
+}
+#else
+namespace STM32T::Trace
+{
+	/**
+	* @brief Tracing is disabled, so there is nothing to write. Nothing else is compiled (not even the dependencies of tracing).
+	*/
+	template <class... Args>
+	inline void Dump(Args&&...) {}
+}
+#endif
@@ -0,0 +1,108 @@
+import json
+import re
+import sys
+import argparse
+
+
+HEADER_RE = re.compile(r"# STM32T trace\tclk=(\d+)\tevents=(\d+)\toverwritten=(\d+)")
+EVENT_RE = re.compile(r"([BEiC])\t(\d+)\t(\d+)\t([^\t]*)(?:\t(?:\"(.{0,4})\"|(\d+)))?$")
+
+
+def parse_dumps(lines):
+	"""Yields (clk, overwritten, events) for every dump in the text (other lines, e.g. logs, are ignored)."""
+	dump = None
+	for line in lines:
+		line = line.rstrip("\r\n")
+		header = HEADER_RE.search(line)
+		if header:
+			dump = (int(header.group(1)), int(header.group(3)), [])
+			continue
+		
+		if dump is None:
+			continue
+		
+		if line.endswith("# end"):
+			yield dump
+			dump = None
+			continue
+		
+		m = EVENT_RE.search(line)
+		if m:
+			ph, cycles, context, name, text, number = m.groups()
+			dump[2].append({ "ph": ph, "cycles": int(cycles), "context": int(context), "name": name,
+				"arg": text if text is not None else (int(number) if number is not None else None) })
+	
+	if dump is not None:
+		print("Warning: the last dump is incomplete.", file=sys.stderr)
+		yield dump
+
+def context_name(context: int) -> str:
+	if context == 0:
+		return "Thread"
+	elif context < 16:
+		return { 2: "NMI", 3: "HardFault", 11: "SVCall", 14: "PendSV", 15: "SysTick" }.get(context, f"Exception {context}")
+	else:
+		return f"IRQ {context - 16}"
+
+def convert(dumps, hex_args: bool) -> dict:
+	trace, offset, pid = [], 0.0, 0
+	for clk, overwritten, events in dumps:
+		if overwritten:
+			print(f"Warning: {overwritten} older event(s) were overwritten.", file=sys.stderr)
+		
+		high, last, first, stacks = 0, None, None, {}
+		for context in sorted({ e["context"] for e in events }):
+			trace.append({ "ph": "M", "name": "thread_name", "pid": pid, "tid": context, "args": { "name": context_name(context) } })
+		
+		for e in events:
+			cycles = e["cycles"]
+			if last is not None and cycles < last:
+				high += 1 << 32		# The 32-bit cycle counter wrapped.
+			
+			last = cycles
+			time = high + cycles
+			first = time if first is None else first
+			ts = offset + (time - first) * 1e6 / clk
+			
+			event = { "ph": e["ph"], "name": e["name"], "ts": round(ts, 3), "pid": pid, "tid": e["context"] }
+			stack = stacks.setdefault(e["context"], [])
+			
+			if e["ph"] == "B":
+				stack.append(e["name"])
+			elif e["ph"] == "E":
+				if not stack:
+					continue		# Its Begin event was overwritten.
+				
+				stack.pop()
+			elif e["ph"] == "i":
+				event["s"] = "t"
+			
+			if e["ph"] == "C":
+				event["args"] = { e["name"]: e["arg"] if e["arg"] is not None else 0 }
+			elif e["arg"] is not None:
+				event["args"] = { "arg": f"0x{e['arg']:08X}" if hex_args and isinstance(e["arg"], int) else e["arg"] }
+			
+			trace.append(event)
+		
+		if first is not None:
+			offset += (last + high - first) * 1e6 / clk + 1000		# Consecutive dumps are placed one after the other.
+	
+	return { "traceEvents": trace, "displayTimeUnit": "ns" }
+
+
+parser = argparse.ArgumentParser(formatter_class=argparse.ArgumentDefaultsHelpFormatter,
+	description="Converts the dumps of STM32T::Trace to the Chrome trace format (chrome://tracing or https://ui.perfetto.dev).")
+parser.add_argument('-i', metavar='', default='-', help="Input file (the log containing the dumps); - for stdin")
+parser.add_argument('-o', metavar='', default='-', help="Output file (JSON); - for stdout")
+parser.add_argument('--hex', action='store_true', help="Show the numeric arguments in hex (e.g. the function addresses of Runnable)")
+
+args = parser.parse_args()
+
+input = sys.stdin if args.i == '-' else open(args.i, encoding="utf-8", errors="replace")
+output = sys.stdout if args.o == '-' else open(args.o, 'w', encoding="utf-8")
+
+json.dump(convert(parse_dumps(input), args.hex), output, indent=None)
+output.write("\n")
+
+if output is not sys.stdout:
+	output.close()
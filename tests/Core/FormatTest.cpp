@@ -0,0 +1,160 @@
+// Format against snprintf(): random integer and f conversions with every flag, width and precision, the conversions passed to
+// snprintf() (also when they are longer than its scratch buffer), every buffer size down to 0, shortest() round trips and the speed.
+
+#include "Core/Format.hpp"
+#include "Test.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <string>
+
+using namespace STM32T;
+
+
+
+static size_t s_mismatches = 0;
+
+template <typename... Args>
+static void compare(const size_t size, const char *const fmt, const Args... args)
+{
+	char expected[512], actual[512];
+	std::memset(expected, 'X', sizeof(expected));
+	std::memset(actual, 'X', sizeof(actual));
+	
+	const int n1 = snprintf(size ? expected : nullptr, size, fmt, args...);
+	const int n2 = Format::format(size ? actual : nullptr, size, fmt, args...);
+	
+	if (n1 != n2 || std::memcmp(expected, actual, sizeof(expected)) != 0)
+	{
+		if (s_mismatches++ < 20)
+			printf("%s (size %zu): \"%.*s\" (%d) instead of \"%.*s\" (%d)\n", fmt, size, int(std::min(size, sizeof(actual))), actual, n2,
+				int(std::min(size, sizeof(expected))), expected, n1);
+	}
+}
+
+template <typename... Args>
+static void compare(const char *const fmt, const Args... args)
+{
+	compare(128, fmt, args...);
+}
+
+int main()
+{
+	std::mt19937_64 rng(1);
+	
+	const char *const flags[] = { "", "-", "+", " ", "#", "0", "-0", "+0", " 0", "#0", "-#", "+ " };
+	const char *const widths[] = { "", "1", "5", "12", "20" };
+	const char *const precisions[] = { "", ".", ".0", ".1", ".3", ".8", ".13", ".14", ".20" };
+	
+	for (int i = 0; i < 200000; i++)
+	{
+		const std::string spec = std::string("%") + flags[rng() % std::size(flags)] + widths[rng() % std::size(widths)]
+			+ precisions[rng() % std::size(precisions)];
+		
+		long long v = static_cast<long long>(rng());
+		if (rng() % 2)
+			v >>= rng() % 63;
+		
+		double d;
+		switch (rng() % 4)
+		{
+			case 0:		d = double(int64_t(rng())) / double(1ull << (rng() % 60)); break;
+			case 1:		d = std::ldexp(double(rng() >> 11), int(rng() % 80) - 60); break;
+			case 2:		d = (int(rng() % 2000) - 1000) / 8.0 + 0.0625 * (rng() % 3); break;
+			default:	d = (rng() % 100000) / 1000.0; break;
+		}
+		
+		if (rng() % 2)
+			d = -d;
+		
+		switch (rng() % 9)
+		{
+			case 0:		compare((spec + "d").c_str(), int(v)); break;
+			case 1:		compare((spec + "u").c_str(), unsigned(v)); break;
+			case 2:		compare((spec + "x").c_str(), unsigned(v)); break;
+			case 3:		compare((spec + "llX").c_str(), static_cast<unsigned long long>(v)); break;
+			case 4:		compare((spec + "o").c_str(), unsigned(v)); break;
+			case 5:		compare((spec + "lld").c_str(), v); break;
+			case 6:		compare((spec + "f").c_str(), d); break;
+			case 7:		compare((spec + "hhd").c_str(), int(v)); break;
+			default:	compare((spec + "hu").c_str(), unsigned(v)); break;
+		}
+	}
+	
+	compare("%f", 1e300);
+	compare("%.3f", -0.0);
+	compare("%.0f|%.0f|%.0f", 0.5, 1.5, 2.5);
+	compare("%5.1f%%", 99.95);
+	compare("%e|%g|%10.3e|%a", 1.5, 0.0001, 123.456, 0.1);
+	compare("%s|%-6s|%.2s", "ab", "cd", "efg");
+	compare("%c%3c", 'a', 'b');
+	compare("%*d|%.*f", -5, 3, -1, 2.5);
+	compare("%p", reinterpret_cast<void *>(0x1234));
+	compare("%f|%.13f|%f", 18446744073709551615.0, 1844674.4073709551615, 1e-320);
+	compare("%f|%010f", NAN, -INFINITY);
+	
+	// Conversions passed to snprintf() that are longer than its scratch buffer, cut at every buffer size
+	for (size_t size = 0; size <= 300; size++)
+	{
+		compare(size, "[%100e]", 1.5);
+		compare(size, "[%-90p]", reinterpret_cast<void *>(0x1234));
+		compare(size, "%s %.70e %d", "x", 1.0 / 3, 42);
+		compare(size, "%-12d|%08.3f|%#x|%s", -42, 3.14159, 255u, "end");
+	}
+	
+	CHECK_EQ(s_mismatches, 0u);
+	
+	// shortest() must read back as the same value, and be as short as std::to_chars() for floats.
+	size_t wrong = 0, longer = 0;
+	for (int i = 0; i < 200000; i++)
+	{
+		char str[64];
+		
+		double d;
+		const uint64_t bits = rng();
+		std::memcpy(&d, &bits, sizeof(d));
+		if (std::isfinite(d))
+		{
+			Format::shortest(str, sizeof(str), d);
+			wrong += std::strtod(str, nullptr) != d;
+		}
+		
+		float f;
+		const uint32_t fbits = uint32_t(rng());
+		std::memcpy(&f, &fbits, sizeof(f));
+		if (!std::isfinite(f))
+			continue;
+		
+		const int n = Format::shortest(str, sizeof(str), f);
+		wrong += std::strtof(str, nullptr) != f;
+		
+		char ref[64];
+		longer += n > std::to_chars(ref, ref + sizeof(ref), f).ptr - ref;
+	}
+	
+	CHECK_EQ(wrong, 0u);
+	CHECK_EQ(longer, 0u);
+	
+	// Speed, with a log-like format
+	constexpr int N = 200000;
+	char buf[128];
+	size_t sum = 0;
+	
+	auto t0 = std::chrono::steady_clock::now();
+	for (int i = 0; i < N; i++)
+		sum += snprintf(buf, sizeof(buf), "[%10u] x=%d y=%5d %s t=%.2f", unsigned(i), i * 7, -i, "ok", i * 0.01);
+	
+	const double printfNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / N;
+	
+	t0 = std::chrono::steady_clock::now();
+	for (int i = 0; i < N; i++)
+		sum -= Format::format(buf, sizeof(buf), "[%10u] x=%d y=%5d %s t=%.2f", unsigned(i), i * 7, -i, "ok", i * 0.01);
+	
+	const double formatNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / N;
+	
+	printf("A log line: snprintf() %.0f ns, Format::format() %.0f ns\n", printfNs, formatNs);
+	CHECK_EQ(sum, 0u);
+	
+	return Test::Result();
+}
@@ -0,0 +1,88 @@
+// function_ref: functions, lambdas with and without captures, null ones, and the cost of passing a callback compared with func<>.
+// ScopeActionF with a deduced callable and with an empty func<>, which isn't called.
+
+#include "Core/Utils.hpp"
+#include "Test.hpp"
+
+#include <chrono>
+
+using namespace STM32T;
+
+
+
+static int twice(const int x) { return 2 * x; }
+
+// The callback parameters, as in the GSM driver. noinline: the callable mustn't be seen through.
+[[gnu::noinline]] static int withRef(const function_ref<int(int)> f, const int x) { return f ? f(x) : -1; }
+[[gnu::noinline]] static int withFunc(const func<int(int)>& f, const int x) { return f ? f(x) : -1; }
+
+template <class F>
+static double bench(F&& body)
+{
+	constexpr int N = 2000000;
+	const auto start = std::chrono::steady_clock::now();
+	
+	for (int i = 0; i < N; i++)
+		body(i);
+	
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / N;
+}
+
+int main()
+{
+	// Functions, null pointers and lambdas
+	int (*const null)(int) = nullptr;
+	CHECK_EQ(withRef(twice, 21), 42);
+	CHECK_EQ(withRef(null, 1), -1);
+	CHECK_EQ(withRef(nullptr, 1), -1);
+	CHECK_EQ(withRef([](const int x) { return x + 1; }, 1), 2);
+	
+	int a = 1, b = 2, c = 3, d = 4;
+	const auto big = [&a, &b, &c, &d](const int x) { return x + a + b + c + d; };		// 32 bytes: func<> allocates them.
+	CHECK_EQ(withRef(big, 0), 10);
+	a = 11;
+	CHECK_EQ(withRef(big, 0), 20);		// A reference, not a copy
+	
+	// ScopeActionF
+	int calls = 0;
+	{
+		ScopeActionF end([&] { calls++; });
+	}
+	CHECK_EQ(calls, 1);
+	
+	{
+		ScopeActionF end([&] { calls++; });
+		end.EarlyExit();
+		end.EarlyExit();
+	}
+	CHECK_EQ(calls, 2);
+	
+	{
+		ScopeActionF end([&] { calls++; });
+		end.Cancel();
+	}
+	CHECK_EQ(calls, 2);
+	
+	{
+		ScopeActionF<> empty(func<void()>{});		// Calling it would throw std::bad_function_call.
+		ScopeActionF<> early(func<void()>{});
+		early.EarlyExit();
+		ScopeActionF<> some([&] { calls++; });
+	}
+	CHECK_EQ(calls, 3);
+	
+	// Constructing and passing a callback with 32 bytes of captures, and calling one constructed beforehand
+	volatile int sink = 0;
+	const double refBig = bench([&](const int i) { sink = withRef([&a, &b, &c, &i](const int x) { return x + a + b + c + i; }, i); });
+	const double funcBig = bench([&](const int i) { sink = withFunc([&a, &b, &c, &i](const int x) { return x + a + b + c + i; }, i); });
+	
+	const function_ref<int(int)> ref = big;
+	const func<int(int)> fn = big;
+	const double refCall = bench([&](const int i) { sink = withRef(ref, i); });
+	const double funcCall = bench([&](const int i) { sink = withFunc(fn, i); });
+	
+	printf("32-byte capture passed: %.1f ns with function_ref, %.1f ns with func<>\n", refBig, funcBig);
+	printf("Existing callable:      %.1f ns with function_ref, %.1f ns with func<>\n", refCall, funcCall);
+	
+	return Test::Result();
+}
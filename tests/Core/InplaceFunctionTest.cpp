@@ -0,0 +1,108 @@
+// inplace_function: empty ones (default, nullptr and a null function pointer) copied and moved, callables with and without state,
+// destruction of a non-trivial one, and the cost of constructing, copying and calling one compared with std::function.
+
+#include "Core/inplace_function.hpp"
+#include "Test.hpp"
+
+#include <chrono>
+#include <functional>
+#include <memory>
+
+using namespace STM32T;
+
+
+
+static int twice(const int x) { return 2 * x; }
+
+struct Counted
+{
+	static inline int alive = 0;
+	int value;
+	
+	Counted(const int value) : value(value) { alive++; }
+	Counted(const Counted& other) : value(other.value) { alive++; }
+	~Counted() { alive--; }
+	
+	int operator()(const int x) const { return x + value; }
+};
+
+template <class F>
+static double bench(F&& body)
+{
+	constexpr int N = 2000000;
+	const auto start = std::chrono::steady_clock::now();
+	
+	for (int i = 0; i < N; i++)
+		body(i);
+	
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / N;
+}
+
+int main()
+{
+	using fn = inplace_function<int(int), 32>;
+	
+	// Empty ones stay empty when copied or moved.
+	int (*const null)(int) = nullptr;
+	fn empty, fromNull = nullptr, fromNullPointer = null;
+	CHECK(!empty && !fromNull && !fromNullPointer);
+	CHECK(!std::function<int(int)>(null));
+	
+	fn copy = empty, moved = std::move(fromNullPointer);
+	CHECK(!copy && !moved);
+	copy = fromNull;
+	CHECK(!copy);
+	
+	// Function pointers and lambdas
+	fn f = twice;
+	CHECK(f && f(21) == 42);
+	
+	int offset = 5;
+	fn g = [offset](const int x) { return twice(x) + offset; };
+	fn h = g;
+	offset = 0;
+	CHECK_EQ(h(1), 7);
+	
+	h.swap(f);
+	CHECK_EQ(f(1), 7);
+	CHECK_EQ(h(1), 2);
+	
+	// A non-trivial callable is copied, moved and destroyed.
+	{
+		fn a = Counted(10);
+		fn b = a;
+		fn c = std::move(a);
+		CHECK(!a && b(1) == 11 && c(2) == 12);
+		CHECK_EQ(Counted::alive, 2);
+		
+		b = nullptr;
+		CHECK_EQ(Counted::alive, 1);
+	}
+	CHECK_EQ(Counted::alive, 0);
+	
+	// The cost: a callable capturing 24 bytes (std::function allocates for it), constructed, copied and called
+	volatile int sink = 0;
+	const int64_t a = 1, b = 2, c = 3;
+	
+	const double inplaceMake = bench([&](const int i) {
+		fn f = [a, b, c](const int x) { return int(x + a + b + c); };
+		fn g = f;
+		sink = g(i);
+	});
+	
+	const double stdMake = bench([&](const int i) {
+		std::function<int(int)> f = [a, b, c](const int x) { return int(x + a + b + c); };
+		std::function<int(int)> g = f;
+		sink = g(i);
+	});
+	
+	fn inplace = [a, b, c](const int x) { return int(x + a + b + c); };
+	std::function<int(int)> std = [a, b, c](const int x) { return int(x + a + b + c); };
+	const double inplaceCall = bench([&](const int i) { sink = inplace(i); });
+	const double stdCall = bench([&](const int i) { sink = std(i); });
+	
+	printf("Construct, copy and call: inplace_function %.1f ns, std::function %.1f ns\n", inplaceMake, stdMake);
+	printf("Call: inplace_function %.1f ns, std::function %.1f ns\n", inplaceCall, stdCall);
+	
+	return Test::Result();
+}
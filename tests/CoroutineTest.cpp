@@ -0,0 +1,193 @@
+// Coroutine tasks on a simulated tick: a flash erase waiting with a timeout, a modem power-up waiting for a delay, a pin and a Future
+// completed from an ISR, a task that stops itself, and Runnable::Idle() sleeping until the next wake-up in between.
+
+#include "Coroutine.hpp"
+#include "Test.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace STM32T;
+
+
+
+static std::vector<std::string> s_log;
+
+static void log(const char *const text)
+{
+	s_log.push_back(std::to_string(uwTick) + " " + text);
+}
+
+struct Flash
+{
+	uint32_t busyUntil = 0;
+	
+	void StartErase(const uint32_t time) { busyUntil = uwTick + time; }
+	bool IsBusy() const { return int32_t(uwTick - busyUntil) < 0; }
+};
+
+struct Pin
+{
+	bool state = false;
+	
+	bool Read() const { return state; }
+};
+
+static Flash s_flash;
+static Pin s_pin;
+static Co::Future<int> s_rx;
+
+struct Erase : Co::Task
+{
+	int i = 0;
+	
+	Co::Status run() override
+	{
+		STM32T_CO_BEGIN();
+		
+		for (i = 0; i < 3; i++)
+		{
+			s_flash.StartErase(i == 2 ? 2000 : 400);
+			STM32T_CO_AWAIT_FOR(!s_flash.IsBusy(), 1000);
+			log(TimedOut() ? "erase: timeout" : "erase: done");
+		}
+		
+		STM32T_CO_END();
+	}
+};
+
+struct Modem : Co::Task
+{
+	Co::Status run() override
+	{
+		STM32T_CO_BEGIN();
+		
+		log("modem: power key");
+		STM32T_CO_DELAY(300);
+		log("modem: wait for the status pin");
+		STM32T_CO_PIN(s_pin, true);
+		
+		s_rx.reset();
+		STM32T_CO_FUTURE(s_rx);
+		log(s_rx.get() == 42 ? "modem: OK" : "modem: wrong value");
+		
+		STM32T_CO_END();
+	}
+};
+
+struct Counter : Co::Task
+{
+	int n = 0;
+	
+	Co::Status run() override
+	{
+		STM32T_CO_BEGIN();
+		
+		for (n = 0; n < 5; n++)
+			STM32T_CO_YIELD();
+		
+		log("counter: 5 yields");
+		Stop();
+		STM32T_CO_DELAY(1);
+		log("counter: ran after Stop()");
+		
+		STM32T_CO_END();
+	}
+};
+
+struct Sleeper : Co::Task
+{
+	Co::Status run() override
+	{
+		STM32T_CO_BEGIN();
+		
+		STM32T_CO_DELAY(5000);
+		log("sleeper: woke up");
+		
+		STM32T_CO_END();
+	}
+};
+
+static uint32_t s_slept = 0, s_sleeps = 0;
+
+static uint32_t sleep(uint32_t ticks)
+{
+	if (ticks == UINT32_MAX)
+		ticks = 1;
+	
+	s_slept += ticks;
+	s_sleeps++;
+	return ticks;
+}
+
+int main()
+{
+	uwTick = 1000;
+	Runnable::Init();
+	Runnable::SetIdle(sleep);
+	
+	Erase erase;
+	Modem modem;
+	Counter counter;
+	
+	erase.Start();
+	modem.Start();
+	counter.Start();
+	
+	const uint32_t start = uwTick;
+	size_t loops = 0;
+	
+	while (erase.IsRunning() || modem.IsRunning() || counter.IsRunning())
+	{
+		if (uwTick - start >= 600)
+			s_pin.state = true;
+		
+		if (uwTick - start >= 700 && !s_rx.ready())		// A driver callback completes the future.
+		{
+			Stub::IPSR = 16 + 37;
+			s_rx.set(42);
+			Stub::IPSR = 0;
+		}
+		
+		Runnable::Process();
+		Runnable::Idle();
+		
+		if (++loops > 100000)
+			break;
+	}
+	
+	CHECK(s_log == std::vector<std::string>({
+		"1000 modem: power key",
+		"1000 counter: 5 yields",
+		"1300 modem: wait for the status pin",
+		"1400 erase: done",
+		"1700 modem: OK",
+		"1800 erase: done",
+		"2800 erase: timeout",
+	}));
+	CHECK(!erase.IsRunning() && !modem.IsRunning() && !counter.IsRunning());
+	
+	// Only a delay left: Idle() sleeps until it's over.
+	s_log.clear();
+	s_slept = s_sleeps = 0;
+	
+	Sleeper sleeper;
+	sleeper.Start();
+	
+	for (;;)
+	{
+		Runnable::Process();
+		if (!sleeper.IsRunning())
+			break;
+		
+		Runnable::Idle();
+	}
+	
+	CHECK(s_log == std::vector<std::string>({ std::to_string(uwTick) + " sleeper: woke up" }));
+	CHECK_EQ(s_sleeps, 1u);
+	CHECK(!Runnable::NextDeadline());
+	
+	printf("The tasks: %zu loops. The delay alone: %u ticks slept in %u sleep(s)\n", loops, unsigned(s_slept), unsigned(s_sleeps));
+	
+	return Test::Result();
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+// A simulated W25Q SPI flash behind the SPI and GPIO hooks of the stub: read data, read status, write enable, page program (wrapping
+// within the page, only clearing bits) and sector erase. A write or erase issued while the chip is busy is ignored, like the real chip.
+// Faults can be injected: SPI errors, and a power cut in the middle of a page program after which the chip ignores everything (and
+// reads as 0) until PowerOn().
+
+#include "main.h"
+
+#include <algorithm>
+#include <vector>
+
+
+
+namespace Sim
+{
+	class Flash
+	{
+	public:
+		static constexpr uint32_t SECTOR_SIZE = 4096, PAGE_SIZE = 256;
+		
+		std::vector<uint8_t> mem;
+		
+		long cutAfter = -1;				// Bytes programmed before the power is cut (-1: never)
+		bool failSPI = false;			// HAL_SPI_Transmit() fails.
+		uint32_t eraseBusy = 3;			// Status reads that show an erase in progress
+		
+		// Statistics
+		size_t programs = 0, erases = 0, ignored = 0, transactions = 0;
+		
+	private:
+		static inline Flash *s_this = nullptr;
+		
+		GPIO_TypeDef *const p_port;
+		const uint32_t c_pin;
+		
+		std::vector<uint8_t> m_cmd;
+		bool m_selected = false, m_wel = false, m_powered = true;
+		uint32_t m_readAddr = 0, m_busy = 0;
+		
+		uint32_t address() const { return (m_cmd[1] << 16 | m_cmd[2] << 8 | m_cmd[3]) % mem.size(); }
+		
+		void execute()
+		{
+			if (m_cmd.empty() || !m_powered)
+				return;
+			
+			const uint8_t cmd = m_cmd[0];
+			const bool write = cmd == 0x02 || cmd == 0x20;
+			
+			if (write && (m_busy || !m_wel || m_cmd.size() < 4))
+			{
+				ignored++;
+				return;
+			}
+			
+			if (cmd == 0x06)
+				m_wel = true;
+			else if (cmd == 0x02)
+			{
+				const uint32_t addr = address();
+				programs++;
+				
+				for (size_t i = 4; i < m_cmd.size(); i++)
+				{
+					if (cutAfter == 0)
+					{
+						m_powered = false;
+						break;
+					}
+					
+					if (cutAfter > 0)
+						cutAfter--;
+					
+					mem[(addr & ~(PAGE_SIZE - 1)) | ((addr + i - 4) & (PAGE_SIZE - 1))] &= m_cmd[i];
+				}
+				
+				m_wel = false;
+			}
+			else if (cmd == 0x20)
+			{
+				const uint32_t addr = address() & ~(SECTOR_SIZE - 1);
+				std::fill(mem.begin() + addr, mem.begin() + addr + SECTOR_SIZE, 0xFF);
+				erases++;
+				m_wel = false;
+				m_busy = eraseBusy;
+			}
+		}
+		
+	public:
+		/**
+		* @param mbit: The size of the chip in Mbit.
+		* @param port, pin: The chip select (active low).
+		*/
+		Flash(const uint16_t mbit, GPIO_TypeDef *const port, const uint32_t pin) : mem(mbit * 1024 * 1024 / 8, 0xFF), p_port(port), c_pin(pin)
+		{
+			s_this = this;
+			port->ODR |= pin;
+			
+			Stub::OnGPIOWrite = [](GPIO_TypeDef *const port, const uint32_t odr) {
+				if (port != s_this->p_port)
+					return;
+				
+				const bool selected = !(odr & s_this->c_pin);
+				if (selected && !s_this->m_selected)
+				{
+					s_this->m_cmd.clear();
+					s_this->transactions++;
+				}
+				else if (!selected && s_this->m_selected)
+					s_this->execute();
+				
+				s_this->m_selected = selected;
+			};
+			
+			Stub::SPI.Transmit = [](SPI_HandleTypeDef *, const uint8_t *const data, const uint16_t size) {
+				Flash& f = *s_this;
+				if (f.failSPI)
+					return HAL_ERROR;
+				
+				f.m_cmd.insert(f.m_cmd.end(), data, data + size);
+				if (f.m_cmd.size() == 4 && f.m_cmd[0] == 0x03)
+					f.m_readAddr = f.address();
+				
+				return HAL_OK;
+			};
+			
+			Stub::SPI.Receive = [](SPI_HandleTypeDef *, uint8_t *const data, const uint16_t size) {
+				Flash& f = *s_this;
+				const uint8_t cmd = f.m_cmd.empty() || !f.m_powered ? 0 : f.m_cmd[0];
+				
+				for (uint16_t i = 0; i < size; i++)
+				{
+					if (cmd == 0x03)
+						data[i] = f.mem[f.m_readAddr++ % f.mem.size()];
+					else if (cmd == 0x05)
+						data[i] = f.m_busy ? (f.m_busy--, 0x01) : (f.m_wel ? 0x02 : 0);
+					else
+						data[i] = 0;
+				}
+				
+				return HAL_OK;
+			};
+		}
+		
+		~Flash()
+		{
+			Stub::OnGPIOWrite = nullptr;
+			Stub::SPI = {};
+			s_this = nullptr;
+		}
+		
+		Flash(const Flash&) = delete;
+		
+		/**
+		* @brief Restores the power after a cut (the memory is kept).
+		*/
+		void PowerOn()
+		{
+			m_powered = true;
+			m_wel = false;
+			m_busy = 0;
+			cutAfter = -1;
+		}
+		
+		bool Powered() const { return m_powered; }
+	};
+}
@@ -0,0 +1,173 @@
+// Replays modem transcripts through ATParser, split at random chunk boundaries, and checks the events against the lines of the
+// whole transcript.
+
+#include "GSM/ATParser.hpp"
+#include "Test.hpp"
+
+#include <string>
+#include <vector>
+#include <random>
+
+using namespace STM32T;
+
+
+
+using Parser = ATParser<128>;
+
+struct Event
+{
+	Parser::Event type;
+	std::string text;
+	bool continued;
+};
+
+struct Transcript
+{
+	const char *name;
+	std::string text;
+	Parser::Result result;
+	uint16_t code;
+	size_t lines;		// Without the final result code
+	std::string rest;	// What's left after the final result code
+};
+
+static std::vector<Event> replay(const std::string& text, std::mt19937& rng, const size_t max_chunk, Parser& parser, size_t& consumed)
+{
+	std::vector<Event> events;
+	consumed = 0;
+	
+	while (consumed < text.size() && !parser.Done())
+	{
+		const size_t n = std::min<size_t>(text.size() - consumed, 1 + rng() % max_chunk);
+		const size_t used = parser.Feed(strv(text.data() + consumed, n), [&](const Parser::Event event, const strv line) {
+			CHECK(line.data()[line.size()] == 0);
+			events.push_back({ event, std::string(line), parser.IsContinued() });
+		});
+		
+		CHECK(used == n || parser.Done());
+		consumed += used;
+	}
+	
+	return events;
+}
+
+/**
+* @retval The non-empty lines of TEXT without the CRs, up to the prompt.
+*/
+static std::vector<std::string> reference(const std::string& text)
+{
+	std::vector<std::string> lines;
+	std::string line;
+	
+	for (const char c : text)
+	{
+		if (c == '\r')
+			continue;
+		
+		if (c == '\n')
+		{
+			if (!line.empty())
+				lines.push_back(line);
+			
+			line.clear();
+			continue;
+		}
+		
+		line += c;
+		
+		if (line == "> ")
+		{
+			lines.push_back(line);
+			break;
+		}
+	}
+	
+	return lines;
+}
+
+int main()
+{
+	std::string hex;
+	for (int i = 0; i < 1500; i++)
+	{
+		char byte[3];
+		snprintf(byte, sizeof(byte), "%02X", (i * 7) & 0xFF);
+		hex += byte;
+	}
+	
+	using R = Parser::Result;
+	const Transcript transcripts[] = {
+		{ "CSQ", "\r\n+CSQ: 17,0\r\n\r\nOK\r\n", R::OK, 0, 1, "" },
+		{ "CME", "\r\n+CME ERROR: 10\r\n", R::CME, 10, 0, "" },
+		{ "CMS", "\r\n+CMS ERROR: 500\r\n", R::CMS, 500, 0, "" },
+		{ "CME verbose", "\r\n+CME ERROR: SIM not inserted\r\n", R::Error, 0, 0, "" },
+		{ "ERROR", "\r\nERROR\r\n", R::Error, 0, 0, "" },
+		{ "prompt", "\r\n> ", R::Prompt, 0, 0, "" },
+		{ "CMGL+URC", "\r\n+CMGL: 1,\"REC READ\"\r\nhello\r\n+CREG: 5\r\n+CMGL: 2,\"REC UNREAD\"\r\nworld\r\n\r\nOK\r\nRING\r\n", R::OK, 0, 5, "RING\r\n" },
+		{ "SRECV", "\r\n#SRECV: 1,1500\r\n" + hex + "\r\n\r\nOK\r\n", R::OK, 0, 2, "" },
+		{ "CONNECT", "\r\nCONNECT\r\nbinary data follows", R::Connect, 0, 0, "binary data follows" },
+		{ "NO CARRIER", "\r\nNO CARRIER\r\n", R::NoCarrier, 0, 0, "" },
+		{ "bare LF", "\n+CGREG: 0,1\n\nOK\n", R::OK, 0, 1, "" },
+	};
+	
+	std::mt19937 rng(12345);
+	
+	for (const Transcript& t : transcripts)
+	{
+		const int failures = Test::s_failures;
+		
+		for (const size_t max_chunk : { 1, 2, 3, 7, 16, 64, 4096 })
+		{
+			for (int rep = 0; rep < 200; rep++)
+			{
+				Parser parser;
+				size_t consumed;
+				const std::vector<Event> events = replay(t.text, rng, max_chunk, parser, consumed);
+				
+				CHECK_EQ(parser.GetResult(), t.result);
+				CHECK_EQ(parser.Code(), t.code);
+				CHECK_EQ(t.text.substr(consumed), t.rest);
+				
+				// The lines reassembled from the events must be the same, however the transcript was split.
+				std::vector<std::string> lines;
+				std::string fragments;
+				size_t finals = 0;
+				
+				for (const Event& e : events)
+				{
+					switch (e.type)
+					{
+						case Parser::Event::Fragment:
+							CHECK_EQ(e.text.size(), 128u);
+							CHECK_EQ(e.continued, !fragments.empty());
+							fragments += e.text;
+							break;
+						
+						case Parser::Event::Line:
+							CHECK_EQ(e.continued, !fragments.empty());
+							lines.push_back(fragments + e.text);
+							fragments.clear();
+							break;
+						
+						case Parser::Event::Final:
+							++finals;
+							lines.push_back(e.text);
+							break;
+						
+						default:
+							lines.push_back(e.text);
+							break;
+					}
+				}
+				
+				CHECK(lines == reference(t.text.substr(0, consumed)));
+				CHECK_EQ(lines.size(), t.lines + 1);
+				CHECK_EQ(finals, t.result == R::Prompt ? 0u : 1u);
+			}
+		}
+		
+		printf("%-12s %s\n", t.name, failures == Test::s_failures ? "ok" : "FAILED");
+	}
+	
+	return Test::Result();
+}
@@ -0,0 +1,157 @@
+// The GSM commands against the simulated modem must not allocate once warmed up: the callbacks are passed as function_ref (a
+// ResponseToken with a 32-byte capture, SingleToken and Tokens3) and the lines are split into a vector that keeps its capacity.
+// Counted with a global operator new; the simulator's own allocations aren't. Built with and without STM32T_GSM_DMA_RX.
+
+#include "GSM/GL865.hpp"
+#include "ModemSim.hpp"
+#include "Test.hpp"
+
+#include <cstdlib>
+#include <new>
+
+using namespace STM32T;
+
+
+
+static size_t s_allocs = 0;
+static bool s_inSim = false;		// The simulator allocates (its script, the bytes on the line), not the driver.
+
+void *operator new(const size_t size)
+{
+	if (!s_inSim)
+		++s_allocs;
+	
+	if (void *const p = std::malloc(size ? size : 1))
+		return p;
+	
+	throw std::bad_alloc();
+}
+
+void *operator new[](const size_t size) { return operator new(size); }
+void operator delete(void *const p) noexcept { std::free(p); }
+void operator delete[](void *const p) noexcept { std::free(p); }
+
+// The simulator's hooks, wrapped so that only the driver is counted (the RX events call the driver back from the simulator).
+namespace Hooks
+{
+	struct Stub::UART sim;
+	void (*wfi)() = nullptr;
+	
+	template <class F, class... Args>
+	auto inSim(const bool in, F f, Args... args)
+	{
+		const bool was = s_inSim;
+		s_inSim = in;
+		const auto result = f(args...);
+		s_inSim = was;
+		return result;
+	}
+	
+	void install()
+	{
+		sim = Stub::UART;
+		wfi = Stub::OnWFI;
+		
+		Stub::OnWFI = [] { inSim(true, [] { wfi(); return 0; }); };
+		Stub::UART.Transmit = [](UART_HandleTypeDef *huart, const uint8_t *data, const uint16_t size, const uint32_t timeout)
+		{
+			return inSim(true, sim.Transmit, huart, data, size, timeout);
+		};
+		Stub::UART.Receive = [](UART_HandleTypeDef *huart, uint8_t *data, const uint16_t size, const uint32_t timeout)
+		{
+			return inSim(true, sim.Receive, huart, data, size, timeout);
+		};
+		
+		if (sim.RxEventCallback)
+		{
+			Stub::UART.RxEventCallback = [](UART_HandleTypeDef *huart, const uint16_t pos)
+			{
+				inSim(false, [&] { sim.RxEventCallback(huart, pos); return 0; });
+			};
+		}
+	}
+}
+
+struct Modem : GL865
+{
+	using GL865::GL865;
+	using GL865::ErrorCode;
+	
+	ErrorCode CSQ(int& rssi, int& ber)
+	{
+		int parsed = 0;
+		const strv format = "%d,%d"sv;
+		
+		// 32 bytes of captures: a std::function would allocate them.
+		return ResponseToken(300, CommandType::Execute, "+CSQ"sv, {}, [&rssi, &ber, &parsed, &format](const strv token) -> ErrorCode {
+			parsed = sscanf(token.data(), format.data(), &rssi, &ber);
+			return parsed == 2 ? OK : WRONG_FORMAT;
+		});
+	}
+	
+	ErrorCode EchoOff() { return SingleToken(300, CommandType::Execute, "E0"sv); }
+	
+	ErrorCode Operators(size_t& count)
+	{
+		return Tokens3(300, CommandType::Read, "+COPS"sv, {}, [&](vec<strv>& tokens) {
+			count = tokens.size();
+			return OK;
+		});
+	}
+};
+
+int main()
+{
+	UART_HandleTypeDef huart{};
+	DMA_HandleTypeDef hdma{};
+	huart.hdmarx = &hdma;
+	huart.Init.BaudRate = 115200;
+	#ifdef STM32T_GSM_DMA_RX
+	hdma.Init.Mode = DMA_CIRCULAR;
+	#endif
+	
+	s_inSim = true;
+	Sim::Modem sim(&huart);
+	sim.script["AT+CSQ\r"] = { { 5, "\r\n+CSQ: 17,3\r\n\r\nOK\r\n" } };
+	sim.script["ATE0\r"] = { { 3, "\r\nOK\r\n" } };
+	sim.script["AT+COPS?\r"] = { { 5, "\r\n+COPS: 0,0,\"Operator\"\r\n+COPS: 1,0,\"Other\"\r\n\r\nOK\r\n" } };
+	sim.commands.reserve(16000);
+	s_inSim = false;
+	
+	Modem modem(&huart, IO::None(), IO::None());
+	#ifdef STM32T_GSM_DMA_RX
+	modem.EnableURC(true);
+	#endif
+	
+	int rssi = 0, ber = 0;
+	size_t operators = 0;
+	
+	const auto transaction = [&]
+	{
+		CHECK_EQ(modem.CSQ(rssi, ber), Modem::OK);
+		sim.Run(10);
+		CHECK_EQ(modem.EchoOff(), Modem::OK);
+		sim.Run(10);
+		CHECK_EQ(modem.Operators(operators), Modem::OK);
+		sim.Run(10);
+	};
+	
+	// Warm-up: the vector of lines grows to its size.
+	transaction();
+	CHECK_EQ(rssi, 17);
+	CHECK_EQ(ber, 3);
+	CHECK_EQ(operators, 2u);
+	
+	Hooks::install();
+	const size_t before = s_allocs;
+	
+	constexpr int N = 1000;
+	for (int i = 0; i < N; i++)
+		transaction();
+	
+	printf("%d transactions (3 commands each): %zu allocations after the warm-up\n", N, s_allocs - before);
+	CHECK_EQ(s_allocs - before, 0u);
+	CHECK_EQ(sim.unknown, 0u);
+	
+	return Test::Result();
+}
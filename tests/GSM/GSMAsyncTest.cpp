@@ -0,0 +1,191 @@
+// The asynchronous commands (STM32T_GSM_DMA_RX) against the simulated modem: the queue, URCs inside and between the responses,
+// errors and timeouts, a synchronous command while an asynchronous one is in flight, a full queue, and the throughput.
+
+#define STM32T_GSM_URC_SUPPORT
+#define STM32T_GSM_DMA_RX
+
+#include "GSM/GL865.hpp"
+#include "ModemSim.hpp"
+#include "Test.hpp"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace STM32T;
+
+
+
+struct Modem : GL865
+{
+	using GL865::GL865;
+	using GL865::ErrorCode;
+	
+	ErrorCode CSQ(int& rssi)
+	{
+		return ResponseToken(300, CommandType::Execute, "+CSQ"sv, {}, [&](const strv token) -> ErrorCode {
+			return sscanf(token.data(), "%d", &rssi) == 1 ? OK : WRONG_FORMAT;
+		});
+	}
+	
+	std::string URCs()
+	{
+		std::string all;
+		HandleURCs([&](const strv urc, uint32_t) {
+			all += std::string(urc) + "|";
+			return true;
+		});
+		
+		return all;
+	}
+};
+
+static std::vector<std::string> s_log;
+static Modem *s_modem = nullptr;
+
+static void log(const char *const fmt, ...)
+{
+	char buf[200];
+	va_list args;
+	va_start(args, fmt);
+	vsnprintf(buf, sizeof(buf), fmt, args);
+	va_end(args);
+	
+	s_log.push_back(buf);
+}
+
+int main()
+{
+	UART_HandleTypeDef huart{};
+	DMA_HandleTypeDef hdma{};
+	huart.hdmarx = &hdma;
+	huart.Init.BaudRate = 115200;
+	hdma.Init.Mode = DMA_CIRCULAR;
+	
+	Sim::Modem sim(&huart);
+	
+	sim.script["AT+CSQ\r"] = { { 5, "\r\n+CSQ: 17,0\r\n\r\nOK\r\n" } };
+	sim.script["AT+CGREG?\r"] = { { 4, "\r\n+CGREG: 0,1\r\n" }, { 6, "\r\n+CREG: 5\r\n" }, { 8, "\r\nOK\r\n" } };		// A URC inside the response
+	sim.script["AT#SS=2\r"] = { { 5, "\r\n#SS: 2,3,10.0.0.1,1000,1.2.3.4,80\r\n\r\nOK\r\n" } };
+	sim.script["AT+BAD\r"] = { { 3, "\r\n+CME ERROR: 10\r\n" } };
+	sim.script["ATE0\r"] = { { 3, "\r\nOK\r\n" } };
+	sim.script["AT+BIG\r"] = { { 3, "\r\n+BIG: " + std::string(300, 'x') + "\r\n\r\nOK\r\n" } };
+	sim.script["AT+CMGL\r"] = { { 3, "\r\n+CMGL: 1\r\nhello\r\n+CMGL: 2\r\nworld\r\n\r\nOK\r\n" } };
+	
+	Modem modem(&huart, IO::None(), IO::None());
+	s_modem = &modem;
+	modem.EnableURC(true);
+	
+	// The main loop calls ProcessAsync() once per tick; it must never block (the clock mustn't move inside it).
+	uint32_t longest = 0;
+	size_t calls = 0;
+	double hostNs = 0;
+	
+	const auto loop = [&](const uint32_t ms)
+	{
+		for (uint32_t i = 0; i < ms; i++)
+		{
+			const uint32_t start = HAL_GetTick();
+			const auto host = std::chrono::steady_clock::now();
+			
+			modem.ProcessAsync();
+			
+			hostNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - host).count();
+			longest = std::max(longest, HAL_GetTick() - start);
+			++calls;
+			sim.Tick();
+		}
+	};
+	
+	// Queued at once; a URC inside one response and one between the responses
+	CHECK(modem.SignalQualityAsync([](void *, const GL865::ErrorCode code, const int8_t rssi, const int16_t ber) {
+		log("CSQ %d rssi %d ber %d", int(code), rssi, ber);
+	}));
+	CHECK(modem.NetworkCheckAsync([](void *, const int32_t stat) { log("CGREG %d", int(stat)); }));
+	CHECK(modem.SocketStatusAsync(2, [](void *, const uint8_t conn_id, const int32_t stat) { log("SS %u stat %d", conn_id, int(stat)); }));
+	CHECK_EQ(modem.AsyncPending(), 3u);
+	
+	loop(60);
+	sim.Send("\r\n+CREG: 1\r\n", 2);
+	loop(20);
+	
+	CHECK_EQ(modem.AsyncPending(), 0u);
+	CHECK_EQ(modem.URCs(), "+CREG: 5|+CREG: 1|");
+	CHECK(s_log == std::vector<std::string>({ "CSQ 0 rssi -79 ber 0", "CGREG 1", "SS 2 stat 3" }));
+	
+	// Errors, a timeout, a response too long and a multi-line response
+	s_log.clear();
+	modem.CustomAsync("+BAD"sv, [](const GL865::ErrorCode code, vec<strv>& lines) { log("BAD %d lines %zu", int(code), lines.size()); });
+	modem.CustomAsync("+NONE"sv, [](const GL865::ErrorCode code, vec<strv>&) { log("NONE %d", int(code)); }, 50);
+	modem.CustomAsync("+BIG"sv, [](const GL865::ErrorCode code, vec<strv>&) { log("BIG %d", int(code)); });
+	modem.CustomAsync("+CMGL"sv, [](const GL865::ErrorCode code, vec<strv>& lines) {
+		std::string all;
+		for (const strv line : lines)
+			all += std::string(line) + "|";
+		
+		log("CMGL %d %s", int(code), all.c_str());
+	});
+	
+	loop(200);
+	CHECK(s_log == std::vector<std::string>({ "BAD -1010 lines 0", "NONE -4", "BIG -8", "CMGL 0 +CMGL: 1|hello|+CMGL: 2|world|" }));
+	CHECK_EQ(modem.URCs(), "");
+	
+	// A synchronous command while an asynchronous one is in flight, and commands from a handler
+	s_log.clear();
+	modem.CustomAsync("+CSQ"sv, [](const GL865::ErrorCode code, vec<strv>& lines) {
+		log("async CSQ %d %s", int(code), lines.empty() ? "" : std::string(lines[0]).c_str());
+		
+		int rssi;
+		log("sync in handler %d", int(s_modem->CSQ(rssi)));
+		
+		s_modem->CustomAsync("E0"sv, [](const GL865::ErrorCode code, vec<strv>& lines) { log("chained E0 %d lines %zu", int(code), lines.size()); });
+	});
+	
+	loop(2);		// The CSQ is in flight.
+	
+	int rssi = 0;
+	CHECK_EQ(modem.CSQ(rssi), Modem::OK);
+	CHECK_EQ(rssi, 17);
+	
+	loop(30);
+	CHECK(s_log == std::vector<std::string>({ "async CSQ 0 +CSQ: 17,0", "sync in handler 0", "chained E0 0 lines 0" }));
+	
+	// A full queue and a command too long
+	size_t queued = 0;
+	while (modem.CustomAsync("E0"sv, nullptr))
+		queued++;
+	
+	CHECK_EQ(queued, size_t(STM32T_GSM_ASYNC_QUEUE));
+	loop(100);
+	CHECK_EQ(modem.AsyncPending(), 0u);
+	
+	CHECK(!modem.CustomAsync(strv(std::string(STM32T_GSM_ASYNC_CMD_LEN, 'X')), nullptr));
+	CHECK_EQ(modem.AsyncPending(), 0u);
+	
+	printf("The main loop: %zu ProcessAsync() calls, the longest %u ms, %.0f ns each\n", calls, unsigned(longest), hostNs / calls);
+	CHECK_EQ(longest, 0u);
+	
+	// Throughput
+	constexpr int N = 1000;
+	size_t done = 0;
+	const uint32_t start = HAL_GetTick();
+	calls = 0;
+	hostNs = 0;
+	
+	for (int i = 0; i < N; i++)
+	{
+		while (!modem.SignalQualityAsync([](void *context, GL865::ErrorCode, int8_t, int16_t) { ++*static_cast<size_t *>(context); }, &done))
+			loop(1);
+	}
+	
+	while (modem.AsyncPending())
+		loop(1);
+	
+	const uint32_t time = HAL_GetTick() - start;
+	printf("%d asynchronous CSQs: %u ms (%.1f ms each), %zu ProcessAsync() calls, %.0f ns each\n", N, unsigned(time), double(time) / N,
+		calls, hostNs / calls);
+	CHECK_EQ(done, size_t(N));
+	CHECK_EQ(sim.unknown, 1u);		// +NONE
+	
+	return Test::Result();
+}
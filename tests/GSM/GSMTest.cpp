@@ -0,0 +1,182 @@
+// The GSM commands against the simulated modem: the response types, a URC between commands, the online mode (CONNECT ... NO CARRIER)
+// and the cost of a command. Built with and without STM32T_GSM_DMA_RX.
+
+#define STM32T_GSM_URC_SUPPORT
+
+#include "GSM/GL865.hpp"
+#include "ModemSim.hpp"
+#include "Test.hpp"
+
+#include <chrono>
+#include <string>
+
+using namespace STM32T;
+
+
+
+struct Modem : GL865
+{
+	using GL865::GL865;
+	using GL865::ErrorCode;
+	
+	ErrorCode CSQ(int& rssi)
+	{
+		return ResponseToken(300, CommandType::Execute, "+CSQ"sv, {}, [&](const strv token) -> ErrorCode {
+			return sscanf(token.data(), "%d", &rssi) == 1 ? OK : WRONG_FORMAT;
+		});
+	}
+	
+	ErrorCode EchoOff() { return SingleToken(300, CommandType::Execute, "E0"sv); }
+	ErrorCode Bad() { return SingleToken(300, CommandType::Execute, "+BAD"sv); }
+	ErrorCode Prompt() { return WaitForReady(300, CommandType::Write, "+CMGS"sv, "\"123\""sv); }
+	
+	ErrorCode Big(size_t& size)
+	{
+		return ResponseToken<700>(2, 2000, CommandType::Write, "#SRECV"sv, "1,600"sv, 1, [&](vec<strv>& tokens) {
+			size = tokens[0].size();
+			return OK;
+		});
+	}
+	
+	ErrorCode USSD(std::string& ussd)
+	{
+		return DelayedResponseToken<128>(2000, CommandType::Write, "+CUSD"sv, "1,\"*100#\""sv, [&](const strv token) {
+			ussd = std::string(token);
+			return OK;
+		});
+	}
+	
+	int32_t FTPGet(const strv file, std::string& data)
+	{
+		data.clear();
+		return ReceiveOnline<600>(1000, 3000, CommandType::Write, "#FTPGET"sv, [&](const strv chunk, const size_t pos) {
+			CHECK_EQ(pos, data.size());
+			data.append(chunk.data(), chunk.size());
+			return OK;
+		}, file);
+	}
+	
+	std::string URCs()
+	{
+		std::string all;
+		HandleURCs([&](const strv urc, uint32_t) {
+			all += std::string(urc) + "|";
+			return true;
+		});
+		
+		return all;
+	}
+};
+
+int main()
+{
+	UART_HandleTypeDef huart{};
+	DMA_HandleTypeDef hdma{};
+	huart.hdmarx = &hdma;
+	huart.Init.BaudRate = 115200;
+	#ifdef STM32T_GSM_DMA_RX
+	hdma.Init.Mode = DMA_CIRCULAR;
+	#endif
+	
+	Sim::Modem sim(&huart);
+	
+	std::string payload, file;
+	for (int i = 0; i < 600; i++)
+		payload += "0123456789ABCDEF"[i % 16];
+	
+	for (int i = 0; i < 2000; i++)
+		file += char('a' + i % 26);
+	
+	sim.script["AT+CSQ\r"] = { { 5, "\r\n+CSQ: 17,0\r\n\r\nOK\r\n" } };
+	sim.script["ATE0\r"] = { { 3, "\r\nOK\r\n" } };
+	sim.script["AT+BAD\r"] = { { 3, "\r\n+CME ERROR: 10\r\n" } };
+	sim.script["AT+CMGS=\"123\"\r"] = { { 10, "\r\n> " } };
+	sim.script["AT#SRECV=1,600\r"] = { { 5, "\r\n#SRECV: " + payload + "\r\n\r\nOK\r\n" } };
+	sim.script["AT+CUSD=1,\"*100#\"\r"] = { { 5, "\r\nOK\r\n" }, { 300, "\r\n+CUSD: 0,\"0048\",15\r\n" } };
+	sim.script["+++"] = {};		// It's in command mode after NO CARRIER.
+	
+	// NO CARRIER after a pause, right after the data, split between two chunks (1795 + 5 = 3 * 600) and after data that ends like
+	// its start.
+	sim.script["AT#FTPGET=pause\r"] = { { 20, "\r\nCONNECT\r\n" }, { 100, file }, { 500, "\r\nNO CARRIER\r\n" } };
+	sim.script["AT#FTPGET=merged\r"] = { { 20, "\r\nCONNECT\r\n" }, { 100, file + "\r\nNO CARRIER\r\n" } };
+	sim.script["AT#FTPGET=split\r"] = { { 20, "\r\nCONNECT\r\n" }, { 100, file.substr(0, 1795) + "\r\nNO CARRIER\r\n" } };
+	sim.script["AT#FTPGET=crlf\r"] = { { 20, "\r\nCONNECT\r\n" }, { 100, file + "\r\nNO\r\n" }, { 500, "\r\nNO CARRIER\r\n" } };
+	
+	Modem modem(&huart, IO::None(), IO::None());
+	#ifdef STM32T_GSM_DMA_RX
+	modem.EnableURC(true);
+	#endif
+	
+	int rssi = 0;
+	CHECK_EQ(modem.CSQ(rssi), Modem::OK);
+	CHECK_EQ(rssi, 17);
+	sim.Run(100);
+	
+	sim.Send("\r\nRING\r\n", 10);		// A URC between commands
+	sim.Run(50);
+	
+	CHECK_EQ(modem.EchoOff(), Modem::OK);
+	sim.Run(100);
+	CHECK_EQ(modem.Bad(), -1010);
+	sim.Run(100);
+	CHECK_EQ(modem.Prompt(), Modem::OK);
+	sim.Run(100);
+	
+	size_t size = 0;
+	CHECK_EQ(modem.Big(size), Modem::OK);
+	CHECK_EQ(size, 600u);
+	sim.Run(100);
+	
+	std::string ussd;
+	CHECK_EQ(modem.USSD(ussd), Modem::OK);
+	CHECK_EQ(ussd, "0,\"0048\",15");
+	sim.Run(100);
+	
+	#ifdef STM32T_GSM_DMA_RX
+	CHECK_EQ(modem.URCs(), "RING|");
+	
+	std::string data;
+	CHECK_EQ(modem.FTPGet("pause"sv, data), 2000);
+	CHECK_EQ(data, file);
+	sim.Run(2000);
+	
+	CHECK_EQ(modem.FTPGet("merged"sv, data), 2000);
+	CHECK_EQ(data, file);
+	sim.Run(2000);
+	
+	CHECK_EQ(modem.FTPGet("split"sv, data), 1795);
+	CHECK_EQ(data, file.substr(0, 1795));
+	sim.Run(2000);
+	
+	CHECK_EQ(modem.FTPGet("crlf"sv, data), 2006);
+	CHECK_EQ(data, file + "\r\nNO\r\n");
+	sim.Run(2000);
+	
+	CHECK_EQ(modem.URCs(), "");
+	#endif
+	
+	CHECK_EQ(sim.unknown, 0u);
+	
+	// The cost of a command on the host, without the simulation of the modem
+	constexpr int N = 2000;
+	uint32_t latency = 0;
+	double total = 0;
+	sim.ResetStats();
+	
+	for (int i = 0; i < N; i++)
+	{
+		const uint32_t start = HAL_GetTick();
+		const auto host = std::chrono::steady_clock::now();
+		
+		CHECK_EQ(modem.CSQ(rssi), Modem::OK);
+		
+		total += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - host).count();
+		latency += HAL_GetTick() - start;
+		sim.Run(10);
+	}
+	
+	printf("CSQ x%d: latency %.1f ms, %.1f wakeups, %.0f ns per command, %.0f ns of it in RX events\n", N, double(latency) / N,
+		double(sim.wakeups) / N, total / N, sim.eventNs / N);
+	
+	return Test::Result();
+}
@@ -0,0 +1,91 @@
+// GL865::SocketRead() against the simulated modem: a full 1500-byte read, a URC in the middle of the data, malformed data and an
+// error. Built with and without STM32T_GSM_DMA_RX.
+
+#define STM32T_GSM_URC_SUPPORT
+
+#include "GSM/GL865.hpp"
+#include "ModemSim.hpp"
+#include "Test.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace STM32T;
+
+
+
+struct Modem : GL865
+{
+	using GL865::GL865;
+	
+	std::string URCs()
+	{
+		std::string all;
+		HandleURCs([&](const strv urc, uint32_t) {
+			all += std::string(urc) + "|";
+			return true;
+		});
+		
+		return all;
+	}
+};
+
+int main()
+{
+	UART_HandleTypeDef huart{};
+	DMA_HandleTypeDef hdma{};
+	huart.hdmarx = &hdma;
+	huart.Init.BaudRate = 115200;
+	#ifdef STM32T_GSM_DMA_RX
+	hdma.Init.Mode = DMA_CIRCULAR;
+	#endif
+	
+	Sim::Modem sim(&huart);
+	
+	std::string payload, hex;
+	for (int i = 0; i < 1500; i++)
+	{
+		payload += char((i * 7) & 0xFF);
+		
+		char byte[3];
+		snprintf(byte, sizeof(byte), "%02X", uint8_t(payload.back()));
+		hex += byte;
+	}
+	
+	sim.script["AT#SRECV=1,1500\r"] = { { 5, "\r\n#SRECV: 1,1500\r\n" + hex + "\r\n\r\nOK\r\n" } };
+	sim.script["AT#SRECV=2,1500\r"] = { { 5, "\r\n#SRECV: 2,4\r\n0A0B0C0D\r\n+CREG: 1\r\n\r\nOK\r\n" } };
+	sim.script["AT#SRECV=3,1500\r"] = { { 5, "\r\n#SRECV: 3,4\r\n0A0B0C\r\n\r\nOK\r\n" } };
+	sim.script["AT#SRECV=4,1500\r"] = { { 5, "\r\n+CME ERROR: 3\r\n" } };
+	
+	Modem modem(&huart, IO::None(), IO::None());
+	#ifdef STM32T_GSM_DMA_RX
+	modem.EnableURC(true);
+	#endif
+	
+	std::vector<char> buf(1500);
+	
+	const uint32_t start = HAL_GetTick();
+	int32_t n = modem.SocketRead(1, buf.data(), 1500, 2000);
+	printf("SocketRead of 1500 bytes: %d in %u ms\n", int(n), unsigned(HAL_GetTick() - start));
+	CHECK_EQ(n, 1500);
+	CHECK(std::string(buf.data(), 1500) == payload);
+	sim.Run(50);
+	
+	n = modem.SocketRead(2, buf.data(), 1500, 2000);
+	CHECK_EQ(n, 4);
+	CHECK(std::string(buf.data(), 4) == "\x0A\x0B\x0C\x0D");
+	sim.Run(50);
+	
+	CHECK_EQ(modem.SocketRead(3, buf.data(), 1500, 2000), GL865::WRONG_FORMAT);
+	sim.Run(50);
+	
+	CHECK_EQ(modem.SocketRead(4, buf.data(), 1500, 2000), -1003);
+	sim.Run(50);
+	
+	CHECK_EQ(sim.unknown, 0u);
+	#ifdef STM32T_GSM_DMA_RX
+	CHECK_EQ(modem.URCs(), "+CREG: 1|");
+	#endif
+	
+	return Test::Result();
+}
@@ -0,0 +1,189 @@
+// URCRing, and the URC reception without STM32T_GSM_DMA_RX (an RX event per idle line or full buffer): URCs split between the
+// events at random, a command sent while a URC is being received, a full buffer and the cost per event.
+
+#define STM32T_GSM_URC_SUPPORT
+
+#include "GSM/GL865.hpp"
+#include "ModemSim.hpp"
+#include "Test.hpp"
+
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace STM32T;
+
+
+
+struct Modem : GL865
+{
+	using GL865::GL865;
+	using GL865::ErrorCode;
+	
+	std::vector<std::string> urcs;
+	
+	ErrorCode CSQ(int& rssi)
+	{
+		return ResponseToken(300, CommandType::Execute, "+CSQ"sv, {}, [&](const strv token) -> ErrorCode {
+			return sscanf(token.data(), "%d", &rssi) == 1 ? OK : WRONG_FORMAT;
+		});
+	}
+	
+	size_t Take()
+	{
+		return HandleURCs([&](const strv urc, uint32_t) {
+			urcs.emplace_back(urc);
+			return true;
+		});
+	}
+};
+
+template <size_t SIZE>
+static std::string handle(URCRing<SIZE>& ring, const std::function<bool (strv)>& remove = [](strv) { return true; })
+{
+	std::string all;
+	ring.Handle([&](const strv urc, uint32_t) {
+		CHECK(urc.data()[urc.size()] == 0);
+		all += std::string(urc) + "|";
+		return remove(urc);
+	});
+	
+	return all;
+}
+
+static void testRing()
+{
+	URCRing<64> ring;
+	
+	// Records: 8 bytes of header and the text with its null, padded to 8
+	CHECK(ring.Push("U0"sv, 1));
+	CHECK(ring.Push("U1"sv, 2));
+	CHECK(ring.Push("U2"sv, 3));
+	CHECK(ring.Push("U3"sv, 4));
+	CHECK(!ring.Push("U4"sv, 5));
+	CHECK_EQ(ring.Dropped(), 1u);
+	CHECK_EQ(ring.MaxUsed(), 64u);
+	
+	// Only the odd ones are removed; the rest keep their order.
+	CHECK_EQ(handle(ring, [](const strv urc) { return urc.back() % 2 == 1; }), "U0|U1|U2|U3|");
+	CHECK_EQ(handle(ring, [](strv) { return false; }), "U0|U2|");
+	
+	// A nested Handle() doesn't free the record that the outer one is handling.
+	std::string nested;
+	ring.Handle([&](const strv urc, uint32_t) {
+		if (urc == "U0"sv)
+			nested = handle(ring, [](const strv urc) { return urc == "U2"sv; });
+		
+		return urc == "U0"sv;
+	});
+	
+	CHECK_EQ(nested, "U0|U2|");
+	CHECK(ring.Empty());
+	
+	// The empty ring is rewound: the longest URC fits, though the last record ended in the middle of the buffer.
+	CHECK(ring.Push("U5"sv, 6));
+	CHECK_EQ(handle(ring), "U5|");
+	
+	const std::string longest(64 - 8 - 1, 'L');
+	CHECK(ring.Push(longest, 7));
+	CHECK_EQ(handle(ring), longest + "|");
+	CHECK(!ring.Push(longest + "L", 8));
+	
+	// A record that doesn't fit before the end of the buffer is put at the beginning.
+	CHECK(ring.Push("1234567"sv, 9));
+	CHECK(ring.Push("A"sv, 10));
+	CHECK(ring.Push("B"sv, 11));
+	CHECK_EQ(handle(ring, [](const strv urc) { return urc != "B"sv; }), "1234567|A|B|");
+	CHECK(ring.Push(std::string(20, 'C'), 12));
+	CHECK_EQ(handle(ring), "B|" + std::string(20, 'C') + "|");
+	CHECK(ring.Empty());
+}
+
+int main()
+{
+	testRing();
+	
+	UART_HandleTypeDef huart{};
+	DMA_HandleTypeDef hdma{};
+	huart.hdmarx = &hdma;
+	huart.Init.BaudRate = 115200;
+	
+	Sim::Modem sim(&huart);
+	sim.script["AT+CSQ\r"] = { { 5, "\r\n+CSQ: 17,0\r\n\r\nOK\r\n" } };
+	
+	Modem modem(&huart, IO::None(), IO::None());
+	modem.EnableURC(true);
+	
+	// Random URCs, split between the RX events by idle gaps and the full buffer
+	const char *const kinds[] = { "RING", "+CREG: 5", "+CGREG: 1,\"1A2B\",\"0001ABCD\"", "#SRING: 1,20", "+CMTI: \"SM\",3", "NO CARRIER" };
+	std::mt19937 rng(1);
+	std::vector<std::string> expected;
+	std::string stream;
+	
+	for (int i = 0; i < 20000; i++)
+	{
+		std::string urc = kinds[rng() % std::size(kinds)];
+		if (rng() % 4 == 0)
+			urc += "," + std::string(rng() % 60, 'x');
+		
+		expected.push_back(urc);
+		stream += "\r\n" + urc + "\r\n";
+	}
+	
+	for (size_t pos = 0; pos < stream.size();)
+	{
+		const size_t n = std::min<size_t>(rng() % 8 == 0 ? 700 : 1 + rng() % 80, stream.size() - pos);
+		sim.Send(stream.substr(pos, n));
+		pos += n;
+		
+		if (rng() % 3 == 0)		// The next piece follows without a gap.
+			continue;
+		
+		while (!sim.Sent())
+			sim.Run(1);
+		
+		if (rng() % 2 == 0)
+			modem.Take();
+	}
+	
+	sim.Run(10);
+	modem.Take();
+	
+	// The stored ones must be whole, in order; the newest are dropped when the buffer is full.
+	size_t matched = 0, e = 0;
+	for (const std::string& urc : modem.urcs)
+	{
+		while (e < expected.size() && expected[e] != urc)
+			e++;
+		
+		if (e < expected.size())
+		{
+			matched++;
+			e++;
+		}
+	}
+	
+	printf("%zu URCs, %zu stored (the rest dropped with the buffer full), %zu RX events, %.0f ns per event\n", expected.size(), modem.urcs.size(), sim.events, sim.eventNs / sim.events);
+	CHECK_EQ(matched, modem.urcs.size());
+	CHECK_EQ(modem.urcs.size() + modem.DroppedURCs(), expected.size());
+	CHECK(modem.urcs.size() > expected.size() / 2);
+	
+	// A command sent right after a URC, before the idle line raised its RX event: the URC is stored, the response isn't.
+	modem.urcs.clear();
+	sim.Send("\r\nRING\r\n");
+	sim.Advance(8 * Sim::Modem::BYTE_US - 1);
+	
+	int rssi = 0;
+	CHECK_EQ(modem.CSQ(rssi), Modem::OK);
+	CHECK_EQ(rssi, 17);
+	sim.Run(100);
+	
+	modem.Take();
+	std::string all;
+	for (const std::string& urc : modem.urcs)
+		all += urc + "|";
+	
+	CHECK_EQ(all, "RING|");
+	
+	return Test::Result();
+}
@@ -0,0 +1,144 @@
+// ITM: the writes to the stimulus ports captured as an SWO stream and checked against known packets (text split into 4/2/1-byte
+// writes, a name definition and an event), then the whole capture, with sync, overflow, timestamp and hardware source packets
+// mixed in, decoded by ITM.py and checked event by event.
+
+#include "ITM.hpp"
+#include "Test.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace STM32T;
+
+
+
+static std::vector<uint8_t> s_swo;
+
+// A software source packet: the port, the size, then the value (little-endian)
+static void capture(const uint8_t port, const uint32_t value, const uint8_t size)
+{
+	s_swo.push_back(uint8_t(port << 3 | (size == 4 ? 3 : size)));
+	
+	for (uint8_t i = 0; i < size; i++)
+		s_swo.push_back(uint8_t(value >> 8 * i));
+}
+
+static void protocol(const std::vector<uint8_t>& bytes)
+{
+	s_swo.insert(s_swo.end(), bytes.begin(), bytes.end());
+}
+
+// The bytes of 32-bit writes to port 1
+static std::vector<uint8_t> words(const std::vector<uint32_t>& values)
+{
+	std::vector<uint8_t> bytes;
+	
+	for (const uint32_t value : values)
+		bytes.insert(bytes.end(), { 0x0B, uint8_t(value), uint8_t(value >> 8), uint8_t(value >> 16), uint8_t(value >> 24) });
+	
+	return bytes;
+}
+
+static std::string decode(const std::string& itmPy)
+{
+	const char *const path = "ITMTest.swo";
+	
+	FILE *file = fopen(path, "wb");
+	fwrite(s_swo.data(), 1, s_swo.size(), file);
+	fclose(file);
+	
+	FILE *const pipe = popen(("python3 \"" + itmPy + "\" --json -i " + path + " 2>&1").c_str(), "r");
+	if (!pipe)
+		return "";
+	
+	std::string out;
+	char buf[256];
+	while (const size_t len = fread(buf, 1, sizeof(buf), pipe))
+		out.append(buf, len);
+	
+	pclose(pipe);
+	return out;
+}
+
+static void zone()
+{
+	STM32T_ITM_ZONE("Work");
+	Stub_DWT.CYCCNT += 500;
+}
+
+int main()
+{
+	Stub::OnITMWrite = capture;
+	
+	// Disabled: nothing is written.
+	Itm::Output<0>("lost\n"sv, true);
+	CHECK(s_swo.empty());
+	
+	ITM->TCR = ITM_TCR_ITMENA_Msk;
+	ITM->TER = 0b111;
+	
+	// Text: a 4-byte packet, then a 2-byte and a 1-byte one for the rest
+	Itm::Output<0>("boot!\n"sv, true);
+	CHECK(s_swo == std::vector<uint8_t>({ 0x03, 'b', 'o', 'o', 't', 0x02, '!', '\n' }));
+	
+	Itm::Output<0>("abcdefg"sv, false);
+	Itm::Output<0>("\n"sv, true);
+	CHECK(std::vector<uint8_t>(s_swo.begin() + 8, s_swo.end()) == std::vector<uint8_t>({ 0x03, 'a', 'b', 'c', 'd', 0x02, 'e', 'f', 0x01, 'g',
+		0x01, '\n' }));
+	
+	// The first use of a name sends its definition (the rest of the name and the padding to 4 bytes in smaller writes), then the
+	// event with its timestamp.
+	protocol({ 0x00, 0x00, 0x00, 0x00, 0x00, 0x80 });		// Sync
+	const size_t start = s_swo.size();
+	Stub_DWT.CYCCNT = 1000;
+	STM32T_ITM_MARK("Boot!");
+	
+	std::vector<uint8_t> expected = words({ 0x01000001, 5, 0x746F6F42 });
+	expected.insert(expected.end(), { 0x09, '!', 0x0A, 0, 0, 0x09, 0 });
+	const std::vector<uint8_t> event = words({ 0x04000001, 1000 });
+	expected.insert(expected.end(), event.begin(), event.end());
+	CHECK(std::vector<uint8_t>(s_swo.begin() + start, s_swo.end()) == expected);
+	
+	protocol({ 0xC0, 0x85, 0x03 });		// Local timestamp, 3 bytes
+	protocol({ 0x30 });					// Local timestamp, 1 byte
+	
+	Stub_DWT.CYCCNT = 2000;
+	zone();
+	
+	protocol({ 0x70 });					// Overflow
+	protocol({ 0x94, 0x81, 0x02 });		// Global timestamp
+	protocol({ 0x05, 0x21 });			// Hardware source (event counter)
+	
+	Stub_DWT.CYCCNT = 3000;
+	STM32T_ITM_VALUE("temp", -5);
+	STM32T_ITM_VALUE("count", 7u);
+	STM32T_ITM_VALUE("ratio", 2.5);
+	STM32T_ITM_MARK("Boot!");
+	Itm::Output<0>("done\n"sv, true);
+	
+	// The counter wraps: the timestamps are unwrapped.
+	Stub_DWT.CYCCNT = 100;
+	STM32T_ITM_MARK("Boot!");
+	
+	std::string itmPy = __FILE__;
+	itmPy = itmPy.substr(0, itmPy.rfind("tests")) + "ITM.py";
+	
+	const std::string decoded = decode(itmPy);
+	printf("%zu bytes captured, decoded by ITM.py:\n%s", s_swo.size(), decoded.c_str());
+	
+	CHECK_EQ(decoded,
+		"Warning: 1 ITM overflow packet(s); some data was lost.\n"
+		"{\"time\": 0, \"type\": \"text\", \"text\": \"boot!\"}\n"
+		"{\"time\": 0, \"type\": \"text\", \"text\": \"abcdefg\"}\n"
+		"{\"time\": 1000, \"type\": \"mark\", \"name\": \"Boot!\"}\n"
+		"{\"time\": 2000, \"type\": \"begin\", \"name\": \"Work\"}\n"
+		"{\"time\": 2500, \"type\": \"end\", \"name\": \"Work\", \"duration\": 500}\n"
+		"{\"time\": 3000, \"type\": \"value\", \"name\": \"temp\", \"value\": -5}\n"
+		"{\"time\": 3000, \"type\": \"value\", \"name\": \"count\", \"value\": 7}\n"
+		"{\"time\": 3000, \"type\": \"value\", \"name\": \"ratio\", \"value\": 2.5}\n"
+		"{\"time\": 3000, \"type\": \"mark\", \"name\": \"Boot!\"}\n"
+		"{\"time\": 3000, \"type\": \"text\", \"text\": \"done\"}\n"
+		"{\"time\": 4294967396, \"type\": \"mark\", \"name\": \"Boot!\"}\n");
+	
+	return Test::Result();
+}
@@ -0,0 +1,145 @@
+// AsyncOutput: messages in one or several chunks, wrapping around the buffer, the three overflow policies, a message from an ISR in
+// the middle of another one, a line cut short by an invalid format, and the time spent logging compared with a slow output.
+
+#include "Log.hpp"
+#include "Test.hpp"
+
+#include <chrono>
+#include <string>
+
+using namespace STM32T;
+using namespace STM32T::Log;
+
+
+
+namespace Sim
+{
+	constexpr uint32_t USART_IRQ = 53 + 16;
+	
+	std::string sink;
+	size_t messages = 0;
+	
+	// ~1 us per byte, like a UART at 1 Mbaud
+	void slow(const strv data, const bool last)
+	{
+		const auto end = std::chrono::steady_clock::now() + std::chrono::nanoseconds(1000 * data.size());
+		while (std::chrono::steady_clock::now() < end);
+		
+		sink.append(data.data(), data.size());
+		if (last)
+			messages++;
+	}
+	
+	void clear()
+	{
+		sink.clear();
+		messages = 0;
+	}
+}
+
+static AsyncOutput<4096> s_async(std::array{Sim::slow});
+static const Logger<1> s_sync(Level::Debug, "S"sv, std::array<output_t, 1>{Sim::slow}, nullptr);
+static const Logger<1> s_log(Level::Debug, "A"sv, std::array<output_t, 1>{AsyncOutput<4096>::Output<s_async>}, nullptr);
+
+template <class L>
+static double bench(const L& log, const int count)
+{
+	double total = 0;
+	for (int i = 0; i < count; i++)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		log.d("iteration %d value %u name %s", i, 1234u, "abc");
+		total += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+		
+		if (i % 8 == 7)
+			s_async.Drain();
+	}
+	
+	return total / count;
+}
+
+int main()
+{
+	// The cost of logging
+	const double sync = bench(s_sync, 500);
+	Sim::clear();
+	
+	const double async = bench(s_log, 500);
+	s_async.Drain();
+	
+	printf("A line: %.2f us to the slow output, %.2f us to AsyncOutput\n", sync, async);
+	CHECK_EQ(Sim::messages, 500u);
+	CHECK_EQ(s_async.DroppedNewest(), 0u);
+	CHECK(async < sync);
+	
+	// The overflow policies, with more messages than the buffer holds
+	for (const Overflow policy : { Overflow::DropNewest, Overflow::DropOldest, Overflow::Block })
+	{
+		Sim::clear();
+		s_async.policy = policy;
+		const uint32_t newest = s_async.DroppedNewest(), oldest = s_async.DroppedOldest();
+		
+		for (int i = 0; i < 400; i++)
+			s_log.d("overload %d", i);
+		
+		s_async.Drain();
+		CHECK_EQ(Sim::messages + s_async.DroppedNewest() - newest + s_async.DroppedOldest() - oldest, 400u);
+		
+		if (policy == Overflow::DropNewest)
+			CHECK(Sim::sink.find("overload 0\n") != std::string::npos);
+		else
+			CHECK(Sim::sink.find("overload 399\n") != std::string::npos);
+		
+		if (policy == Overflow::Block)
+			CHECK_EQ(Sim::messages, 400u);
+	}
+	
+	// Messages in several chunks wrapping around the buffer
+	Sim::clear();
+	s_async.policy = Overflow::DropNewest;
+	std::string expected;
+	
+	for (int i = 0; i < 5000; i++)
+	{
+		const std::string text(i % 300, char('a' + i % 26));
+		s_async.Write(text, false);
+		s_async.Write("\n"sv, true);
+		expected += text + "\n";
+		
+		if (i % 3 == 0)
+			s_async.Drain();
+	}
+	
+	s_async.Drain();
+	CHECK(Sim::sink == expected);
+	
+	// A message from an ISR in the middle of another one is dropped; the first one is whole.
+	Sim::clear();
+	const uint32_t dropped = s_async.DroppedNewest();
+	
+	s_async.Write("main part1 "sv, false);
+	Stub::IPSR = Sim::USART_IRQ;
+	s_log.d("isr");
+	Stub::IPSR = 0;
+	s_async.Write("part2\n"sv, true);
+	
+	s_async.Drain();
+	CHECK_EQ(Sim::sink, "main part1 part2\n");
+	CHECK_EQ(s_async.DroppedNewest(), dropped + 1);
+	
+	// A line cut short by an invalid format still ends its message: the next ones, from the same context or an ISR, are kept.
+	Sim::clear();
+	const char *const invalid = "bad %y here";
+	s_log.d(invalid, 1);
+	Stub::IPSR = Sim::USART_IRQ;
+	s_log.d("isr %d", 2);
+	Stub::IPSR = 0;
+	s_log.d("main %d", 3);
+	
+	s_async.Drain();
+	CHECK_EQ(Sim::messages, 3u);
+	CHECK_EQ(Sim::sink, "[Debug][A]: bad [Debug][A]: isr 2\n[Debug][A]: main 3\n");
+	CHECK_EQ(s_async.DroppedNewest(), dropped + 1);
+	
+	return Test::Result();
+}
@@ -0,0 +1,132 @@
+// DeferredLogger: the bytes of a record, the records drained to the outputs, dropped records, and the capture decoded by
+// DeferredLog.py with this file as the source. Then the cost of a deferred call (drained every 16 calls) against the same line
+// formatted by Logger with a timestamp.
+
+#include "DeferredLog.hpp"
+#include "Test.hpp"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace STM32T;
+using namespace STM32T::Log;
+
+
+
+static std::vector<uint8_t> s_out;
+static size_t s_writes = 0;
+
+static void collect(const strv data, bool)
+{
+	s_out.insert(s_out.end(), data.begin(), data.end());
+	s_writes++;
+}
+
+static void discard(strv, bool) {}
+
+static DeferredLogger<512> s_dlog(Level::Info, std::array<output_t, 1>{collect});
+
+static std::string decode(const std::vector<uint8_t>& capture, const std::string& script)
+{
+	const char *const path = "DeferredLogTest.bin";
+	
+	FILE *file = fopen(path, "wb");
+	fwrite(capture.data(), 1, capture.size(), file);
+	fclose(file);
+	
+	FILE *const pipe = popen(("python3 \"" + script + "\" -s \"" __FILE__ "\" -i " + path + " 2>&1").c_str(), "r");
+	if (!pipe)
+		return "";
+	
+	std::string out;
+	char buf[256];
+	while (const size_t len = fread(buf, 1, sizeof(buf), pipe))
+		out.append(buf, len);
+	
+	pclose(pipe);
+	return out;
+}
+
+template <class F>
+static double bench(F&& log)
+{
+	constexpr int N = 2000000;
+	const auto start = std::chrono::steady_clock::now();
+	
+	for (int i = 0; i < N; i++)
+		log(i);
+	
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / N;
+}
+
+int main()
+{
+	// A record: [SYNC][len][level][id][timestamp][args...]
+	uwTick = 563;
+	STM32T_DLOG_I(s_dlog, "Hello, %s! %d", "World", 42);
+	CHECK_EQ(s_dlog.Pending(), 21u);
+	CHECK_EQ(s_dlog.Drain(), 21u);
+	CHECK_EQ(s_writes, 1u);
+	
+	const uint32_t id = FormatId("Hello, %s! %d");
+	const std::vector<uint8_t> expected = { DeferredLogger<>::SYNC, 19, uint8_t(Level::Info), uint8_t(id), uint8_t(id >> 8),
+		uint8_t(id >> 16), uint8_t(id >> 24), 0x33, 0x02, 0, 0, 5, 'W', 'o', 'r', 'l', 'd', 42, 0, 0, 0 };
+	CHECK(s_out == expected);
+	
+	// Disabled levels aren't stored; the other argument types
+	STM32T_DLOG_D(s_dlog, "Hidden %d", 1);
+	CHECK_EQ(s_dlog.Pending(), 0u);
+	
+	uwTick = 1000;
+	STM32T_DLOG_W(s_dlog, "x=%04X big=%lld ratio=%.2f c=%c", 0xBEEFu, -5000000000LL, 2.5, 'z');
+	STM32T_DLOG_E(s_dlog, "%s|%s", "", static_cast<const char *>(nullptr));
+	
+	// Full: the records that don't fit are dropped, and counted once the buffer is drained.
+	uwTick = 2000;
+	for (int i = 0; i < 40; i++)
+		STM32T_DLOG_I(s_dlog, "Fill %d", i);
+	
+	CHECK_EQ(s_dlog.Dropped(), 40u - (512u - 35 - 13) / 15);
+	
+	// Only whole records within max_len
+	CHECK_EQ(s_dlog.Drain(20), 0u);
+	CHECK_EQ(s_dlog.Drain(35 + 13 + 14), 35u + 13);
+	s_writes = 0;
+	s_dlog.Drain();
+	CHECK(s_writes >= 2 && s_writes <= 3);		// The records (one write, or two across the end of the ring), then the dropped record
+	CHECK_EQ(s_dlog.Pending(), 0u);
+	CHECK_EQ(s_dlog.Dropped(), 10u);
+	
+	std::string script = __FILE__;
+	script = script.substr(0, script.rfind("tests")) + "DeferredLog.py";
+	
+	const std::string decoded = decode(s_out, script);
+	std::string lines = "[       563][Info ]: Hello, World! 42\n"
+		"[      1000][Warn ]: x=BEEF big=-5000000000 ratio=2.50 c=z\n"
+		"[      1000][Error]: |\n";
+	
+	for (int i = 0; i < 30; i++)
+		lines += "[      2000][Info ]: Fill " + std::to_string(i) + "\n";
+	
+	lines += "[      2000][Warn ]: <10 record(s) dropped>\n";
+	CHECK_EQ(decoded, lines);
+	
+	// The cost of a call: storing the record against formatting the line
+	static DeferredLogger<1024> deferred(Level::Info, std::array<output_t, 1>{discard});
+	static const Logger<1> text(Level::Info, "L"sv, std::array<output_t, 1>{discard}, default_timestamp);
+	
+	const double deferredNs = bench([](const int i)
+	{
+		STM32T_DLOG_I(deferred, "temp=%d hum=%u name=%s", i, 45u, "sensor");
+		if ((i & 15) == 15)
+			deferred.Drain();
+	});
+	const double textNs = bench([](const int i) { text.i("temp=%d hum=%u name=%s", i, 45u, "sensor"); });
+	CHECK_EQ(deferred.Dropped(), 0u);
+	
+	printf("%zu bytes captured, decoded by DeferredLog.py:\n%s", s_out.size(), decoded.c_str());
+	printf("Per call: %.1f ns deferred (26-byte record), %.1f ns formatted by Logger (%.1fx)\n", deferredNs, textNs, textNs / deferredNs);
+	
+	return Test::Result();
+}
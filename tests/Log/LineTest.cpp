@@ -0,0 +1,108 @@
+// Line buffering: with a counting output, each line (timestamp, prefix, conversions and the end) reaches the output in one write
+// through the runtime and the compile-time format paths, a line longer than the buffer in one write per buffer, and without a
+// buffer in one write per piece. The writes and bytes per line are reported.
+
+#include "Log.hpp"
+#include "Test.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace STM32T;
+using namespace STM32T::Log;
+
+
+
+struct Write
+{
+	std::string data;
+	bool last;
+};
+
+static std::vector<Write> s_writes;
+
+static void count(const strv data, const bool last)
+{
+	s_writes.push_back({ std::string(data), last });
+}
+
+static strv timestamp() { return "        42"sv; }
+
+static constexpr Logger<1> s_log(Level::Info, "Line"sv, std::array{count}, timestamp);
+static constexpr Logger<1, 32> s_small(Level::Info, "Line"sv, std::array{count}, timestamp);
+static constexpr Logger<1, 0> s_unbuffered(Level::Info, "Line"sv, std::array{count}, timestamp);
+
+static std::vector<Write> take()
+{
+	std::vector<Write> writes;
+	writes.swap(s_writes);
+	return writes;
+}
+
+// The whole line, checking that only the last write ends it
+static std::string joined(const std::vector<Write>& writes)
+{
+	std::string line;
+	
+	for (size_t i = 0; i < writes.size(); i++)
+	{
+		CHECK_EQ(writes[i].last, i == writes.size() - 1);
+		line += writes[i].data;
+	}
+	
+	return line;
+}
+
+static void report(const char *const name, const std::vector<Write>& writes)
+{
+	printf("%-34s %2zu write(s), %3zu bytes\n", name, writes.size(), joined(writes).size());
+}
+
+int main()
+{
+	const std::string line = "[        42][Info ][Line]: temp=-12 hum=45% name=sensor x=BEEF\n";
+	
+	s_log.i("temp=%d hum=%u%% name=%s x=%04X", -12, 45u, "sensor", 0xBEEFu);
+	std::vector<Write> writes = take();
+	CHECK_EQ(writes.size(), 1u);
+	CHECK_EQ(joined(writes), line);
+	report("Runtime format", writes);
+	
+	s_log.i(STM32T_FMT("temp=%d hum=%u%% name=%s x=%04X"), -12, 45u, "sensor", 0xBEEFu);
+	writes = take();
+	CHECK_EQ(writes.size(), 1u);
+	CHECK_EQ(joined(writes), line);
+	report("Compile-time format", writes);
+	
+	// Longer than the buffer: one write per buffer, or the piece itself when it alone doesn't fit
+	s_small.i("temp=%d hum=%u%% name=%s x=%04X", -12, 45u, "sensor", 0xBEEFu);
+	writes = take();
+	CHECK(writes.size() > 1 && writes.size() <= 3);
+	CHECK_EQ(joined(writes), line);
+	
+	for (const Write& write : writes)
+		CHECK(write.data.size() <= 32);
+	
+	report("Runtime format, 32-byte buffer", writes);
+	
+	const std::string text(100, 'x');
+	s_small.i("%s", text.c_str());
+	writes = take();
+	CHECK_EQ(joined(writes), "[        42][Info ][Line]: " + text + "\n");
+	report("100-char string, 32-byte buffer", writes);
+	
+	// Without a buffer, every piece is a write.
+	s_unbuffered.i("temp=%d hum=%u%% name=%s x=%04X", -12, 45u, "sensor", 0xBEEFu);
+	writes = take();
+	CHECK(writes.size() > 10);
+	CHECK_EQ(joined(writes), line);
+	report("Runtime format, no buffer", writes);
+	
+	// A line cut short by an invalid format is still ended.
+	s_log.i("ok %d %", 1);
+	writes = take();
+	CHECK_EQ(writes.size(), 1u);
+	CHECK(writes[0].last);
+	
+	return Test::Result();
+}
@@ -0,0 +1,78 @@
+// Log levels with STM32T_LOG_MAX_LEVEL at Info: a call below a ModuleLevel is checked at runtime and follows the module level (set
+// directly or by Command()), a call above the ceiling is removed at compile time whatever the module level, and the cost of each.
+
+#define STM32T_LOG_MAX_LEVEL	Level::Info
+
+#include "Log.hpp"
+#include "Test.hpp"
+
+#include <chrono>
+#include <string>
+
+using namespace STM32T;
+using namespace STM32T::Log;
+
+
+
+static std::string s_sink;
+
+static void collect(const strv data, bool)
+{
+	s_sink.append(data.data(), data.size());
+}
+
+static ModuleLevel s_level("Mod"sv, Level::Warning);
+static constexpr Logger s_log(s_level, Level::Max, "M"sv, std::array{collect}, nullptr);
+
+static std::string take()
+{
+	std::string text;
+	text.swap(s_sink);
+	return text;
+}
+
+template <class F>
+static double bench(F&& body)
+{
+	constexpr int N = 20000000;
+	const auto start = std::chrono::steady_clock::now();
+	
+	for (int i = 0; i < N; i++)
+		body(i);
+	
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / N;
+}
+
+int main()
+{
+	static_assert(s_log.isCompiled(Level::Info) && !s_log.isCompiled(Level::Debug));
+	
+	// Below the module level: compiled in, filtered at runtime
+	LOG_W<s_log>("warn %d", 1);
+	LOG_I<s_log>("info %d", 1);
+	CHECK_EQ(take(), "[Warn ][M]: warn 1\n");
+	
+	s_level.set(Level::Info);
+	LOG_I<s_log>("info %d", 2);
+	CHECK_EQ(take(), "[Info ][M]: info 2\n");
+	
+	// Above the ceiling: removed, even with the module at Max
+	CHECK(ModuleLevel::Command("Mod max"sv, collect));
+	CHECK_EQ(s_level.level(), Level::Max);
+	LOG_D<s_log>("debug %d", 3);
+	LOG_I<s_log>("info %d", 3);
+	CHECK_EQ(take(), "[Info ][M]: info 3\n");
+	
+	// The cost of a call that logs nothing
+	s_level.set(Level::Warning);
+	volatile int sink = 0;
+	const double empty = bench([&](const int i) { sink = i; });
+	const double runtime = bench([&](const int i) { sink = i; LOG_I<s_log>("info %d", i); });
+	const double stripped = bench([&](const int i) { sink = i; LOG_D<s_log>("debug %d", i); });
+	CHECK(s_sink.empty());
+	
+	printf("Call that logs nothing: %.2f ns below the module level, %.2f ns above STM32T_LOG_MAX_LEVEL (%.2f ns for the loop alone)\n",
+		runtime, stripped, empty);
+	
+	return Test::Result();
+}
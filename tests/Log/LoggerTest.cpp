@@ -0,0 +1,85 @@
+// Logger: %s and %.*s with a null pointer and with a string without a null terminator (right before an unreadable page, so reading past
+// the precision crashes), through the runtime and the compile-time format paths, and the cost of a line through each path.
+
+#include "Log.hpp"
+#include "Test.hpp"
+
+#include <chrono>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace STM32T;
+using namespace STM32T::Log;
+
+
+
+static std::string s_sink;
+
+static void collect(const strv data, bool)
+{
+	s_sink.append(data.data(), data.size());
+}
+
+static const Logger<1> s_log(Level::Info, "L"sv, std::array<output_t, 1>{collect}, nullptr);
+
+static std::string take()
+{
+	std::string text;
+	text.swap(s_sink);
+	return text;
+}
+
+template <class F>
+static double bench(F&& log)
+{
+	constexpr int N = 200000;
+	const auto start = std::chrono::steady_clock::now();
+	
+	for (int i = 0; i < N; i++)
+	{
+		log(i);
+		s_sink.clear();
+	}
+	
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / N;
+}
+
+int main()
+{
+	// "abc" at the end of a page followed by an unreadable one
+	const size_t page = sysconf(_SC_PAGESIZE);
+	char *const pages = static_cast<char *>(mmap(nullptr, 2 * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+	CHECK(pages != MAP_FAILED);
+	CHECK_EQ(mprotect(pages + page, page, PROT_NONE), 0);
+	
+	const char *const abc = pages + page - 3;
+	std::memcpy(pages + page - 3, "abc", 3);
+	const char *const null = nullptr;
+	
+	const char *const strings = "%.*s|%.*s|%s";
+	s_log.i(strings, 3, abc, 2, abc, null);
+	CHECK_EQ(take(), "[Info ][L]: abc|ab|(null)\n");
+	
+	s_log.i(STM32T_FMT("%.*s|%.*s|%s"), 3, abc, 2, abc, null);
+	CHECK_EQ(take(), "[Info ][L]: abc|ab|(null)\n");
+	
+	char buf[32];
+	CHECK_EQ(Format::format(buf, sizeof(buf), "%.*s|%5.2s|%s", 3, abc, abc, null), 16);
+	CHECK_EQ(std::string(buf), "abc|   ab|(null)");
+	
+	munmap(pages, 2 * page);
+	
+	// The same line through both paths
+	const char *const fmt = "temp=%d hum=%u%% name=%s x=%04X";
+	s_log.i(fmt, -12, 45u, "sensor", 0xBEEFu);
+	const std::string expected = take();
+	s_log.i(STM32T_FMT("temp=%d hum=%u%% name=%s x=%04X"), -12, 45u, "sensor", 0xBEEFu);
+	CHECK_EQ(take(), expected);
+	
+	const double runtime = bench([fmt](const int i) { s_log.i(fmt, i, 45u, "sensor", 0xBEEFu); });
+	const double compiled = bench([](const int i) { s_log.i(STM32T_FMT("temp=%d hum=%u%% name=%s x=%04X"), i, 45u, "sensor", 0xBEEFu); });
+	printf("A line: %.0f ns with the format parsed at run time, %.0f ns with STM32T_FMT()\n", runtime, compiled);
+	
+	return Test::Result();
+}
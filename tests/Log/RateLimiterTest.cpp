@@ -0,0 +1,121 @@
+// RateLimiter on the stub tick: a burst, a steady flood, the refill after a quiet period, a compile-time format string, more call
+// sites than slots, and the cost of Allow() for a site found in the first slot, in the last one and a new site evicting another.
+
+#include "Log.hpp"
+#include "Test.hpp"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace STM32T;
+using namespace STM32T::Log;
+
+
+
+static std::vector<std::string> s_lines;
+
+static void collect(const strv data, const bool last)
+{
+	static std::string message;
+	message.append(data.data(), data.size());
+	
+	if (last)
+	{
+		s_lines.push_back(message);
+		message.clear();
+	}
+}
+
+static RateLimiter s_limiter(3, 1000);		// 3 at once, then 1 every second
+static constexpr Logger s_log(Level::Info, "L"sv, std::array{collect}, nullptr);
+static constexpr Logger s_limited = s_log.Limited(s_limiter);
+
+static std::vector<std::string> take()
+{
+	std::vector<std::string> lines;
+	lines.swap(s_lines);
+	return lines;
+}
+
+template <class F>
+static double bench(F&& body)
+{
+	constexpr int N = 2000000;
+	const auto start = std::chrono::steady_clock::now();
+	
+	for (int i = 0; i < N; i++)
+		body(i);
+	
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / N;
+}
+
+int main()
+{
+	uwTick = 1000;
+	
+	// A burst of 100 at once: 3 get through.
+	for (int i = 0; i < 100; i++)
+		s_limited.w("Burst %d", i);
+	
+	CHECK(take() == std::vector<std::string>({ "[Warn ][L]: Burst 0\n", "[Warn ][L]: Burst 1\n", "[Warn ][L]: Burst 2\n" }));
+	CHECK_EQ(s_limited.Suppressed(), 97u);
+	
+	// 10 per second for 5 s: the burst, then one per second with the count of the ones suppressed since the previous one
+	for (int i = 0; i < 50; i++, uwTick += 100)
+		s_limited.w("Flood %d", i);
+	
+	const std::vector<std::string> flood = take();
+	const std::vector<std::string> expected = { "[Warn ][L]: Flood 0\n", "[Warn ][L]: Flood 1\n", "[Warn ][L]: Flood 2\n",
+		"[Warn ][L]: Flood 10 [suppressed 7]\n", "[Warn ][L]: Flood 20 [suppressed 9]\n", "[Warn ][L]: Flood 30 [suppressed 9]\n",
+		"[Warn ][L]: Flood 40 [suppressed 9]\n" };
+	CHECK(flood == expected);
+	CHECK_EQ(s_limited.Suppressed(), 97u + 43);
+	
+	// After 10 s of quiet the whole burst is available again, and the burst suppressed before is reported.
+	uwTick += 10'000;
+	for (int i = 0; i < 5; i++)
+		s_limited.w("Burst %d", i);
+	
+	CHECK(take() == std::vector<std::string>({ "[Warn ][L]: Burst 0 [suppressed 97]\n", "[Warn ][L]: Burst 1\n", "[Warn ][L]: Burst 2\n" }));
+	
+	// A compile-time format string is a site too, and a disabled level doesn't take a token.
+	for (int i = 0; i < 5; i++)
+	{
+		s_limited.log(Level::Debug, "Hidden %d", i);
+		s_limited.i(STM32T_FMT("Fmt %d"), i);
+	}
+	
+	CHECK(take() == std::vector<std::string>({ "[Info ][L]: Fmt 0\n", "[Info ][L]: Fmt 1\n", "[Info ][L]: Fmt 2\n" }));
+	
+	// More sites than slots: the least recently seen ones are forgotten.
+	RateLimiter limiter(1, 1000);
+	int keys[STM32T_LOG_RATE_SLOTS + 4];
+	uint32_t suppressed;
+	
+	for (int& key : keys)
+	{
+		CHECK(limiter.Allow(&key, suppressed));
+		uwTick += 1;
+	}
+	
+	CHECK_EQ(limiter.Evicted(), 4u);
+	CHECK(!limiter.Allow(&keys[STM32T_LOG_RATE_SLOTS + 3], suppressed));		// Still tracked
+	CHECK(limiter.Allow(&keys[0], suppressed));								// Forgotten: a new bucket
+	CHECK_EQ(limiter.Evicted(), 5u);
+	
+	// The cost of Allow(): the slots are searched in order (the last 4 sites took the first 4 slots).
+	RateLimiter full(1, 1);
+	for (int& key : keys)
+		full.Allow(&key, suppressed);
+	
+	volatile bool sink;
+	const double first = bench([&](int) { sink = full.Allow(&keys[STM32T_LOG_RATE_SLOTS], suppressed); });
+	const double last = bench([&](int) { sink = full.Allow(&keys[STM32T_LOG_RATE_SLOTS - 1], suppressed); });
+	const double evict = bench([&](const int i) { sink = full.Allow(&keys[i % 2], suppressed); });
+	
+	printf("Allow() with %d slots: %.1f ns for the first slot, %.1f ns for the last one, %.1f ns for a new site\n", STM32T_LOG_RATE_SLOTS,
+		first, last, evict);
+	
+	return Test::Result();
+}
@@ -0,0 +1,169 @@
+// Telemetry: the CBOR encodings checked against the examples of RFC 8949, records mixed with text lines in one output and decoded by
+// Telemetry.py, a record too large for the buffer, then the size and the cost of a record against the equivalent log line.
+
+#include "Telemetry.hpp"
+#include "Test.hpp"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace STM32T;
+using namespace STM32T::Log;
+
+
+
+enum class Mode : uint8_t { Idle, Run = 3 };
+
+static std::string s_out;
+static std::vector<size_t> s_sizes;
+
+static void collect(const strv data, const bool last)
+{
+	static size_t size = 0;
+	s_out.append(data.data(), data.size());
+	size += data.size();
+	
+	if (last)
+	{
+		s_sizes.push_back(size);
+		size = 0;
+	}
+}
+
+static void discard(strv, bool) {}
+
+static constexpr Telemetry s_tlm(std::array<output_t, 1>{collect});
+static constexpr Logger<1> s_log(Level::Info, "App"sv, std::array<output_t, 1>{collect}, default_timestamp);
+
+// The bytes written by F to a CBOR writer, as hex
+template <class F>
+static std::string cbor(F&& write)
+{
+	uint8_t buf[16];
+	Cbor::Writer writer(buf, sizeof(buf));
+	write(writer);
+	
+	std::string hex;
+	char byte[3];
+	
+	for (size_t i = 0; i < writer.size(); i++)
+	{
+		snprintf(byte, sizeof(byte), "%02x", buf[i]);
+		hex += byte;
+	}
+	
+	return hex;
+}
+
+static std::string decode(const std::string& script)
+{
+	const char *const path = "TelemetryTest.bin";
+	
+	FILE *file = fopen(path, "wb");
+	fwrite(s_out.data(), 1, s_out.size(), file);
+	fclose(file);
+	
+	FILE *const pipe = popen(("python3 \"" + script + "\" --text -i " + path + " 2>&1").c_str(), "r");
+	if (!pipe)
+		return "";
+	
+	std::string out;
+	char buf[256];
+	while (const size_t len = fread(buf, 1, sizeof(buf), pipe))
+		out.append(buf, len);
+	
+	pclose(pipe);
+	return out;
+}
+
+template <class F>
+static double bench(F&& send)
+{
+	constexpr int N = 2000000;
+	const auto start = std::chrono::steady_clock::now();
+	
+	for (int i = 0; i < N; i++)
+		send(i);
+	
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / N;
+}
+
+int main()
+{
+	// RFC 8949, appendix A
+	CHECK_EQ(cbor([](auto& w) { w.uint(0); }), "00");
+	CHECK_EQ(cbor([](auto& w) { w.uint(23); }), "17");
+	CHECK_EQ(cbor([](auto& w) { w.uint(24); }), "1818");
+	CHECK_EQ(cbor([](auto& w) { w.uint(1000); }), "1903e8");
+	CHECK_EQ(cbor([](auto& w) { w.uint(1000000); }), "1a000f4240");
+	CHECK_EQ(cbor([](auto& w) { w.uint(1000000000000); }), "1b000000e8d4a51000");
+	CHECK_EQ(cbor([](auto& w) { w.integer(-1); }), "20");
+	CHECK_EQ(cbor([](auto& w) { w.integer(-1000); }), "3903e7");
+	CHECK_EQ(cbor([](auto& w) { w.real(0.0); }), "f90000");
+	CHECK_EQ(cbor([](auto& w) { w.real(-0.0); }), "f98000");
+	CHECK_EQ(cbor([](auto& w) { w.real(1.5); }), "f93e00");
+	CHECK_EQ(cbor([](auto& w) { w.real(65504.0); }), "f97bff");
+	CHECK_EQ(cbor([](auto& w) { w.real(100000.0); }), "fa47c35000");
+	CHECK_EQ(cbor([](auto& w) { w.real(1.1); }), "fb3ff199999999999a");
+	CHECK_EQ(cbor([](auto& w) { w.real(5.960464477539063e-8); }), "f90001");
+	CHECK_EQ(cbor([](auto& w) { w.real(-4.0); }), "f9c400");
+	CHECK_EQ(cbor([](auto& w) { w.real(1.0 / 0.0); }), "f97c00");
+	CHECK_EQ(cbor([](auto& w) { w.real(0.0 / 0.0); }), "f97e00");
+	CHECK_EQ(cbor([](auto& w) { w.value(true).value(nullptr); }), "f5f6");
+	CHECK_EQ(cbor([](auto& w) { w.value("IETF"sv); }), "6449455446");
+	CHECK_EQ(cbor([](auto& w) { w.array(3).uint(1).uint(2).uint(3); }), "83010203");
+	CHECK_EQ(cbor([](auto& w) { w.map(1).text("a"sv).value(Mode::Run); }), "a1616103");
+	
+	// Full: the length keeps counting.
+	uint8_t small[4];
+	Cbor::Writer writer(small, sizeof(small));
+	writer.text("hello"sv);
+	CHECK(!writer.ok());
+	CHECK_EQ(writer.size(), 6u);
+	
+	// Records between text lines, decoded by Telemetry.py
+	uwTick = 563;
+	s_log.i("started");
+	CHECK(s_tlm.send("csq"sv, Field{"rssi"sv, 21}, Field{"ber"sv, 99u}));
+	uwTick = 1000;
+	CHECK(s_tlm.send("env"sv, Field{"t"sv, -2.5f}, Field{"h"sv, 0.1}, Field{"ok"sv, true}, Field{"mode"sv, Mode::Run},
+		Field{"id"sv, "sensor"sv}, Field{"n"sv, -70000}));
+	s_log.w("done %d", 2);
+	
+	// Too large for 64 bytes: not sent
+	const std::string big(60, 'x');
+	CHECK(!s_tlm.send("big"sv, Field{"s"sv, strv(big)}));
+	CHECK_EQ(s_sizes.size(), 4u);
+	
+	std::string script = __FILE__;
+	script = script.substr(0, script.rfind("tests")) + "Telemetry.py";
+	
+	const std::string decoded = decode(script);
+	printf("%zu bytes captured, decoded by Telemetry.py:\n%s", s_out.size(), decoded.c_str());
+	
+	CHECK_EQ(decoded, "[       563][Info ][App]: started\n"
+		"{\"time\": 563, \"record\": \"csq\", \"rssi\": 21, \"ber\": 99}\n"
+		"{\"time\": 1000, \"record\": \"env\", \"t\": -2.5, \"h\": 0.1, \"ok\": true, \"mode\": 3, \"id\": \"sensor\", \"n\": -70000}\n"
+		"[      1000][Warn ][App]: done 2\n");
+	
+	// Size and cost: the record above against the same values in a log line
+	s_out.clear();
+	s_sizes.clear();
+	uwTick = 563;
+	s_log.i("csq rssi=%d ber=%u", 21, 99u);
+	s_tlm.send("csq"sv, Field{"rssi"sv, 21}, Field{"ber"sv, 99u});
+	CHECK_EQ(s_sizes.size(), 2u);
+	CHECK_EQ(s_sizes[1], 23u);
+	CHECK(s_sizes[1] < s_sizes[0]);
+	
+	static constexpr Telemetry tlm(std::array<output_t, 1>{discard});
+	static constexpr Logger<1> log(Level::Info, "App"sv, std::array<output_t, 1>{discard}, default_timestamp);
+	
+	const double recordNs = bench([](const int i) { tlm.send("csq"sv, Field{"rssi"sv, i & 31}, Field{"ber"sv, 99u}); });
+	const double lineNs = bench([](const int i) { log.i("csq rssi=%d ber=%u", i & 31, 99u); });
+	
+	printf("csq record: %zu bytes, %.1f ns; log line: %zu bytes, %.1f ns\n", s_sizes[1], recordNs, s_sizes[0], lineNs);
+	
+	return Test::Result();
+}
@@ -0,0 +1,238 @@
+// UartDmaOutput against a simulated UART with DMA at 115200 baud: the three overflow policies with more data than the line can carry,
+// messages in several chunks and messages longer than the buffer. The DMA reads the buffer when the transfer completes, so a buffer
+// overwritten while being sent is caught.
+
+#include "Log.hpp"
+#include "Test.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace STM32T;
+using namespace STM32T::Log;
+
+
+
+namespace Sim
+{
+	constexpr uint64_t BYTE_US = 87;		// 10 bits at 115200 baud
+	constexpr uint32_t USART_IRQ = 53 + 16;
+	
+	uint64_t now = 0;						// us
+	std::string wire;
+	
+	const uint8_t *txData = nullptr;
+	uint16_t txSize = 0;
+	uint64_t txEnd = 0;
+	
+	void poll()
+	{
+		if (!txData || now < txEnd)
+			return;
+		
+		wire.append(reinterpret_cast<const char *>(txData), txSize);
+		txData = nullptr;
+		
+		const uint32_t ipsr = Stub::IPSR;
+		Stub::IPSR = USART_IRQ;
+		Stub::UART.TxCpltCallback(nullptr);
+		Stub::IPSR = ipsr;
+	}
+	
+	// Time passes while the CPU waits in HAL_GetTick() loops.
+	void tick()
+	{
+		now += 10;
+		uwTick = uint32_t(now / 1000);
+		poll();
+	}
+	
+	void advance(const uint64_t until)
+	{
+		while (now < until)
+			tick();
+	}
+	
+	HAL_StatusTypeDef transmit(UART_HandleTypeDef *, const uint8_t *data, const uint16_t size)
+	{
+		if (txData)
+			return HAL_BUSY;
+		
+		txData = data;
+		txSize = size;
+		txEnd = now + size * BYTE_US;
+		return HAL_OK;
+	}
+}
+
+static UART_HandleTypeDef s_huart;
+static UartDmaOutput<256> s_uart(&s_huart);
+static uint64_t s_longestWait = 0;
+
+static std::string line(const int i)
+{
+	char buf[64];
+	return std::string(buf, snprintf(buf, sizeof(buf), "[%10d][Info ][Main]: sample %d value=%d\n", i * 2, i, i * 7));
+}
+
+static void drain()
+{
+	while (s_uart.IsBusy() || s_uart.Pending())
+		Sim::tick();
+}
+
+static void reset(const Overflow policy)
+{
+	drain();
+	Sim::wire.clear();
+	s_uart.policy = policy;
+}
+
+// The lines on the wire must be whole and in order.
+static size_t whole(const std::vector<std::string>& lines)
+{
+	size_t count = 0, pos = 0;
+	
+	for (const std::string& l : lines)
+	{
+		if (Sim::wire.compare(pos, l.size(), l) == 0)
+		{
+			pos += l.size();
+			count++;
+		}
+	}
+	
+	CHECK_EQ(pos, Sim::wire.size());
+	return count;
+}
+
+// A line every period_us for 1 s, in one chunk or in three.
+static std::vector<std::string> run(const char *const name, const uint64_t period_us, const bool chunks = false)
+{
+	std::vector<std::string> lines;
+	const uint32_t dropped = s_uart.BytesDropped(), blocked = s_uart.Blocked();
+	uint64_t waited = 0;
+	s_longestWait = 0;
+	
+	for (uint64_t next = 0, end = Sim::now + 1'000'000; Sim::now < end; next += period_us)
+	{
+		Sim::advance(std::max(Sim::now, end - 1'000'000 + next));
+		
+		lines.push_back(line(int(lines.size())));
+		const strv l = lines.back();
+		const uint64_t start = Sim::now;
+		
+		if (chunks)
+		{
+			s_uart.Write(l.substr(0, 13), false);
+			s_uart.Write(l.substr(13, 9), false);
+			s_uart.Write(l.substr(22), true);
+		}
+		else
+			s_uart.Write(l);
+		
+		waited += Sim::now - start;
+		s_longestWait = std::max(s_longestWait, Sim::now - start);
+	}
+	
+	drain();
+	
+	printf("%-28s %4zu lines, %4zu on the wire, %5u bytes dropped, %4u blocked writes, %6.0f us waited per line (%u at most)\n", name,
+		lines.size(), whole(lines), unsigned(s_uart.BytesDropped() - dropped), unsigned(s_uart.Blocked() - blocked), double(waited) / lines.size(),
+		unsigned(s_longestWait));
+	
+	return lines;
+}
+
+int main()
+{
+	Stub::OnGetTick = Sim::tick;
+	Stub::UART.TransmitDMA = Sim::transmit;
+	HAL_UART_RegisterCallback(&s_huart, HAL_UART_TX_COMPLETE_CB_ID, UartDmaOutput<256>::TxCpltCallback<s_uart>);
+	
+	// Within the capacity of the line, every policy sends everything.
+	for (const Overflow policy : { Overflow::DropNewest, Overflow::DropOldest, Overflow::Block })
+	{
+		reset(policy);
+		const std::vector<std::string> lines = run("10 ms period", 10'000);
+		CHECK_EQ(whole(lines), lines.size());
+	}
+	
+	// A line every 2 ms is twice what the line carries: DropNewest and DropOldest only send whole lines.
+	for (const bool chunks : { false, true })
+	{
+		reset(Overflow::DropNewest);
+		uint32_t dropped = s_uart.BytesDropped();
+		std::vector<std::string> lines = run(chunks ? "DropNewest, 2 ms, 3 chunks" : "DropNewest, 2 ms", 2'000, chunks);
+		
+		size_t bytes = 0;
+		for (const std::string& l : lines)
+			bytes += l.size();
+		
+		CHECK(whole(lines) < lines.size());
+		CHECK_EQ(Sim::wire.size() + s_uart.BytesDropped() - dropped, bytes);
+		
+		reset(Overflow::DropOldest);
+		dropped = s_uart.BytesDropped();
+		lines = run(chunks ? "DropOldest, 2 ms, 3 chunks" : "DropOldest, 2 ms", 2'000, chunks);
+		
+		CHECK(whole(lines) < lines.size());
+		CHECK_EQ(lines.back(), Sim::wire.substr(Sim::wire.size() - lines.back().size()));		// The newest is kept.
+	}
+	
+	// Block waits for the space freed by each transfer, not for the line to be idle (the next transfer starts at once).
+	reset(Overflow::Block);
+	const uint32_t blockDropped = s_uart.BytesDropped();
+	std::vector<std::string> lines = run("Block, 2 ms", 2'000);
+	
+	CHECK_EQ(whole(lines), lines.size());
+	CHECK_EQ(s_uart.BytesDropped(), blockDropped);
+	CHECK(s_uart.Blocked() > 0);
+	CHECK(s_longestWait <= 256 * Sim::BYTE_US + 100);		// At most a whole buffer to send
+	
+	// A message longer than the buffer: sent in pieces by Block, and by DropNewest as far as the two buffers go.
+	const std::string big(1000, 'B');
+	reset(Overflow::Block);
+	s_uart.Write(big);
+	drain();
+	CHECK_EQ(Sim::wire, big);
+	
+	reset(Overflow::DropNewest);
+	s_uart.Write(strv(big).substr(0, 400));
+	drain();
+	CHECK_EQ(Sim::wire, big.substr(0, 400));
+	
+	reset(Overflow::DropNewest);
+	uint32_t dropped = s_uart.BytesDropped();
+	s_uart.Write(big);
+	drain();
+	CHECK_EQ(Sim::wire, big.substr(0, 512));
+	CHECK_EQ(s_uart.BytesDropped() - dropped, 488u);
+	
+	// Behind whole messages, a message that doesn't fit is dropped whole.
+	reset(Overflow::DropNewest);
+	dropped = s_uart.BytesDropped();
+	s_uart.Write("first\n"sv);
+	s_uart.Write("second\n"sv);
+	s_uart.Write(big);
+	s_uart.Write("xx"sv, false);
+	s_uart.Write(big, false);
+	s_uart.Write("yy\n"sv, true);
+	s_uart.Write("last\n"sv);
+	drain();
+	CHECK_EQ(Sim::wire, "first\nsecond\nlast\n");
+	CHECK_EQ(s_uart.BytesDropped() - dropped, big.size() + 2 + big.size() + 3);
+	
+	// Interrupts disabled: Block drops instead of waiting.
+	s_uart.policy = Overflow::Block;
+	Stub::PRIMASK = 1;
+	const uint64_t start = Sim::now;
+	s_uart.Write(big);
+	CHECK_EQ(Sim::now, start);
+	Stub::PRIMASK = 0;
+	
+	CHECK(s_uart.Flush());
+	CHECK_EQ(s_uart.Errors(), 0u);
+	
+	return Test::Result();
+}
@@ -0,0 +1,189 @@
+// W25QJournal on the simulated flash: messages in several chunks and longer than a page, wrapping around the sectors, remounting,
+// a power cut in the middle of a page program, pages that can't be programmed, and damaged pages in the middle of a message.
+
+#include "Memory/W25QJournal.hpp"
+#include "FlashSim.hpp"
+#include "Test.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace STM32T;
+
+
+
+constexpr uint16_t FIRST_SECTOR = 10, SECTORS = 3;
+constexpr uint32_t CS_PIN = 1 << 4;
+
+struct Message
+{
+	std::string text;
+	bool cut = false;		// Ended with an empty chunk: its continuation is missing.
+};
+
+static std::vector<Message> read(W25QJournal& journal)
+{
+	std::vector<Message> messages;
+	std::string current;
+	
+	journal.Read([&](const strv data, const bool last_chunk) {
+		current.append(data.data(), data.size());
+		if (last_chunk)
+		{
+			messages.push_back({ current, data.empty() });
+			current.clear();
+		}
+	});
+	
+	CHECK(current.empty());
+	return messages;
+}
+
+static std::string line(const int i)
+{
+	return "[" + std::to_string(i) + "] line number " + std::to_string(i) + "\n";
+}
+
+// The lines must be whole (or the beginning of one when cut), in order, the last one being LAST. Other messages are ignored.
+static void checkLines(const std::vector<Message>& messages, const int last)
+{
+	CHECK(!messages.empty());
+	
+	int prev = -1;
+	for (const Message& m : messages)
+	{
+		if (m.text.empty() || m.text[0] != '[')
+			continue;
+		
+		const int i = std::stoi(m.text.substr(1));
+		CHECK(i > prev);
+		CHECK(m.cut ? line(i).compare(0, m.text.size(), m.text) == 0 && m.text.size() < line(i).size() : m.text == line(i));
+		prev = i;
+	}
+	
+	CHECK_EQ(prev, last);
+}
+
+int main()
+{
+	GPIO_TypeDef port;
+	SPI_HandleTypeDef hspi{};
+	Sim::Flash sim(16, &port, CS_PIN);
+	W25Q flash(&hspi, IO(&port, CS_PIN, true), 16);
+	
+	// Messages in two chunks, read back before and after a remount
+	{
+		W25QJournal journal(flash, FIRST_SECTOR, SECTORS);
+		CHECK(journal.Mount());
+		
+		for (int i = 0; i < 100; i++)
+		{
+			const std::string l = line(i);
+			journal.Write(strv(l).substr(0, 5), false);
+			journal.Write(strv(l).substr(5), true);
+		}
+		
+		CHECK(journal.Flush());
+		checkLines(read(journal), 99);
+		CHECK_EQ(read(journal).size(), 100u);
+	}
+	
+	W25QJournal journal(flash, FIRST_SECTOR, SECTORS);
+	CHECK(journal.Mount());
+	CHECK_EQ(read(journal).size(), 100u);
+	
+	// Wrapping around: only the newest messages are left, the first one possibly without its beginning (skipped).
+	for (int i = 100; i < 1000; i++)
+		journal.Write(line(i), true);
+	
+	CHECK(journal.Flush());
+	std::vector<Message> messages = read(journal);
+	checkLines(messages, 999);
+	CHECK(messages.size() > 200);
+	CHECK(!messages.front().cut);
+	
+	// A message over three pages
+	const std::string big = std::string(600, 'x') + "END";
+	journal.Write(big, true);
+	journal.Write(line(1000), true);
+	CHECK(journal.Flush());
+	
+	messages = read(journal);
+	CHECK_EQ(messages[messages.size() - 2].text, big);
+	CHECK_EQ(messages.back().text, line(1000));
+	
+	// A page that can't be programmed: the journal stays on it and drops what doesn't fit, then catches up.
+	const uint32_t programs = journal.Programs();
+	sim.failSPI = true;
+	
+	for (int i = 1001; i < 1100; i++)
+	{
+		const std::string l = line(i);
+		journal.Write(strv(l).substr(0, 7), false);
+		journal.Write(strv(l).substr(7), true);
+	}
+	
+	CHECK(!journal.Flush());
+	CHECK(journal.Errors() > 0);
+	CHECK(journal.Dropped() > 0);
+	CHECK_EQ(journal.Programs(), programs);
+	
+	sim.failSPI = false;
+	for (int i = 1100; i < 1200; i++)
+		journal.Write(line(i), true);
+	
+	CHECK(journal.Flush());
+	checkLines(read(journal), 1199);
+	
+	// A damaged page in the middle of a message: its beginning ends cut, its end is skipped.
+	journal.Write(std::string(700, 'y'), true);
+	journal.Write(line(1200), true);
+	CHECK(journal.Flush());
+	
+	messages = read(journal);
+	size_t y = messages.size() - 2;
+	CHECK_EQ(messages[y].text, std::string(700, 'y'));
+	
+	uint32_t middle = 0;		// The page where the y's continue
+	for (uint32_t addr = W25Q::Sector(FIRST_SECTOR); addr < W25Q::Sector(FIRST_SECTOR + SECTORS); addr += W25Q::PAGE_SIZE)
+		if (sim.mem[addr + 8] == W25QJournal::MAX_RECORD_LEN && sim.mem[addr + 9] == (W25QJournal::CONTINUED | W25QJournal::CONTINUATION))
+			middle = addr;
+	
+	CHECK(middle != 0);
+	sim.mem[middle + 2] ^= 0x01;		// The sequence number in the header
+	
+	messages = read(journal);
+	y = messages.size() - 2;
+	CHECK(messages[y].cut);
+	CHECK_EQ(messages[y].text, std::string(messages[y].text.size(), 'y'));
+	CHECK(messages[y].text.size() < 700);
+	CHECK_EQ(messages.back().text, line(1200));
+	
+	// A power cut in the middle of a page program: the records before it are intact after a remount.
+	sim.cutAfter = 300;
+	for (int i = 1201; i < 1220; i++)
+		journal.Write(line(i), true);
+	
+	journal.Flush();
+	CHECK(!sim.Powered());
+	sim.PowerOn();
+	
+	W25QJournal after(flash, FIRST_SECTOR, SECTORS);
+	CHECK(after.Mount());
+	
+	messages = read(after);
+	const int lastBefore = std::stoi(messages.back().text.substr(1));
+	CHECK(lastBefore > 1200 && lastBefore < 1219);
+	
+	after.Write(line(1300), true);
+	CHECK(after.Flush());
+	messages = read(after);
+	CHECK_EQ(messages.back().text, line(1300));
+	CHECK_EQ(std::stoi(messages[messages.size() - 2].text.substr(1)), lastBefore);
+	
+	printf("%u pages programmed, %zu erases, %zu SPI transactions, %zu writes ignored by the busy chip\n", unsigned(journal.Programs()),
+		sim.erases, sim.transactions, sim.ignored);
+	CHECK_EQ(sim.ignored, 0u);
+	
+	return Test::Result();
+}
@@ -0,0 +1,172 @@
+// W25QStream on the simulated flash: a table of variable-length records (a few KB) parsed through one stream and through a Read()
+// per header and per payload, with the same result. The SPI transactions (chip selects) and the time of each are reported. Then
+// seeking, short and long skips, and reading past the end of the memory.
+
+#include "Memory/W25Q.hpp"
+#include "FlashSim.hpp"
+#include "Test.hpp"
+
+#include <chrono>
+
+using namespace STM32T;
+
+
+
+constexpr uint32_t CS_PIN = 1 << 4;
+constexpr W25Q::addr_t TABLE = 0x10000;
+constexpr uint16_t RECORDS = 200;
+
+struct Header
+{
+	uint16_t type;
+	uint16_t len;
+};
+
+struct Result
+{
+	uint32_t sum = 0, records = 0, skipped = 0;
+	
+	bool operator==(const Result& other) const { return sum == other.sum && records == other.records && skipped == other.skipped; }
+};
+
+// Type 1 records are summed, the others are skipped.
+static void add(Result& result, const Header& header, const uint8_t *const payload)
+{
+	result.records++;
+	
+	if (header.type != 1)
+	{
+		result.skipped++;
+		return;
+	}
+	
+	for (uint16_t i = 0; i < header.len; i++)
+		result.sum += payload[i];
+}
+
+static Result parseStream(W25Q& flash)
+{
+	Result result;
+	W25QStream stream(flash, TABLE);
+	uint16_t count = 0;
+	CHECK(stream.read(count));
+	
+	for (uint16_t r = 0; r < count; r++)
+	{
+		Header header;
+		uint8_t payload[64];
+		CHECK(stream.read(header));
+		
+		if (header.type == 1)
+			CHECK(stream.read(payload, header.len));
+		else
+			CHECK(stream.skip(header.len));
+		
+		add(result, header, payload);
+	}
+	
+	return result;
+}
+
+static Result parseRead(W25Q& flash)
+{
+	Result result;
+	W25Q::addr_t addr = TABLE;
+	uint16_t count = 0;
+	CHECK(flash.Read(addr, count));
+	addr += sizeof(count);
+	
+	for (uint16_t r = 0; r < count; r++)
+	{
+		Header header;
+		uint8_t payload[64];
+		CHECK(flash.Read(addr, header));
+		addr += sizeof(header);
+		
+		if (header.type == 1)
+			CHECK(flash.ReadData(addr, payload, header.len));
+		
+		addr += header.len;
+		add(result, header, payload);
+	}
+	
+	return result;
+}
+
+template <class F>
+static double bench(F&& parse)
+{
+	constexpr int N = 200;
+	const auto start = std::chrono::steady_clock::now();
+	
+	for (int i = 0; i < N; i++)
+		parse();
+	
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / N;
+}
+
+int main()
+{
+	GPIO_TypeDef port;
+	SPI_HandleTypeDef hspi{};
+	Sim::Flash sim(16, &port, CS_PIN);
+	W25Q flash(&hspi, IO(&port, CS_PIN, true), 16);
+	
+	// The table: a count, then records of 2 to 64 bytes, one in 3 skipped (some skips short enough to be clocked out)
+	uint32_t addr = TABLE;
+	const auto put = [&](const uint16_t value) { sim.mem[addr++] = uint8_t(value); sim.mem[addr++] = uint8_t(value >> 8); };
+	put(RECORDS);
+	
+	for (uint16_t r = 0; r < RECORDS; r++)
+	{
+		const uint16_t len = 2 + (r * 37) % 63;
+		put(r % 3 == 2 ? 2 : 1);
+		put(len);
+		
+		for (uint16_t i = 0; i < len; i++)
+			sim.mem[addr++] = uint8_t(r + i);
+	}
+	
+	const size_t size = addr - TABLE;
+	
+	size_t before = sim.transactions;
+	const Result stream = parseStream(flash);
+	const size_t streamTransactions = sim.transactions - before;
+	
+	before = sim.transactions;
+	const Result read = parseRead(flash);
+	const size_t readTransactions = sim.transactions - before;
+	
+	CHECK(stream == read);
+	CHECK_EQ(stream.records, RECORDS);
+	CHECK_EQ(stream.skipped, RECORDS / 3u);
+	CHECK(streamTransactions < 1 + stream.skipped);
+	CHECK_EQ(readTransactions, 1 + RECORDS + stream.records - stream.skipped);
+	
+	const double streamUs = bench([&] { parseStream(flash); }), readUs = bench([&] { parseRead(flash); });
+	
+	printf("%zu-byte table, %u records: W25QStream %zu SPI transactions, %.1f us; Read() %zu SPI transactions, %.1f us\n", size,
+		unsigned(RECORDS), streamTransactions, streamUs, readTransactions, readUs);
+	
+	// Seeking, skipping and the end of the memory
+	W25QStream s(flash, TABLE + 2);
+	Header header;
+	CHECK(s.read(header) && header.type == 1 && header.len == 2);
+	CHECK(s.skip(2) && s.is_open());		// Clocked out
+	CHECK(s.read(header) && header.type == 1 && header.len == 39);
+	CHECK(s.skip(39) && !s.is_open());		// A new burst at the next read
+	CHECK(s.read(header) && header.type == 2);
+	CHECK_EQ(s.tell(), TABLE + 2 + 4 + 2 + 4 + 39 + 4);
+	
+	const W25Q::addr_t end = 16 * 1024 * 1024 / 8;
+	s.seek(end - 2);
+	CHECK_EQ(s.remaining(), 2u);
+	CHECK(!s.read(header));
+	uint16_t last = 0;
+	CHECK(s.read(last) && last == 0xFFFF);
+	CHECK(!s.skip(1));
+	s.close();
+	CHECK(!s.is_open());
+	
+	return Test::Result();
+}
@@ -0,0 +1,324 @@
+#pragma once
+
+// A simulated AT modem on the other end of a simulated UART, on a virtual clock. The modem answers the commands from a script; the
+// UART receives either with DMA (circular or normal, with the RX events of HAL_UARTEx_ReceiveToIdle_DMA()) or by polling
+// HAL_UART_Receive() (the receive data register holds 1 byte: the bytes that arrive while nothing is receiving are lost).
+// __WFI() advances the clock by 1 ms and delivers the bytes received meanwhile.
+
+#include "main.h"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+
+
+namespace Sim
+{
+	class Modem
+	{
+	public:
+		static constexpr uint64_t BYTE_US = 87;		// 10 bits at 115200 baud
+		static constexpr uint32_t USART_IRQ = 16 + 37;
+		
+		struct Reply
+		{
+			uint32_t delay;		// ms after the command
+			std::string text;
+		};
+		
+		/**
+		* @brief The replies to each command, which is the text up to and including the CR ("AT+CSQ\r"), or "+++".
+		*/
+		std::map<std::string, std::vector<Reply>> script;
+		
+		std::vector<std::string> commands;		// Received, in order
+		size_t unknown = 0;						// Commands without a script
+		
+		// Statistics
+		size_t wakeups = 0, events = 0, overruns = 0;
+		double eventNs = 0;		// Time spent in the RX event callbacks
+		
+	private:
+		struct Byte
+		{
+			uint64_t at;		// us
+			char c;
+		};
+		
+		static inline Modem *s_this = nullptr;
+		
+		UART_HandleTypeDef *p_huart = nullptr;
+		std::deque<Byte> m_line;
+		std::string m_command;
+		uint64_t m_us = 0, m_lastRx = 0;		// The time of the last byte received
+		
+		// Polling
+		bool m_rdrFull = false;
+		char m_rdr = 0;
+		
+		// DMA
+		uint8_t *m_dma = nullptr;
+		uint16_t m_dmaSize = 0, m_dmaPos = 0;
+		bool m_dmaOn = false, m_circular = false, m_idlePending = false;
+		
+		uint64_t now() const { return std::max(m_us, uint64_t(uwTick) * 1000); }
+		
+		void event(const uint16_t pos)
+		{
+			if (!Stub::UART.RxEventCallback)
+				return;
+			
+			const uint32_t ipsr = Stub::IPSR;
+			Stub::IPSR = USART_IRQ;
+			
+			const auto start = std::chrono::steady_clock::now();
+			Stub::UART.RxEventCallback(p_huart, pos);
+			eventNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+			++events;
+			
+			Stub::IPSR = ipsr;
+		}
+		
+		void endReception()
+		{
+			m_dmaOn = false;
+			p_huart->RxState = HAL_UART_STATE_READY;
+			p_huart->RxXferCount = uint16_t(m_dmaSize - m_dmaPos);
+		}
+		
+		void receive(const Byte& byte)
+		{
+			if (!m_dmaOn)
+			{
+				if (m_rdrFull)
+					++overruns;
+				else
+				{
+					m_rdr = byte.c;
+					m_rdrFull = true;
+				}
+				
+				return;
+			}
+			
+			m_lastRx = byte.at;
+			m_dma[m_dmaPos++] = uint8_t(byte.c);
+			Stub::DMACounter = uint16_t(m_dmaSize - m_dmaPos);
+			m_idlePending = true;
+			
+			if (m_circular)
+			{
+				if (m_dmaPos == m_dmaSize / 2)
+					event(m_dmaPos);
+				
+				if (m_dmaPos == m_dmaSize)
+				{
+					m_dmaPos = 0;
+					Stub::DMACounter = m_dmaSize;
+					m_idlePending = false;
+					event(m_dmaSize);
+				}
+			}
+			else if (m_dmaPos == m_dmaSize)
+			{
+				m_idlePending = false;
+				endReception();
+				event(m_dmaSize);
+			}
+		}
+		
+		void command(const char c)
+		{
+			m_command += c;
+			
+			if (c != '\r' && m_command != "+++")
+				return;
+			
+			commands.push_back(m_command);
+			
+			const auto it = script.find(m_command);
+			if (it != script.end())
+			{
+				for (const Reply& reply : it->second)
+					Send(reply.text, reply.delay);
+			}
+			else if (m_command != "+++")
+				++unknown;
+			
+			m_command.clear();
+		}
+		
+	public:
+		explicit Modem(UART_HandleTypeDef *const huart) : p_huart(huart)
+		{
+			s_this = this;
+			m_us = uint64_t(uwTick) * 1000;
+			
+			Stub::OnWFI = [] { s_this->Tick(); };
+			
+			Stub::UART.Transmit = [](UART_HandleTypeDef *, const uint8_t *data, const uint16_t size, uint32_t)
+			{
+				for (uint16_t i = 0; i < size; i++)
+					s_this->command(char(data[i]));
+				
+				return HAL_OK;
+			};
+			
+			Stub::UART.Receive = [](UART_HandleTypeDef *, uint8_t *data, const uint16_t size, const uint32_t timeout)
+			{
+				return s_this->Poll(reinterpret_cast<char *>(data), size, timeout);
+			};
+			
+			Stub::UART.ReceiveToIdleDMA = [](UART_HandleTypeDef *huart, uint8_t *data, const uint16_t size)
+			{
+				Modem& m = *s_this;
+				m.m_dma = data;
+				m.m_dmaSize = size;
+				m.m_dmaPos = 0;
+				m.m_dmaOn = true;
+				m.m_circular = huart->hdmarx && huart->hdmarx->Init.Mode == DMA_CIRCULAR;
+				m.m_idlePending = false;
+				m.m_rdrFull = false;
+				
+				return HAL_OK;
+			};
+			
+			Stub::UART.AbortReceive = [](UART_HandleTypeDef *)
+			{
+				s_this->m_dmaOn = false;
+				return HAL_OK;
+			};
+		}
+		
+		~Modem()
+		{
+			Stub::OnWFI = nullptr;
+			Stub::UART = {};
+			s_this = nullptr;
+		}
+		
+		Modem(const Modem&) = delete;
+		
+		/**
+		* @brief Sends TEXT after DELAY ms (after the bytes already being sent).
+		*/
+		void Send(const std::string& text, const uint32_t delay = 0)
+		{
+			uint64_t at = std::max(now() + uint64_t(delay) * 1000, m_line.empty() ? 0 : m_line.back().at + BYTE_US);
+			
+			for (const char c : text)
+			{
+				m_line.push_back({ at, c });
+				at += BYTE_US;
+			}
+		}
+		
+		/**
+		* @brief Receives the bytes due by now, with the RX events they cause.
+		*/
+		void Deliver()
+		{
+			const uint64_t t = now();
+			
+			while (!m_line.empty() && m_line.front().at <= t)
+			{
+				const Byte byte = m_line.front();
+				m_line.pop_front();
+				receive(byte);
+			}
+			
+			if (m_dmaOn && m_idlePending && t >= m_lastRx + BYTE_US)		// The line has been idle for a byte.
+			{
+				m_idlePending = false;
+				
+				if (m_circular)
+					event(m_dmaPos);
+				else
+				{
+					const uint16_t received = m_dmaPos;
+					endReception();
+					event(received);
+				}
+			}
+		}
+		
+		/**
+		* @brief Advances the clock by 1 ms.
+		*/
+		void Tick()
+		{
+			++wakeups;
+			m_us = now() + 1000;
+			uwTick = uint32_t(m_us / 1000);
+			Deliver();
+		}
+		
+		/**
+		* @brief Advances the clock by MS ms.
+		*/
+		void Run(const uint32_t ms)
+		{
+			for (uint32_t i = 0; i < ms; i++)
+				Tick();
+		}
+		
+		/**
+		* @brief Advances the clock by US us, without waking the CPU up.
+		*/
+		void Advance(const uint64_t us)
+		{
+			m_us = now() + us;
+			uwTick = uint32_t(m_us / 1000);
+			Deliver();
+		}
+		
+		/**
+		* @brief Receives SIZE bytes by polling, as HAL_UART_Receive().
+		*/
+		HAL_StatusTypeDef Poll(char *const data, const uint16_t size, const uint32_t timeout)
+		{
+			const uint64_t deadline = now() + uint64_t(timeout) * 1000;
+			Deliver();
+			
+			for (uint16_t i = 0; i < size; i++)
+			{
+				if (!m_rdrFull)
+				{
+					if (m_line.empty() || m_line.front().at > deadline)
+					{
+						m_us = deadline;
+						uwTick = uint32_t(m_us / 1000);
+						Deliver();
+						return HAL_TIMEOUT;
+					}
+					
+					// Waits for the next byte.
+					m_us = std::max(now(), m_line.front().at);
+					uwTick = uint32_t(m_us / 1000);
+					receive(m_line.front());
+					m_line.pop_front();
+				}
+				
+				data[i] = m_rdr;
+				m_rdrFull = false;
+			}
+			
+			return HAL_OK;
+		}
+		
+		/**
+		* @retval If all the scripted bytes have been received.
+		*/
+		bool Sent() const { return m_line.empty(); }
+		
+		void ResetStats()
+		{
+			wakeups = events = overruns = 0;
+			eventNs = 0;
+		}
+	};
+}
@@ -0,0 +1,144 @@
+// Profile: zones on a mock cycle counter (count, min, max, mean, the log2 histogram with its overflow bucket), nested zones, the
+// calibration of the cost of reading the counter and the dump. Then the overhead of a zone with the host clock as the counter.
+
+#include <chrono>
+#include <cstdint>
+
+inline bool g_hostClock = false;
+inline uint32_t g_cycles = 0;
+inline uint32_t g_readCost = 0;		// Cycles each read of the mock counter takes
+
+inline uint32_t readCycles()
+{
+	if (g_hostClock)
+		return uint32_t(std::chrono::steady_clock::now().time_since_epoch() / std::chrono::nanoseconds(1));
+	
+	return g_cycles += g_readCost;
+}
+
+#define STM32T_PROFILE_CYCLES()	readCycles()
+#define STM32T_PROFILE_BUCKETS	8
+
+#include "Profile.hpp"
+#include "Test.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace STM32T;
+
+
+
+static std::vector<std::string> s_lines;
+static std::string s_message;
+
+static void collect(const strv data, const bool last)
+{
+	s_message.append(data.data(), data.size());
+	if (last)
+	{
+		const size_t start = s_message.find("]: ") + 3;		// Without the prefix and the \n
+		s_lines.push_back(s_message.substr(start, s_message.size() - start - 1));
+		s_message.clear();
+	}
+}
+
+static constexpr Log::Logger s_log(Log::Level::Info, "P"sv, std::array{collect}, nullptr);
+
+static void work(const uint32_t cycles)
+{
+	STM32T_PROFILE("Work");
+	g_cycles += cycles;
+}
+
+static void outer(const uint32_t own, const uint32_t inner)
+{
+	STM32T_PROFILE("Outer");
+	g_cycles += own;
+	{
+		STM32T_PROFILE("Inner");
+		g_cycles += inner;
+	}
+}
+
+int main()
+{
+	// The buckets: 0, then [2^(i-1), 2^i), the last one also counting everything above
+	static_assert(Profile::Zone::Bucket(0) == 0 && Profile::Zone::Bucket(1) == 1 && Profile::Zone::Bucket(2) == 2);
+	static_assert(Profile::Zone::Bucket(3) == 2 && Profile::Zone::Bucket(4) == 3 && Profile::Zone::Bucket(63) == 6);
+	static_assert(Profile::Zone::Bucket(64) == 7 && Profile::Zone::Bucket(UINT32_MAX) == 7);
+	
+	CHECK(!Profile::Zone::Find("Work"sv));		// Not entered yet
+	
+	for (const uint32_t cycles : { 10, 20, 30, 0, 1000 })
+		work(cycles);
+	
+	const Profile::Zone *const zone = Profile::Zone::Find("Work"sv);
+	CHECK(zone);
+	CHECK_EQ(zone->count(), 5u);
+	CHECK_EQ(zone->min(), 0u);
+	CHECK_EQ(zone->max(), 1000u);
+	CHECK_EQ(zone->mean(), 212u);
+	CHECK_EQ(zone->total(), 1060u);
+	
+	const uint32_t hist[Profile::BUCKETS] = { 1, 0, 0, 0, 1, 2, 0, 1 };
+	for (size_t i = 0; i < Profile::BUCKETS; i++)
+		CHECK_EQ(zone->hist(i), hist[i]);
+	
+	// The cost of reading the counter is subtracted once calibrated.
+	Profile::Reset();
+	CHECK_EQ(zone->count(), 0u);
+	CHECK_EQ(zone->min(), 0u);
+	
+	g_readCost = 7;
+	work(100);
+	CHECK_EQ(zone->max(), 107u);
+	CHECK_EQ(Profile::Calibrate(), 7u);
+	
+	Profile::Reset();
+	work(100);
+	CHECK_EQ(zone->min(), 100u);
+	CHECK_EQ(zone->max(), 100u);
+	
+	// A nested zone is part of the enclosing one, which also pays for the inner zone reading the counter.
+	for (int i = 0; i < 4; i++)
+		outer(50, 200 * (i + 1));
+	
+	const Profile::Zone *const out = Profile::Zone::Find("Outer"sv), *const in = Profile::Zone::Find("Inner"sv);
+	CHECK(out && in);
+	CHECK_EQ(in->count(), 4u);
+	CHECK_EQ(in->min(), 200u);
+	CHECK_EQ(in->max(), 800u);
+	CHECK_EQ(in->mean(), 500u);
+	CHECK_EQ(out->min(), 200u + 50 + 2 * 7);
+	CHECK_EQ(out->mean(), 500u + 50 + 2 * 7);
+	
+	int zones = 0;
+	Profile::Zone::ForEach([&zones](const Profile::Zone&) { zones++; });
+	CHECK_EQ(zones, 3);		// Overhead() hasn't been called yet.
+	
+	// The dump: the bias and the overhead (2 reads of the counter), then 2 lines per zone entered since the reset
+	Profile::Reset();
+	work(10);
+	work(20);
+	work(30);
+	work(1000);
+	Profile::Dump(s_log);
+	
+	const std::vector<std::string> expected = {
+		"Profile: bias 7 cycles, overhead 14 cycles/zone",
+		"Work: n=4 min=10 mean=265 max=1000 cycles (mean 3 us)",
+		"Work: hist <2^4:1 <2^5:2 >=2^6:1",
+	};
+	CHECK(s_lines == expected);
+	
+	for (const std::string& line : s_lines)
+		printf("%s\n", line.c_str());
+	
+	// The overhead of a zone (two reads of the counter and the statistics), with the host clock in ns
+	g_hostClock = true;
+	const uint32_t bias = Profile::Calibrate(1000);
+	printf("Host clock: %u ns to read it, %u ns per zone\n", unsigned(bias), unsigned(Profile::Overhead(1000000)));
+	
+	return Test::Result();
+}
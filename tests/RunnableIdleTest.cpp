@@ -0,0 +1,134 @@
+// Runnable::Idle() on a simulated tick: 5 periodic tasks over 60k ticks (crossing the wrap of the tick) in a busy loop, with WFI and
+// with a STOP mode that stops the tick and is woken up early by interrupts. Every task must run exactly on time; the share of the time
+// slept and the wake-ups are printed.
+
+#include "Runnable.hpp"
+#include "Test.hpp"
+
+#include <utility>
+
+using namespace STM32T;
+
+
+
+static constexpr uint32_t PERIODS[] = { 20, 100, 250, 1000, 5000 };
+static constexpr uint32_t TICKS = 60000, IRQ_PERIOD = 137;
+
+static uint32_t s_lastRun[std::size(PERIODS)];
+static bool s_ran[std::size(PERIODS)];
+static uint32_t s_runs = 0, s_late = 0;
+
+template <size_t I>
+static void task()
+{
+	const uint32_t now = HAL_GetTick();
+	if (s_ran[I] && now - s_lastRun[I] != PERIODS[I])
+		s_late++;
+	
+	s_lastRun[I] = now;
+	s_ran[I] = true;
+	s_runs++;
+}
+
+template <size_t... I>
+static void repeatAll(std::index_sequence<I...>) { (Runnable::Repeat(task<I>, PERIODS[I]), ...); }
+
+template <size_t... I>
+static void removeAll(std::index_sequence<I...>) { (Runnable::Remove(task<I>), ...); }
+
+static uint32_t s_slept = 0, s_sleeps = 0, s_irqs = 0, s_nextIrq = 0;
+static bool s_masked = true;
+
+// STOP mode: the tick stops and the low-power timer wakes the core up after TICKS, unless an interrupt comes first.
+static uint32_t sleepStop(const uint32_t ticks)
+{
+	s_masked &= Stub::PRIMASK == 1;
+	s_sleeps++;
+	
+	uint32_t slept = ticks;
+	if (int32_t(s_nextIrq - uwTick) > 0 && int32_t(s_nextIrq - (uwTick + ticks)) < 0)
+	{
+		slept = s_nextIrq - uwTick;
+		s_irqs++;
+	}
+	
+	s_slept += slept;
+	return slept;
+}
+
+static void wfi()
+{
+	s_sleeps++;
+	s_slept++;
+	uwTick = uwTick + 1;
+}
+
+static void run(const char *const name)
+{
+	s_runs = s_late = s_slept = s_sleeps = s_irqs = 0;
+	std::fill(std::begin(s_ran), std::end(s_ran), false);
+	
+	uwTick = 0xFFFFFFFF - 3000;
+	s_nextIrq = uwTick + IRQ_PERIOD;
+	repeatAll(std::make_index_sequence<std::size(PERIODS)>());
+	
+	const uint32_t start = uwTick;
+	uint64_t loops = 0;
+	
+	while (uwTick - start < TICKS)
+	{
+		Runnable::Process();
+		
+		if (++loops % 20 == 0)		// 20 loops take a tick while awake.
+			uwTick = uwTick + 1;
+		
+		Runnable::Idle();
+		
+		if (int32_t(uwTick - s_nextIrq) >= 0)
+			s_nextIrq += IRQ_PERIOD;
+	}
+	
+	printf("%-9s %u runs, %u late, %llu loops, %u sleeps (%u cut by an interrupt), %.1f%% of the time asleep\n", name, unsigned(s_runs),
+		unsigned(s_late), (unsigned long long)loops, unsigned(s_sleeps), unsigned(s_irqs), 100.0 * s_slept / TICKS);
+	
+	uint32_t expected = 0;		// The runs due at the last tick are after the loop.
+	for (const uint32_t period : PERIODS)
+		expected += TICKS / period - 1;
+	
+	CHECK_EQ(s_runs, expected);
+	CHECK_EQ(s_late, 0u);
+	
+	removeAll(std::make_index_sequence<std::size(PERIODS)>());
+}
+
+int main()
+{
+	Runnable::Init();
+	
+	run("Busy:");
+	CHECK_EQ(s_sleeps, 0u);
+	
+	Stub::OnWFI = wfi;
+	Runnable::SetIdle(Runnable::SleepWFI, nullptr);
+	run("WFI:");
+	CHECK(s_slept > TICKS * 9 / 10);
+	
+	Runnable::SetIdle(sleepStop, Runnable::AddTicks, 2);
+	run("STOP:");
+	CHECK(s_masked);
+	CHECK(s_slept > TICKS * 9 / 10);
+	CHECK(s_sleeps < TICKS / 10);		// About one per tick with a task due and per interrupt
+	
+	// Idle() sleeps until the sooner of the next task and the given deadline (e.g. TimerWheel::NextDeadline()).
+	s_slept = 0;
+	s_nextIrq = uwTick;
+	
+	Runnable::Idle(uwTick + 3);
+	CHECK_EQ(s_slept, 3u);
+	
+	Runnable::Do(task<0>, 10);
+	Runnable::Idle(uwTick + 30);
+	CHECK_EQ(s_slept, 3u + 10);
+	
+	return Test::Result();
+}
@@ -0,0 +1,103 @@
+// The Runnable statistics (STM32T_RUNNABLE_STATS) on a simulated tick and cycle counter at 72 MHz: a short task, a task that blocks the
+// main loop for 7 ticks and makes the others late, and a lambda, with their lateness, overruns, histograms, execution times and log.
+
+#include <cstdint>
+
+inline uint32_t g_cycles = 0;
+
+#define STM32T_RUNNABLE_STATS		1
+#define STM32T_RUNNABLE_CYCLES()	(g_cycles)
+
+#include "Runnable.hpp"
+#include "Test.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace STM32T;
+
+
+
+static std::vector<std::string> s_lines;
+static std::string s_line;
+
+static void collect(const strv data, const bool last)
+{
+	s_line.append(data.data(), data.size());
+	if (last)
+	{
+		s_lines.push_back(s_line);
+		s_line.clear();
+	}
+}
+
+static void fast()
+{
+	g_cycles += 720;		// 10 us
+}
+
+static void slow()
+{
+	g_cycles += 7 * 72000;		// 7 ms, blocking the tick
+	uwTick = uwTick + 7;
+}
+
+int main()
+{
+	Runnable::Init();
+	
+	const auto hFast = Runnable::Repeat(fast, 5);
+	const auto hSlow = Runnable::Repeat(slow, 20);
+	
+	int n = 0;
+	const auto hLambda = Runnable::Repeat([&n] {
+		n++;
+		g_cycles += 100;
+	}, 3);
+	
+	for (int t = 0; t < 1000; t++)
+	{
+		uwTick = uwTick + 1;
+		Runnable::Process();
+	}
+	
+	// Each run of the slow task makes the other two late by a whole interval or more, once.
+	const Runnable::Stats f = *Runnable::GetStats(hFast), s = *Runnable::GetStats(hSlow), l = *Runnable::GetStats(hLambda);
+	printf("fast: %u runs, %u late, max %u; slow: %u runs; lambda: %u runs, %u late, max %u\n", unsigned(f.runs), unsigned(f.late),
+		unsigned(f.maxLateness), unsigned(s.runs), unsigned(l.runs), unsigned(l.late), unsigned(l.maxLateness));
+	
+	CHECK_EQ(s.runs, (1000 + 7 * s.runs) / 20);
+	CHECK_EQ(s.late, 0u);
+	CHECK_EQ(s.overruns, 0u);
+	CHECK_EQ(s.hist[0], s.runs);
+	CHECK_EQ(s.meanCycles(), 7u * 72000);
+	
+	CHECK_EQ(f.late, s.runs);
+	CHECK_EQ(f.overruns, s.runs);
+	CHECK_EQ(f.maxLateness, 7u);
+	CHECK(f.minCycles == 720 && f.maxCycles == 720);
+	CHECK_EQ(f.hist[0] + f.hist[3], f.runs);
+	
+	CHECK_EQ(l.runs, uint32_t(n));
+	CHECK_EQ(l.late, s.runs);
+	CHECK_EQ(l.overruns, s.runs);
+	CHECK(l.maxLateness >= 4 && l.maxLateness <= 7);
+	CHECK_EQ(l.hist[0] + l.hist[3], l.runs);
+	
+	CHECK_EQ(Runnable::GetStats(fast)->runs, f.runs);
+	CHECK(!Runnable::GetStats(Runnable::Handle()));
+	
+	// Two lines per task
+	const Log::Logger<1> logger(Log::Level::Info, "main"sv, std::array<Log::output_t, 1>{collect}, nullptr);
+	Runnable::DumpStats(logger);
+	
+	CHECK_EQ(s_lines.size(), 6u);
+	const std::string slowLine = "every 20): n=" + std::to_string(s.runs) + " late=0 overruns=0 lateness mean=0 max=0, us min=7000 mean=7000 max=7000\n";
+	CHECK(s_lines[2].find(slowLine) != std::string::npos);
+	CHECK_EQ(s_lines[3], "[Info ][main]: Runnable #2: lateness <1:" + std::to_string(s.runs) + "\n");
+	
+	Runnable::ResetStats();
+	CHECK_EQ(Runnable::GetStats(hFast)->runs, 0u);
+	
+	return Test::Result();
+}
@@ -0,0 +1,101 @@
+// Runnable: a task that advances or refreshes itself, or adds another task, from inside Process(), and 40 periodic tasks over 100k
+// simulated ticks (crossing the wrap of the tick) checked against the number of runs they must have, with the cost of Process().
+
+#include "Runnable.hpp"
+#include "Test.hpp"
+
+#include <chrono>
+#include <utility>
+
+using namespace STM32T;
+
+
+
+static int s_counts[40];
+
+template <int I>
+static void task() { s_counts[I]++; }
+
+template <int... I>
+static void repeatAll(std::integer_sequence<int, I...>) { (Runnable::Repeat(task<I>, 10 + I * 7), ...); }
+
+static int s_advanced = 0, s_added = 0;
+
+static void advanceSelf()
+{
+	s_advanced++;
+	Runnable::Advance(advanceSelf);
+}
+
+static void addOther()
+{
+	Runnable::Do([] { s_added++; });
+}
+
+int main()
+{
+	Runnable::Init();
+	uwTick = 1000;
+	
+	// A task advancing itself runs once per Process() call, not again in the same call (once per other task, before).
+	const auto idle1 = Runnable::Repeat([] {}, 10000), idle2 = Runnable::Repeat([] {}, 10000);
+	Runnable::Repeat(advanceSelf, 100);
+	Runnable::Advance(advanceSelf);
+	
+	Runnable::Process();
+	CHECK_EQ(s_advanced, 1);
+	Runnable::Process();
+	Runnable::Process();
+	CHECK_EQ(s_advanced, 3);
+	Runnable::Remove(advanceSelf);
+	
+	// So does a task added by a task.
+	Runnable::Repeat(addOther, 0);
+	Runnable::Process();
+	CHECK_EQ(s_added, 0);
+	Runnable::Process();
+	CHECK_EQ(s_added, 1);
+	Runnable::Remove(addOther);
+	Runnable::Process();
+	CHECK_EQ(s_added, 2);
+	
+	Runnable::Remove(idle1);
+	Runnable::Remove(idle2);
+	CHECK(!Runnable::NextDeadline());
+	
+	// A task refreshing itself after some work counts its interval from then, not from the tick it started at.
+	static Runnable::Handle s_slow;
+	s_slow = Runnable::Repeat([] {
+		uwTick = uwTick + 5;
+		CHECK(Runnable::Refresh(s_slow));
+	}, 10);
+	
+	uwTick = uwTick + 10;
+	const uint32_t ran = uwTick;
+	Runnable::Process();
+	CHECK_EQ(*Runnable::NextDeadline(), ran + 5 + 10);
+	CHECK(Runnable::Remove(s_slow));
+	CHECK(!Runnable::NextDeadline());
+	
+	// 40 periodic tasks, each run at every multiple of its interval
+	uwTick = 0xFFFFFFFF - 5000;
+	repeatAll(std::make_integer_sequence<int, 40>());
+	
+	constexpr int TICKS = 100000, CALLS = 100;
+	const auto host = std::chrono::steady_clock::now();
+	
+	for (int t = 0; t < TICKS; t++)
+	{
+		uwTick = uwTick + 1;
+		for (int i = 0; i < CALLS; i++)
+			Runnable::Process();
+	}
+	
+	const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - host).count();
+	printf("40 tasks, %d ticks: %.1f ns per Process()\n", TICKS, ns / (double(TICKS) * CALLS));
+	
+	for (int i = 0; i < 40; i++)
+		CHECK_EQ(s_counts[i], TICKS / (10 + i * 7));
+	
+	return Test::Result();
+}
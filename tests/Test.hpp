@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdio>
+#include <cinttypes>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+
+
+// A minimal check library for the host tests. A failed check is reported and counted without stopping the test; main() returns
+// Test::Result().
+
+namespace Test
+{
+	inline int s_failures = 0;
+	
+	template <class T>
+	std::string ToString(const T& value)
+	{
+		if constexpr (std::is_convertible_v<const T&, std::string_view>)
+		{
+			std::string str = "\"";
+			for (const char c : std::string_view(value))
+			{
+				if (c >= ' ' && c <= '~')
+					str += c;
+				else
+				{
+					char buf[5];
+					snprintf(buf, sizeof(buf), "\\x%02X", uint8_t(c));
+					str += buf;
+				}
+			}
+			
+			return str + "\"";
+		}
+		else if constexpr (std::is_same_v<T, bool>)
+			return value ? "true" : "false";
+		else if constexpr (std::is_enum_v<T>)
+			return ToString(std::underlying_type_t<T>(value));
+		else if constexpr (std::is_floating_point_v<T>)
+		{
+			char buf[32];
+			snprintf(buf, sizeof(buf), "%.17g", double(value));
+			return buf;
+		}
+		else if constexpr (std::is_signed_v<T>)
+			return std::to_string(intmax_t(value));
+		else if constexpr (std::is_unsigned_v<T>)
+			return std::to_string(uintmax_t(value));
+		else if constexpr (std::is_pointer_v<T>)
+		{
+			char buf[32];
+			snprintf(buf, sizeof(buf), "%p", static_cast<const void *>(value));
+			return buf;
+		}
+		else
+			return "?";
+	}
+	
+	inline bool Check(const bool ok, const char *const expr, const char *const file, const int line)
+	{
+		if (!ok)
+		{
+			++s_failures;
+			fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expr);
+		}
+		
+		return ok;
+	}
+	
+	template <class A, class B>
+	bool CheckEqual(const A& a, const B& b, const char *const expr_a, const char *const expr_b, const char *const file, const int line)
+	{
+		bool equal;
+		if constexpr (std::is_integral_v<A> && std::is_integral_v<B> && !std::is_same_v<A, bool> && !std::is_same_v<B, bool>)
+			equal = (a < 0) == (b < 0) && uintmax_t(a) == uintmax_t(b);		// Without the sign-compare surprises
+		else
+			equal = a == b;
+		
+		if (!equal)
+		{
+			++s_failures;
+			fprintf(stderr, "%s:%d: check failed: %s == %s\n    %s\n    %s\n", file, line, expr_a, expr_b, ToString(a).c_str(), ToString(b).c_str());
+		}
+		
+		return equal;
+	}
+	
+	/**
+	* @retval The exit code of the test: 0 if every check passed.
+	*/
+	inline int Result()
+	{
+		if (s_failures)
+			fprintf(stderr, "%d check(s) failed\n", s_failures);
+		
+		return s_failures ? 1 : 0;
+	}
+}
+
+#define CHECK(EXPR)			Test::Check(bool(EXPR), #EXPR, __FILE__, __LINE__)
+#define CHECK_EQ(A, B)		Test::CheckEqual((A), (B), #A, #B, __FILE__, __LINE__)
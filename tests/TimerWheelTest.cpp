@@ -0,0 +1,286 @@
+// TimerWheel: a callable that refreshes and then stops its own timer, 10k random timers (one-shot and periodic, stopped, refreshed and
+// advanced at random) checked against the exact tick they must fire at while the tick wraps around, and the cost per tick compared with
+// scanning a list of the timers.
+
+#include "TimerWheel.hpp"
+#include "Test.hpp"
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace STM32T;
+
+
+
+constexpr size_t N = 10000;
+using Wheel = TimerWheel<N>;
+
+static Wheel *s_wheel;
+
+struct Timer
+{
+	Wheel::Handle handle;
+	uint32_t due = 0, interval = 0, period = 0;
+	bool active = false, advanced = false;
+	int fired = 0;
+};
+
+static std::vector<Timer> s_timers(N);
+static size_t s_errors = 0, s_fired = 0;
+
+static void fire(void *const context)
+{
+	Timer& t = *static_cast<Timer *>(context);
+	s_fired++;
+	
+	if (!t.active || t.due != uwTick)
+	{
+		if (s_errors++ < 10)
+			printf("timer %zu: due %u, fired at %u, active %d\n", size_t(&t - s_timers.data()), unsigned(t.due), unsigned(uwTick), t.active);
+		
+		return;
+	}
+	
+	t.fired++;
+	
+	// An advanced timer fires at the next tick, but its period counts from when it was advanced; the missed periods are skipped.
+	if (t.period)
+	{
+		t.due += t.period - t.advanced;
+		if (int32_t(t.due - uwTick) <= 0)
+			t.due = uwTick + t.period;
+	}
+	else
+		t.active = false;
+	
+	t.advanced = false;
+}
+
+// Refreshes and then stops its own timer: it must be released once, when the callable returns.
+static void refreshAndStop(void *const context)
+{
+	Wheel::Handle& handle = *static_cast<Wheel::Handle *>(context);
+	s_fired++;
+	
+	CHECK(s_wheel->Refresh(handle));
+	Wheel::Handle copy = handle;
+	CHECK(s_wheel->Stop(copy));
+	CHECK(!s_wheel->IsActive(handle));
+	CHECK(!s_wheel->Refresh(handle));
+}
+
+static void nop(void *)
+{
+	s_fired++;
+}
+
+static void testSelfStop(Wheel& wheel)
+{
+	Wheel::Handle handle = wheel.Start(refreshAndStop, &handle, 5);
+	
+	for (int i = 0; i < 20; i++)
+	{
+		uwTick++;
+		wheel.Process();
+	}
+	
+	CHECK_EQ(s_fired, 1u);
+	CHECK_EQ(wheel.Count(), 0u);
+	
+	// The pool is intact: exactly N timers can be started.
+	std::vector<Wheel::Handle> handles;
+	for (Wheel::Handle h; (h = wheel.Start(nop, nullptr, 1000));)
+		handles.push_back(h);
+	
+	CHECK_EQ(handles.size(), N);
+	
+	for (Wheel::Handle& h : handles)
+		CHECK(wheel.Stop(h));
+	
+	CHECK_EQ(wheel.Count(), 0u);
+}
+
+int main()
+{
+	uwTick = 0xFFFFFFFF - 300000;		// The tick wraps around during the run.
+	
+	const auto wheel = std::make_unique<Wheel>();
+	s_wheel = wheel.get();
+	
+	testSelfStop(*wheel);
+	s_fired = 0;
+	
+	// Delays on every level (up to 2^24), a third periodic
+	std::mt19937 rng(1);
+	
+	for (Timer& t : s_timers)
+	{
+		t.period = rng() % 3 == 0 ? 1 + rng() % 5000 : 0;
+		t.interval = t.period ? t.period : 1 + rng() % (1u << (1 + rng() % 24));
+		t.due = uwTick + t.interval;
+		t.active = true;
+		t.handle = wheel->Start(fire, &t, t.interval, t.period);
+		CHECK(t.handle);
+	}
+	
+	CHECK_EQ(wheel->Count(), N);
+	
+	size_t stopped = 0, refreshed = 0, advanced = 0;
+	const auto start = std::chrono::steady_clock::now();
+	
+	for (int tick = 0; tick < 600000; tick++)
+	{
+		uwTick++;
+		wheel->Process();
+		
+		if (tick % 50)
+			continue;
+		
+		Timer& t = s_timers[rng() % N];
+		switch (rng() % 4)
+		{
+			case 0:
+				CHECK_EQ(wheel->Stop(t.handle), t.active);
+				t.active = false;
+				stopped++;
+				break;
+			
+			case 1:
+				CHECK_EQ(wheel->Refresh(t.handle), t.active);
+				if (t.active)
+				{
+					t.due = uwTick + t.interval;
+					t.advanced = false;
+					refreshed++;
+				}
+				break;
+			
+			case 2:
+				CHECK_EQ(wheel->Advance(t.handle), t.active);
+				if (t.active)
+				{
+					t.due = uwTick + 1;
+					t.advanced = true;
+					advanced++;
+				}
+				break;
+		}
+		
+		if (!t.active && !t.handle)
+		{
+			t.interval = 1 + rng() % 100000;
+			t.period = 0;
+			t.due = uwTick + t.interval;
+			t.advanced = false;
+			t.active = true;
+			t.handle = wheel->Start(fire, &t, t.interval);
+		}
+	}
+	
+	const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	
+	size_t active = 0, late = 0;
+	for (const Timer& t : s_timers)
+	{
+		active += t.active;
+		late += t.active && int32_t(uwTick - t.due) >= 0;
+		CHECK_EQ(wheel->IsActive(t.handle), t.active);
+	}
+	
+	printf("%zu timers: %zu fired, %zu stopped, %zu refreshed, %zu advanced, %zu active, %.0f ns per tick\n", N, s_fired, stopped, refreshed,
+		advanced, active, ns / 600000);
+	CHECK_EQ(s_errors, 0u);
+	CHECK_EQ(late, 0u);
+	CHECK_EQ(wheel->Count(), active);
+	
+	// A blocking call: the timers fire late, once (the periodic ones skip the missed periods), in a single Process().
+	for (Timer& t : s_timers)
+		wheel->Stop(t.handle);
+	
+	CHECK_EQ(wheel->Count(), 0u);
+	s_fired = 0;
+	
+	for (size_t i = 0; i < N; i++)
+		wheel->Start(nop, nullptr, 1 + rng() % 100000, i % 2 ? 100000 : 0);
+	
+	uwTick += 100000;
+	wheel->Process();
+	CHECK_EQ(s_fired, N);
+	CHECK_EQ(wheel->Count(), N / 2);
+	
+	// The cost per tick with 10k pending timers, against scanning them all
+	struct Entry
+	{
+		uint32_t due;
+		void (*callable)(void *);
+	};
+	
+	std::vector<Entry> list;
+	for (size_t i = 0; i < N / 2; i++)
+	{
+		const uint32_t delay = 1 + rng() % 1000000;
+		wheel->Start(nop, nullptr, delay);
+		list.push_back({ uwTick + delay, nop });
+	}
+	
+	for (size_t i = 0; i < N; i++)
+		list.push_back({ uint32_t(uwTick + 1 + rng() % 1000000), nop });
+	
+	constexpr int TICKS = 100000;
+	s_fired = 0;
+	auto t0 = std::chrono::steady_clock::now();
+	
+	for (int i = 0; i < TICKS; i++)
+	{
+		uwTick++;
+		wheel->Process();
+	}
+	
+	const double wheelNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / TICKS;
+	const size_t wheelFired = s_fired;
+	
+	uwTick -= TICKS;
+	s_fired = 0;
+	t0 = std::chrono::steady_clock::now();
+	
+	for (int i = 0; i < TICKS; i++)
+	{
+		uwTick++;
+		for (size_t j = 0; j < list.size();)
+		{
+			if (int32_t(uwTick - list[j].due) >= 0)
+			{
+				const Entry e = list[j];
+				list[j] = list.back();
+				list.pop_back();
+				e.callable(nullptr);
+			}
+			else
+				j++;
+		}
+	}
+	
+	const double listNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / TICKS;
+	
+	printf("Per tick with %zu timers: the wheel %.0f ns (%zu fired), a list %.0f ns (%zu fired)\n", N, wheelNs, wheelFired, listNs, s_fired);
+	CHECK(wheelFired > 0);
+	
+	// Starting and stopping
+	std::vector<Wheel::Handle> handles(N / 2);
+	t0 = std::chrono::steady_clock::now();
+	
+	for (int rep = 0; rep < 100; rep++)
+	{
+		for (Wheel::Handle& h : handles)
+			h = wheel->Start(nop, nullptr, 1 + rng() % 100000);
+		
+		for (Wheel::Handle& h : handles)
+			wheel->Stop(h);
+	}
+	
+	printf("Start() + Stop(): %.0f ns\n", std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / (100 * handles.size()));
+	
+	return Test::Result();
+}
@@ -0,0 +1,101 @@
+// Trace: events from thread mode and an ISR with numeric and text arguments, a buffer that overwrites its oldest events while the
+// simulated cycle counter wraps, and a dump through an AsyncOutput smaller than the dump, checked line by line.
+
+#include <cstdint>
+
+inline uint32_t g_cycles = 0xFFFF0000u;
+
+#define STM32T_TRACE_ENABLE		1
+#define STM32T_TRACE_SIZE		256
+#define STM32T_TRACE_CYCLES()	(g_cycles)
+
+#include "Trace.hpp"
+#include "Test.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace STM32T;
+using namespace STM32T::Log;
+
+
+
+static std::vector<std::string> s_lines;
+static std::string s_message;
+
+static void collect(const strv data, const bool last)
+{
+	s_message.append(data.data(), data.size());
+	if (last)
+	{
+		s_lines.push_back(s_message);
+		s_message.clear();
+	}
+}
+
+static AsyncOutput<1024> s_async(std::array{collect}, Overflow::Block);
+
+static void sensor()
+{
+	STM32T_TRACE_SCOPE("Sensor");
+	g_cycles += 3000;
+	STM32T_TRACE_COUNTER("temp", 25);
+}
+
+static void irq()
+{
+	Stub::IPSR = 16 + 37;
+	{
+		STM32T_TRACE_SCOPE_ARG("USART2", Trace::Arg::Text("+CSQ"));
+		g_cycles += 500;
+	}
+	Stub::IPSR = 0;
+}
+
+int main()
+{
+	// 3 events per round, so the first rounds are overwritten.
+	constexpr int ROUNDS = 100;
+	for (int i = 0; i < ROUNDS; i++)
+	{
+		if (i % 2)
+			sensor();
+		else
+		{
+			irq();
+			g_cycles += 100;
+			STM32T_TRACE_INSTANT("tick");
+		}
+		
+		g_cycles += 2000000;
+	}
+	
+	CHECK_EQ(Trace::g_trace.size(), 256u);
+	CHECK_EQ(Trace::g_trace.overwritten(), 3u * ROUNDS - 256);
+	
+	Trace::Dump(AsyncOutput<1024>::Output<s_async>);
+	s_async.Drain();
+	
+	CHECK_EQ(s_async.DroppedNewest(), 0u);
+	CHECK_EQ(Trace::g_trace.size(), 0u);
+	CHECK_EQ(s_lines.size(), 256u + 2);
+	CHECK(s_lines.front().rfind("# STM32T trace\tclk=", 0) == 0);
+	CHECK(s_lines.front().find("\tevents=256\toverwritten=") != std::string::npos);
+	CHECK_EQ(s_lines.back(), "# end\n");
+	
+	// The last round was a sensor() run, after an irq() and an instant event.
+	const size_t n = s_lines.size();
+	const auto line = [](const char type, const uint32_t cycles, const unsigned context, const char *const rest) {
+		return std::string(1, type) + "\t" + std::to_string(cycles) + "\t" + std::to_string(context) + "\t" + rest + "\n";
+	};
+	
+	const uint32_t sensor = g_cycles - 2000000 - 3000, tick = sensor - 2000000;
+	CHECK_EQ(s_lines[n - 2], line('E', sensor + 3000, 0, "Sensor"));
+	CHECK_EQ(s_lines[n - 3], line('C', sensor + 3000, 0, "temp\t25"));
+	CHECK_EQ(s_lines[n - 4], line('B', sensor, 0, "Sensor"));
+	CHECK_EQ(s_lines[n - 5], line('i', tick, 0, "tick"));
+	CHECK_EQ(s_lines[n - 6], line('E', tick - 100, 53, "USART2"));
+	CHECK_EQ(s_lines[n - 7], line('B', tick - 600, 53, "USART2\t\"+CSQ\""));
+	
+	return Test::Result();
+}
@@ -0,0 +1,479 @@
+#pragma once
+
+// A host stand-in for the main.h that CubeMX generates: the HAL and CMSIS declarations the headers use, so they can be built and
+// tested on a PC. The peripherals do nothing unless a test simulates them through the hooks in Stub.
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdio>
+#include <cstdarg>
+#include <climits>
+#include <cwchar>
+#include <atomic>
+
+
+
+#define STM32T_TIME_CLK		72'000'000
+
+#define HAL_UART_MODULE_ENABLED
+#define USE_HAL_UART_REGISTER_CALLBACKS		1
+
+
+
+typedef enum
+{
+	HAL_OK,
+	HAL_ERROR,
+	HAL_BUSY,
+	HAL_TIMEOUT,
+} HAL_StatusTypeDef;
+
+#define HAL_MAX_DELAY		0xFFFFFFFFU
+
+#define READ_BIT(REG, BIT)		((REG) & (BIT))
+#define SET_BIT(REG, BIT)		((REG) |= (BIT))
+#define CLEAR_BIT(REG, BIT)		((REG) &= ~(BIT))
+
+#define assert_param(expr)		((void)0U)
+
+inline void Error_Handler() {}
+
+
+
+// Core
+
+struct DWT_Type
+{
+	volatile uint32_t CTRL, CYCCNT, LAR;
+};
+
+struct CoreDebug_Type
+{
+	volatile uint32_t DEMCR;
+};
+
+struct SysTick_Type
+{
+	volatile uint32_t LOAD, VAL;
+};
+
+struct RCC_TypeDef
+{
+	volatile uint32_t CSR;
+};
+
+inline DWT_Type Stub_DWT;
+inline CoreDebug_Type Stub_CoreDebug;
+inline SysTick_Type Stub_SysTick = { STM32T_TIME_CLK / 1000 - 1, 0 };
+inline RCC_TypeDef Stub_RCC;
+
+#define DWT			(&Stub_DWT)
+#define CoreDebug	(&Stub_CoreDebug)
+#define SysTick		(&Stub_SysTick)
+#define RCC			(&Stub_RCC)
+
+#define CoreDebug_DEMCR_TRCENA_Msk		(1UL << 24)
+#define DWT_CTRL_CYCCNTENA_Msk			(1UL << 0)
+
+#define RCC_CSR_LPWRRSTF		(1UL << 31)
+#define RCC_CSR_WWDGRSTF		(1UL << 30)
+#define RCC_CSR_IWDGRSTF		(1UL << 29)
+#define RCC_CSR_SFTRSTF			(1UL << 28)
+#define RCC_CSR_PORRSTF			(1UL << 27)
+#define RCC_CSR_PINRSTF			(1UL << 26)
+#define RCC_CSR_BORRSTF			(1UL << 25)
+
+inline uint32_t SystemCoreClock = STM32T_TIME_CLK;
+
+
+
+// ITM
+
+namespace Stub
+{
+	/**
+	* @brief Called for each write to a stimulus port, with the size of the write (1, 2 or 4 bytes), e.g. to capture the SWO stream.
+	*/
+	inline void (*OnITMWrite)(uint8_t port, uint32_t value, uint8_t size) = nullptr;
+	
+	/**
+	* @brief A stimulus port register of a given width: reading it tells that the FIFO is ready, writing it calls OnITMWrite.
+	*/
+	template <class T>
+	struct ITMStimulus
+	{
+		uint8_t port = 0;
+		
+		operator uint32_t() const { return 1; }
+		
+		void operator=(const T value)
+		{
+			if (OnITMWrite)
+				OnITMWrite(port, value, sizeof(T));
+		}
+	};
+}
+
+struct ITM_Type
+{
+	struct
+	{
+		Stub::ITMStimulus<uint8_t> u8;
+		Stub::ITMStimulus<uint16_t> u16;
+		Stub::ITMStimulus<uint32_t> u32;
+	} PORT[32];
+	
+	volatile uint32_t TER = 0, TCR = 0;
+	
+	ITM_Type()
+	{
+		for (uint8_t i = 0; i < 32; i++)
+			PORT[i].u8.port = PORT[i].u16.port = PORT[i].u32.port = i;
+	}
+};
+
+inline ITM_Type Stub_ITM;
+
+#define ITM			(&Stub_ITM)
+
+#define ITM_TCR_ITMENA_Msk		(1UL << 0)
+
+
+
+// GPIO
+
+struct GPIO_TypeDef;
+
+namespace Stub
+{
+	/**
+	* @brief Called when a pin of PORT is written, with the new ODR (e.g. to follow the chip select of a simulated SPI device).
+	*/
+	inline void (*OnGPIOWrite)(GPIO_TypeDef *port, uint32_t odr) = nullptr;
+}
+
+/**
+* @brief Applies the writes to BSRR to ODR, like the hardware.
+*/
+class Stub_BSRR
+{
+	GPIO_TypeDef *const p_port;
+	
+public:
+	explicit Stub_BSRR(GPIO_TypeDef *const port) : p_port(port) {}
+	
+	Stub_BSRR(const Stub_BSRR&) = delete;
+	
+	inline void operator=(uint32_t value);
+};
+
+struct GPIO_TypeDef
+{
+	volatile uint32_t IDR = 0, ODR = 0;
+	Stub_BSRR BSRR{this};
+	volatile uint32_t BRR = 0;
+	
+	GPIO_TypeDef() = default;
+	GPIO_TypeDef(const GPIO_TypeDef&) = delete;
+};
+
+inline void Stub_BSRR::operator=(const uint32_t value)
+{
+	p_port->ODR = (p_port->ODR | (value & 0xFFFF)) & ~(value >> 16);
+	
+	if (Stub::OnGPIOWrite)
+		Stub::OnGPIOWrite(p_port, p_port->ODR);
+}
+
+typedef enum
+{
+	GPIO_PIN_RESET = 0,
+	GPIO_PIN_SET,
+} GPIO_PinState;
+
+typedef struct
+{
+	uint32_t Pin, Mode, Pull, Speed;
+} GPIO_InitTypeDef;
+
+#define GPIO_PIN_0				0x0001U
+#define GPIO_PIN_All			0xFFFFU
+#define IS_GPIO_PIN(PIN)		((PIN) != 0)
+
+#define GPIO_MODE_INPUT			0x0U
+#define GPIO_MODE_OUTPUT_PP		0x1U
+#define GPIO_MODE_OUTPUT_OD		0x11U
+#define GPIO_NOPULL				0x0U
+#define GPIO_PULLUP				0x1U
+#define GPIO_SPEED_FREQ_LOW		0x0U
+
+inline void HAL_GPIO_Init(GPIO_TypeDef *, GPIO_InitTypeDef *) {}
+inline GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *port, const uint16_t pin) { return (port->IDR & pin) ? GPIO_PIN_SET : GPIO_PIN_RESET; }
+inline void HAL_GPIO_WritePin(GPIO_TypeDef *port, const uint16_t pin, const GPIO_PinState state) { port->BSRR = state ? pin : uint32_t(pin) << 16; }
+inline void HAL_GPIO_TogglePin(GPIO_TypeDef *port, const uint16_t pin) { port->BSRR = (port->ODR & pin) ? uint32_t(pin) << 16 : pin; }
+
+
+
+// Tick, interrupts and barriers
+
+inline volatile uint32_t uwTick = 0;
+inline uint32_t uwTickFreq = 1;
+
+namespace Stub
+{
+	/**
+	* @brief Called by HAL_GetTick() before it returns uwTick (e.g. to advance a simulated clock).
+	*/
+	inline void (*OnGetTick)() = nullptr;
+	
+	/**
+	* @brief Called by __WFI(). Without it, __WFI() advances uwTick by 1 ms (as if SysTick woke the CPU up).
+	*/
+	inline void (*OnWFI)() = nullptr;
+	
+	/**
+	* @brief The value of IPSR: 0 in thread mode, the exception number (16 + IRQn) in an interrupt handler.
+	*/
+	inline uint32_t IPSR = 0;
+	
+	inline uint32_t PRIMASK = 0;
+}
+
+inline uint32_t HAL_GetTick()
+{
+	if (Stub::OnGetTick)
+		Stub::OnGetTick();
+	
+	return uwTick;
+}
+
+inline void HAL_Delay(const uint32_t delay) { uwTick += delay; }
+
+inline uint32_t HAL_GetHalVersion() { return 0x01080000; }
+inline uint32_t HAL_GetREVID() { return 0x1000; }
+inline uint32_t HAL_GetDEVID() { return 0x410; }
+inline uint32_t HAL_GetUIDw0() { return 0x11111111; }
+inline uint32_t HAL_GetUIDw1() { return 0x22222222; }
+inline uint32_t HAL_GetUIDw2() { return 0x33333333; }
+inline uint32_t HAL_RCC_GetHCLKFreq() { return SystemCoreClock; }
+
+inline void __disable_irq() { Stub::PRIMASK = 1; }
+inline void __enable_irq() { Stub::PRIMASK = 0; }
+inline uint32_t __get_PRIMASK() { return Stub::PRIMASK; }
+inline void __set_PRIMASK(const uint32_t primask) { Stub::PRIMASK = primask; }
+inline uint32_t __get_IPSR() { return Stub::IPSR; }
+
+inline void __DMB() { std::atomic_thread_fence(std::memory_order_seq_cst); }
+inline void __DSB() { std::atomic_thread_fence(std::memory_order_seq_cst); }
+inline void __ISB() {}
+inline void __NOP() {}
+
+inline void __WFI()
+{
+	if (Stub::OnWFI)
+		Stub::OnWFI();
+	else
+		uwTick = uwTick + 1;
+}
+
+
+
+// SPI
+
+typedef struct
+{
+	int id;
+} SPI_HandleTypeDef;
+
+namespace Stub
+{
+	struct SPI
+	{
+		HAL_StatusTypeDef (*Transmit)(SPI_HandleTypeDef *hspi, const uint8_t *data, uint16_t size) = nullptr;
+		HAL_StatusTypeDef (*Receive)(SPI_HandleTypeDef *hspi, uint8_t *data, uint16_t size) = nullptr;
+	};
+	
+	inline SPI SPI;
+}
+
+inline HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef *hspi, const uint8_t *data, const uint16_t size, uint32_t)
+{
+	return Stub::SPI.Transmit ? Stub::SPI.Transmit(hspi, data, size) : HAL_OK;
+}
+
+inline HAL_StatusTypeDef HAL_SPI_Receive(SPI_HandleTypeDef *hspi, uint8_t *data, const uint16_t size, uint32_t)
+{
+	if (Stub::SPI.Receive)
+		return Stub::SPI.Receive(hspi, data, size);
+	
+	memset(data, 0, size);
+	return HAL_OK;
+}
+
+inline HAL_StatusTypeDef HAL_SPI_TransmitReceive(SPI_HandleTypeDef *hspi, const uint8_t *tx, uint8_t *rx, const uint16_t size, const uint32_t timeout)
+{
+	const HAL_StatusTypeDef status = HAL_SPI_Transmit(hspi, tx, size, timeout);
+	return status == HAL_OK ? HAL_SPI_Receive(hspi, rx, size, timeout) : status;
+}
+
+
+
+// UART and DMA
+
+typedef struct
+{
+	uint32_t Mode;
+} DMA_InitTypeDef;
+
+typedef struct
+{
+	DMA_InitTypeDef Init;
+	void *Instance;
+} DMA_HandleTypeDef;
+
+typedef struct
+{
+	uint32_t BaudRate;
+} UART_InitTypeDef;
+
+typedef enum
+{
+	HAL_UART_STATE_RESET = 0x00,
+	HAL_UART_STATE_READY = 0x20,
+	HAL_UART_STATE_BUSY = 0x24,
+	HAL_UART_STATE_BUSY_TX = 0x21,
+	HAL_UART_STATE_BUSY_RX = 0x22,
+} HAL_UART_StateTypeDef;
+
+typedef struct __UART_HandleTypeDef
+{
+	void *Instance;
+	UART_InitTypeDef Init;
+	uint8_t *pRxBuffPtr;
+	uint16_t RxXferSize, RxXferCount;
+	DMA_HandleTypeDef *hdmarx, *hdmatx;
+	volatile HAL_UART_StateTypeDef gState, RxState;
+	volatile uint32_t ErrorCode;
+} UART_HandleTypeDef;
+
+typedef void (*pUART_CallbackTypeDef)(UART_HandleTypeDef *huart);
+typedef void (*pUART_RxEventCallbackTypeDef)(UART_HandleTypeDef *huart, uint16_t pos);
+
+typedef enum
+{
+	HAL_UART_TX_HALFCOMPLETE_CB_ID,
+	HAL_UART_TX_COMPLETE_CB_ID,
+	HAL_UART_RX_HALFCOMPLETE_CB_ID,
+	HAL_UART_RX_COMPLETE_CB_ID,
+	HAL_UART_ERROR_CB_ID,
+} HAL_UART_CallbackIDTypeDef;
+
+#define DMA_CIRCULAR		0x20U
+#define DMA_IT_HT			0x04U
+
+namespace Stub
+{
+	/**
+	* @brief The UART functions of a simulated peripheral. Where a function isn't set, the HAL function does nothing and returns
+	*		HAL_OK (Receive() returns HAL_TIMEOUT).
+	*/
+	struct UART
+	{
+		HAL_StatusTypeDef (*Transmit)(UART_HandleTypeDef *huart, const uint8_t *data, uint16_t size, uint32_t timeout) = nullptr;
+		HAL_StatusTypeDef (*TransmitDMA)(UART_HandleTypeDef *huart, const uint8_t *data, uint16_t size) = nullptr;
+		HAL_StatusTypeDef (*Receive)(UART_HandleTypeDef *huart, uint8_t *data, uint16_t size, uint32_t timeout) = nullptr;
+		HAL_StatusTypeDef (*ReceiveToIdleDMA)(UART_HandleTypeDef *huart, uint8_t *data, uint16_t size) = nullptr;
+		HAL_StatusTypeDef (*AbortReceive)(UART_HandleTypeDef *huart) = nullptr;
+		
+		pUART_RxEventCallbackTypeDef RxEventCallback = nullptr;
+		pUART_CallbackTypeDef TxCpltCallback = nullptr;
+		pUART_CallbackTypeDef ErrorCallback = nullptr;
+	};
+	
+	inline UART UART;
+	
+	/**
+	* @brief What __HAL_DMA_GET_COUNTER() returns: the bytes left to transfer.
+	*/
+	inline volatile uint16_t DMACounter = 0;
+}
+
+#define __HAL_DMA_GET_COUNTER(HANDLE)				((void)(HANDLE), Stub::DMACounter)
+#define __HAL_DMA_DISABLE_IT(HANDLE, INTERRUPT)		((void)(HANDLE))
+#define __HAL_UART_CLEAR_OREFLAG(HANDLE)			((void)(HANDLE))
+#define __HAL_UART_CLEAR_IDLEFLAG(HANDLE)			((void)(HANDLE))
+
+inline HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef *) { return HAL_OK; }
+inline HAL_UART_StateTypeDef HAL_UART_GetState(UART_HandleTypeDef *huart) { return HAL_UART_StateTypeDef(huart->gState | huart->RxState); }
+
+inline HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, const uint8_t *data, const uint16_t size, const uint32_t timeout)
+{
+	return Stub::UART.Transmit ? Stub::UART.Transmit(huart, data, size, timeout) : HAL_OK;
+}
+
+inline HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, const uint8_t *data, const uint16_t size)
+{
+	return Stub::UART.TransmitDMA ? Stub::UART.TransmitDMA(huart, data, size) : HAL_OK;
+}
+
+inline HAL_StatusTypeDef HAL_UART_Transmit_IT(UART_HandleTypeDef *huart, const uint8_t *data, const uint16_t size)
+{
+	return HAL_UART_Transmit_DMA(huart, data, size);
+}
+
+inline HAL_StatusTypeDef HAL_UART_Receive(UART_HandleTypeDef *huart, uint8_t *data, const uint16_t size, const uint32_t timeout)
+{
+	return Stub::UART.Receive ? Stub::UART.Receive(huart, data, size, timeout) : HAL_TIMEOUT;
+}
+
+inline HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef *huart, uint8_t *data, const uint16_t size)
+{
+	huart->pRxBuffPtr = data;
+	huart->RxXferSize = size;
+	huart->RxState = HAL_UART_STATE_BUSY_RX;
+	Stub::DMACounter = size;
+	
+	return Stub::UART.ReceiveToIdleDMA ? Stub::UART.ReceiveToIdleDMA(huart, data, size) : HAL_OK;
+}
+
+inline HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_IT(UART_HandleTypeDef *huart, uint8_t *data, const uint16_t size)
+{
+	return HAL_UARTEx_ReceiveToIdle_DMA(huart, data, size);
+}
+
+inline HAL_StatusTypeDef HAL_UART_AbortReceive(UART_HandleTypeDef *huart)
+{
+	huart->RxState = HAL_UART_STATE_READY;
+	return Stub::UART.AbortReceive ? Stub::UART.AbortReceive(huart) : HAL_OK;
+}
+
+inline HAL_StatusTypeDef HAL_UART_AbortReceive_IT(UART_HandleTypeDef *huart) { return HAL_UART_AbortReceive(huart); }
+inline HAL_StatusTypeDef HAL_UART_DMAStop(UART_HandleTypeDef *huart) { return HAL_UART_AbortReceive(huart); }
+
+inline HAL_StatusTypeDef HAL_UART_RegisterRxEventCallback(UART_HandleTypeDef *, const pUART_RxEventCallbackTypeDef callback)
+{
+	Stub::UART.RxEventCallback = callback;
+	return HAL_OK;
+}
+
+inline HAL_StatusTypeDef HAL_UART_UnRegisterRxEventCallback(UART_HandleTypeDef *)
+{
+	Stub::UART.RxEventCallback = nullptr;
+	return HAL_OK;
+}
+
+inline HAL_StatusTypeDef HAL_UART_RegisterCallback(UART_HandleTypeDef *, const HAL_UART_CallbackIDTypeDef id, const pUART_CallbackTypeDef callback)
+{
+	if (id == HAL_UART_TX_COMPLETE_CB_ID)
+		Stub::UART.TxCpltCallback = callback;
+	else if (id == HAL_UART_ERROR_CB_ID)
+		Stub::UART.ErrorCallback = callback;
+	
+	return HAL_OK;
+}
+
+inline HAL_StatusTypeDef HAL_UART_UnRegisterCallback(UART_HandleTypeDef *huart, const HAL_UART_CallbackIDTypeDef id)
+{
+	return HAL_UART_RegisterCallback(huart, id, nullptr);
+}